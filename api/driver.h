@@ -20,6 +20,8 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "api/buffer.h"
 #include "api/package_reference.h"
@@ -108,6 +110,151 @@ class Driver {
     int64 host_to_tpu_bps;
   };
 
+  // Bytes moved by DMA between host and device. Counters accumulate from the
+  // creation of the driver or the last call to ResetDmaStatistics().
+  struct DmaStatistics {
+    // Number and total size of DMAs of one kind.
+    struct Counter {
+      int64 bytes = 0;
+      int64 count = 0;
+    };
+
+    // Counters by DMA descriptor type. Instructions, input activations and
+    // parameters move from host to device, output activations from device to
+    // host.
+    struct TypeCounters {
+      Counter instructions;
+      Counter input_activations;
+      Counter parameters;
+      Counter output_activations;
+    };
+
+    // Bandwidth achieved over the most recent |window_ms| milliseconds.
+    struct Bandwidth {
+      int64 window_ms = 0;
+      double host_to_device_bytes_per_second = 0;
+      double device_to_host_bytes_per_second = 0;
+    };
+
+    // Transfers completed on one USB endpoint.
+    struct Endpoint {
+      int endpoint = 0;
+      bool device_to_host = false;
+      Counter transfers;
+
+      // Bytes given to short transfers that the endpoint did not deliver, and
+      // were asked for again, by number of short transfers. Only bulk-in
+      // transfers can come up short.
+      Counter dropped;
+    };
+
+    // Occupancy of one segment of the device virtual address space, at the
+    // time of the call. Not affected by ResetDmaStatistics().
+    struct AddressSpace {
+      // Name of the segment, e.g. "simple" or "extended".
+      std::string name;
+
+      // Bytes mapped, rounded up to whole blocks, and bytes free. Free bytes
+      // not in the largest free block are fragmented.
+      int64 allocated_bytes = 0;
+      int64 free_bytes = 0;
+      int64 largest_free_block_bytes = 0;
+
+      // Number of long-lived mappings, e.g. parameters, placed in the segment
+      // since the driver was created.
+      int64 num_long_lived_mappings = 0;
+    };
+
+    // Counters of all DMAs on the device.
+    TypeCounters total;
+
+    // Counters by name of the executable the DMAs were issued for.
+    std::unordered_map<std::string, TypeCounters> per_executable;
+
+    // Achieved bandwidth over sliding windows, shortest window first.
+    std::vector<Bandwidth> bandwidth;
+
+    // Traffic by USB endpoint. Empty for other transports. Includes transfers
+    // not described by DMA hints, e.g. outputs announced by the device.
+    std::vector<Endpoint> endpoints;
+
+    // Segments of the device virtual address space managed by the driver.
+    // Empty for transports without a device MMU, such as USB.
+    std::vector<AddressSpace> address_spaces;
+  };
+
+  // Die temperature as sampled by the thermal monitor of the driver, see
+  // thermal_monitor_period_ms in DriverOptions.
+  struct ThermalSample {
+    // Driver clock time of the sample, in nanoseconds.
+    int64 timestamp_ns = 0;
+
+    // Die temperature in millidegrees Celsius. Some devices only report
+    // crossing their warning threshold, in which case has_temperature is
+    // false.
+    bool has_temperature = false;
+    int temperature_millicelsius = 0;
+
+    // True if the device raised a thermal warning since the previous sample.
+    bool warning = false;
+
+    // Value of api::PerformanceExpectation in effect after the sample was
+    // acted upon.
+    int performance_expectation = 0;
+  };
+
+  struct ThermalState {
+    // True if the driver is open and samples die temperature.
+    bool monitoring = false;
+
+    // Number of times performance was stepped down due to temperature.
+    int64 num_throttles = 0;
+
+    // Most recent samples, oldest first. The last one is the current state.
+    std::vector<ThermalSample> history;
+  };
+
+  // Kinds of fatal errors, for bucketing device failures.
+  enum class ErrorClass {
+    // Not classified, e.g. a failure to enqueue work on the device.
+    kUnknown = 0,
+
+    // The host interface block raised its fatal error interrupt.
+    kHibError = 1,
+
+    // The device completed an instruction queue descriptor with an error.
+    kHostQueueError = 2,
+
+    // The TPU watchdog expired and the device was reset.
+    kWatchdogTimeout = 3,
+  };
+
+  // A fatal error, along with the device state it was raised in.
+  struct ErrorRecord {
+    ErrorClass error_class = ErrorClass::kUnknown;
+
+    // Driver clock time of the error, in nanoseconds.
+    int64 timestamp_ns = 0;
+
+    // Canonical error code and message of the reported status.
+    int status_code = 0;
+    std::string message;
+
+    // Oldest request active on the device: its id as in api::Request::id(),
+    // the id of its TPU request, and the name of its executable. -1 and empty
+    // if no request was active.
+    int request_id = -1;
+    int tpu_request_id = -1;
+    std::string executable_name;
+
+    // Index in the instruction queue of the last descriptor completed by the
+    // device. -1 if not known, e.g. on USB.
+    int last_completed_descriptor = -1;
+
+    // Values of CSRs relevant to the error, by CSR name.
+    std::vector<std::pair<std::string, uint64>> csr_snapshot;
+  };
+
   Driver() = default;
   virtual ~Driver() = default;
 
@@ -197,7 +344,8 @@ class Driver {
   virtual void SetFatalErrorCallback(FatalErrorCallback callback) = 0;
 
   // Sets the callback for thermal warnings. Application may be required to
-  // to reduce performance level and/or throttle new requests.
+  // to reduce performance level and/or throttle new requests. The callback runs
+  // on a driver thread without driver locks held, and may call the driver.
   virtual void SetThermalWarningCallback(ThermalWarningCallback callback) = 0;
 
   // Enters/leaves real-time mode, if applicable. This is best effort as it
@@ -229,6 +377,32 @@ class Driver {
   virtual void UpdateOperationalSettings(
       const OperationalSettings& settings) = 0;
 
+  // Returns the operational settings currently in effect. Some of them may be
+  // derived by the driver at open time, e.g. host_to_tpu_bps from the
+  // negotiated link speed when not set in driver options.
+  virtual OperationalSettings GetOperationalSettings() const = 0;
+
+  // Returns the negotiated speed of the link between host and device, e.g.
+  // "SuperSpeed" for a USB3 connection. Returns an empty string if it is not
+  // applicable or not known, or if the driver is not open.
+  virtual std::string GetLinkSpeed() const = 0;
+
+  // Returns the DMA traffic statistics of the device. These are always
+  // collected, and comparing parameter bytes and bandwidth with the link
+  // speed tells whether a model is bound by the link or by compute.
+  virtual DmaStatistics GetDmaStatistics() const = 0;
+
+  // Clears the DMA traffic statistics.
+  virtual void ResetDmaStatistics() = 0;
+
+  // Returns the die temperature history of the device. Empty if the driver
+  // does not monitor temperature of the device.
+  virtual ThermalState GetThermalState() const = 0;
+
+  // Returns the most recent fatal errors of the device, oldest first. Only a
+  // bounded number of records is kept.
+  virtual std::vector<ErrorRecord> GetErrorRecords() const = 0;
+
   // TODO: Add function for dumping bugreport.
 };
 
@@ -15,6 +15,8 @@
 #include "api/layer_information.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -24,8 +26,10 @@
 #include "executable/executable_generated.h"
 #include "port/errors.h"
 #include "port/logging.h"
+#include "port/ptr_util.h"
 #include "port/status.h"
 #include "port/status_macros.h"
+#include "port/statusor.h"
 #include "port/stringprintf.h"
 
 namespace platforms {
@@ -59,39 +63,20 @@ Status SanityCheckShapeInformation(const OutputShapeInfo& shape_info,
 }
 
 // Copies elements in source shape to dest address. Destination layout is in
-// dest_shape.
+// dest_layout. Source shape can be in non-contiguous memory space if there are
+// z-padding elements, so elements are copied one contiguous run at a time.
 void CopyShape(const TensorShapeT& source_shape,
-               const TensorLayout& source_layout,
+               const tensor_util::TensorLayoutPlan& source_layout,
                const unsigned char* source_address,
-               const TensorLayout& dest_layout, unsigned char* dest_address,
-               int bytes_per_element, int dimension) {
-  CHECK_LT(dimension, tensor_util::kNumDimensions);
-  CHECK_GE(dimension, 0);
-
-  // Source shape can be in non-contiguous memory space if there are z-padding
-  // elements.
-  if (tensor_util::IsShapeInContiguousLayout(source_layout, source_shape) &&
-      tensor_util::IsShapeInContiguousLayout(dest_layout, source_shape)) {
-    const int dest_offset =
-        tensor_util::GetFirstMemoryIndexForShape(dest_layout, source_shape) *
-        bytes_per_element;
-    const int source_offset =
-        tensor_util::GetFirstMemoryIndexForShape(source_layout, source_shape) *
-        bytes_per_element;
-
-    // Do mem copy for the shape.
-    memcpy(
-        dest_address + dest_offset, source_address + source_offset,
-        tensor_util::GetNumElementsInShape(source_shape) * bytes_per_element);
-  } else {
-    const auto range = source_shape.dimension.at(dimension);
-    for (int i = range.start(); i <= range.end(); ++i) {
-      auto slice = source_shape;
-      slice.dimension.at(dimension) = {i, i};
-      CopyShape(slice, source_layout, source_address, dest_layout, dest_address,
-                bytes_per_element, dimension + 1);
-    }
-  }
+               const tensor_util::TensorLayoutPlan& dest_layout,
+               unsigned char* dest_address, int bytes_per_element) {
+  tensor_util::ForEachContiguousRun(
+      source_layout, dest_layout, source_shape,
+      [&](int source_index, int dest_index, int num_elements) {
+        memcpy(dest_address + dest_index * bytes_per_element,
+               source_address + source_index * bytes_per_element,
+               num_elements * bytes_per_element);
+      });
 }
 
 }  // namespace
@@ -132,18 +117,13 @@ Status LayerInformation::TransformSignedDataType(Buffer buffer) const {
         buffer.size_bytes(), ActualSizeBytes()));
   }
   auto buffer_pointer = buffer.ptr();
-  int buffer_index = 0;
-
-  for (int y = 0; y < y_dim(); ++y) {
-    for (int x = 0; x < x_dim(); ++x) {
-      for (int z = 0; z < z_dim(); ++z) {
-        // XORing with 128 on the last byte of each entry will flip the MSB of
-        // each entry. Please note that bytes are stored little endian.
-        int msb_index = buffer_index + data_type_size - 1;
-        buffer_pointer[msb_index] = buffer_pointer[msb_index] ^ 128;
-        buffer_index += data_type_size;
-      }
-    }
+  const size_t num_values = buffer.size_bytes() / data_type_size;
+
+  for (size_t i = 0; i < num_values; ++i) {
+    // XORing with 128 on the last byte of each entry will flip the MSB of
+    // each entry. Please note that bytes are stored little endian.
+    const size_t msb_index = i * data_type_size + data_type_size - 1;
+    buffer_pointer[msb_index] = buffer_pointer[msb_index] ^ 128;
   }
 
   return OkStatus();
@@ -152,10 +132,109 @@ Status LayerInformation::TransformSignedDataType(Buffer buffer) const {
 InputLayerInformation::InputLayerInformation(const Layer* layer)
     : LayerInformation(layer) {}
 
+int InputLayerInformation::InputSizeBytes(InputDataFormat format) const {
+  const int num_values = ActualSizeBytes() / DataTypeSize();
+  switch (format) {
+    case InputDataFormat::kNative:
+      return ActualSizeBytes();
+    case InputDataFormat::kFloat32:
+      return num_values * sizeof(float);
+    case InputDataFormat::kUint8:
+      return num_values;
+  }
+  LOG(FATAL) << "Unknown input data format: " << static_cast<int>(format);
+  return 0;
+}
+
+Status InputLayerInformation::ConvertInput(InputDataFormat format,
+                                           const unsigned char* src,
+                                           unsigned char* dest) const {
+  if (format == InputDataFormat::kNative) {
+    return InvalidArgumentError("Input data is already in the layer type.");
+  }
+  if (DataTypeSize() != 1) {
+    return UnimplementedError(StringPrintf(
+        "Input conversion is not supported for data type %d.",
+        static_cast<int>(data_type())));
+  }
+  if (layer()->numerics() == nullptr || dequantization_factor() <= 0.0f) {
+    return FailedPreconditionError(StringPrintf(
+        "Layer %s has no valid quantization parameters.", name().c_str()));
+  }
+
+  // The TPU expects signed values with their MSB flipped, which is the same
+  // as adding 128.
+  const bool is_signed = SignedDataType();
+  const float min_value = is_signed ? -128.0f : 0.0f;
+  const float max_value = is_signed ? 127.0f : 255.0f;
+  const unsigned char sign_flip = is_signed ? 0x80 : 0;
+  const float inverse_scale = 1.0f / dequantization_factor();
+  const float zero_point = static_cast<float>(this->zero_point());
+
+  // Rounds half away from zero, like TFLite quantization. NaN has no
+  // quantized value and maps to the zero point.
+  const auto quantize = [=](float value) -> unsigned char {
+    value = value * inverse_scale + zero_point;
+    if (std::isnan(value)) {
+      value = zero_point;
+    }
+    value = std::min(std::max(value, min_value), max_value);
+    const int quantized =
+        static_cast<int>(value + (value >= 0.0f ? 0.5f : -0.5f));
+    return static_cast<unsigned char>(quantized) ^ sign_flip;
+  };
+
+  // 8-bit data is converted with a lookup table.
+  unsigned char table[256];
+  if (format == InputDataFormat::kUint8) {
+    for (int i = 0; i < 256; ++i) {
+      table[i] = quantize(static_cast<float>(i));
+    }
+  }
+
+  // Iterations are padded in the TPU input buffer.
+  const int executions = execution_count_per_inference();
+  const int values_per_execution = ActualSizeBytes() / executions;
+  const int padded_bytes_per_execution = SizeBytesPerIteration();
+  for (int execution = 0; execution < executions; ++execution) {
+    unsigned char* out = dest + execution * padded_bytes_per_execution;
+    const int first_value = execution * values_per_execution;
+    if (format == InputDataFormat::kUint8) {
+      const unsigned char* in = src + first_value;
+      for (int i = 0; i < values_per_execution; ++i) {
+        out[i] = table[in[i]];
+      }
+    } else {
+      const unsigned char* in = src + first_value * sizeof(float);
+      for (int i = 0; i < values_per_execution; ++i) {
+        float value;
+        memcpy(&value, in + i * sizeof(float), sizeof(float));
+        out[i] = quantize(value);
+      }
+    }
+  }
+
+  return OkStatus();
+}
+
 OutputLayerInformation::OutputLayerInformation(const Layer* layer)
     : LayerInformation(layer),
       output_layer_(layer->any_layer_as_OutputLayer()) {
   CHECK(output_layer_ != nullptr);
+
+  // Relayout and element lookups go through these for every request, so
+  // compile the layouts once.
+  if (output_layer_->shape_info()) {
+    const auto& slice_layouts = *output_layer_->shape_info()->slice_layout();
+    slice_layout_plans_.reserve(slice_layouts.size());
+    for (int i = 0; i < slice_layouts.size(); ++i) {
+      slice_layout_plans_.emplace_back(*slice_layouts.Get(i));
+    }
+    if (layer->shape()) {
+      packed_layout_plan_.emplace(
+          *tensor_util::BuildPackedLayout(*layer->shape()));
+    }
+  }
 }
 
 OutputLayerInformation::YBufferIndex OutputLayerInformation::GetYBufferIndex(
@@ -386,24 +465,173 @@ Status OutputLayerInformation::RelayoutWithShapeInformation(
 
   RETURN_IF_ERROR(SanityCheckShapeInformation(shape_info, data_type_size));
 
-  flatbuffers::FlatBufferBuilder builder;
-  const auto fb_layout = tensor_util::BuildPackedLayout(*layer()->shape());
-  builder.Finish(darwinn::TensorLayout::Pack(builder, fb_layout.get()));
-  const TensorLayout& dest_layout =
-      *flatbuffers::GetRoot<TensorLayout>(builder.GetBufferPointer());
+  CHECK(packed_layout_plan_);
   unsigned char* dest_address = dest;
 
   const auto& slice_layouts = *shape_info.slice_layout();
   for (int i = 0; i < slice_layouts.size(); ++i) {
     // Each slice is stored in a contiguous memory space.
-    const TensorLayout& source_layout = *slice_layouts.Get(i);
     TensorShapeT source_shape;
-    source_layout.shape()->UnPackTo(&source_shape);
+    slice_layouts.Get(i)->shape()->UnPackTo(&source_shape);
     const unsigned char* source_address =
         src + shape_info.slice_offset()->Get(i);
 
-    CopyShape(source_shape, source_layout, source_address, dest_layout,
-              dest_address, data_type_size, tensor_util::kBatch);
+    CopyShape(source_shape, slice_layout_plans_[i], source_address,
+              *packed_layout_plan_, dest_address, data_type_size);
+  }
+
+  return OkStatus();
+}
+
+bool OutputDestination::IsDefault() const {
+  for (const Dimension* dimension : {&batch, &y, &x, &z}) {
+    if (dimension->start != 0 || dimension->size >= 0 ||
+        dimension->stride_bytes != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+StatusOr<OutputLayerInformation::ResolvedDestination>
+OutputLayerInformation::ResolveDestination(
+    const OutputDestination& destination) const {
+  const int data_type_size = DataTypeSize();
+  const int dims[] = {batch_dim(), y_dim(), x_dim(), z_dim()};
+  const OutputDestination::Dimension* requested[] = {
+      &destination.batch, &destination.y, &destination.x, &destination.z};
+  const int shape_dims[] = {tensor_util::kBatch, tensor_util::kY,
+                            tensor_util::kX, tensor_util::kZ};
+
+  ResolvedDestination resolved;
+  resolved.window.resize(tensor_util::kNumDimensions, Range(0, 0));
+  resolved.stride_bytes.resize(tensor_util::kNumDimensions, 0);
+
+  // Default strides pack the window densely, so compute them inner to outer.
+  int dense_stride_bytes = data_type_size;
+  for (int i = 3; i >= 0; --i) {
+    const auto& dimension = *requested[i];
+    const int size =
+        dimension.size < 0 ? dims[i] - dimension.start : dimension.size;
+    if (dimension.start < 0 || size <= 0 || dimension.start + size > dims[i]) {
+      return InvalidArgumentError(StringPrintf(
+          "Destination window [%d, +%d) is out of range for dimension %d of "
+          "size %d.",
+          dimension.start, size, shape_dims[i], dims[i]));
+    }
+    if (dimension.stride_bytes < 0 ||
+        dimension.stride_bytes % data_type_size != 0) {
+      return InvalidArgumentError(StringPrintf(
+          "Destination stride %d is not a multiple of the element size %d.",
+          dimension.stride_bytes, data_type_size));
+    }
+
+    resolved.window[shape_dims[i]] =
+        Range(dimension.start, dimension.start + size - 1);
+    resolved.stride_bytes[shape_dims[i]] = dimension.stride_bytes != 0
+                                               ? dimension.stride_bytes
+                                               : dense_stride_bytes;
+    dense_stride_bytes *= size;
+  }
+  resolved.stride_bytes[tensor_util::kW] = dense_stride_bytes;
+  return resolved;
+}
+
+StatusOr<int> OutputLayerInformation::DestinationSizeBytes(
+    const OutputDestination& destination) const {
+  ASSIGN_OR_RETURN(const auto resolved, ResolveDestination(destination));
+  int last_byte = DataTypeSize();
+  for (int i = 0; i < tensor_util::kNumDimensions; ++i) {
+    const auto& range = resolved.window[i];
+    last_byte += (range.end() - range.start()) * resolved.stride_bytes[i];
+  }
+  return last_byte;
+}
+
+Status OutputLayerInformation::Relayout(
+    unsigned char* dest, const unsigned char* src,
+    const OutputDestination& destination) const {
+  if (execution_count_per_inference() != 1) {
+    return UnimplementedError(
+        "Relayout to a destination is not supported for multiple executions "
+        "per inference.");
+  }
+  ASSIGN_OR_RETURN(const auto resolved, ResolveDestination(destination));
+  const int data_type_size = DataTypeSize();
+
+  if (!output_layer_->shape_info()) {
+    // Only the y, x and z dimensions are described by the tile layout.
+    if (batch_dim() != 1) {
+      return UnimplementedError(
+          "Relayout to a destination requires output shape information for "
+          "batched outputs.");
+    }
+    const auto& y_range = resolved.window[tensor_util::kY];
+    const auto& x_range = resolved.window[tensor_util::kX];
+    const auto& z_range = resolved.window[tensor_util::kZ];
+    const int y_stride = resolved.stride_bytes[tensor_util::kY];
+    const int x_stride = resolved.stride_bytes[tensor_util::kX];
+    const int z_stride = resolved.stride_bytes[tensor_util::kZ];
+    const int z_size = z_range.end() - z_range.start() + 1;
+
+    for (int y = y_range.start(); y <= y_range.end(); ++y) {
+      const auto y_buffer_index = GetYBufferIndex(y);
+      unsigned char* dest_row = dest + (y - y_range.start()) * y_stride;
+      for (int x = x_range.start(); x <= x_range.end(); ++x) {
+        const unsigned char* source =
+            src + GetBufferIndex(y_buffer_index, x, z_range.start()) *
+                      data_type_size;
+        unsigned char* target = dest_row + (x - x_range.start()) * x_stride;
+        if (z_stride == data_type_size) {
+          memcpy(target, source, z_size * data_type_size);
+        } else {
+          for (int z = 0; z < z_size; ++z) {
+            memcpy(target + z * z_stride, source + z * data_type_size,
+                   data_type_size);
+          }
+        }
+      }
+    }
+    return OkStatus();
+  }
+
+  const auto& shape_info = *output_layer_->shape_info();
+  RETURN_IF_ERROR(SanityCheckShapeInformation(shape_info, data_type_size));
+
+  // Describe the destination as a layout of the window, so that slices are
+  // copied with the same machinery as the dense relayout.
+  TensorLayoutT dest_layout_t;
+  dest_layout_t.shape =
+      gtl::MakeUnique<TensorShapeT>(tensor_util::MakeTensorShape(
+          resolved.window));
+  for (const int stride_bytes : resolved.stride_bytes) {
+    dest_layout_t.stride.push_back(stride_bytes / data_type_size);
+  }
+  const tensor_util::TensorLayoutPlan dest_layout(dest_layout_t);
+
+  const auto& slice_layouts = *shape_info.slice_layout();
+  for (int i = 0; i < slice_layouts.size(); ++i) {
+    const TensorLayout& source_layout = *slice_layouts.Get(i);
+    TensorShapeT source_shape;
+    source_layout.shape()->UnPackTo(&source_shape);
+    if (source_shape.dimension.size() != tensor_util::kNumDimensions) {
+      return UnimplementedError(StringPrintf(
+          "Relayout to a destination requires %d-dimensional slices.",
+          tensor_util::kNumDimensions));
+    }
+
+    // Slices of the window in the w dimension are taken as they are.
+    auto window = tensor_util::MakeTensorShape(resolved.window);
+    window.dimension[tensor_util::kW] =
+        source_shape.dimension[tensor_util::kW];
+    const auto copy_shape = tensor_util::GetIntersectShape(source_shape, window);
+    if (!tensor_util::IsValidShape(copy_shape)) {
+      continue;
+    }
+
+    CopyShape(copy_shape, slice_layout_plans_[i],
+              src + shape_info.slice_offset()->Get(i), dest_layout, dest,
+              data_type_size);
   }
 
   return OkStatus();
@@ -471,9 +699,10 @@ int OutputLayerInformation::GetBufferIndex(
       VLOG(10) << "Position legalized: " << position_string;
     }
 
-    if (tensor_util::IsElementInShape(slice_shape, legalized_position)) {
-      const int index = tensor_util::GetMemoryIndexFromPosition(
-          slice_layout, legalized_position);
+    const auto& slice_layout_plan = slice_layout_plans_[i];
+    if (slice_layout_plan.IsElementInShape(legalized_position)) {
+      const int index =
+          slice_layout_plan.GetMemoryIndexFromPosition(legalized_position);
       const int slice_base_offset_in_bytes = shape_info->slice_offset()->Get(i);
       CHECK_EQ(slice_base_offset_in_bytes % data_type_size, 0);
       const int slice_base_offset_in_elements =
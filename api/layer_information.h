@@ -16,16 +16,32 @@
 #define DARWINN_API_LAYER_INFORMATION_H_
 
 #include <string>
+#include <vector>
 
+#include "absl/types/optional.h"
 #include "api/buffer.h"
 #include "api/tensor_util.h"
 #include "executable/executable_generated.h"
 #include "port/status.h"
+#include "port/statusor.h"
 
 namespace platforms {
 namespace darwinn {
 namespace api {
 
+// Formats of input data. Data not in the layer data type is quantized with the
+// layer numerics while it is copied into the TPU input buffer.
+enum class InputDataFormat {
+  // Data is already in the layer data type.
+  kNative,
+
+  // Real values as 32-bit floats.
+  kFloat32,
+
+  // Real values as 8-bit unsigned integers, e.g. RGB pixels.
+  kUint8,
+};
+
 // Provides information on input and output layers.
 class LayerInformation {
  public:
@@ -95,7 +111,8 @@ class LayerInformation {
   bool CacheOnDram() const { return layer_->cache_on_dram(); }
 
   // Converts unsigned values for a provided buffer of this layer to signed and
-  // vice versa.
+  // vice versa. The buffer must hold at least ActualSizeBytes(), and all values
+  // it holds are converted, including padding.
   Status TransformSignedDataType(Buffer buffer) const;
 
  protected:
@@ -112,6 +129,41 @@ class InputLayerInformation : public LayerInformation {
  public:
   explicit InputLayerInformation(const Layer* layer);
   ~InputLayerInformation() override = default;
+
+  // Returns the size of input data in the given format, without padding.
+  int InputSizeBytes(InputDataFormat format) const;
+
+  // Converts input data in the given format to the layer data type and writes
+  // it to |dest|, which must hold PaddedSizeBytes(). Quantization, the signed
+  // data type transform and padding between iterations are done in a single
+  // pass. Only supported for 8-bit layers.
+  Status ConvertInput(InputDataFormat format, const unsigned char* src,
+                      unsigned char* dest) const;
+};
+
+// Describes a window of an output tensor and where it is written in a
+// destination buffer, e.g. planar layouts, regions of a larger image or a
+// subset of channels. Default values describe the whole tensor densely packed
+// in YXZ order.
+struct OutputDestination {
+  struct Dimension {
+    // First index and number of elements to write. A negative size writes all
+    // elements from |start|.
+    int start = 0;
+    int size = -1;
+
+    // Distance in bytes between adjacent elements in the destination. 0 packs
+    // the window densely in batch, y, x, z order.
+    int stride_bytes = 0;
+  };
+
+  Dimension batch;
+  Dimension y;
+  Dimension x;
+  Dimension z;
+
+  // Returns true if all fields have default values.
+  bool IsDefault() const;
 };
 
 // Provides detailed information on output layers.
@@ -155,6 +207,17 @@ class OutputLayerInformation : public LayerInformation {
   // dependencies are removed.
   Status Relayout(unsigned char* dest, const unsigned char* src) const;
 
+  // Same as above, but writes only the window described by |destination|, at
+  // its strides. |dest| must hold DestinationSizeBytes(destination). Signed
+  // data types are not transformed, see TransformSignedDataType.
+  Status Relayout(unsigned char* dest, const unsigned char* src,
+                  const OutputDestination& destination) const;
+
+  // Returns the number of bytes spanned by |destination|, or an error if it
+  // does not fit the layer.
+  StatusOr<int> DestinationSizeBytes(
+      const OutputDestination& destination) const;
+
   // Returns true if relayout is needed.
   bool NeedsRelayout() const;
 
@@ -167,7 +230,23 @@ class OutputLayerInformation : public LayerInformation {
   Status RelayoutWithShapeInformation(unsigned char* dest,
                                       const unsigned char* src) const;
 
+  // Window and strides of an OutputDestination, with one entry for each of
+  // the tensor_util::ShapeDimension values.
+  struct ResolvedDestination {
+    std::vector<Range> window;
+    std::vector<int> stride_bytes;
+  };
+
+  // Validates |destination| against the layer shape and fills in defaults.
+  StatusOr<ResolvedDestination> ResolveDestination(
+      const OutputDestination& destination) const;
+
   const OutputLayer* output_layer_;
+
+  // Compiled slice layouts, and packed layout of the layer shape. Only set if
+  // the layer has output shape information.
+  std::vector<tensor_util::TensorLayoutPlan> slice_layout_plans_;
+  absl::optional<tensor_util::TensorLayoutPlan> packed_layout_plan_;
 };
 
 // Returns the byte size of a provided tensor data type.
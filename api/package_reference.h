@@ -33,6 +33,28 @@ namespace api {
 // Specifies the most recent package identifier for executable.fbs.
 constexpr const char* kHeadPackageIdentifier = "DWN1";
 
+// Host memory held by a registered package.
+struct PackageMemoryUsage {
+  // Size of the driver's copy of the package.
+  int64 package_bytes = 0;
+
+  // Bytes of the package copy released after registration, as they are only
+  // needed to verify signatures, or belong to executables which are not used.
+  int64 released_package_bytes = 0;
+
+  // Bytes of instruction buffers pooled for reuse by requests.
+  int64 instruction_buffer_bytes = 0;
+
+  // Bytes of scratch memory allocated on host.
+  int64 scratch_bytes = 0;
+
+  // Returns the number of bytes resident in host memory.
+  int64 ResidentBytes() const {
+    return package_bytes - released_package_bytes + instruction_buffer_bytes +
+           scratch_bytes;
+  }
+};
+
 // Type for a registered executable.
 class PackageReference {
  public:
@@ -142,6 +164,9 @@ class PackageReference {
   // only.
   virtual std::string ModelIdentifier() const = 0;
 
+  // Returns host memory currently held by this package.
+  virtual PackageMemoryUsage GetMemoryUsage() const = 0;
+
  protected:
   PackageReference() = default;
 };
@@ -20,6 +20,7 @@
 #include <string>
 
 #include "api/buffer.h"
+#include "api/layer_information.h"
 #include "port/integral_types.h"
 #include "port/status_macros.h"
 #include "port/statusor.h"
@@ -100,6 +101,13 @@ class Request {
   // Buffers with and without padding are both acceptable.
   virtual Status AddInput(const std::string& name, const Buffer& input) = 0;
 
+  // Adds an input buffer holding data in the given format, which is quantized
+  // to the layer data type while being copied to the TPU input buffer. This
+  // saves a separate pass over the input in the caller. The buffer must be
+  // InputLayerInformation::InputSizeBytes(format) bytes.
+  virtual Status AddInput(const std::string& name, const Buffer& input,
+                          InputDataFormat format) = 0;
+
   // Adds an output buffer. This may be called repeatedly depending
   // on the batch size as long as the request instance is not submitted. The
   // size constraints on the input and output buffers will be evaluated during
@@ -114,6 +122,14 @@ class Request {
   // output.
   virtual Status AddOutput(const std::string& name, Buffer output) = 0;
 
+  // Adds an output buffer to which the output is written at the window and
+  // strides described by |destination|, e.g. into a region of a larger buffer
+  // or in a planar layout. The buffer must hold at least
+  // OutputLayerInformation::DestinationSizeBytes(destination) bytes. Elements
+  // outside of the window are left untouched.
+  virtual Status AddOutput(const std::string& name, Buffer output,
+                           const OutputDestination& destination) = 0;
+
   // Sets the scheduling priority of this request (must be a positive int) where
   // 0 is highest priority. P0 requests are immediately scheduled for execution
   // while lower priorities (higher in value) may get preempted if device is
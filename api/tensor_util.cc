@@ -295,6 +295,64 @@ bool IsShapeInContiguousLayout(const TensorLayout& layout,
   return GetNumElementsInShape(shape) == (last_index - first_index + 1);
 }
 
+TensorLayoutPlan::TensorLayoutPlan(const TensorLayout& layout) {
+  const auto& dimensions = *layout.shape()->dimension();
+  CHECK_EQ(dimensions.size(), layout.stride()->size());
+  start_.reserve(dimensions.size());
+  end_.reserve(dimensions.size());
+  stride_.reserve(dimensions.size());
+  for (int i = 0; i < dimensions.size(); ++i) {
+    start_.push_back(dimensions.Get(i)->start());
+    end_.push_back(dimensions.Get(i)->end());
+    stride_.push_back(layout.stride()->Get(i));
+  }
+}
+
+TensorLayoutPlan::TensorLayoutPlan(const TensorLayoutT& layout)
+    : stride_(layout.stride) {
+  const auto& dimensions = layout.shape->dimension;
+  CHECK_EQ(dimensions.size(), stride_.size());
+  start_.reserve(dimensions.size());
+  end_.reserve(dimensions.size());
+  for (const auto& range : dimensions) {
+    start_.push_back(range.start());
+    end_.push_back(range.end());
+  }
+}
+
+bool TensorLayoutPlan::IsElementInShape(
+    const std::vector<int>& position) const {
+  CHECK_EQ(position.size(), num_dimensions());
+  for (int i = 0; i < position.size(); ++i) {
+    if (position[i] < start_[i] || position[i] > end_[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int TensorLayoutPlan::GetMemoryIndexFromPosition(
+    const std::vector<int>& position) const {
+  CHECK(IsElementInShape(position));
+  int memory_index = 0;
+  for (int i = 0; i < position.size(); ++i) {
+    memory_index += stride_[i] * (position[i] - start_[i]);
+  }
+  return memory_index;
+}
+
+int TensorLayoutPlan::GetFirstMemoryIndexForShape(
+    const TensorShapeT& shape) const {
+  CHECK_EQ(shape.dimension.size(), num_dimensions());
+  int memory_index = 0;
+  for (int i = 0; i < shape.dimension.size(); ++i) {
+    const auto& range = shape.dimension[i];
+    CHECK(range.start() >= start_[i] && range.end() <= end_[i]);
+    memory_index += stride_[i] * (range.start() - start_[i]);
+  }
+  return memory_index;
+}
+
 std::string DumpShape(const TensorShape& shape) {
   std::string str;
   for (int i = 0; i < shape.dimension()->size(); ++i) {
@@ -105,6 +105,88 @@ int GetLastMemoryIndexForShape(const TensorLayout& layout,
 bool IsShapeInContiguousLayout(const TensorLayout& layout,
                                const TensorShapeT& shape);
 
+// A tensor layout compiled into plain arrays of dimension ranges and strides,
+// for code that computes memory indexes of many elements of the same layout.
+class TensorLayoutPlan {
+ public:
+  explicit TensorLayoutPlan(const TensorLayout& layout);
+  explicit TensorLayoutPlan(const TensorLayoutT& layout);
+
+  int num_dimensions() const { return stride_.size(); }
+  int start(int dimension) const { return start_[dimension]; }
+  int end(int dimension) const { return end_[dimension]; }
+  int stride(int dimension) const { return stride_[dimension]; }
+
+  // Same as the functions above with the same names, for this layout.
+  bool IsElementInShape(const std::vector<int>& position) const;
+  int GetMemoryIndexFromPosition(const std::vector<int>& position) const;
+  int GetFirstMemoryIndexForShape(const TensorShapeT& shape) const;
+
+ private:
+  std::vector<int> start_;
+  std::vector<int> end_;
+  std::vector<int> stride_;
+};
+
+// Calls |run_func(source_index, dest_index, num_elements)| for runs of
+// elements of |shape| in row-major order, where each run is stored without
+// gaps in both layouts. Inner dimensions are merged into a run for as long as
+// both layouts store them densely, so copying a shape takes one call per run
+// rather than one index computation per element. Indexes are linear memory
+// indexes of the first element of a run in each layout.
+template <typename RunFunc>
+void ForEachContiguousRun(const TensorLayoutPlan& source_layout,
+                          const TensorLayoutPlan& dest_layout,
+                          const TensorShapeT& shape, const RunFunc& run_func) {
+  const int num_dimensions = shape.dimension.size();
+  CHECK_EQ(source_layout.num_dimensions(), num_dimensions);
+  CHECK_EQ(dest_layout.num_dimensions(), num_dimensions);
+
+  std::vector<int> lengths(num_dimensions);
+  for (int i = 0; i < num_dimensions; ++i) {
+    lengths[i] = GetDimensionLength(shape, i);
+    CHECK_GT(lengths[i], 0);
+  }
+
+  // Dimensions of length 1 never break a run, whatever their stride.
+  int run_length = 1;
+  int outer_dimensions = num_dimensions;
+  while (outer_dimensions > 0) {
+    const int i = outer_dimensions - 1;
+    if (lengths[i] != 1 && (source_layout.stride(i) != run_length ||
+                            dest_layout.stride(i) != run_length)) {
+      break;
+    }
+    run_length *= lengths[i];
+    --outer_dimensions;
+  }
+
+  int source_index = source_layout.GetFirstMemoryIndexForShape(shape);
+  int dest_index = dest_layout.GetFirstMemoryIndexForShape(shape);
+
+  // Walks the remaining outer dimensions like an odometer, updating memory
+  // indexes incrementally.
+  std::vector<int> counters(outer_dimensions, 0);
+  while (true) {
+    run_func(source_index, dest_index, run_length);
+
+    int i = outer_dimensions - 1;
+    for (; i >= 0; --i) {
+      source_index += source_layout.stride(i);
+      dest_index += dest_layout.stride(i);
+      if (++counters[i] < lengths[i]) {
+        break;
+      }
+      source_index -= source_layout.stride(i) * lengths[i];
+      dest_index -= dest_layout.stride(i) * lengths[i];
+      counters[i] = 0;
+    }
+    if (i < 0) {
+      return;
+    }
+  }
+}
+
 // Dumps shape information.
 std::string DumpShape(const TensorShape& shape);
 std::string DumpShape(const TensorShapeT& shape);
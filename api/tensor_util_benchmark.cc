@@ -0,0 +1,203 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures copying output slices into a packed layout by contiguous runs of
+// compiled layouts, against the recursive copy over flatbuffer layouts that it
+// replaced, and checks that both produce the same output.
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "api/tensor_util.h"
+#include "executable/executable_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "port/gflags.h"
+#include "port/logging.h"
+#include "port/ptr_util.h"
+
+ABSL_FLAG(int, iterations, 2000, "Number of relayouts per case.");
+
+namespace platforms {
+namespace darwinn {
+namespace api {
+namespace {
+
+// Copies elements in |source_shape| one slice of |dimension| at a time until
+// the slice is contiguous in both layouts.
+void RecursiveCopyShape(const TensorShapeT& source_shape,
+                        const TensorLayout& source_layout,
+                        const unsigned char* source_address,
+                        const TensorLayout& dest_layout,
+                        unsigned char* dest_address, int dimension) {
+  CHECK_LT(dimension, tensor_util::kNumDimensions);
+  if (tensor_util::IsShapeInContiguousLayout(source_layout, source_shape) &&
+      tensor_util::IsShapeInContiguousLayout(dest_layout, source_shape)) {
+    const int dest_offset =
+        tensor_util::GetFirstMemoryIndexForShape(dest_layout, source_shape);
+    const int source_offset =
+        tensor_util::GetFirstMemoryIndexForShape(source_layout, source_shape);
+    memcpy(dest_address + dest_offset, source_address + source_offset,
+           tensor_util::GetNumElementsInShape(source_shape));
+    return;
+  }
+
+  const auto range = source_shape.dimension.at(dimension);
+  for (int i = range.start(); i <= range.end(); ++i) {
+    TensorShapeT slice = source_shape;
+    slice.dimension.at(dimension) = Range(i, i);
+    RecursiveCopyShape(slice, source_layout, source_address, dest_layout,
+                       dest_address, dimension + 1);
+  }
+}
+
+// Copies elements in |source_shape| by contiguous runs.
+void RunCopyShape(const TensorShapeT& source_shape,
+                  const tensor_util::TensorLayoutPlan& source_layout,
+                  const unsigned char* source_address,
+                  const tensor_util::TensorLayoutPlan& dest_layout,
+                  unsigned char* dest_address) {
+  tensor_util::ForEachContiguousRun(
+      source_layout, dest_layout, source_shape,
+      [source_address, dest_address](int source_index, int dest_index,
+                                     int num_elements) {
+        memcpy(dest_address + dest_index, source_address + source_index,
+               num_elements);
+      });
+}
+
+// Serializes |layout| into |builder|, and returns the flatbuffer table.
+const TensorLayout* PackLayout(const TensorLayoutT& layout,
+                               flatbuffers::FlatBufferBuilder* builder) {
+  builder->Finish(CreateTensorLayout(*builder, &layout));
+  return flatbuffers::GetRoot<TensorLayout>(builder->GetBufferPointer());
+}
+
+// Returns the average time of |function| in microseconds.
+double MeasureMicros(const std::function<void()>& function, int iterations) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    function();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::micro>(elapsed).count() /
+         iterations;
+}
+
+// An output of byte elements, produced as a grid of slices with z padded to
+// |z_padded| elements.
+struct Case {
+  const char* name;
+  int y, x, z, z_padded;
+  int y_slices, x_slices;
+};
+
+void RunCase(const Case& test_case, int iterations) {
+  const auto dest_layout_t =
+      tensor_util::BuildPackedLayout(tensor_util::MakeTensorShape(
+          std::vector<int>{1, 1, test_case.y, test_case.x, test_case.z}));
+  flatbuffers::FlatBufferBuilder dest_builder;
+  const TensorLayout* dest_layout = PackLayout(*dest_layout_t, &dest_builder);
+  const tensor_util::TensorLayoutPlan dest_plan(*dest_layout_t);
+
+  // Slices are stored one after another in the source buffer.
+  std::vector<TensorShapeT> shapes;
+  std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> builders;
+  std::vector<const TensorLayout*> layouts;
+  std::vector<tensor_util::TensorLayoutPlan> plans;
+  std::vector<int> offsets;
+  int source_size = 0;
+  for (int y_slice = 0; y_slice < test_case.y_slices; ++y_slice) {
+    for (int x_slice = 0; x_slice < test_case.x_slices; ++x_slice) {
+      const int y_start = y_slice * test_case.y / test_case.y_slices;
+      const int y_end = (y_slice + 1) * test_case.y / test_case.y_slices - 1;
+      const int x_start = x_slice * test_case.x / test_case.x_slices;
+      const int x_end = (x_slice + 1) * test_case.x / test_case.x_slices - 1;
+
+      TensorLayoutT layout;
+      layout.shape = gtl::MakeUnique<TensorShapeT>(
+          tensor_util::MakeTensorShape(std::vector<Range>{
+              Range(0, 0), Range(0, 0), Range(y_start, y_end),
+              Range(x_start, x_end), Range(0, test_case.z - 1)}));
+      const int x_stride = test_case.z_padded;
+      const int y_stride = x_stride * (x_end - x_start + 1);
+      const int slice_size = y_stride * (y_end - y_start + 1);
+      layout.stride = {slice_size, slice_size, y_stride, x_stride, 1};
+
+      shapes.push_back(*layout.shape);
+      builders.push_back(gtl::MakeUnique<flatbuffers::FlatBufferBuilder>());
+      layouts.push_back(PackLayout(layout, builders.back().get()));
+      plans.emplace_back(layout);
+      offsets.push_back(source_size);
+      source_size += slice_size;
+    }
+  }
+
+  std::vector<unsigned char> source(source_size);
+  for (int i = 0; i < source_size; ++i) {
+    source[i] = static_cast<unsigned char>(i * 131 + 7);
+  }
+  const int dest_size = test_case.y * test_case.x * test_case.z;
+  std::vector<unsigned char> recursive_dest(dest_size);
+  std::vector<unsigned char> run_dest(dest_size);
+
+  const double recursive_us = MeasureMicros(
+      [&]() {
+        for (size_t i = 0; i < shapes.size(); ++i) {
+          RecursiveCopyShape(shapes[i], *layouts[i], source.data() + offsets[i],
+                             *dest_layout, recursive_dest.data(),
+                             /*dimension=*/0);
+        }
+      },
+      iterations);
+  const double run_us = MeasureMicros(
+      [&]() {
+        for (size_t i = 0; i < shapes.size(); ++i) {
+          RunCopyShape(shapes[i], plans[i], source.data() + offsets[i],
+                       dest_plan, run_dest.data());
+        }
+      },
+      iterations);
+
+  CHECK(recursive_dest == run_dest) << test_case.name;
+  printf("%-32s recursive %9.2f us, runs %8.2f us (%.1fx).\n", test_case.name,
+         recursive_us, run_us, recursive_us / run_us);
+}
+
+int Run() {
+  const Case cases[] = {
+      {"56x56x24, z padded to 32, 4 x", 56, 56, 24, 32, 1, 4},
+      {"28x28x128, 4 x", 28, 28, 128, 128, 1, 4},
+      {"14x14x1024, 2 y", 14, 14, 1024, 1024, 2, 1},
+      {"7x7x1001, z padded to 1008", 7, 7, 1001, 1008, 1, 1},
+  };
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  for (const Case& test_case : cases) {
+    RunCase(test_case, iterations);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace api
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::api::Run();
+}
@@ -0,0 +1,58 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/beagle/beagle_csr_thermal_sensor.h"
+
+#include "driver/config/beagle_csr_helper.h"
+#include "port/logging.h"
+#include "port/status_macros.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+BeagleCsrThermalSensor::BeagleCsrThermalSensor(
+    const config::ChipConfig& config, Registers* registers,
+    const BeagleTopLevelInterruptManager* interrupt_manager)
+    : apex_csr_offsets_(config.GetApexCsrOffsets()),
+      registers_(registers),
+      interrupt_manager_(interrupt_manager) {
+  CHECK(registers != nullptr);
+}
+
+StatusOr<ThermalReading> BeagleCsrThermalSensor::Read() {
+  ThermalReading reading;
+
+  // warn_o stays set until cleared, which only happens when the thermal
+  // warning interrupt is handled.
+  ASSIGN_OR_RETURN(const uint32 omc0_dc_read,
+                   registers_->Read32(apex_csr_offsets_.omc0_dc));
+  const config::registers::Omc0DC omc0_dc_helper(omc0_dc_read);
+  reading.warning = omc0_dc_helper.warn_o() != 0;
+
+  if (interrupt_manager_ != nullptr) {
+    const int64 num_thermal_warnings =
+        interrupt_manager_->num_thermal_warnings();
+    if (num_thermal_warnings != num_thermal_warnings_) {
+      reading.warning = true;
+      num_thermal_warnings_ = num_thermal_warnings;
+    }
+  }
+
+  return reading;
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,61 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_BEAGLE_BEAGLE_CSR_THERMAL_SENSOR_H_
+#define DARWINN_DRIVER_BEAGLE_BEAGLE_CSR_THERMAL_SENSOR_H_
+
+#include "driver/beagle/beagle_top_level_interrupt_manager.h"
+#include "driver/config/apex_csr_offsets.h"
+#include "driver/config/chip_config.h"
+#include "driver/registers/registers.h"
+#include "driver/thermal_sensor.h"
+#include "port/integral_types.h"
+#include "port/statusor.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Reads the thermal warning of Beagle through CSRs. Only used in remote
+// driver, as the kernel driver reports temperature itself. The die
+// temperature is not reported, as the raw thermal sensor data is not
+// calibrated.
+class BeagleCsrThermalSensor : public ThermalSensor {
+ public:
+  // |interrupt_manager| handles thermal warning interrupts, which clears the
+  // warning in hardware. It may be null if those are not handled.
+  BeagleCsrThermalSensor(
+      const config::ChipConfig& config, Registers* registers,
+      const BeagleTopLevelInterruptManager* interrupt_manager);
+  ~BeagleCsrThermalSensor() override = default;
+
+  StatusOr<ThermalReading> Read() override;
+
+ private:
+  // Apex CSR offsets.
+  const config::ApexCsrOffsets& apex_csr_offsets_;
+
+  // CSR interface.
+  Registers* const registers_;
+
+  // Interrupt manager, and its count of thermal warnings at the last read.
+  const BeagleTopLevelInterruptManager* const interrupt_manager_;
+  int64 num_thermal_warnings_{0};
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_BEAGLE_BEAGLE_CSR_THERMAL_SENSOR_H_
@@ -100,11 +100,12 @@ Status BeagleKernelTopLevelHandler::Close() {
   return Status();  // OK
 }
 
-Status BeagleKernelTopLevelHandler::QuitReset() {
+Status BeagleKernelTopLevelHandler::IoctlPerformanceExpectation(
+    api::PerformanceExpectation performance) {
   apex_performance_expectation_ioctl ioctl_buffer;
   memset(&ioctl_buffer, 0, sizeof(ioctl_buffer));
 
-  switch (performance_) {
+  switch (performance) {
     case api::PerformanceExpectation_Low:
       ioctl_buffer.performance = APEX_PERFORMANCE_LOW;
       break;
@@ -123,16 +124,39 @@ Status BeagleKernelTopLevelHandler::QuitReset() {
 
     default:
       return InvalidArgumentError(
-          StringPrintf("Bad performance setting %d.", performance_));
+          StringPrintf("Bad performance setting %d.", performance));
   }
 
-  StdMutexLock lock(&mutex_);
   if (ioctl(fd_, APEX_IOCTL_PERFORMANCE_EXPECTATION, &ioctl_buffer) != 0) {
-    LOG(WARNING) << StringPrintf(
-        "Could not set performance expectation : %d (%s)", fd_,
-        strerror(errno));
+    return FailedPreconditionError(
+        StringPrintf("Could not set performance expectation : %d (%s)", fd_,
+                     strerror(errno)));
+  }
+
+  return Status();  // OK
+}
+
+Status BeagleKernelTopLevelHandler::QuitReset() {
+  StdMutexLock lock(&mutex_);
+  Status status = IoctlPerformanceExpectation(performance_);
+  if (IsFailedPrecondition(status)) {
+    // Older kernel drivers do not support performance expectation.
+    LOG(WARNING) << status.message();
+    return Status();  // OK
+  }
+
+  return status;
+}
+
+Status BeagleKernelTopLevelHandler::SetPerformanceExpectation(
+    api::PerformanceExpectation performance) {
+  StdMutexLock lock(&mutex_);
+  if (fd_ == INVALID_FD_VALUE) {
+    return FailedPreconditionError("Device not open.");
   }
 
+  RETURN_IF_ERROR(IoctlPerformanceExpectation(performance));
+  performance_ = performance;
   return Status();  // OK
 }
 
@@ -40,22 +40,28 @@ class BeagleKernelTopLevelHandler : public TopLevelHandler {
   Status EnableSoftwareClockGate() override;
   Status DisableSoftwareClockGate() override;
   Status QuitReset() override;
+  Status SetPerformanceExpectation(
+      api::PerformanceExpectation performance) override;
 
  private:
+  // Asks the kernel driver to apply the given performance level.
+  Status IoctlPerformanceExpectation(api::PerformanceExpectation performance)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Device path.
   const std::string device_path_;
 
   // File descriptor of the opened device.
   FileDescriptor fd_ GUARDED_BY(mutex_){INVALID_FD_VALUE};
 
-  // Mutex that guards fd_.
+  // Mutex that guards fd_ and performance_.
   std::mutex mutex_;
 
   // Chip starts in clock gated state.
   bool clock_gated_{true};
 
   // Performance setting.
-  const api::PerformanceExpectation performance_;
+  api::PerformanceExpectation performance_ GUARDED_BY(mutex_);
 };
 
 }  // namespace driver
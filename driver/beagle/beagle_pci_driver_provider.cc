@@ -38,7 +38,7 @@
 #include "driver/package_verifier.h"
 #include "driver/run_controller.h"
 #include "driver/scalar_core_controller.h"
-#include "driver_shared/time_stamper/driver_time_stamper.h"
+#include "driver_shared/time_stamper/driver_time_stamper_factory.h"
 
 namespace platforms {
 namespace darwinn {
@@ -54,6 +54,11 @@ std::vector<Device> BeaglePciDriverProvider::Enumerate() {
   return EnumerateSysfs("apex", Chip::kBeagle, Device::Type::PCI);
 }
 
+std::unique_ptr<DeviceWatcher> BeaglePciDriverProvider::WatchDevices(
+    std::function<void()> on_change) {
+  return WatchDeviceFiles("apex", std::move(on_change));
+}
+
 bool BeaglePciDriverProvider::CanCreate(const Device& device) {
   return device.type == Device::Type::PCI && device.chip == Chip::kBeagle;
 }
@@ -133,9 +138,10 @@ StatusOr<std::unique_ptr<api::Driver>> BeaglePciDriverProvider::CreateDriver(
       MakeExecutableVerifier(flatbuffers::GetString(options.public_key())));
   auto executable_registry = gtl::MakeUnique<PackageRegistry>(
       device.chip, std::move(verifier), dram_allocator.get());
-  auto time_stamper = gtl::MakeUnique<driver_shared::DriverTimeStamper>();
+  auto time_stamper =
+      driver_shared::DriverTimeStamperFactory().CreateTimeStamper();
 
-  return {gtl::MakeUnique<MmioDriver>(
+  auto driver = gtl::MakeUnique<MmioDriver>(
       options, std::move(config), std::move(registers),
       std::move(dram_allocator), std::move(mmu_mapper),
       std::move(address_space), std::move(allocator), std::move(host_queue),
@@ -143,7 +149,14 @@ StatusOr<std::unique_ptr<api::Driver>> BeaglePciDriverProvider::CreateDriver(
       std::move(fatal_error_interrupt_controller),
       std::move(scalar_core_controller), std::move(run_controller),
       std::move(top_level_handler), std::move(executable_registry),
-      std::move(time_stamper))};
+      std::move(time_stamper));
+
+  auto thermal_sensor = CreateThermalSensor(device.path);
+  if (thermal_sensor != nullptr) {
+    driver->SetThermalSensor(std::move(thermal_sensor));
+  }
+
+  return {std::move(driver)};
 }
 
 }  // namespace driver
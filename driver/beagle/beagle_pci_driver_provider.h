@@ -21,6 +21,7 @@
 #include "driver/kernel/kernel_coherent_allocator.h"
 #include "driver/kernel/kernel_interrupt_handler.h"
 #include "driver/kernel/kernel_registers.h"
+#include "driver/thermal_sensor.h"
 #include "port/integral_types.h"
 #include "port/ptr_util.h"
 
@@ -31,6 +32,8 @@ namespace driver {
 class BeaglePciDriverProvider : public DriverProvider {
  public:
   std::vector<api::Device> Enumerate() override;
+  std::unique_ptr<DeviceWatcher> WatchDevices(
+      std::function<void()> on_change) override;
   bool CanCreate(const api::Device& device) override;
   StatusOr<std::unique_ptr<api::Driver>> CreateDriver(
       const api::Device& device, const api::DriverOptions& options) override;
@@ -45,6 +48,12 @@ class BeaglePciDriverProvider : public DriverProvider {
       bool read_only) = 0;
   virtual std::unique_ptr<KernelInterruptHandler> CreateKernelInterruptHandler(
       const std::string& device_path) = 0;
+
+  // Returns null if die temperature cannot be read on the platform.
+  virtual std::unique_ptr<ThermalSensor> CreateThermalSensor(
+      const std::string& device_path) {
+    return nullptr;
+  }
 };
 
 }  // namespace driver
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "driver/beagle/beagle_pci_driver_provider.h"
+#include "driver/beagle/beagle_sysfs_thermal_sensor.h"
 #include "driver/kernel/linux/kernel_coherent_allocator_linux.h"
 #include "driver/kernel/linux/kernel_event_handler_linux.h"
 #include "driver/kernel/linux/kernel_registers_linux.h"
@@ -52,6 +53,11 @@ class BeaglePciDriverProviderLinux : public BeaglePciDriverProvider {
     return gtl::MakeUnique<KernelInterruptHandler>(std::move(event_handler));
   }
 
+  std::unique_ptr<ThermalSensor> CreateThermalSensor(
+      const std::string& device_path) override {
+    return gtl::MakeUnique<BeagleSysfsThermalSensor>(device_path);
+  }
+
  private:
   BeaglePciDriverProviderLinux() = default;
 };
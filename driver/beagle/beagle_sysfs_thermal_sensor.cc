@@ -0,0 +1,61 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/beagle/beagle_sysfs_thermal_sensor.h"
+
+#include <fstream>
+
+#include "port/errors.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+namespace {
+
+// Returns the sysfs temperature attribute of the given device node.
+std::string TemperaturePath(const std::string& device_path) {
+  const std::string::size_type separator = device_path.find_last_of('/');
+  const std::string device_name = separator == std::string::npos
+                                      ? device_path
+                                      : device_path.substr(separator + 1);
+  return "/sys/class/apex/" + device_name + "/temp";
+}
+
+}  // namespace
+
+BeagleSysfsThermalSensor::BeagleSysfsThermalSensor(
+    const std::string& device_path)
+    : temperature_path_(TemperaturePath(device_path)) {}
+
+StatusOr<ThermalReading> BeagleSysfsThermalSensor::Read() {
+  // Sysfs attributes are generated on open, so the file is opened for every
+  // reading.
+  std::ifstream file(temperature_path_);
+  int temperature_millicelsius;
+  if (!(file >> temperature_millicelsius)) {
+    return UnavailableError(
+        StringPrintf("Could not read %s.", temperature_path_.c_str()));
+  }
+
+  ThermalReading reading;
+  reading.has_temperature = true;
+  reading.temperature_millicelsius = temperature_millicelsius;
+  return reading;
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,46 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_BEAGLE_BEAGLE_SYSFS_THERMAL_SENSOR_H_
+#define DARWINN_DRIVER_BEAGLE_BEAGLE_SYSFS_THERMAL_SENSOR_H_
+
+#include <string>
+
+#include "driver/thermal_sensor.h"
+#include "port/statusor.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Reads die temperature of Beagle through sysfs, as reported by the apex
+// kernel driver in millidegrees Celsius.
+class BeagleSysfsThermalSensor : public ThermalSensor {
+ public:
+  // |device_path| is the device node, e.g. /dev/apex_0.
+  explicit BeagleSysfsThermalSensor(const std::string& device_path);
+  ~BeagleSysfsThermalSensor() override = default;
+
+  StatusOr<ThermalReading> Read() override;
+
+ private:
+  // Path of the sysfs temperature attribute.
+  const std::string temperature_path_;
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_BEAGLE_BEAGLE_SYSFS_THERMAL_SENSOR_H_
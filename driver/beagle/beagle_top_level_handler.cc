@@ -16,6 +16,7 @@
 
 #include "driver/config/beagle_csr_helper.h"
 #include "driver/config/common_csr_helper.h"
+#include "driver/registers/register_batch.h"
 #include "driver/registers/registers.h"
 #include "port/errors.h"
 #include "port/integral_types.h"
@@ -31,6 +32,13 @@ namespace {
 
 using config::registers::ScuCtrl3;
 
+// Copies GCB, AXI, and 8051 clock rates, preserving other fields of |to|.
+void CopyClockRates(const ScuCtrl3& from, ScuCtrl3* to) {
+  to->set_gcb_clock_rate(from.gcb_clock_rate());
+  to->set_axi_clock_rate(from.axi_clock_rate());
+  to->set_usb_8051_clock_rate(from.usb_8051_clock_rate());
+}
+
 }  // namespace
 
 BeagleTopLevelHandler::BeagleTopLevelHandler(
@@ -55,21 +63,24 @@ Status BeagleTopLevelHandler::Open() {
   software_clock_gated_ = false;
   hardware_clock_gated_ = false;
 
-  // 1. Always disable inactive mode.
-  // Read the register to preserve other fields.
-  ASSIGN_OR_RETURN(uint32 scu_ctrl_0_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_0));
-  config::registers::ScuCtrl0 helper(scu_ctrl_0_reg);
-  helper.set_rg_pcie_inact_phy_mode(0);
-  helper.set_rg_usb_inact_phy_mode(0);
-  RETURN_IF_ERROR(registers_->Write32(reset_offsets_.scu_ctrl_0, helper.raw()));
+  RegisterBatch batch;
+
+  // 1. Always disable inactive mode. Preserve other fields.
+  batch.Modify32(reset_offsets_.scu_ctrl_0, [](uint32 value) {
+    config::registers::ScuCtrl0 helper(value);
+    helper.set_rg_pcie_inact_phy_mode(0);
+    helper.set_rg_usb_inact_phy_mode(0);
+    return static_cast<uint32>(helper.raw());
+  });
 
   // 2. Check "rg_gated_gcb".
   // 0x0: deprecated
   // 0x1: hardware clock gated
   // 0x2: no clock gating
-  ASSIGN_OR_RETURN(uint32 scu_ctrl_2_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_2));
+  uint32 scu_ctrl_2_reg = 0;
+  batch.Read32(reset_offsets_.scu_ctrl_2, &scu_ctrl_2_reg);
+  RETURN_IF_ERROR(registers_->Execute(batch));
+
   config::registers::ScuCtrl2 scu_ctrl_2(scu_ctrl_2_reg);
   if (scu_ctrl_2.rg_gated_gcb() == 0x1) {
     hardware_clock_gated_ = true;
@@ -78,84 +89,104 @@ Status BeagleTopLevelHandler::Open() {
   return Status();  // OK
 }
 
-Status BeagleTopLevelHandler::QuitReset() {
-  // Disable Sleep Mode (Partial Software Control)
-  // 1. Make "rg_force_sleep" to be b10. Read the register to preserve other
-  // fields.
-  // 2. Set GCB, AXI, and 8051 clock rate according to desired performance
-  // level.
-  ASSIGN_OR_RETURN(uint32 scu_ctrl_3_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_3));
-  config::registers::ScuCtrl3 helper(scu_ctrl_3_reg);
-  helper.set_rg_force_sleep(0b10);
-
-  switch (performance_) {
+Status BeagleTopLevelHandler::SetClockRates(
+    api::PerformanceExpectation performance, ScuCtrl3* helper) const {
+  switch (performance) {
     case api::PerformanceExpectation_Low:
-      helper.set_gcb_clock_rate(ScuCtrl3::GcbClock::k63MHZ);
-      helper.set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
-      helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
+      helper->set_gcb_clock_rate(ScuCtrl3::GcbClock::k63MHZ);
+      helper->set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
+      helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
       break;
 
     case api::PerformanceExpectation_Medium:
-      helper.set_gcb_clock_rate(ScuCtrl3::GcbClock::k125MHZ);
-      helper.set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
+      helper->set_gcb_clock_rate(ScuCtrl3::GcbClock::k125MHZ);
+      helper->set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
       if (use_usb_) {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
       } else {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
       }
       break;
 
     case api::PerformanceExpectation_High:
-      helper.set_gcb_clock_rate(ScuCtrl3::GcbClock::k250MHZ);
-      helper.set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
+      helper->set_gcb_clock_rate(ScuCtrl3::GcbClock::k250MHZ);
+      helper->set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
       if (use_usb_) {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
       } else {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
       }
       break;
 
     case api::PerformanceExpectation_Max:
-      helper.set_gcb_clock_rate(ScuCtrl3::GcbClock::k500MHZ);
+      helper->set_gcb_clock_rate(ScuCtrl3::GcbClock::k500MHZ);
       if (use_usb_) {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
-        helper.set_axi_clock_rate(ScuCtrl3::AxiClock::k250MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k500MHZ);
+        helper->set_axi_clock_rate(ScuCtrl3::AxiClock::k250MHZ);
       } else {
-        helper.set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
-        helper.set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
+        helper->set_usb_8051_clock_rate(ScuCtrl3::Usb8051Clock::k250MHZ);
+        helper->set_axi_clock_rate(ScuCtrl3::AxiClock::k125MHZ);
       }
       break;
 
     default:
       return InvalidArgumentError(
-          StringPrintf("Bad performance setting %d.", performance_));
+          StringPrintf("Bad performance setting %d.", performance));
   }
 
-  RETURN_IF_ERROR(registers_->Write32(reset_offsets_.scu_ctrl_3, helper.raw()));
+  return Status();  // OK
+}
+
+Status BeagleTopLevelHandler::SetPerformanceExpectation(
+    api::PerformanceExpectation performance) {
+  ScuCtrl3 clock_rates;
+  RETURN_IF_ERROR(SetClockRates(performance, &clock_rates));
+
+  // Preserve other fields, and only change GCB, AXI, and 8051 clock rates.
+  RegisterBatch batch;
+  batch.Modify32(reset_offsets_.scu_ctrl_3, [&clock_rates](uint32 value) {
+    ScuCtrl3 helper(value);
+    CopyClockRates(clock_rates, &helper);
+    return static_cast<uint32>(helper.raw());
+  });
+  RETURN_IF_ERROR(registers_->Execute(batch));
+
+  performance_ = performance;
+  return Status();  // OK
+}
+
+Status BeagleTopLevelHandler::QuitReset() {
+  ScuCtrl3 clock_rates;
+  RETURN_IF_ERROR(SetClockRates(performance_, &clock_rates));
+
+  RegisterBatch batch;
+
+  // Disable Sleep Mode (Partial Software Control)
+  // 1. Make "rg_force_sleep" to be b10. Preserve other fields.
+  // 2. Set GCB, AXI, and 8051 clock rate according to desired performance
+  // level.
+  batch.Modify32(reset_offsets_.scu_ctrl_3, [&clock_rates](uint32 value) {
+    ScuCtrl3 helper(value);
+    helper.set_rg_force_sleep(0b10);
+    CopyClockRates(clock_rates, &helper);
+    return static_cast<uint32>(helper.raw());
+  });
 
   // 2. Poll until "cur_pwr_state" is 0x0. Other fields might change as well,
   // hence "cur_pwr_state" field has to be explicitly checked.
-  ASSIGN_OR_RETURN(scu_ctrl_3_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_3));
-  helper.set_raw(scu_ctrl_3_reg);
-  while (helper.cur_pwr_state() != 0x0) {
-    ASSIGN_OR_RETURN(scu_ctrl_3_reg,
-                     registers_->Read32(reset_offsets_.scu_ctrl_3));
-    helper.set_raw(scu_ctrl_3_reg);
-  }
+  batch.Poll32(reset_offsets_.scu_ctrl_3, [](uint32 value) {
+    return ScuCtrl3(value).cur_pwr_state() == 0x0;
+  });
 
   // 3. Confirm that moved out of reset by reading any CSR with known initial
   // value. scalar core run control should be zero.
-  RETURN_IF_ERROR(
-      registers_->Poll(scalar_core_offsets_.scalarCoreRunControl, 0));
+  batch.Poll(scalar_core_offsets_.scalarCoreRunControl, 0);
 
   // 4. Enable idle register.
   config::registers::IdleRegister idle_reg;
   idle_reg.set_enable();
   idle_reg.set_counter(1);
-  RETURN_IF_ERROR(
-      registers_->Write(misc_offsets_.idleRegister, idle_reg.raw()));
+  batch.Write(misc_offsets_.idleRegister, idle_reg.raw());
 
   // 5. Update sleep/wake delay for tiles. toSleepDelay = 2, toWakeDelay = 30.
   // Broadcast to tiles.
@@ -163,21 +194,18 @@ Status BeagleTopLevelHandler::QuitReset() {
   // automatically for different chips.
   config::registers::TileConfig<7> tile_config_reg;
   tile_config_reg.set_broadcast();
-  RETURN_IF_ERROR(registers_->Write(tile_config_offsets_.tileconfig0,
-                                    tile_config_reg.raw()));
+  batch.Write(tile_config_offsets_.tileconfig0, tile_config_reg.raw());
   // Wait until tileconfig0 is set correctly. Subsequent writes are going to
   // tiles, but hardware does not guarantee correct ordering with previous
   // write.
-  RETURN_IF_ERROR(registers_->Poll(tile_config_offsets_.tileconfig0,
-                                   tile_config_reg.raw()));
+  batch.Poll(tile_config_offsets_.tileconfig0, tile_config_reg.raw());
 
   config::registers::DeepSleep deep_sleep_reg;
   deep_sleep_reg.set_to_sleep_delay(2);
   deep_sleep_reg.set_to_wake_delay(30);
-  RETURN_IF_ERROR(
-      registers_->Write(tile_offsets_.deepSleep, deep_sleep_reg.raw()));
+  batch.Write(tile_offsets_.deepSleep, deep_sleep_reg.raw());
 
-  return Status();  // OK
+  return registers_->Execute(batch);
 }
 
 Status BeagleTopLevelHandler::EnableReset() {
@@ -190,37 +218,35 @@ Status BeagleTopLevelHandler::EnableReset() {
     return Status();  // OK
   }
 
+  RegisterBatch batch;
+
   // Enable Sleep Mode (Partial Software Control).
   if (!use_usb_) {
     // Do Software Force GCB Idle.
     // Make sure all outstanding DMAs are drained. Note that USB does not have
     // to do step 1/2 as host controls DMAs.
     // 1. Enable DMA pause.
-    RETURN_IF_ERROR(registers_->Write(hib_user_offsets_.dma_pause, 1));
+    batch.Write(hib_user_offsets_.dma_pause, 1);
 
     // 2. Wait until DMA is paused.
-    RETURN_IF_ERROR(registers_->Poll(hib_user_offsets_.dma_paused, 1));
+    batch.Poll(hib_user_offsets_.dma_paused, 1);
   }
 
   // Actual enable sleep mode.
-  // 3. Set "rg_force_sleep" to 0x3. Read the register to preserve other fields.
+  // 3. Set "rg_force_sleep" to 0x3, preserving other fields read above.
   helper.set_rg_force_sleep(0x3);
-  RETURN_IF_ERROR(registers_->Write32(reset_offsets_.scu_ctrl_3, helper.raw()));
+  batch.Write32(reset_offsets_.scu_ctrl_3, helper.raw());
 
   // 4. Poll until "cur_pwr_state" becomes 0x2. Other fields might change as
   // well, hence "cur_pwr_state" field has to be explicitly checked.
-  ASSIGN_OR_RETURN(scu_ctrl_3_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_3));
-  helper.set_raw(scu_ctrl_3_reg);
-  while (helper.cur_pwr_state() != 0x2) {
-    ASSIGN_OR_RETURN(scu_ctrl_3_reg,
-                     registers_->Read32(reset_offsets_.scu_ctrl_3));
-    helper.set_raw(scu_ctrl_3_reg);
-  }
+  batch.Poll32(reset_offsets_.scu_ctrl_3, [](uint32 value) {
+    return ScuCtrl3(value).cur_pwr_state() == 0x2;
+  });
 
   // 5. Clear BULK credit by pulsing LSBs of "gcbb_credit0".
-  RETURN_IF_ERROR(registers_->Write32(cb_bridge_offsets_.gcbb_credit0, 0xF));
-  return registers_->Write32(cb_bridge_offsets_.gcbb_credit0, 0x0);
+  batch.Write32(cb_bridge_offsets_.gcbb_credit0, 0xF);
+  batch.Write32(cb_bridge_offsets_.gcbb_credit0, 0x0);
+  return registers_->Execute(batch);
 }
 
 Status BeagleTopLevelHandler::EnableHardwareClockGate() {
@@ -229,13 +255,14 @@ Status BeagleTopLevelHandler::EnableHardwareClockGate() {
   }
 
   // Enable Hardware Clock Gate (GCB)
-  // 1. Write "rg_gated_gcb" to 0x1. Read the register to preserve other fields.
-  ASSIGN_OR_RETURN(uint32 scu_ctrl_2_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_2));
-  config::registers::ScuCtrl2 scu_ctrl_2(scu_ctrl_2_reg);
-  scu_ctrl_2.set_rg_gated_gcb(0x1);
-  RETURN_IF_ERROR(
-      registers_->Write32(reset_offsets_.scu_ctrl_2, scu_ctrl_2.raw()));
+  // 1. Write "rg_gated_gcb" to 0x1. Preserve other fields.
+  RegisterBatch batch;
+  batch.Modify32(reset_offsets_.scu_ctrl_2, [](uint32 value) {
+    config::registers::ScuCtrl2 scu_ctrl_2(value);
+    scu_ctrl_2.set_rg_gated_gcb(0x1);
+    return static_cast<uint32>(scu_ctrl_2.raw());
+  });
+  RETURN_IF_ERROR(registers_->Execute(batch));
 
   hardware_clock_gated_ = true;
   return Status();  // OK
@@ -247,14 +274,15 @@ Status BeagleTopLevelHandler::DisableHardwareClockGate() {
   }
 
   // Disable Software Clock Gate (GCB)
-  // 1. Force clock on by writing "rg_gated_gcb" to 0x2. Read the register to
-  // preserve other fields.
-  ASSIGN_OR_RETURN(uint32 scu_ctrl_2_reg,
-                   registers_->Read32(reset_offsets_.scu_ctrl_2));
-  config::registers::ScuCtrl2 scu_ctrl_2(scu_ctrl_2_reg);
-  scu_ctrl_2.set_rg_gated_gcb(0x2);
-  RETURN_IF_ERROR(
-      registers_->Write32(reset_offsets_.scu_ctrl_2, scu_ctrl_2.raw()));
+  // 1. Force clock on by writing "rg_gated_gcb" to 0x2. Preserve other
+  // fields.
+  RegisterBatch batch;
+  batch.Modify32(reset_offsets_.scu_ctrl_2, [](uint32 value) {
+    config::registers::ScuCtrl2 scu_ctrl_2(value);
+    scu_ctrl_2.set_rg_gated_gcb(0x2);
+    return static_cast<uint32>(scu_ctrl_2.raw());
+  });
+  RETURN_IF_ERROR(registers_->Execute(batch));
 
   hardware_clock_gated_ = false;
   return Status();  // OK
@@ -16,6 +16,7 @@
 #define DARWINN_DRIVER_BEAGLE_BEAGLE_TOP_LEVEL_HANDLER_H_
 
 #include "api/driver_options_generated.h"
+#include "driver/config/beagle_csr_helper.h"
 #include "driver/config/cb_bridge_csr_offsets.h"
 #include "driver/config/chip_config.h"
 #include "driver/config/hib_user_csr_offsets.h"
@@ -46,8 +47,15 @@ class BeagleTopLevelHandler : public TopLevelHandler {
   Status EnableReset() override;
   Status EnableHardwareClockGate() override;
   Status DisableHardwareClockGate() override;
+  Status SetPerformanceExpectation(
+      api::PerformanceExpectation performance) override;
 
  private:
+  // Sets GCB, AXI, and 8051 clock rates in |helper| for the given performance
+  // level.
+  Status SetClockRates(api::PerformanceExpectation performance,
+                       config::registers::ScuCtrl3* helper) const;
+
   // CSR offsets.
   const config::CbBridgeCsrOffsets& cb_bridge_offsets_;
   const config::HibUserCsrOffsets& hib_user_offsets_;
@@ -60,8 +68,9 @@ class BeagleTopLevelHandler : public TopLevelHandler {
   // CSR interface.
   Registers* const registers_;
 
-  // Select clock combinations for performance.
-  const api::PerformanceExpectation performance_;
+  // Select clock combinations for performance. Only changed while out of
+  // reset, so never concurrently with QuitReset().
+  api::PerformanceExpectation performance_;
 
   // Whether USB is used for Beagle.
   const bool use_usb_;
@@ -0,0 +1,274 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Counts the USB control transfers BeagleTopLevelHandler makes for the open
+// and reset sequences of UsbDriver, using a fake device, and checks them
+// against the expected counts.
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+
+#include "api/driver_options_generated.h"
+#include "driver/beagle/beagle_top_level_handler.h"
+#include "driver/config/beagle/beagle_chip_config.h"
+#include "driver/config/beagle_csr_helper.h"
+#include "driver/usb/usb_device_interface.h"
+#include "driver/usb/usb_ml_commands.h"
+#include "driver/usb/usb_registers.h"
+#include "port/errors.h"
+#include "port/gflags.h"
+#include "port/integral_types.h"
+#include "port/logging.h"
+#include "port/ptr_util.h"
+#include "port/status.h"
+#include "port/statusor.h"
+#include "port/time.h"
+
+ABSL_FLAG(int, transfer_latency_us, 150,
+          "Simulated latency of a control transfer.");
+ABSL_FLAG(int, power_transition_us, 2000,
+          "Simulated time for the power state to follow rg_force_sleep.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+using config::registers::ScuCtrl3;
+
+// Device holding CSRs, which counts control transfers. The power state in
+// scu_ctrl_3 follows rg_force_sleep after a delay.
+class FakeUsbDevice : public UsbDeviceInterface {
+ public:
+  explicit FakeUsbDevice(uint64 scu_ctrl_3_offset)
+      : scu_ctrl_3_offset_(scu_ctrl_3_offset) {}
+
+  Status Close(CloseAction action) override { return OkStatus(); }
+  Status SetConfiguration(int configuration) override { return OkStatus(); }
+  Status ClaimInterface(int interface_number) override { return OkStatus(); }
+  Status ReleaseInterface(int interface_number) override { return OkStatus(); }
+
+  Status GetDescriptor(DescriptorType desc_type, uint8_t desc_index,
+                       MutableBuffer data_in, size_t* num_bytes_transferred,
+                       const char* context) override {
+    return UnimplementedError("GetDescriptor");
+  }
+
+  Status SendControlCommand(const SetupPacket& command,
+                            TimeoutMillis timeout_msec,
+                            const char* context) override {
+    return UnimplementedError("SendControlCommand");
+  }
+
+  Status SendControlCommandWithDataOut(const SetupPacket& command,
+                                       ConstBuffer data_out,
+                                       TimeoutMillis timeout_msec,
+                                       const char* context) override {
+    Microsleep(absl::GetFlag(FLAGS_transfer_latency_us));
+    ++writes;
+    const uint64 offset = Offset(command);
+    uint64 value = 0;
+    memcpy(&value, data_out.data(), data_out.size());
+    if (data_out.size() == sizeof(uint32)) {
+      value |= Get(offset) & 0xFFFFFFFF00000000ULL;
+    }
+    Set(offset, value);
+    return OkStatus();
+  }
+
+  Status SendControlCommandWithDataIn(const SetupPacket& command,
+                                      MutableBuffer data_in,
+                                      size_t* num_bytes_transferred,
+                                      TimeoutMillis timeout_msec,
+                                      const char* context) override {
+    Microsleep(absl::GetFlag(FLAGS_transfer_latency_us));
+    ++reads;
+    const uint64 value = Get(Offset(command));
+    memcpy(data_in.data(), &value, data_in.size());
+    *num_bytes_transferred = data_in.size();
+    return OkStatus();
+  }
+
+  Status BulkOutTransfer(uint8_t endpoint, ConstBuffer data_out,
+                         TimeoutMillis timeout_msec,
+                         const char* context) override {
+    return UnimplementedError("BulkOutTransfer");
+  }
+
+  Status BulkInTransfer(uint8_t endpoint, MutableBuffer data_in,
+                        size_t* num_bytes_transferred,
+                        TimeoutMillis timeout_msec,
+                        const char* context) override {
+    return UnimplementedError("BulkInTransfer");
+  }
+
+  Status InterruptInTransfer(uint8_t endpoint, MutableBuffer data_in,
+                             size_t* num_bytes_transferred,
+                             TimeoutMillis timeout_msec,
+                             const char* context) override {
+    return UnimplementedError("InterruptInTransfer");
+  }
+
+  Status AsyncBulkOutTransfer(uint8_t endpoint, ConstBuffer data_out,
+                              TimeoutMillis timeout_msec, DataOutDone callback,
+                              const char* context) override {
+    return UnimplementedError("AsyncBulkOutTransfer");
+  }
+
+  Status AsyncBulkInTransfer(uint8_t endpoint, MutableBuffer data_in,
+                             TimeoutMillis timeout_msec, DataInDone callback,
+                             const char* context) override {
+    return UnimplementedError("AsyncBulkInTransfer");
+  }
+
+  Status AsyncInterruptInTransfer(uint8_t endpoint, MutableBuffer data_in,
+                                  TimeoutMillis timeout_msec,
+                                  DataInDone callback,
+                                  const char* context) override {
+    return UnimplementedError("AsyncInterruptInTransfer");
+  }
+
+  void TryCancelAllTransfers() override {}
+
+  StatusOr<MutableBuffer> AllocateTransferBuffer(size_t buffer_size) override {
+    return UnimplementedError("AllocateTransferBuffer");
+  }
+
+  Status ReleaseTransferBuffer(MutableBuffer buffer) override {
+    return UnimplementedError("ReleaseTransferBuffer");
+  }
+
+  StatusOr<std::function<void()>> DetachTransferBuffer(
+      MutableBuffer buffer) override {
+    return UnimplementedError("DetachTransferBuffer");
+  }
+
+  // Sets the power state right away.
+  void SetPowerState(uint64 power_state) {
+    ScuCtrl3 helper(registers_[scu_ctrl_3_offset_]);
+    helper.set_cur_pwr_state(power_state);
+    registers_[scu_ctrl_3_offset_] = helper.raw();
+    target_power_state_ = power_state;
+  }
+
+  void SetRegister(uint64 offset, uint64 value) { registers_[offset] = value; }
+
+  void ResetCounts() { reads = writes = 0; }
+
+  int reads = 0;
+  int writes = 0;
+
+ private:
+  // CSR offsets are split across the value and index of the setup packet.
+  static uint64 Offset(const SetupPacket& command) {
+    return command.value | (static_cast<uint64>(command.index) << 16);
+  }
+
+  uint64 Get(uint64 offset) {
+    if (offset == scu_ctrl_3_offset_ &&
+        GetCurrentTimeMicros() - transition_start_us_ >=
+            absl::GetFlag(FLAGS_power_transition_us)) {
+      SetPowerState(target_power_state_);
+    }
+    return registers_[offset];
+  }
+
+  void Set(uint64 offset, uint64 value) {
+    if (offset == scu_ctrl_3_offset_) {
+      // The power state is read only, and starts moving towards the state
+      // requested by rg_force_sleep.
+      ScuCtrl3 helper(value);
+      target_power_state_ = helper.rg_force_sleep() == 0x3 ? 0x2 : 0x0;
+      transition_start_us_ = GetCurrentTimeMicros();
+      helper.set_cur_pwr_state(ScuCtrl3(registers_[offset]).cur_pwr_state());
+      value = helper.raw();
+    }
+    registers_[offset] = value;
+  }
+
+  const uint64 scu_ctrl_3_offset_;
+  std::map<uint64, uint64> registers_;
+  uint64 target_power_state_ = 0;
+  int64 transition_start_us_ = 0;
+};
+
+int Run() {
+  config::BeagleChipConfig config;
+  const auto& scu_offsets = config.GetScuCsrOffsets();
+  auto device = gtl::MakeUnique<FakeUsbDevice>(scu_offsets.scu_ctrl_3);
+  FakeUsbDevice* fake_device = device.get();
+
+  // The chip starts in reset, hardware clock gated, with inactive PHY modes.
+  ScuCtrl3 scu_ctrl_3(0);
+  scu_ctrl_3.set_rg_force_sleep(0x3);
+  fake_device->SetRegister(scu_offsets.scu_ctrl_3, scu_ctrl_3.raw());
+  fake_device->SetPowerState(0x2);
+  config::registers::ScuCtrl2 scu_ctrl_2(0);
+  scu_ctrl_2.set_rg_gated_gcb(0x1);
+  fake_device->SetRegister(scu_offsets.scu_ctrl_2, scu_ctrl_2.raw());
+  fake_device->SetRegister(scu_offsets.scu_ctrl_0, 0xFFFFFFFF);
+
+  UsbMlCommands commands(std::move(device), /*default_timeout_msec=*/1000);
+  UsbRegisters registers;
+  CHECK_OK(registers.Open(&commands));
+  BeagleTopLevelHandler handler(config, &registers, /*use_usb=*/true,
+                                api::PerformanceExpectation_High);
+
+  // Polls finish after the power state transition, and read less often the
+  // longer they wait, so only their upper bound is fixed. The bounds hold for
+  // the default latencies.
+  auto check = [fake_device](const char* name, const Status& status,
+                             int expected_writes, int max_reads) {
+    CHECK_OK(status);
+    printf("%-28s %2d reads, %2d writes.\n", name, fake_device->reads,
+           fake_device->writes);
+    CHECK_EQ(fake_device->writes, expected_writes) << name;
+    CHECK_LE(fake_device->reads, max_reads) << name;
+    fake_device->ResetCounts();
+  };
+
+  // Same order as UsbDriver::DoOpen().
+  check("Open", handler.Open(), 1, 2);
+  check("DisableSoftwareClockGate", handler.DisableSoftwareClockGate(), 0, 0);
+  check("DisableHardwareClockGate", handler.DisableHardwareClockGate(), 1, 1);
+  check("EnableReset", handler.EnableReset(), 0, 1);
+  check("QuitReset", handler.QuitReset(), 4, 10);
+  check("EnableHardwareClockGate", handler.EnableHardwareClockGate(), 1, 1);
+
+  // Changing the performance level is one read-modify-write, and only the
+  // read when the clock rates are already set.
+  check("SetPerformanceExpectation",
+        handler.SetPerformanceExpectation(api::PerformanceExpectation_Max), 1,
+        1);
+  check("SetPerformanceExpectation",
+        handler.SetPerformanceExpectation(api::PerformanceExpectation_Max), 0,
+        1);
+
+  // Same order as UsbDriver::DoClose() followed by a reset.
+  check("DisableHardwareClockGate", handler.DisableHardwareClockGate(), 1, 1);
+  check("EnableReset", handler.EnableReset(), 3, 8);
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
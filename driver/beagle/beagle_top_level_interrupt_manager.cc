@@ -234,6 +234,7 @@ Status BeagleTopLevelInterruptManager::HandleThermalWarningInterrupt() {
   // threshold before re-enabling.
   if (helper.warn_o()) {
     VLOG(5) << "Thermal warning interrupt received";
+    ++num_thermal_warnings_;
     helper.set_warn_clear(1);  // Writes 1 to clear.
   }
   RETURN_IF_ERROR(registers_->Write32(apex_csr_offsets_.omc0_dc, helper.raw()));
@@ -15,6 +15,7 @@
 #ifndef DARWINN_DRIVER_BEAGLE_BEAGLE_TOP_LEVEL_INTERRUPT_MANAGER_H_
 #define DARWINN_DRIVER_BEAGLE_BEAGLE_TOP_LEVEL_INTERRUPT_MANAGER_H_
 
+#include <atomic>
 #include <memory>
 
 #include "driver/config/apex_csr_offsets.h"
@@ -23,6 +24,7 @@
 #include "driver/interrupt/interrupt_controller_interface.h"
 #include "driver/interrupt/top_level_interrupt_manager.h"
 #include "driver/registers/registers.h"
+#include "port/integral_types.h"
 #include "port/status.h"
 
 namespace platforms {
@@ -37,6 +39,11 @@ class BeagleTopLevelInterruptManager : public TopLevelInterruptManager {
       const config::ChipConfig& config, Registers* registers);
   ~BeagleTopLevelInterruptManager() override = default;
 
+  // Returns the number of thermal warnings handled so far. Handling clears
+  // the warning in hardware, so this lets others notice warnings in between
+  // reads of the thermal CSRs.
+  int64 num_thermal_warnings() const { return num_thermal_warnings_; }
+
  protected:
   // Implements interfaces.
   Status DoEnableInterrupts() override;
@@ -70,6 +77,9 @@ class BeagleTopLevelInterruptManager : public TopLevelInterruptManager {
 
   // CSR interface.
   Registers* const registers_;
+
+  // Number of thermal warnings handled.
+  std::atomic<int64> num_thermal_warnings_{0};
 };
 
 }  // namespace driver
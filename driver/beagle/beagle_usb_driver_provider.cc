@@ -15,6 +15,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -28,6 +29,7 @@
 #include "api/driver.h"
 #include "api/driver_options_generated.h"
 #include "driver/aligned_allocator.h"
+#include "driver/beagle/beagle_csr_thermal_sensor.h"
 #include "driver/beagle/beagle_top_level_handler.h"
 #include "driver/beagle/beagle_top_level_interrupt_manager.h"
 #include "driver/config/beagle/beagle_chip_config.h"
@@ -45,7 +47,7 @@
 #include "driver/usb/usb_driver.h"
 #include "driver/usb/usb_ml_commands.h"
 #include "driver/usb/usb_registers.h"
-#include "driver_shared/time_stamper/driver_time_stamper.h"
+#include "driver_shared/time_stamper/driver_time_stamper_factory.h"
 #include "port/gflags.h"
 #include "port/ptr_util.h"
 #include "port/tracing.h"
@@ -124,6 +126,11 @@ ABSL_FLAG(int, usb_max_num_async_transfers,
           GetEnv("USB_MAX_NUM_ASYNC_TRANSFERS",
                  kDefaultUsbMaxNumAsyncTransfers),
           "USB max number of pending async bulk out transfer");
+ABSL_FLAG(int, usb_max_num_async_transfers_per_endpoint,
+          GetEnv("USB_MAX_NUM_ASYNC_TRANSFERS_PER_ENDPOINT", 0),
+          "USB max number of pending async bulk out transfer on each bulk out "
+          "endpoint, when used in mode 0. 0 shares "
+          "usb_max_num_async_transfers among all endpoints");
 ABSL_FLAG(
     bool, usb_force_largest_bulk_in_chunk_size,
     GetEnv("USB_FORCE_LARGEST_BULK_IN_CHUNK_SIZE", false),
@@ -148,6 +155,14 @@ ABSL_FLAG(int, usb_bulk_in_queue_capacity,
           GetEnv("USB_BULK_IN_QUEUE_CAPACITY", 32),
           "Max number of USB bulk-in requests that can be queued. This "
           "option is only effective when it is positive.");
+ABSL_FLAG(int, usb_bulk_in_max_transfer_size,
+          GetEnv("USB_BULK_IN_MAX_TRANSFER_SIZE", 64 * 1024),
+          "Max size of a queued USB bulk-in transfer in bytes. Transfers are "
+          "sized from expected output sizes up to this limit.");
+ABSL_FLAG(int, usb_pinned_buffer_pool_capacity,
+          GetEnv("USB_PINNED_BUFFER_POOL_CAPACITY", 0),
+          "Max amount of zero-copy USB transfer memory in bytes handed out "
+          "for host buffers. 0 disables zero-copy buffers.");
 
 namespace platforms {
 namespace darwinn {
@@ -179,6 +194,17 @@ std::vector<uint8_t> ReadToVector(const std::string& file_name) {
   result.insert(result.end(), data, data + content_string.size());
   return result;
 }
+
+// Watches Beagle devices attached to USB.
+class UsbDeviceWatcher : public DeviceWatcher {
+ public:
+  explicit UsbDeviceWatcher(std::unique_ptr<LocalUsbHotplugMonitor> monitor)
+      : monitor_(std::move(monitor)) {}
+  ~UsbDeviceWatcher() override = default;
+
+ private:
+  const std::unique_ptr<LocalUsbHotplugMonitor> monitor_;
+};
 }  // namespace
 
 class BeagleUsbDriverProvider : public DriverProvider {
@@ -190,6 +216,8 @@ class BeagleUsbDriverProvider : public DriverProvider {
   ~BeagleUsbDriverProvider() override = default;
 
   std::vector<Device> Enumerate() override;
+  std::unique_ptr<DeviceWatcher> WatchDevices(
+      std::function<void()> on_change) override;
   bool CanCreate(const Device& device) override;
   StatusOr<std::unique_ptr<api::Driver>> CreateDriver(
       const Device& device, const api::DriverOptions& options) override;
@@ -229,6 +257,22 @@ std::vector<Device> BeagleUsbDriverProvider::Enumerate() {
   return device_list;
 }
 
+std::unique_ptr<DeviceWatcher> BeagleUsbDriverProvider::WatchDevices(
+    std::function<void()> on_change) {
+  // Devices switch from DFU to application mode after firmware download, so
+  // both IDs are watched.
+  auto monitor_or_error = LocalUsbHotplugMonitor::Create(
+      {{kTargetDfuVendorId, kTargetDfuProductId},
+       {kTargetAppVendorId, kTargetAppProductId}},
+      std::move(on_change));
+  if (!monitor_or_error.ok()) {
+    VLOG(1) << "Not watching USB devices: " << monitor_or_error.status();
+    return nullptr;
+  }
+  return gtl::MakeUnique<UsbDeviceWatcher>(
+      std::move(monitor_or_error).ValueOrDie());
+}
+
 bool BeagleUsbDriverProvider::CanCreate(const Device& device) {
   return device.type == Device::Type::USB && device.chip == Chip::kBeagle;
 }
@@ -252,6 +296,8 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
       absl::GetFlag(FLAGS_usb_enable_processing_of_hints);
   options.usb_max_num_async_transfers =
       absl::GetFlag(FLAGS_usb_max_num_async_transfers);
+  options.usb_max_num_async_transfers_per_endpoint =
+      absl::GetFlag(FLAGS_usb_max_num_async_transfers_per_endpoint);
   options.mode = static_cast<UsbDriver::OperatingMode>(
       absl::GetFlag(FLAGS_usb_operating_mode));
   options.max_bulk_out_transfer_size_in_bytes =
@@ -268,6 +314,10 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
       absl::GetFlag(FLAGS_usb_enable_queued_bulk_in_requests);
   options.usb_bulk_in_queue_capacity =
       absl::GetFlag(FLAGS_usb_bulk_in_queue_capacity);
+  options.usb_bulk_in_max_transfer_size_in_bytes =
+      absl::GetFlag(FLAGS_usb_bulk_in_max_transfer_size);
+  options.usb_pinned_buffer_pool_capacity_in_bytes =
+      absl::GetFlag(FLAGS_usb_pinned_buffer_pool_capacity);
 
   auto usb_registers = gtl::MakeUnique<UsbRegisters>();
   std::vector<std::unique_ptr<InterruptControllerInterface>>
@@ -293,6 +343,9 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
           std::move(top_level_interrupt_controller), *config,
           usb_registers.get());
 
+  auto thermal_sensor = gtl::MakeUnique<BeagleCsrThermalSensor>(
+      *config, usb_registers.get(), top_level_interrupt_manager.get());
+
   auto fatal_error_interrupt_controller = gtl::MakeUnique<InterruptController>(
       config->GetUsbFatalErrorInterruptCsrOffsets(), usb_registers.get());
 
@@ -339,6 +392,16 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
       options.usb_bulk_in_queue_capacity =
           usb_options->bulk_in_queue_capacity();
     }
+
+    if (usb_options->has_bulk_in_max_transfer_size()) {
+      options.usb_bulk_in_max_transfer_size_in_bytes =
+          usb_options->bulk_in_max_transfer_size();
+    }
+
+    if (usb_options->has_pinned_buffer_pool_capacity()) {
+      options.usb_pinned_buffer_pool_capacity_in_bytes =
+          usb_options->pinned_buffer_pool_capacity();
+    }
   }
 
   auto dram_allocator = gtl::MakeUnique<NullDramAllocator>();
@@ -349,15 +412,20 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
   auto executable_registry = gtl::MakeUnique<PackageRegistry>(
       device.chip, std::move(verifier), dram_allocator.get());
 
-  auto time_stamper = gtl::MakeUnique<driver_shared::DriverTimeStamper>();
+  auto time_stamper =
+      driver_shared::DriverTimeStamperFactory().CreateTimeStamper();
 
   // Note that although driver_options is passed into constructor of UsbDriver,
   // it's USB portion is not used by the driver directly, due to historical
   // reasons.
-  return {gtl::MakeUnique<UsbDriver>(
+  // Zero-copy transfer memory is only allocated for the pinned buffer pool.
+  const bool use_zero_copy =
+      options.usb_pinned_buffer_pool_capacity_in_bytes > 0;
+
+  auto driver = gtl::MakeUnique<UsbDriver>(
       driver_options, std::move(config),
-      [path] {
-        LocalUsbDeviceFactory usb_device_factory;
+      [path, use_zero_copy] {
+        LocalUsbDeviceFactory usb_device_factory(use_zero_copy);
 
         return usb_device_factory.OpenDevice(
             path, absl::GetFlag(FLAGS_usb_timeout_millis));
@@ -365,7 +433,10 @@ StatusOr<std::unique_ptr<api::Driver>> BeagleUsbDriverProvider::CreateDriver(
       std::move(usb_registers), std::move(top_level_interrupt_manager),
       std::move(fatal_error_interrupt_controller), std::move(top_level_handler),
       std::move(dram_allocator), std::move(executable_registry), options,
-      std::move(time_stamper))};
+      std::move(time_stamper));
+  driver->SetThermalSensor(std::move(thermal_sensor));
+
+  return {std::move(driver)};
 }
 
 }  // namespace driver
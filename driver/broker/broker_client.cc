@@ -0,0 +1,267 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/broker/broker_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "driver/broker/broker_protocol_generated.h"
+#include "driver/broker/broker_socket.h"
+#include "port/cleanup.h"
+#include "port/errors.h"
+#include "port/logging.h"
+#include "port/ptr_util.h"
+#include "port/status_macros.h"
+#include "port/std_mutex_lock.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+namespace {
+
+// Adds seals to a shared memory file.
+Status SealSharedMemory(int fd, int seals) {
+  if (fcntl(fd, F_ADD_SEALS, seals) != 0) {
+    return InternalError(StringPrintf("Failed to seal shared memory: %s",
+                                      strerror(errno)));
+  }
+  return OkStatus();
+}
+
+// Creates an anonymous shared memory file of the given size. Its size is
+// sealed, as the broker refuses files that could shrink under its mapping.
+StatusOr<int> CreateSharedMemory(const char* name, size_t size_bytes) {
+  int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return ResourceExhaustedError(
+        StringPrintf("memfd_create failed: %s", strerror(errno)));
+  }
+  if (ftruncate(fd, size_bytes) != 0) {
+    const std::string error = strerror(errno);
+    close(fd);
+    return ResourceExhaustedError(
+        StringPrintf("ftruncate failed: %s", error.c_str()));
+  }
+  Status status = SealSharedMemory(fd, F_SEAL_SHRINK | F_SEAL_GROW);
+  if (!status.ok()) {
+    close(fd);
+    return status;
+  }
+  return fd;
+}
+
+// Maps a shared memory file for reading and writing.
+StatusOr<unsigned char*> MapSharedMemory(int fd, size_t size_bytes) {
+  void* ptr =
+      mmap(nullptr, size_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    return ResourceExhaustedError(
+        StringPrintf("mmap failed: %s", strerror(errno)));
+  }
+  return static_cast<unsigned char*>(ptr);
+}
+
+// Creates a vector of buffer slices for an execute request.
+flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<BufferSlice>>>
+CreateSlices(flatbuffers::FlatBufferBuilder* builder,
+             const std::vector<BrokerClient::BufferSlice>& slices) {
+  std::vector<flatbuffers::Offset<BufferSlice>> offsets;
+  offsets.reserve(slices.size());
+  for (const auto& slice : slices) {
+    offsets.push_back(CreateBufferSlice(
+        *builder, builder->CreateString(slice.layer_name), slice.buffer_id,
+        slice.offset, slice.size_bytes));
+  }
+  return builder->CreateVector(offsets);
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<BrokerClient>> BrokerClient::Connect(
+    const std::string& socket_path) {
+  struct sockaddr_un address;
+  RETURN_IF_ERROR(MakeSocketAddress(socket_path, &address));
+
+  int socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (socket_fd < 0) {
+    return UnavailableError(
+        StringPrintf("Failed to create socket: %s", strerror(errno)));
+  }
+  if (connect(socket_fd, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0) {
+    const std::string error = strerror(errno);
+    close(socket_fd);
+    return UnavailableError(StringPrintf("Failed to connect to [%s]: %s",
+                                         socket_path.c_str(), error.c_str()));
+  }
+
+  return std::unique_ptr<BrokerClient>(new BrokerClient(socket_fd));
+}
+
+BrokerClient::BrokerClient(int socket_fd) : socket_fd_(socket_fd) {}
+
+BrokerClient::~BrokerClient() {
+  StdMutexLock lock(&mutex_);
+  close(socket_fd_);
+  for (const auto& buffer : buffers_) {
+    munmap(buffer.second.ptr, buffer.second.size_bytes);
+  }
+}
+
+StatusOr<uint64> BrokerClient::Call(
+    const flatbuffers::FlatBufferBuilder& builder, int fd) {
+  RETURN_IF_ERROR(SendMessage(socket_fd_, builder.GetBufferPointer(),
+                              builder.GetSize(), fd));
+
+  int received_fd = -1;
+  ASSIGN_OR_RETURN(auto data, ReceiveMessage(socket_fd_, &received_fd));
+  if (received_fd >= 0) {
+    close(received_fd);
+  }
+
+  flatbuffers::Verifier verifier(data.data(), data.size());
+  if (!verifier.VerifyBuffer<ResponseMessage>(nullptr)) {
+    return DataLossError("Malformed response from broker");
+  }
+  const auto* response = flatbuffers::GetRoot<ResponseMessage>(data.data());
+  RETURN_IF_ERROR(MakeStatus(response->status_code(),
+                             response->status_message() != nullptr
+                                 ? response->status_message()->str()
+                                 : std::string()));
+  return response->id();
+}
+
+StatusOr<uint64> BrokerClient::OpenDevice(const api::Device& device,
+                                          const api::Driver::Options& options) {
+  flatbuffers::FlatBufferBuilder builder;
+  auto device_path = builder.CreateString(device.path);
+  auto driver_options = builder.CreateVector(options);
+  auto request = CreateOpenDeviceRequest(
+      builder, static_cast<int>(device.chip), static_cast<int>(device.type),
+      device_path, driver_options);
+  builder.Finish(CreateRequestMessage(builder, Request_OpenDeviceRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  return Call(builder, /*fd=*/-1);
+}
+
+StatusOr<uint64> BrokerClient::RegisterModel(
+    uint64 device_id, const std::string& executable_content) {
+  if (executable_content.empty()) {
+    return InvalidArgumentError("Executable content is empty");
+  }
+
+  ASSIGN_OR_RETURN(int fd, CreateSharedMemory("darwinn_model",
+                                              executable_content.size()));
+  auto fd_closer = MakeCleanup([fd] { close(fd); });
+
+  ASSIGN_OR_RETURN(unsigned char* ptr,
+                   MapSharedMemory(fd, executable_content.size()));
+  memcpy(ptr, executable_content.data(), executable_content.size());
+  munmap(ptr, executable_content.size());
+
+  // The broker keeps mapping the package while registered.
+  RETURN_IF_ERROR(SealSharedMemory(fd, F_SEAL_WRITE | F_SEAL_SEAL));
+
+  flatbuffers::FlatBufferBuilder builder;
+  auto request =
+      CreateRegisterModelRequest(builder, device_id, executable_content.size());
+  builder.Finish(CreateRequestMessage(builder, Request_RegisterModelRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  return Call(builder, fd);
+}
+
+Status BrokerClient::UnregisterModel(uint64 model_id) {
+  flatbuffers::FlatBufferBuilder builder;
+  auto request = CreateUnregisterModelRequest(builder, model_id);
+  builder.Finish(CreateRequestMessage(builder, Request_UnregisterModelRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  return Call(builder, /*fd=*/-1).status();
+}
+
+StatusOr<BrokerClient::SharedBuffer> BrokerClient::MakeSharedBuffer(
+    size_t size_bytes) {
+  if (size_bytes == 0) {
+    return InvalidArgumentError("Shared buffer size must be positive");
+  }
+
+  ASSIGN_OR_RETURN(int fd, CreateSharedMemory("darwinn_buffer", size_bytes));
+  auto fd_closer = MakeCleanup([fd] { close(fd); });
+
+  RETURN_IF_ERROR(SealSharedMemory(fd, F_SEAL_SEAL));
+
+  ASSIGN_OR_RETURN(unsigned char* ptr, MapSharedMemory(fd, size_bytes));
+  auto unmapper = MakeCleanup([ptr, size_bytes] { munmap(ptr, size_bytes); });
+
+  flatbuffers::FlatBufferBuilder builder;
+  auto request = CreateRegisterBufferRequest(builder, size_bytes);
+  builder.Finish(CreateRequestMessage(builder, Request_RegisterBufferRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  ASSIGN_OR_RETURN(uint64 buffer_id, Call(builder, fd));
+  unmapper.release();
+  buffers_[buffer_id] = {ptr, size_bytes};
+  return SharedBuffer{buffer_id, Buffer(ptr, size_bytes)};
+}
+
+Status BrokerClient::ReleaseSharedBuffer(uint64 buffer_id) {
+  flatbuffers::FlatBufferBuilder builder;
+  auto request = CreateUnregisterBufferRequest(builder, buffer_id);
+  builder.Finish(CreateRequestMessage(builder, Request_UnregisterBufferRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  auto buffer = buffers_.find(buffer_id);
+  if (buffer == buffers_.end()) {
+    return NotFoundError(StringPrintf(
+        "Unknown buffer %llu", static_cast<unsigned long long>(buffer_id)));
+  }
+  munmap(buffer->second.ptr, buffer->second.size_bytes);
+  buffers_.erase(buffer);
+  return Call(builder, /*fd=*/-1).status();
+}
+
+Status BrokerClient::Execute(uint64 model_id,
+                             const std::vector<BufferSlice>& inputs,
+                             const std::vector<BufferSlice>& outputs) {
+  flatbuffers::FlatBufferBuilder builder;
+  auto input_slices = CreateSlices(&builder, inputs);
+  auto output_slices = CreateSlices(&builder, outputs);
+  auto request =
+      CreateExecuteRequest(builder, model_id, input_slices, output_slices);
+  builder.Finish(CreateRequestMessage(builder, Request_ExecuteRequest,
+                                      request.Union()));
+
+  StdMutexLock lock(&mutex_);
+  return Call(builder, /*fd=*/-1).status();
+}
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,129 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_BROKER_BROKER_CLIENT_H_
+#define DARWINN_DRIVER_BROKER_BROKER_CLIENT_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "api/buffer.h"
+#include "api/chip.h"
+#include "api/driver.h"
+#include "api/driver_factory.h"
+#include "flatbuffers/flatbuffers.h"
+#include "port/integral_types.h"
+#include "port/status.h"
+#include "port/statusor.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+
+// Client of a BrokerServer. Devices, models and buffers are referred to by
+// identifiers handed out by the broker. Requests are processed one at a time
+// per client; use multiple clients to keep multiple requests in flight.
+// Thread-safe.
+class BrokerClient {
+ public:
+  // A buffer in memory shared with the broker.
+  struct SharedBuffer {
+    uint64 id;
+    Buffer buffer;
+  };
+
+  // A range of a shared buffer, bound to an input or output layer.
+  struct BufferSlice {
+    std::string layer_name;
+    uint64 buffer_id;
+    size_t offset;
+    size_t size_bytes;
+  };
+
+  // Connects to the broker listening on the given socket.
+  static StatusOr<std::unique_ptr<BrokerClient>> Connect(
+      const std::string& socket_path);
+
+  // Disconnects. The broker releases all models and buffers registered by this
+  // client.
+  ~BrokerClient();
+
+  // This class is neither copyable nor movable.
+  BrokerClient(const BrokerClient&) = delete;
+  BrokerClient& operator=(const BrokerClient&) = delete;
+
+  // Opens a device through the broker, or returns the one already opened by
+  // any client. Options are only used if the broker has to create the driver.
+  StatusOr<uint64> OpenDevice(const api::Device& device,
+                              const api::Driver::Options& options)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Registers a serialized model on the given device.
+  StatusOr<uint64> RegisterModel(uint64 device_id,
+                                 const std::string& executable_content)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Releases a model registered by this client.
+  Status UnregisterModel(uint64 model_id) LOCKS_EXCLUDED(mutex_);
+
+  // Allocates a buffer shared with the broker. The memory stays valid until
+  // ReleaseSharedBuffer is called or this client is destroyed.
+  StatusOr<SharedBuffer> MakeSharedBuffer(size_t size_bytes)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Releases a buffer allocated by MakeSharedBuffer.
+  Status ReleaseSharedBuffer(uint64 buffer_id) LOCKS_EXCLUDED(mutex_);
+
+  // Runs the model on the given shared buffer slices, and waits for it to
+  // complete. Multiple slices for the same layer are consecutive batches.
+  Status Execute(uint64 model_id, const std::vector<BufferSlice>& inputs,
+                 const std::vector<BufferSlice>& outputs)
+      LOCKS_EXCLUDED(mutex_);
+
+ private:
+  // A mapped shared buffer.
+  struct Mapping {
+    unsigned char* ptr;
+    size_t size_bytes;
+  };
+
+  explicit BrokerClient(int socket_fd);
+
+  // Sends a finished request, along with fd if not negative, and waits for the
+  // response. Returns the identifier in the response.
+  StatusOr<uint64> Call(const flatbuffers::FlatBufferBuilder& builder, int fd)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Serializes requests on the connection.
+  std::mutex mutex_;
+
+  // Connection to the broker.
+  const int socket_fd_;
+
+  // Shared buffers, keyed by identifier.
+  std::map<uint64, Mapping> buffers_ GUARDED_BY(mutex_);
+};
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_BROKER_BROKER_CLIENT_H_
@@ -0,0 +1,51 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs a DarwiNN broker, sharing local devices among client processes.
+
+#include <signal.h>
+
+#include <string>
+
+#include "driver/broker/broker_server.h"
+#include "port/gflags.h"
+#include "port/logging.h"
+
+ABSL_FLAG(std::string, socket_path, "/tmp/edgetpu_broker",
+          "Path of the Unix socket clients connect to.");
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+
+  // Block termination signals in all threads; they are handled below.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  platforms::darwinn::driver::broker::BrokerServer server(
+      absl::GetFlag(FLAGS_socket_path));
+  auto status = server.Start();
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to start broker: " << status;
+    return 1;
+  }
+
+  int signal_number = 0;
+  sigwait(&signals, &signal_number);
+  VLOG(1) << "Stopping broker on signal " << signal_number;
+  server.Stop();
+  return 0;
+}
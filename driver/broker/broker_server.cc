@@ -0,0 +1,613 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/broker/broker_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <functional>
+#include <utility>
+
+#include "absl/hash/hash.h"
+#include "absl/strings/string_view.h"
+#include "api/buffer.h"
+#include "api/chip.h"
+#include "api/driver_factory.h"
+#include "api/request.h"
+#include "driver/broker/broker_socket.h"
+#include "flatbuffers/flatbuffers.h"
+#include "port/cleanup.h"
+#include "port/errors.h"
+#include "port/logging.h"
+#include "port/status_macros.h"
+#include "port/std_mutex_lock.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+namespace {
+
+// Max number of pending connections on the listening socket.
+constexpr int kListenBacklog = 16;
+
+// Seals required on all shared memory files. A file the client could still
+// shrink would fault the broker when accessed past its new end.
+constexpr int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+// Maps size_bytes of the given shared memory file, after making sure it is
+// large enough and sealed with at least required_seals.
+StatusOr<unsigned char*> MapSharedMemory(int fd, size_t size_bytes, int prot,
+                                         int required_seals) {
+  if (fd < 0) {
+    return InvalidArgumentError("Shared memory file descriptor is missing");
+  }
+  if (size_bytes == 0) {
+    return InvalidArgumentError("Shared memory size must be positive");
+  }
+
+  const int seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0) {
+    return InvalidArgumentError(
+        StringPrintf("Shared memory is not sealable: %s", strerror(errno)));
+  }
+  if ((seals & required_seals) != required_seals) {
+    return InvalidArgumentError(StringPrintf(
+        "Shared memory is sealed with 0x%x, 0x%x required", seals,
+        required_seals));
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    return InvalidArgumentError(
+        StringPrintf("fstat failed: %s", strerror(errno)));
+  }
+  if (static_cast<size_t>(file_stat.st_size) < size_bytes) {
+    return InvalidArgumentError(StringPrintf(
+        "Shared memory holds %lld bytes, %zu expected",
+        static_cast<long long>(file_stat.st_size), size_bytes));
+  }
+
+  void* ptr = mmap(nullptr, size_bytes, prot, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    return ResourceExhaustedError(
+        StringPrintf("mmap failed: %s", strerror(errno)));
+  }
+  return static_cast<unsigned char*>(ptr);
+}
+
+}  // namespace
+
+BrokerServer::BrokerServer(const std::string& socket_path)
+    : socket_path_(socket_path) {}
+
+BrokerServer::~BrokerServer() { Stop(); }
+
+Status BrokerServer::Start() {
+  if (listen_fd_ >= 0) {
+    return FailedPreconditionError("Broker already started");
+  }
+
+  struct sockaddr_un address;
+  RETURN_IF_ERROR(MakeSocketAddress(socket_path_, &address));
+
+  listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return UnavailableError(
+        StringPrintf("Failed to create socket: %s", strerror(errno)));
+  }
+
+  // A stale socket file is left behind if a previous broker crashed. Only
+  // remove it if nobody is listening on it anymore.
+  int probe_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (probe_fd >= 0) {
+    const bool is_live =
+        connect(probe_fd, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) == 0;
+    const int connect_errno = errno;
+    close(probe_fd);
+    if (is_live) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+      return AlreadyExistsError(StringPrintf(
+          "Another broker is listening on [%s]", socket_path_.c_str()));
+    }
+    if (connect_errno == ECONNREFUSED) {
+      unlink(socket_path_.c_str());
+    }
+  }
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, kListenBacklog) != 0) {
+    const std::string error = strerror(errno);
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return UnavailableError(StringPrintf("Failed to listen on [%s]: %s",
+                                         socket_path_.c_str(), error.c_str()));
+  }
+
+  stopping_ = false;
+  accept_thread_ = std::thread([this] { AcceptLoop(); });
+  VLOG(1) << StringPrintf("Broker listening on [%s]", socket_path_.c_str());
+  return OkStatus();
+}
+
+void BrokerServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+
+  // Wake up accept() and stop taking new clients.
+  stopping_ = true;
+  shutdown(listen_fd_, SHUT_RDWR);
+  if (accept_thread_.joinable()) {
+    accept_thread_.join();
+  }
+  close(listen_fd_);
+  listen_fd_ = -1;
+  unlink(socket_path_.c_str());
+
+  // Disconnect all clients, and wait for their sessions to clean up.
+  std::vector<std::thread> threads;
+  {
+    StdMutexLock lock(&mutex_);
+    for (auto& session_thread : session_threads_) {
+      shutdown(session_thread.first, SHUT_RDWR);
+      threads.push_back(std::move(session_thread.second));
+    }
+    session_threads_.clear();
+    for (auto& finished : finished_session_threads_) {
+      threads.push_back(std::move(finished));
+    }
+    finished_session_threads_.clear();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  StdMutexLock lock(&mutex_);
+  for (auto& model : models_) {
+    auto* driver = devices_[model.second.device_id].driver.get();
+    Status status = driver->UnregisterExecutable(model.second.package_ref);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to unregister model: " << status;
+    }
+    munmap(model.second.content.ptr, model.second.content.size_bytes);
+  }
+  models_.clear();
+  model_ids_by_hash_.clear();
+
+  for (auto& device : devices_) {
+    Status status =
+        device.second.driver->Close(api::Driver::ClosingMode::kGraceful);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to close device: " << status;
+    }
+  }
+  devices_.clear();
+  device_ids_.clear();
+}
+
+void BrokerServer::AcceptLoop() {
+  while (!stopping_) {
+    int socket_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (socket_fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (!stopping_) {
+        LOG(ERROR) << StringPrintf("accept failed: %s", strerror(errno));
+      }
+      return;
+    }
+
+    std::vector<std::thread> finished_threads;
+    {
+      StdMutexLock lock(&mutex_);
+      finished_threads.swap(finished_session_threads_);
+      session_threads_[socket_fd] =
+          std::thread([this, socket_fd] { ServeSession(socket_fd); });
+    }
+    for (auto& thread : finished_threads) {
+      thread.join();
+    }
+  }
+}
+
+void BrokerServer::ServeSession(int socket_fd) {
+  VLOG(2) << StringPrintf("Client connected on socket %d", socket_fd);
+  Session session;
+  session.socket_fd = socket_fd;
+
+  while (!stopping_) {
+    int received_fd = -1;
+    auto data_or_error = ReceiveMessage(socket_fd, &received_fd);
+    if (!data_or_error.ok()) {
+      VLOG(2) << StringPrintf("Client on socket %d disconnected: ", socket_fd)
+              << data_or_error.status();
+      break;
+    }
+    const auto& data = data_or_error.ValueOrDie();
+
+    uint64 id = 0;
+    Status status;
+    flatbuffers::Verifier verifier(data.data(), data.size());
+    if (!VerifyRequestMessageBuffer(verifier)) {
+      status = InvalidArgumentError("Malformed request");
+    } else {
+      status = HandleRequest(&session, *GetRequestMessage(data.data()),
+                             received_fd, &id);
+    }
+
+    // Mappings and registrations do not need the descriptor to stay open.
+    if (received_fd >= 0) {
+      close(received_fd);
+    }
+
+    flatbuffers::FlatBufferBuilder builder;
+    auto status_message = builder.CreateString(status.error_message());
+    builder.Finish(CreateResponseMessage(builder, GetStatusCode(status),
+                                         status_message, id));
+    Status send_status = SendMessage(socket_fd, builder.GetBufferPointer(),
+                                     builder.GetSize(), /*fd_to_send=*/-1);
+    if (!send_status.ok()) {
+      VLOG(2) << send_status;
+      break;
+    }
+  }
+
+  CloseSession(&session);
+
+  // Hand this thread over to be joined, before the socket number can be
+  // reused by a new connection.
+  {
+    StdMutexLock lock(&mutex_);
+    auto session_thread = session_threads_.find(socket_fd);
+    if (session_thread != session_threads_.end()) {
+      finished_session_threads_.push_back(std::move(session_thread->second));
+      session_threads_.erase(session_thread);
+    }
+  }
+  close(socket_fd);
+}
+
+void BrokerServer::CloseSession(Session* session) {
+  for (const auto& buffer : session->buffers) {
+    munmap(buffer.second.ptr, buffer.second.size_bytes);
+  }
+  session->buffers.clear();
+
+  StdMutexLock lock(&mutex_);
+  for (const auto& model : session->models) {
+    for (int i = 0; i < model.second; ++i) {
+      Status status = ReleaseModel(model.first);
+      if (!status.ok()) {
+        LOG(WARNING) << "Failed to release model: " << status;
+      }
+    }
+  }
+  session->models.clear();
+}
+
+Status BrokerServer::HandleRequest(Session* session,
+                                   const RequestMessage& message,
+                                   int received_fd, uint64* id) {
+  switch (message.request_type()) {
+    case Request_OpenDeviceRequest: {
+      ASSIGN_OR_RETURN(*id,
+                       OpenDevice(*message.request_as_OpenDeviceRequest()));
+      return OkStatus();
+    }
+
+    case Request_RegisterModelRequest: {
+      ASSIGN_OR_RETURN(
+          *id, RegisterModel(session, *message.request_as_RegisterModelRequest(),
+                             received_fd));
+      return OkStatus();
+    }
+
+    case Request_UnregisterModelRequest:
+      return UnregisterModel(
+          session, message.request_as_UnregisterModelRequest()->model_id());
+
+    case Request_RegisterBufferRequest: {
+      ASSIGN_OR_RETURN(
+          *id, RegisterBuffer(session,
+                              *message.request_as_RegisterBufferRequest(),
+                              received_fd));
+      return OkStatus();
+    }
+
+    case Request_UnregisterBufferRequest:
+      return UnregisterBuffer(
+          session, message.request_as_UnregisterBufferRequest()->buffer_id());
+
+    case Request_ExecuteRequest:
+      return Execute(session, *message.request_as_ExecuteRequest());
+
+    default:
+      return UnimplementedError(StringPrintf(
+          "Unknown request type %d", static_cast<int>(message.request_type())));
+  }
+}
+
+StatusOr<uint64> BrokerServer::OpenDevice(const OpenDeviceRequest& request) {
+  const std::string device_path =
+      request.device_path() != nullptr
+          ? request.device_path()->str()
+          : std::string(api::DriverFactory::kDefaultDevicePath);
+  const std::string key = StringPrintf(
+      "%d:%d:%s", request.chip(), request.device_type(), device_path.c_str());
+
+  // Opening a device may take a while, for example when firmware has to be
+  // loaded. Hold the lock all along anyway, so concurrent clients asking for
+  // the same device end up sharing it.
+  StdMutexLock lock(&mutex_);
+  auto existing = device_ids_.find(key);
+  if (existing != device_ids_.end()) {
+    return existing->second;
+  }
+
+  auto* factory = api::DriverFactory::GetOrCreate();
+  if (factory == nullptr) {
+    return UnavailableError("Failed to create driver factory");
+  }
+
+  api::Device device;
+  device.chip = static_cast<api::Chip>(request.chip());
+  device.type = static_cast<api::Device::Type>(request.device_type());
+  device.path = device_path;
+
+  std::unique_ptr<api::Driver> driver;
+  if (request.driver_options() != nullptr &&
+      request.driver_options()->size() > 0) {
+    api::Driver::Options options(request.driver_options()->begin(),
+                                 request.driver_options()->end());
+    ASSIGN_OR_RETURN(driver, factory->CreateDriver(device, options));
+  } else {
+    ASSIGN_OR_RETURN(driver, factory->CreateDriver(device));
+  }
+  RETURN_IF_ERROR(driver->Open());
+
+  const uint64 device_id = next_id_++;
+  devices_[device_id].driver = std::move(driver);
+  device_ids_[key] = device_id;
+  VLOG(1) << StringPrintf("Opened device [%s] as %llu", key.c_str(),
+                          static_cast<unsigned long long>(device_id));
+  return device_id;
+}
+
+StatusOr<uint64> BrokerServer::RegisterModel(
+    Session* session, const RegisterModelRequest& request, int model_fd) {
+  // The mapping is kept for as long as the model is registered, so its
+  // content must not change either.
+  ASSIGN_OR_RETURN(unsigned char* ptr,
+                   MapSharedMemory(model_fd, request.size_bytes(), PROT_READ,
+                                   kRequiredSeals | F_SEAL_WRITE));
+  const Mapping content{ptr, request.size_bytes()};
+  auto unmapper = MakeCleanup([content] {
+    munmap(content.ptr, content.size_bytes);
+  });
+
+  const size_t hash = HashContent(content);
+  const uint64 device_id = request.device_id();
+
+  api::Driver* driver = nullptr;
+  {
+    StdMutexLock lock(&mutex_);
+    auto device = devices_.find(device_id);
+    if (device == devices_.end()) {
+      return NotFoundError(StringPrintf(
+          "Unknown device %llu", static_cast<unsigned long long>(device_id)));
+    }
+    driver = device->second.driver.get();
+
+    const uint64 model_id = FindRegisteredModel(device_id, hash, content);
+    if (model_id != 0) {
+      ++models_[model_id].num_registrations;
+      ++session->models[model_id];
+      VLOG(2) << StringPrintf("Reusing registration of model %llu",
+                              static_cast<unsigned long long>(model_id));
+      return model_id;
+    }
+  }
+
+  // Register without holding the lock, as it may take a while.
+  ASSIGN_OR_RETURN(const api::PackageReference* package_ref,
+                   driver->RegisterExecutableSerialized(
+                       reinterpret_cast<const char*>(content.ptr),
+                       content.size_bytes));
+
+  uint64 model_id;
+  {
+    StdMutexLock lock(&mutex_);
+    model_id = FindRegisteredModel(device_id, hash, content);
+    if (model_id != 0) {
+      // Another client registered the same model in the meantime.
+      ++models_[model_id].num_registrations;
+      ++session->models[model_id];
+    } else {
+      model_id = next_id_++;
+      Model& model = models_[model_id];
+      model.device_id = device_id;
+      model.package_ref = package_ref;
+      model.content = content;
+      model.num_registrations = 1;
+      unmapper.release();
+      model_ids_by_hash_.insert({hash, model_id});
+      ++session->models[model_id];
+      return model_id;
+    }
+  }
+
+  RETURN_IF_ERROR(driver->UnregisterExecutable(package_ref));
+  return model_id;
+}
+
+size_t BrokerServer::HashContent(const Mapping& content) {
+  return absl::Hash<absl::string_view>()(absl::string_view(
+      reinterpret_cast<const char*>(content.ptr), content.size_bytes));
+}
+
+uint64 BrokerServer::FindRegisteredModel(uint64 device_id, size_t hash,
+                                         const Mapping& content) {
+  auto range = model_ids_by_hash_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const Model& model = models_[it->second];
+    if (model.device_id == device_id &&
+        model.content.size_bytes == content.size_bytes &&
+        memcmp(model.content.ptr, content.ptr, content.size_bytes) == 0) {
+      return it->second;
+    }
+  }
+  return 0;
+}
+
+Status BrokerServer::UnregisterModel(Session* session, uint64 model_id) {
+  auto session_model = session->models.find(model_id);
+  if (session_model == session->models.end()) {
+    return NotFoundError(StringPrintf(
+        "Unknown model %llu", static_cast<unsigned long long>(model_id)));
+  }
+  if (--session_model->second == 0) {
+    session->models.erase(session_model);
+  }
+
+  StdMutexLock lock(&mutex_);
+  return ReleaseModel(model_id);
+}
+
+Status BrokerServer::ReleaseModel(uint64 model_id) {
+  auto model = models_.find(model_id);
+  if (model == models_.end()) {
+    return NotFoundError(StringPrintf(
+        "Unknown model %llu", static_cast<unsigned long long>(model_id)));
+  }
+  if (--model->second.num_registrations > 0) {
+    return OkStatus();
+  }
+
+  auto range =
+      model_ids_by_hash_.equal_range(HashContent(model->second.content));
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == model_id) {
+      model_ids_by_hash_.erase(it);
+      break;
+    }
+  }
+
+  auto* driver = devices_[model->second.device_id].driver.get();
+  const api::PackageReference* package_ref = model->second.package_ref;
+  const Mapping content = model->second.content;
+  models_.erase(model);
+  Status status = driver->UnregisterExecutable(package_ref);
+  munmap(content.ptr, content.size_bytes);
+  return status;
+}
+
+StatusOr<uint64> BrokerServer::RegisterBuffer(
+    Session* session, const RegisterBufferRequest& request, int buffer_fd) {
+  ASSIGN_OR_RETURN(unsigned char* ptr,
+                   MapSharedMemory(buffer_fd, request.size_bytes(),
+                                   PROT_READ | PROT_WRITE, kRequiredSeals));
+
+  uint64 buffer_id;
+  {
+    StdMutexLock lock(&mutex_);
+    buffer_id = next_id_++;
+  }
+  session->buffers[buffer_id] = {ptr, request.size_bytes()};
+  return buffer_id;
+}
+
+Status BrokerServer::UnregisterBuffer(Session* session, uint64 buffer_id) {
+  auto buffer = session->buffers.find(buffer_id);
+  if (buffer == session->buffers.end()) {
+    return NotFoundError(StringPrintf(
+        "Unknown buffer %llu", static_cast<unsigned long long>(buffer_id)));
+  }
+  munmap(buffer->second.ptr, buffer->second.size_bytes);
+  session->buffers.erase(buffer);
+  return OkStatus();
+}
+
+Status BrokerServer::Execute(Session* session, const ExecuteRequest& request) {
+  if (session->models.find(request.model_id()) == session->models.end()) {
+    return NotFoundError(
+        StringPrintf("Unknown model %llu",
+                     static_cast<unsigned long long>(request.model_id())));
+  }
+
+  // The model and its device stay alive while this client holds a
+  // registration on it.
+  api::Driver* driver;
+  const api::PackageReference* package_ref;
+  {
+    StdMutexLock lock(&mutex_);
+    const Model& model = models_[request.model_id()];
+    driver = devices_[model.device_id].driver.get();
+    package_ref = model.package_ref;
+  }
+
+  // Returns a buffer over the given slice of a registered buffer.
+  auto make_buffer = [session](const BufferSlice& slice) -> StatusOr<Buffer> {
+    auto buffer = session->buffers.find(slice.buffer_id());
+    if (buffer == session->buffers.end()) {
+      return NotFoundError(
+          StringPrintf("Unknown buffer %llu",
+                       static_cast<unsigned long long>(slice.buffer_id())));
+    }
+    if (slice.offset() > buffer->second.size_bytes ||
+        slice.size_bytes() > buffer->second.size_bytes - slice.offset()) {
+      return OutOfRangeError("Slice exceeds registered buffer");
+    }
+    return Buffer(buffer->second.ptr + slice.offset(), slice.size_bytes());
+  };
+
+  ASSIGN_OR_RETURN(auto request_ref, driver->CreateRequest(package_ref));
+  if (request.inputs() != nullptr) {
+    for (const auto* slice : *request.inputs()) {
+      if (slice->layer_name() == nullptr) {
+        return InvalidArgumentError("Input layer name is missing");
+      }
+      ASSIGN_OR_RETURN(auto buffer, make_buffer(*slice));
+      RETURN_IF_ERROR(request_ref->AddInput(slice->layer_name()->str(), buffer));
+    }
+  }
+  if (request.outputs() != nullptr) {
+    for (const auto* slice : *request.outputs()) {
+      if (slice->layer_name() == nullptr) {
+        return InvalidArgumentError("Output layer name is missing");
+      }
+      ASSIGN_OR_RETURN(auto buffer, make_buffer(*slice));
+      RETURN_IF_ERROR(
+          request_ref->AddOutput(slice->layer_name()->str(), buffer));
+    }
+  }
+
+  return driver->Execute(std::move(request_ref));
+}
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
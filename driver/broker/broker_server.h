@@ -0,0 +1,184 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_BROKER_BROKER_SERVER_H_
+#define DARWINN_DRIVER_BROKER_BROKER_SERVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "api/driver.h"
+#include "api/package_reference.h"
+#include "driver/broker/broker_protocol_generated.h"
+#include "port/integral_types.h"
+#include "port/status.h"
+#include "port/statusor.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+
+// Local broker sharing DarwiNN devices among processes. The broker owns all
+// api::Driver instances, and serves clients connecting to a Unix socket.
+// Clients exchange data with the broker through shared memory buffers, which
+// the broker maps once at registration and reuses for every request.
+// Identical models registered on the same device are registered only once,
+// no matter how many clients use them.
+//
+// Each client connection is served by its own thread, so requests from
+// different clients run concurrently, subject to the drivers' own scheduling.
+// Thread-safe.
+class BrokerServer {
+ public:
+  explicit BrokerServer(const std::string& socket_path);
+
+  // Stops serving and closes all devices.
+  ~BrokerServer();
+
+  // This class is neither copyable nor movable.
+  BrokerServer(const BrokerServer&) = delete;
+  BrokerServer& operator=(const BrokerServer&) = delete;
+
+  // Starts listening on the socket and serving clients in the background.
+  Status Start() LOCKS_EXCLUDED(mutex_);
+
+  // Disconnects all clients, stops listening and closes all devices.
+  void Stop() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  // A device owned by the broker.
+  struct Device {
+    std::unique_ptr<api::Driver> driver;
+  };
+
+  // A shared memory buffer mapped on behalf of a client.
+  struct Mapping {
+    unsigned char* ptr;
+    size_t size_bytes;
+  };
+
+  // A model registered on a device, shared by all clients using it.
+  struct Model {
+    uint64 device_id;
+    const api::PackageReference* package_ref;
+
+    // Read-only mapping of the sealed serialized package, kept to tell
+    // identical packages apart from hash collisions.
+    Mapping content;
+
+    // Number of outstanding registrations across all clients.
+    int num_registrations;
+  };
+
+  // State of one client connection. Only accessed from its serving thread.
+  struct Session {
+    int socket_fd;
+
+    // Buffers registered by this client.
+    std::map<uint64, Mapping> buffers;
+
+    // Models registered by this client, with their registration counts.
+    std::map<uint64, int> models;
+  };
+
+  // Accepts client connections until stopped.
+  void AcceptLoop();
+
+  // Serves a single client until it disconnects or the server stops.
+  void ServeSession(int socket_fd);
+
+  // Releases everything held by a disconnected client.
+  void CloseSession(Session* session) LOCKS_EXCLUDED(mutex_);
+
+  // Handles one request, and returns the response status. Identifiers of
+  // newly created objects are returned through id.
+  Status HandleRequest(Session* session, const RequestMessage& message,
+                       int received_fd, uint64* id);
+
+  StatusOr<uint64> OpenDevice(const OpenDeviceRequest& request)
+      LOCKS_EXCLUDED(mutex_);
+  StatusOr<uint64> RegisterModel(Session* session,
+                                 const RegisterModelRequest& request,
+                                 int model_fd) LOCKS_EXCLUDED(mutex_);
+  Status UnregisterModel(Session* session, uint64 model_id)
+      LOCKS_EXCLUDED(mutex_);
+  StatusOr<uint64> RegisterBuffer(Session* session,
+                                  const RegisterBufferRequest& request,
+                                  int buffer_fd) LOCKS_EXCLUDED(mutex_);
+  Status UnregisterBuffer(Session* session, uint64 buffer_id);
+  Status Execute(Session* session, const ExecuteRequest& request)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Returns the hash of a model's serialized package.
+  static size_t HashContent(const Mapping& content);
+
+  // Returns the identifier of a model with the given content already
+  // registered on the device, or 0 if there is none.
+  uint64 FindRegisteredModel(uint64 device_id, size_t hash,
+                             const Mapping& content)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Drops one registration of a model, unregistering it from its device when
+  // no client uses it anymore.
+  Status ReleaseModel(uint64 model_id) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Path to the listening socket.
+  const std::string socket_path_;
+
+  // Listening socket. Negative when not started.
+  int listen_fd_{-1};
+
+  // Thread accepting client connections.
+  std::thread accept_thread_;
+
+  // Set when stopping.
+  std::atomic<bool> stopping_{false};
+
+  // Guards all states below.
+  mutable std::mutex mutex_;
+
+  // Threads serving client connections, keyed by their socket.
+  std::unordered_map<int, std::thread> session_threads_ GUARDED_BY(mutex_);
+
+  // Serving threads which have finished and can be joined.
+  std::vector<std::thread> finished_session_threads_ GUARDED_BY(mutex_);
+
+  // Open devices, keyed by identifier and by chip, type and path.
+  std::map<uint64, Device> devices_ GUARDED_BY(mutex_);
+  std::unordered_map<std::string, uint64> device_ids_ GUARDED_BY(mutex_);
+
+  // Registered models, keyed by identifier and by content hash.
+  std::map<uint64, Model> models_ GUARDED_BY(mutex_);
+  std::unordered_multimap<size_t, uint64> model_ids_by_hash_
+      GUARDED_BY(mutex_);
+
+  // Generator for device, model and buffer identifiers.
+  uint64 next_id_ GUARDED_BY(mutex_){1};
+};
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_BROKER_BROKER_SERVER_H_
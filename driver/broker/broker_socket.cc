@@ -0,0 +1,179 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/broker/broker_socket.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "port/errors.h"
+#include "port/logging.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+
+Status SendMessage(int socket_fd, const uint8_t* data, size_t size_bytes,
+                   int fd_to_send) {
+  if (size_bytes > kMaxMessageSizeBytes) {
+    return InvalidArgumentError(
+        StringPrintf("Message too large: %zu bytes", size_bytes));
+  }
+
+  struct iovec iov;
+  iov.iov_base = const_cast<uint8_t*>(data);
+  iov.iov_len = size_bytes;
+
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+
+  char control[CMSG_SPACE(sizeof(int))] = {};
+  if (fd_to_send >= 0) {
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd_to_send, sizeof(int));
+  }
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(socket_fd, &message, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+
+  if (sent < 0) {
+    return UnavailableError(
+        StringPrintf("Failed to send message: %s", strerror(errno)));
+  }
+  return OkStatus();
+}
+
+StatusOr<std::vector<uint8_t>> ReceiveMessage(int socket_fd,
+                                              int* received_fd) {
+  *received_fd = -1;
+
+  std::vector<uint8_t> data(kMaxMessageSizeBytes);
+  struct iovec iov;
+  iov.iov_base = data.data();
+  iov.iov_len = data.size();
+
+  char control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  if (received < 0) {
+    return UnavailableError(
+        StringPrintf("Failed to receive message: %s", strerror(errno)));
+  }
+  if (received == 0) {
+    return UnavailableError("Connection closed by peer");
+  }
+
+  for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+       header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+      memcpy(received_fd, CMSG_DATA(header), sizeof(int));
+    }
+  }
+
+  if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    if (*received_fd >= 0) {
+      close(*received_fd);
+      *received_fd = -1;
+    }
+    return InvalidArgumentError("Received message was truncated");
+  }
+
+  data.resize(received);
+  return data;
+}
+
+Status MakeSocketAddress(const std::string& socket_path,
+                         struct sockaddr_un* address) {
+  *address = {};
+  address->sun_family = AF_UNIX;
+  if (socket_path.empty() ||
+      socket_path.size() >= sizeof(address->sun_path)) {
+    return InvalidArgumentError(
+        StringPrintf("Invalid socket path [%s]", socket_path.c_str()));
+  }
+  memcpy(address->sun_path, socket_path.c_str(), socket_path.size());
+  return OkStatus();
+}
+
+int GetStatusCode(const Status& status) {
+  return static_cast<int>(status.code());
+}
+
+Status MakeStatus(int code, const std::string& message) {
+  // Canonical error codes, shared by all status implementations.
+  switch (code) {
+    case 0:
+      return OkStatus();
+    case 1:
+      return CancelledError(message);
+    case 3:
+      return InvalidArgumentError(message);
+    case 4:
+      return DeadlineExceededError(message);
+    case 5:
+      return NotFoundError(message);
+    case 6:
+      return AlreadyExistsError(message);
+    case 7:
+      return PermissionDeniedError(message);
+    case 8:
+      return ResourceExhaustedError(message);
+    case 9:
+      return FailedPreconditionError(message);
+    case 10:
+      return AbortedError(message);
+    case 11:
+      return OutOfRangeError(message);
+    case 12:
+      return UnimplementedError(message);
+    case 13:
+      return InternalError(message);
+    case 14:
+      return UnavailableError(message);
+    case 15:
+      return DataLossError(message);
+    case 16:
+      return UnauthenticatedError(message);
+    case 2:
+    default:
+      return UnknownError(message);
+  }
+}
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,64 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_BROKER_BROKER_SOCKET_H_
+#define DARWINN_DRIVER_BROKER_BROKER_SOCKET_H_
+
+#include <sys/un.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "port/status.h"
+#include "port/statusor.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace broker {
+
+// Largest message exchanged with the broker. Bulk data always travels through
+// shared memory, so messages only carry names and identifiers.
+constexpr size_t kMaxMessageSizeBytes = 64 * 1024;
+
+// Sends one message over a SOCK_SEQPACKET socket, along with the given file
+// descriptor if it is not negative.
+Status SendMessage(int socket_fd, const uint8_t* data, size_t size_bytes,
+                   int fd_to_send);
+
+// Receives one message from a SOCK_SEQPACKET socket. If a file descriptor is
+// attached, it is returned through received_fd and owned by the caller.
+// Otherwise received_fd is set to -1. Returns an unavailable error if the peer
+// has closed the connection.
+StatusOr<std::vector<uint8_t>> ReceiveMessage(int socket_fd,
+                                              int* received_fd);
+
+// Fills in a Unix socket address for the given path.
+Status MakeSocketAddress(const std::string& socket_path,
+                         struct sockaddr_un* address);
+
+// Serializes a status into a canonical error code.
+int GetStatusCode(const Status& status);
+
+// Reconstructs a status from a canonical error code and message.
+Status MakeStatus(int code, const std::string& message);
+
+}  // namespace broker
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_BROKER_BROKER_SOCKET_H_
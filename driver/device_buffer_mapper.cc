@@ -101,11 +101,35 @@ Status DeviceBufferMapper::MapInstructions(const std::vector<Buffer>& buffers) {
   return ret;
 }
 
+StatusOr<MappedDeviceBuffer> DeviceBufferMapper::MapLongLivedInstruction(
+    const Buffer& buffer) {
+  TRACE_SCOPE("DeviceBufferMapper::MapLongLivedInstruction");
+  ASSIGN_OR_RETURN(auto device_buffer, Map(buffer, DmaDirection::kToDevice,
+                                           MappingTypeHint::kLongLived));
+
+  // The mapping may outlive this mapper, but not the address space.
+  AddressSpace* address_space = address_space_;
+  return MappedDeviceBuffer(device_buffer,
+                            [address_space](const DeviceBuffer& buffer) {
+                              return address_space->UnmapMemory(buffer);
+                            });
+}
+
+Status DeviceBufferMapper::SetInstructions(
+    const std::vector<DeviceBuffer>& device_buffers) {
+  if (!instruction_mappings_.empty()) {
+    return InvalidArgumentError("Instructions are already mapped.");
+  }
+  instructions_ = device_buffers;
+  return Status();  // OK
+}
+
 StatusOr<DeviceBuffer> DeviceBufferMapper::Map(const Buffer& buffer,
-                                               DmaDirection direction) {
+                                               DmaDirection direction,
+                                               MappingTypeHint mapping_type) {
   TRACE_SCOPE("DeviceBufferMapper::Map");
   if (buffer.IsValid()) {
-    return address_space_->MapMemory(buffer, direction, MappingTypeHint::kAny);
+    return address_space_->MapMemory(buffer, direction, mapping_type);
   }
   return DeviceBuffer();  // Invalid buffer.
 }
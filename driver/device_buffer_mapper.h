@@ -31,6 +31,8 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+class MappedDeviceBuffer;
+
 // Thread-unsafe.
 // Maps request-specific Buffers to DeviceBuffers, and keeps track of
 // DeviceBuffers. These include: input, output, instruction and scratch.
@@ -54,6 +56,14 @@ class DeviceBufferMapper {
   Status MapScratch(const Buffer& buffer);
   Status MapInstructions(const std::vector<Buffer>& buffers);
 
+  // Maps an instruction buffer on behalf of the caller, who owns the mapping.
+  // Such mappings may outlive this object and are not unmapped by UnmapAll.
+  StatusOr<MappedDeviceBuffer> MapLongLivedInstruction(const Buffer& buffer);
+
+  // Uses the given instruction DeviceBuffers, mapped and owned by the caller,
+  // for the current request.
+  Status SetInstructions(const std::vector<DeviceBuffer>& device_buffers);
+
   // Returns mapped DeviceBuffers.
   const DeviceBuffer::NamedMap& GetInputDeviceBuffers() const {
     return inputs_;
@@ -82,8 +92,10 @@ class DeviceBufferMapper {
 
  private:
   // Convenience function that wraps AddressSpace#Map() handling invalid
-  // buffers.
-  StatusOr<DeviceBuffer> Map(const Buffer& buffer, DmaDirection direction);
+  // buffers. Per-request buffers use the default mapping type.
+  StatusOr<DeviceBuffer> Map(const Buffer& buffer, DmaDirection direction,
+                             MappingTypeHint mapping_type =
+                                 MappingTypeHint::kAny);
 
   // Convenience function that wraps AddressSpace#UnmapMemory() handling invalid
   // buffers.
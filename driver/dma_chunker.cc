@@ -24,6 +24,35 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+DmaChunkSizer::DmaChunkSizer(int granularity_bytes, int max_bytes)
+    : granularity_bytes_(granularity_bytes),
+      max_bytes_(std::max(granularity_bytes,
+                          max_bytes / granularity_bytes * granularity_bytes)),
+      chunk_bytes_(max_bytes_) {
+  CHECK_GT(granularity_bytes_, 0);
+}
+
+void DmaChunkSizer::NotifyTransfer(int chunk_bytes, int transferred_bytes) {
+  if (transferred_bytes < chunk_bytes) {
+    // Shrink towards what was delivered, but slowly: transfers also come up
+    // short at random, and every shrink below the typical yield costs extra
+    // transfers until sizes grow back.
+    chunk_bytes_ =
+        Clamp(std::max(transferred_bytes, chunk_bytes_ - chunk_bytes_ / 4));
+  } else if (chunk_bytes >= chunk_bytes_) {
+    // Grow fast after a full chunk. Chunks cut short by the end of the
+    // buffer say nothing about larger sizes.
+    chunk_bytes_ = Clamp(std::min(max_bytes_ / 4, chunk_bytes_) * 4);
+  }
+}
+
+int DmaChunkSizer::Clamp(int num_bytes) const {
+  const int rounded_bytes =
+      (num_bytes + granularity_bytes_ - 1) / granularity_bytes_ *
+      granularity_bytes_;
+  return std::min(max_bytes_, std::max(granularity_bytes_, rounded_bytes));
+}
+
 DeviceBuffer DmaChunker::GetNextChunk() {
   const auto curr_offset = GetNextChunkOffset();
   const int remaining_bytes = buffer_.size_bytes() - curr_offset;
@@ -31,6 +60,7 @@ DeviceBuffer DmaChunker::GetNextChunk() {
       "Completed %zd bytes; Outstanding %zd bytes; Processing next %d bytes",
       transferred_bytes_, active_bytes_, remaining_bytes);
 
+  sizer_ = nullptr;
   MarkActive(remaining_bytes);
   return buffer_.Slice(curr_offset, remaining_bytes);
 }
@@ -43,13 +73,25 @@ DeviceBuffer DmaChunker::GetNextChunk(int num_bytes) {
       "Completed %zd bytes; Outstanding %zd bytes; Processing next %d bytes",
       transferred_bytes_, active_bytes_, transfer_bytes);
 
+  sizer_ = nullptr;
   MarkActive(transfer_bytes);
   return buffer_.Slice(curr_offset, transfer_bytes);
 }
 
+DeviceBuffer DmaChunker::GetNextChunk(DmaChunkSizer* sizer) {
+  auto chunk = GetNextChunk(sizer->chunk_bytes());
+  sizer_ = sizer;
+  sized_chunk_bytes_ = chunk.size_bytes();
+  return chunk;
+}
+
 void DmaChunker::NotifyTransfer(int transferred_bytes) {
   transferred_bytes_ += transferred_bytes;
   CHECK_GE(active_bytes_, transferred_bytes);
+  if (sizer_ != nullptr) {
+    sizer_->NotifyTransfer(sized_chunk_bytes_, transferred_bytes);
+    sizer_ = nullptr;
+  }
   switch (processing_) {
     case HardwareProcessing::kCommitted:
       active_bytes_ -= transferred_bytes;
@@ -57,6 +99,7 @@ void DmaChunker::NotifyTransfer(int transferred_bytes) {
 
     case HardwareProcessing::kBestEffort:
       // Active bytes may be partially dropped by HW. Re-chunk them.
+      dropped_bytes_ += active_bytes_ - transferred_bytes;
       active_bytes_ = 0;
       break;
   }
@@ -23,6 +23,33 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+// Picks chunk sizes for one DMA stream, e.g. a USB endpoint, from how its
+// previous chunks completed. Sizes grow on chunks completed in full, and
+// shrink after chunks the hardware processed only partially. Sizes are whole
+// multiples of a granularity, within [granularity, max]. Not thread-safe.
+class DmaChunkSizer {
+ public:
+  // Sizes start at "max_bytes", rounded down to "granularity_bytes".
+  DmaChunkSizer(int granularity_bytes, int max_bytes);
+
+  // Returns size of the next chunk.
+  int chunk_bytes() const { return chunk_bytes_; }
+
+  // Notifies that a chunk of "chunk_bytes" yielded "transferred_bytes".
+  void NotifyTransfer(int chunk_bytes, int transferred_bytes);
+
+ private:
+  // Returns "num_bytes" rounded up to granularity, within [granularity, max].
+  int Clamp(int num_bytes) const;
+
+  // Size constraints.
+  const int granularity_bytes_;
+  const int max_bytes_;
+
+  // Size of the next chunk.
+  int chunk_bytes_;
+};
+
 // A class to chunk DMAs into smaller DMAs given hardware constraints.
 //
 // Hardware can be:
@@ -60,6 +87,10 @@ class DmaChunker {
   // Returns next DMA chunk to perform upto "num_bytes".
   DeviceBuffer GetNextChunk(int num_bytes);
 
+  // Returns next DMA chunk sized by "sizer", which is notified when the chunk
+  // completes. Only the most recent chunk is reported to "sizer".
+  DeviceBuffer GetNextChunk(DmaChunkSizer* sizer);
+
   // Notifies that "transferred_bytes" amount of data has been transferred.
   void NotifyTransfer(int transferred_bytes);
 
@@ -72,6 +103,15 @@ class DmaChunker {
   // Returns total DMA buffer.
   const DeviceBuffer& buffer() const { return buffer_; }
 
+  // Returns number of bytes which have not been transferred yet.
+  size_t GetRemainingBytes() const {
+    return buffer_.size_bytes() - transferred_bytes_;
+  }
+
+  // Returns number of bytes given out in best-effort chunks which hardware
+  // did not process, and were given out again.
+  size_t GetDroppedBytes() const { return dropped_bytes_; }
+
   // Returns how many active transfers are out, where each transfer is "bytes".
   int GetActiveCounts(int bytes) const {
     // Want to calculate CeilOfRatio(active_btyes_, bytes)
@@ -97,6 +137,13 @@ class DmaChunker {
 
   // Number of transferred bytes.
   size_t transferred_bytes_{0};
+
+  // Number of best-effort bytes dropped by hardware.
+  size_t dropped_bytes_{0};
+
+  // Sizer of the most recent chunk, if any, and the chunk size it picked.
+  DmaChunkSizer* sizer_{nullptr};
+  int sized_chunk_bytes_{0};
 };
 
 }  // namespace driver
@@ -0,0 +1,153 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures transfers and dropped bytes per output megabyte of best-effort
+// DmaChunker streams, for fixed chunk sizes and for chunks sized by
+// DmaChunkSizer. A simulated transport delivers each output in pieces, as the
+// device does with output descriptors, and cuts a configurable fraction of
+// transfers short at random. The transport is seeded, so runs are repeatable.
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+
+#include "driver/device_buffer.h"
+#include "driver/dma_chunker.h"
+#include "port/gflags.h"
+#include "port/integral_types.h"
+#include "port/logging.h"
+
+ABSL_FLAG(int, output_kb, 1024, "Size of each output in KB.");
+ABSL_FLAG(int, iterations, 100, "Number of outputs streamed per policy.");
+ABSL_FLAG(int, piece_kb, 16,
+          "Size in KB of the pieces the transport delivers an output in. A "
+          "transfer ends short at the end of a piece.");
+ABSL_FLAG(double, drop_fraction, 0.1,
+          "Fraction of transfers the transport cuts short at random.");
+ABSL_FLAG(int, granularity_bytes, 1024, "Chunk size granularity, in bytes.");
+ABSL_FLAG(int, max_chunk_kb, 192, "Largest chunk in KB.");
+ABSL_FLAG(int, seed, 1, "Seed of the simulated transport.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+struct Result {
+  int64 transfers;
+  int64 dropped_bytes;
+};
+
+// Streams |iterations| outputs of |output_bytes| through best-effort chunkers.
+// |next_chunk| hands out each chunk.
+Result Stream(int output_bytes, int iterations, int piece_bytes,
+              double drop_fraction, int granularity_bytes, int seed,
+              const std::function<DeviceBuffer(DmaChunker*)>& next_chunk) {
+  std::mt19937 random(seed);
+  std::bernoulli_distribution drop(drop_fraction);
+
+  Result result = {0, 0};
+  for (int i = 0; i < iterations; ++i) {
+    DmaChunker chunker(DmaChunker::HardwareProcessing::kBestEffort,
+                       DeviceBuffer(/*device_address=*/0, output_bytes));
+    int piece_remaining_bytes = piece_bytes;
+    while (!chunker.IsCompleted()) {
+      const int chunk_bytes = next_chunk(&chunker).size_bytes();
+      int transferred_bytes = std::min(chunk_bytes, piece_remaining_bytes);
+      if (drop(random)) {
+        // Cut short at a random granule, keeping at least one.
+        const int num_granules =
+            (transferred_bytes + granularity_bytes - 1) / granularity_bytes;
+        const int kept_granules =
+            std::uniform_int_distribution<int>(1, num_granules)(random);
+        transferred_bytes =
+            std::min(transferred_bytes, kept_granules * granularity_bytes);
+      }
+      chunker.NotifyTransfer(transferred_bytes);
+      ++result.transfers;
+
+      piece_remaining_bytes -= transferred_bytes;
+      if (piece_remaining_bytes == 0) {
+        piece_remaining_bytes = piece_bytes;
+      }
+    }
+    CHECK_EQ(chunker.GetRemainingBytes(), 0);
+    result.dropped_bytes += chunker.GetDroppedBytes();
+  }
+  return result;
+}
+
+int Run() {
+  const int output_bytes = absl::GetFlag(FLAGS_output_kb) * 1024;
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  const int piece_bytes = absl::GetFlag(FLAGS_piece_kb) * 1024;
+  const double drop_fraction = absl::GetFlag(FLAGS_drop_fraction);
+  const int granularity_bytes = absl::GetFlag(FLAGS_granularity_bytes);
+  const int max_chunk_bytes = absl::GetFlag(FLAGS_max_chunk_kb) * 1024;
+  const int seed = absl::GetFlag(FLAGS_seed);
+  CHECK_GT(output_bytes, 0);
+  CHECK_GT(iterations, 0);
+  CHECK_GT(piece_bytes, 0);
+  CHECK_GE(drop_fraction, 0.0);
+  CHECK_LE(drop_fraction, 1.0);
+  CHECK_GT(granularity_bytes, 0);
+  CHECK_GE(max_chunk_bytes, granularity_bytes);
+
+  auto stream = [&](const std::function<DeviceBuffer(DmaChunker*)>& next) {
+    return Stream(output_bytes, iterations, piece_bytes, drop_fraction,
+                  granularity_bytes, seed, next);
+  };
+
+  const double total_mb =
+      static_cast<double>(output_bytes) * iterations / (1024.0 * 1024.0);
+  auto report = [total_mb](const char* name, const Result& result) {
+    printf("%-12s %9.1f transfers/MB %11.1f dropped KB/MB\n", name,
+           result.transfers / total_mb,
+           result.dropped_bytes / 1024.0 / total_mb);
+  };
+
+  report("remaining:", stream([](DmaChunker* chunker) {
+           return chunker->GetNextChunk();
+         }));
+  report("fixed max:", stream([max_chunk_bytes](DmaChunker* chunker) {
+           return chunker->GetNextChunk(max_chunk_bytes);
+         }));
+
+  // Sizers are per stream, so every output but the first starts from the
+  // sizes the previous ones settled on.
+  DmaChunkSizer sizer(granularity_bytes, max_chunk_bytes);
+  const Result adaptive = stream(
+      [&sizer](DmaChunker* chunker) { return chunker->GetNextChunk(&sizer); });
+  report("adaptive:", adaptive);
+
+  // The transport is deterministic, so a second run must match.
+  DmaChunkSizer repeat_sizer(granularity_bytes, max_chunk_bytes);
+  const Result repeat = stream([&repeat_sizer](DmaChunker* chunker) {
+    return chunker->GetNextChunk(&repeat_sizer);
+  });
+  CHECK_EQ(repeat.transfers, adaptive.transfers);
+  CHECK_EQ(repeat.dropped_bytes, adaptive.dropped_bytes);
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
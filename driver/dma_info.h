@@ -16,6 +16,7 @@
 #define DARWINN_DRIVER_DMA_INFO_H_
 
 #include <string>
+#include <vector>
 
 #include "driver/device_buffer.h"
 
@@ -23,6 +24,8 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+class ExecutableReference;
+
 // Possible DMA descriptor types.
 enum class DmaDescriptorType {
   kInstruction = 0,
@@ -69,6 +72,12 @@ class DmaInfo {
   DmaDescriptorType type() const { return type_; }
   const DeviceBuffer& buffer() const { return buffer_; }
 
+  // Executable the DMA is issued for. May be null.
+  const ExecutableReference* executable() const { return executable_; }
+  void set_executable(const ExecutableReference* executable) {
+    executable_ = executable;
+  }
+
   // Returns true if DMA is in given state.
   bool IsActive() const { return state_ == DmaState::kActive; }
   bool IsCompleted() const { return state_ == DmaState::kCompleted; }
@@ -93,8 +102,43 @@ class DmaInfo {
 
   // Memory to DMA from the device point of view.
   DeviceBuffer buffer_;
+
+  // Executable the DMA is issued for. Not owned.
+  const ExecutableReference* executable_{nullptr};
 };
 
+// A DMA hint decoded once from an executable. The buffer it refers to is left
+// unresolved, and is looked up from the buffers of each request.
+struct DmaHintPlanEntry {
+  // Where the DMA buffer comes from.
+  enum class Source {
+    // DMA does not carry any data, e.g. interrupts and fences.
+    kNone,
+    kInputActivation,
+    kOutputActivation,
+    kParameter,
+    kScratch,
+    kInstruction,
+  };
+
+  DmaDescriptorType type{DmaDescriptorType::kInstruction};
+  Source source{Source::kNone};
+
+  // Layer name and batch, for input and output activations.
+  std::string layer_name;
+  int batch{0};
+
+  // Chunk index, for instructions.
+  int chunk_id{0};
+
+  // Slice of the source buffer, for all but instructions.
+  int offset_bytes{0};
+  int size_bytes{0};
+};
+
+// DMA hints of an executable, in the order they should be performed.
+using DmaHintPlan = std::vector<DmaHintPlanEntry>;
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
@@ -64,94 +64,60 @@ std::list<DmaInfo> DmaInfoExtractor::ExtractDmaHints(
   const DmaHints& dma_hints = *executable_reference.executable().dma_hints();
   std::list<DmaInfo> dmas;
   int id = 0;
-  for (const auto& dma_hint : *dma_hints.hints()) {
-    switch (dma_hint->any_hint_type()) {
-      case AnyHint_DmaDescriptorHint: {
-        const auto& descriptor = dma_hint->any_hint_as_DmaDescriptorHint();
-        const auto& meta = descriptor->meta();
-        switch (meta->desc()) {
-          case Description_BASE_ADDRESS_INPUT_ACTIVATION: {
-            const auto& buffer = buffers.GetInputDeviceBuffer(
-                meta->name()->str(), meta->batch());
-            // Input buffers may not be padded, so the DMA may request a small
-            // amount of data past the end of the input buffer. Double check
-            // that we don't cross a page boundary, but otherwise allow the
-            // DMA to read past the end of the buffer.
-            uint64 last_page_of_buffer = GetPageAddress(
-                buffer.device_address() + buffer.size_bytes() - 1);
-            uint64 last_page_of_dma = GetPageAddress(
-                buffer.device_address() + descriptor->offset_in_bytes() +
-                descriptor->size_in_bytes() - 1);
-            CHECK_LE(last_page_of_dma, last_page_of_buffer);
-            dmas.push_back(DmaInfo(id++, DmaDescriptorType::kInputActivation,
-                                   buffer.Slice(descriptor->offset_in_bytes(),
-                                                descriptor->size_in_bytes(),
-                                                /*allow_overflow=*/true)));
-            break;
-          }
-
-          case Description_BASE_ADDRESS_OUTPUT_ACTIVATION: {
-            const auto& buffer = buffers.GetOutputDeviceBuffer(
-                meta->name()->str(), meta->batch());
-            dmas.push_back(DmaInfo(id++, DmaDescriptorType::kOutputActivation,
-                                   buffer.Slice(descriptor->offset_in_bytes(),
-                                                descriptor->size_in_bytes())));
-            break;
-          }
-
-          case Description_BASE_ADDRESS_PARAMETER: {
-            const auto& buffer =
-                executable_reference.GetParameterDeviceBuffer();
-            dmas.push_back(DmaInfo(id++, DmaDescriptorType::kParameter,
-                                   buffer.Slice(descriptor->offset_in_bytes(),
-                                                descriptor->size_in_bytes())));
-            break;
-          }
-
-          case Description_BASE_ADDRESS_SCRATCH: {
-            const auto& buffer = buffers.GetScratchDeviceBuffer();
-            if (dma_hint->direction() == Direction_INFEED) {
-              dmas.push_back(
-                  DmaInfo(id++, DmaDescriptorType::kInputActivation,
-                          buffer.Slice(descriptor->offset_in_bytes(),
-                                       descriptor->size_in_bytes())));
-            } else {
-              DCHECK_EQ(dma_hint->direction(), Direction_OUTFEED);
-              dmas.push_back(
-                  DmaInfo(id++, DmaDescriptorType::kOutputActivation,
-                          buffer.Slice(descriptor->offset_in_bytes(),
-                                       descriptor->size_in_bytes())));
-            }
-            break;
-          }
-        }
+
+  // Hints are decoded once at registration time. Only the buffers they refer
+  // to are resolved here.
+  for (const auto& hint : executable_reference.dma_hint_plan()) {
+    switch (hint.source) {
+      case DmaHintPlanEntry::Source::kInputActivation: {
+        const auto& buffer =
+            buffers.GetInputDeviceBuffer(hint.layer_name, hint.batch);
+        // Input buffers may not be padded, so the DMA may request a small
+        // amount of data past the end of the input buffer. Double check
+        // that we don't cross a page boundary, but otherwise allow the
+        // DMA to read past the end of the buffer.
+        uint64 last_page_of_buffer = GetPageAddress(
+            buffer.device_address() + buffer.size_bytes() - 1);
+        uint64 last_page_of_dma =
+            GetPageAddress(buffer.device_address() + hint.offset_bytes +
+                           hint.size_bytes - 1);
+        CHECK_LE(last_page_of_dma, last_page_of_buffer);
+        dmas.push_back(DmaInfo(id++, hint.type,
+                               buffer.Slice(hint.offset_bytes, hint.size_bytes,
+                                            /*allow_overflow=*/true)));
+        break;
+      }
+
+      case DmaHintPlanEntry::Source::kOutputActivation: {
+        const auto& buffer =
+            buffers.GetOutputDeviceBuffer(hint.layer_name, hint.batch);
+        dmas.push_back(DmaInfo(
+            id++, hint.type, buffer.Slice(hint.offset_bytes, hint.size_bytes)));
         break;
       }
 
-      case AnyHint_InstructionHint: {
-        const int chunk_id =
-            dma_hint->any_hint_as_InstructionHint()->instruction_chunk_index();
-        const auto& buffer = buffers.GetInstructionDeviceBuffer(chunk_id);
-        dmas.push_back(DmaInfo(id++, DmaDescriptorType::kInstruction, buffer));
+      case DmaHintPlanEntry::Source::kParameter: {
+        const auto& buffer = executable_reference.GetParameterDeviceBuffer();
+        dmas.push_back(DmaInfo(
+            id++, hint.type, buffer.Slice(hint.offset_bytes, hint.size_bytes)));
         break;
       }
 
-      case AnyHint_InterruptHint: {
-        const auto& interrupt = dma_hint->any_hint_as_InterruptHint();
-        const DmaDescriptorType type = static_cast<DmaDescriptorType>(
-            static_cast<int>(DmaDescriptorType::kScalarCoreInterrupt0) +
-            static_cast<int>(interrupt->type()));
-        dmas.push_back(DmaInfo(id++, type));
+      case DmaHintPlanEntry::Source::kScratch: {
+        const auto& buffer = buffers.GetScratchDeviceBuffer();
+        dmas.push_back(DmaInfo(
+            id++, hint.type, buffer.Slice(hint.offset_bytes, hint.size_bytes)));
         break;
       }
 
-      case AnyHint_FenceHint: {
-        dmas.push_back(DmaInfo(id++, DmaDescriptorType::kLocalFence));
+      case DmaHintPlanEntry::Source::kInstruction: {
+        const auto& buffer = buffers.GetInstructionDeviceBuffer(hint.chunk_id);
+        dmas.push_back(DmaInfo(id++, hint.type, buffer));
         break;
       }
 
-      case AnyHint_NONE:
-        LOG(FATAL) << StringPrintf("Unrecognized hint");
+      case DmaHintPlanEntry::Source::kNone:
+        dmas.push_back(DmaInfo(id++, hint.type));
         break;
     }
   }
@@ -0,0 +1,190 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/dma_statistics_recorder.h"
+
+#include <algorithm>
+
+#include "driver/package_registry.h"
+#include "executable/executable_generated.h"
+#include "port/std_mutex_lock.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+namespace {
+
+// Lengths of the reported bandwidth windows.
+constexpr int64 kWindowsMs[] = {1000, 10000};
+
+}  // namespace
+
+constexpr int64 DmaStatisticsRecorder::kBucketMs;
+constexpr int DmaStatisticsRecorder::kNumBuckets;
+
+DmaStatisticsRecorder::DmaStatisticsRecorder(
+    const driver_shared::TimeStamper* time_stamper)
+    : time_stamper_(time_stamper) {}
+
+DmaStatisticsRecorder::Statistics::Counter* DmaStatisticsRecorder::GetCounter(
+    DmaDescriptorType type, Statistics::TypeCounters* counters) {
+  switch (type) {
+    case DmaDescriptorType::kInstruction:
+      return &counters->instructions;
+    case DmaDescriptorType::kInputActivation:
+      return &counters->input_activations;
+    case DmaDescriptorType::kParameter:
+      return &counters->parameters;
+    case DmaDescriptorType::kOutputActivation:
+      return &counters->output_activations;
+    default:
+      return nullptr;
+  }
+}
+
+void DmaStatisticsRecorder::RecordDma(const DmaInfo& dma_info) {
+  const int64 size_bytes = dma_info.buffer().size_bytes();
+  if (size_bytes == 0) {
+    return;
+  }
+
+  // Look the name up before taking the lock.
+  const char* executable_name = "";
+  if (dma_info.executable() != nullptr &&
+      dma_info.executable()->executable().name() != nullptr) {
+    executable_name = dma_info.executable()->executable().name()->c_str();
+  }
+  const int64 now_ms = time_stamper_->GetTimeMilliSeconds();
+
+  StdMutexLock lock(&mutex_);
+  auto* counter = GetCounter(dma_info.type(), &total_);
+  if (counter == nullptr) {
+    return;
+  }
+  counter->bytes += size_bytes;
+  ++counter->count;
+
+  auto it = per_executable_.find(executable_name);
+  if (it == per_executable_.end()) {
+    it = per_executable_.emplace(executable_name, Statistics::TypeCounters())
+             .first;
+  }
+  auto* executable_counter = GetCounter(dma_info.type(), &it->second);
+  executable_counter->bytes += size_bytes;
+  ++executable_counter->count;
+
+  const bool device_to_host =
+      dma_info.type() == DmaDescriptorType::kOutputActivation;
+  AddToWindow(now_ms, device_to_host, size_bytes);
+}
+
+void DmaStatisticsRecorder::RecordEndpointTransfer(int endpoint,
+                                                   bool device_to_host,
+                                                   size_t size_bytes) {
+  StdMutexLock lock(&mutex_);
+  auto& counter =
+      endpoints_[std::make_pair(endpoint, device_to_host)].transfers;
+  counter.bytes += size_bytes;
+  ++counter.count;
+}
+
+void DmaStatisticsRecorder::RecordEndpointDrop(int endpoint,
+                                               bool device_to_host,
+                                               size_t dropped_bytes) {
+  StdMutexLock lock(&mutex_);
+  auto& counter = endpoints_[std::make_pair(endpoint, device_to_host)].dropped;
+  counter.bytes += dropped_bytes;
+  ++counter.count;
+}
+
+void DmaStatisticsRecorder::AddToWindow(int64 now_ms, bool device_to_host,
+                                        int64 size_bytes) {
+  const int64 index = now_ms / kBucketMs;
+  auto& bucket = buckets_[index % kNumBuckets];
+  if (bucket.index != index) {
+    bucket = Bucket();
+    bucket.index = index;
+  }
+  if (device_to_host) {
+    bucket.device_to_host_bytes += size_bytes;
+  } else {
+    bucket.host_to_device_bytes += size_bytes;
+  }
+}
+
+DmaStatisticsRecorder::Statistics::Bandwidth
+DmaStatisticsRecorder::GetBandwidth(int64 now_ms, int64 window_ms) const {
+  Statistics::Bandwidth bandwidth;
+  bandwidth.window_ms = window_ms;
+
+  // The current bucket is only partially elapsed, so the window spans the
+  // full buckets before it plus the elapsed part of the current one.
+  const int64 current_index = now_ms / kBucketMs;
+  const int64 num_buckets =
+      std::min<int64>(window_ms / kBucketMs, kNumBuckets);
+  const int64 first_index = current_index - num_buckets + 1;
+  const int64 elapsed_ms =
+      (num_buckets - 1) * kBucketMs + now_ms % kBucketMs + 1;
+
+  int64 host_to_device_bytes = 0;
+  int64 device_to_host_bytes = 0;
+  for (const auto& bucket : buckets_) {
+    if (bucket.index >= first_index && bucket.index <= current_index) {
+      host_to_device_bytes += bucket.host_to_device_bytes;
+      device_to_host_bytes += bucket.device_to_host_bytes;
+    }
+  }
+
+  bandwidth.host_to_device_bytes_per_second =
+      host_to_device_bytes * 1000.0 / elapsed_ms;
+  bandwidth.device_to_host_bytes_per_second =
+      device_to_host_bytes * 1000.0 / elapsed_ms;
+  return bandwidth;
+}
+
+api::Driver::DmaStatistics DmaStatisticsRecorder::Get() const {
+  const int64 now_ms = time_stamper_->GetTimeMilliSeconds();
+
+  StdMutexLock lock(&mutex_);
+  Statistics statistics;
+  statistics.total = total_;
+  for (const auto& name_and_counters : per_executable_) {
+    statistics.per_executable.insert(name_and_counters);
+  }
+  for (const int64 window_ms : kWindowsMs) {
+    statistics.bandwidth.push_back(GetBandwidth(now_ms, window_ms));
+  }
+  for (const auto& key_and_endpoint : endpoints_) {
+    Statistics::Endpoint endpoint = key_and_endpoint.second;
+    endpoint.endpoint = key_and_endpoint.first.first;
+    endpoint.device_to_host = key_and_endpoint.first.second;
+    statistics.endpoints.push_back(endpoint);
+  }
+  return statistics;
+}
+
+void DmaStatisticsRecorder::Reset() {
+  StdMutexLock lock(&mutex_);
+  total_ = Statistics::TypeCounters();
+  per_executable_.clear();
+  endpoints_.clear();
+  for (auto& bucket : buckets_) {
+    bucket = Bucket();
+  }
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,123 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_DMA_STATISTICS_RECORDER_H_
+#define DARWINN_DRIVER_DMA_STATISTICS_RECORDER_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+
+#include "api/driver.h"
+#include "driver/dma_info.h"
+#include "driver_shared/time_stamper/time_stamper.h"
+#include "port/integral_types.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Accumulates the bytes moved by DMA on one device, by descriptor type,
+// executable and USB endpoint, along with the bandwidth achieved over sliding
+// windows. Recording costs one uncontended lock and no allocation once an
+// executable or endpoint has been seen. Thread-safe.
+class DmaStatisticsRecorder {
+ public:
+  explicit DmaStatisticsRecorder(
+      const driver_shared::TimeStamper* time_stamper);
+
+  // This class is neither copyable nor movable.
+  DmaStatisticsRecorder(const DmaStatisticsRecorder&) = delete;
+  DmaStatisticsRecorder& operator=(const DmaStatisticsRecorder&) = delete;
+
+  ~DmaStatisticsRecorder() = default;
+
+  // Records a completed DMA. DMAs that carry no data, e.g. interrupts and
+  // fences, are ignored.
+  void RecordDma(const DmaInfo& dma_info) LOCKS_EXCLUDED(mutex_);
+
+  // Records a completed transfer on a USB endpoint.
+  void RecordEndpointTransfer(int endpoint, bool device_to_host,
+                              size_t size_bytes) LOCKS_EXCLUDED(mutex_);
+
+  // Records a transfer on a USB endpoint that delivered "dropped_bytes" less
+  // than it asked for.
+  void RecordEndpointDrop(int endpoint, bool device_to_host,
+                          size_t dropped_bytes) LOCKS_EXCLUDED(mutex_);
+
+  // Returns a snapshot of the statistics.
+  api::Driver::DmaStatistics Get() const LOCKS_EXCLUDED(mutex_);
+
+  // Clears all counters.
+  void Reset() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  using Statistics = api::Driver::DmaStatistics;
+
+  // Bandwidth is tracked in buckets of fixed duration, which cover the longest
+  // reported window.
+  static constexpr int64 kBucketMs = 100;
+  static constexpr int kNumBuckets = 100;
+
+  // Bytes transferred in one bucket.
+  struct Bucket {
+    // Index of the bucket since the epoch of the time stamper. -1 if unused.
+    int64 index{-1};
+    int64 host_to_device_bytes{0};
+    int64 device_to_host_bytes{0};
+  };
+
+  // Returns the counter of the given type, or null if it carries no data.
+  static Statistics::Counter* GetCounter(DmaDescriptorType type,
+                                         Statistics::TypeCounters* counters);
+
+  // Adds bytes to the current bucket.
+  void AddToWindow(int64 now_ms, bool device_to_host, int64 size_bytes)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the bandwidth over the last |window_ms| milliseconds.
+  Statistics::Bandwidth GetBandwidth(int64 now_ms, int64 window_ms) const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Clock for sliding windows. Not owned.
+  const driver_shared::TimeStamper* const time_stamper_;
+
+  mutable std::mutex mutex_;
+
+  // Counters of all DMAs.
+  Statistics::TypeCounters total_ GUARDED_BY(mutex_);
+
+  // Counters by executable name. The transparent comparator lets the name be
+  // looked up without copying it.
+  std::map<std::string, Statistics::TypeCounters, std::less<>>
+      per_executable_ GUARDED_BY(mutex_);
+
+  // Counters by (endpoint, device_to_host).
+  std::map<std::pair<int, bool>, Statistics::Endpoint> endpoints_
+      GUARDED_BY(mutex_);
+
+  // Ring of bandwidth buckets.
+  Bucket buckets_[kNumBuckets] GUARDED_BY(mutex_);
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_DMA_STATISTICS_RECORDER_H_
@@ -14,6 +14,7 @@
 
 #include "driver/driver.h"
 
+#include <algorithm>
 #include <atomic>
 #include <memory>
 
@@ -48,6 +49,19 @@ namespace {
 
 using api::ExecutionContextInterface;
 
+// Returns thermal monitor settings from driver options.
+ThermalMonitor::Options GetThermalMonitorOptions(
+    const api::DriverOptions& driver_options) {
+  ThermalMonitor::Options options;
+  options.period_ms = driver_options.thermal_monitor_period_ms();
+  options.throttle_millicelsius =
+      driver_options.thermal_throttle_millicelsius();
+  options.release_millicelsius = std::min(
+      driver_options.thermal_release_millicelsius(),
+      driver_options.thermal_throttle_millicelsius());
+  return options;
+}
+
 }  // namespace
 
 Driver::Driver(api::Chip, std::unique_ptr<PackageRegistry> executable_registry,
@@ -55,6 +69,9 @@ Driver::Driver(api::Chip, std::unique_ptr<PackageRegistry> executable_registry,
                std::unique_ptr<driver_shared::TimeStamper> time_stamper)
     : executable_registry_(std::move(executable_registry)),
       time_stamper_(std::move(time_stamper)),
+      dma_statistics_recorder_(time_stamper_.get()),
+      thermal_monitor_options_(GetThermalMonitorOptions(driver_options)),
+      performance_expectation_(driver_options.performance_expectation()),
       current_parameter_caching_token_(0),
       debug_mode_(false),
       max_scheduled_work_ns_(driver_options.max_scheduled_work_ns()) {
@@ -145,6 +162,10 @@ Status Driver::Open(bool debug_mode, bool context_lost) {
   RETURN_IF_ERROR(DoOpen(debug_mode));
   num_clients_++;
 
+  if (thermal_monitor_) {
+    thermal_monitor_->Start();
+  }
+
   // All good. Move state to open.
   RETURN_IF_ERROR(SetState(kOpen));
 
@@ -164,6 +185,27 @@ int64 ComputeMETinMs(int64 cycles, int64 frequency) {
   }
 }
 
+// Returns number of bytes moved from host to TPU for a single inference of the
+// given package, not counting parameters cached on TPU.
+int64 InferenceTransferBytes(const PackageReference& package_ref) {
+  const auto* main_ref = package_ref.MainExecutableReference();
+  int64 size_bytes = main_ref->parameters().size_bytes();
+  for (int i = 0; i < main_ref->NumInputLayers(); ++i) {
+    size_bytes += main_ref->InputLayerSizeBytes(i);
+  }
+  return size_bytes;
+}
+
+// Returns number of bytes moved from host to TPU for caching parameters of the
+// given package.
+int64 ParameterCachingTransferBytes(const PackageReference& package_ref) {
+  const auto* parameter_caching_ref =
+      package_ref.ParameterCachingExecutableReference();
+  return parameter_caching_ref == nullptr
+             ? 0
+             : parameter_caching_ref->parameters().size_bytes();
+}
+
 }  // namespace
 
 Status Driver::UpdateInitialTiming(
@@ -316,6 +358,7 @@ Status Driver::Submit(std::shared_ptr<api::Request> api_request,
         "Request [%d]: Pushing P%d request to its priority queue.",
         request->id(), request->GetPriority());
     pending_requests_[request->GetPriority()].push(std::move(request));
+    num_pending_requests_.fetch_add(1);
     RETURN_IF_ERROR(TrySchedulePendingRequests());
   }
 
@@ -347,6 +390,12 @@ Status Driver::CheckLatencyTolerance(const std::shared_ptr<Request>& request) {
         package_ref.ParameterCachingExecutableReference()->EstimatedCycles();
   }
 
+  // Data still has to reach the TPU, which dominates on slow host links.
+  estimated_cycles += HostToTpuTransferCycles(
+      tpu_request_count * InferenceTransferBytes(package_ref) +
+      (needs_parameter_caching ? ParameterCachingTransferBytes(package_ref)
+                               : 0));
+
   estimated_cycles += MaxRemainingCycles();
 
   int64 estimated_time_ms =
@@ -445,9 +494,12 @@ void Driver::ResetCachedParameters() {
 
 void Driver::SchedulerWorker() {
   while (true) {
+    bool schedule_more_requests = false;
+    ThermalWarningCallback thermal_warning_callback;
     {
       StdCondMutexLock lock(&scheduler_mutex_);
-      while (!schedule_more_requests_ && !destructing_) {
+      while (!schedule_more_requests_ && !thermal_warning_pending_ &&
+             !destructing_) {
         scheduler_wakeup_.wait(lock);
       }
 
@@ -455,17 +507,43 @@ void Driver::SchedulerWorker() {
         return;
       }
 
+      if (thermal_warning_pending_) {
+        thermal_warning_pending_ = false;
+        thermal_warning_callback = thermal_warning_callback_;
+      }
+
+      schedule_more_requests = schedule_more_requests_;
       schedule_more_requests_ = false;
     }
 
-    ReaderMutexLock state_reader_lock(&state_mutex_);
-    StdMutexLock submit_lock(&submit_mutex_);
-    // TODO Improve handling of this error.
-    CHECK_OK(TrySchedulePendingRequests());
+    // No driver locks are held, so the callback may call back into the driver.
+    if (thermal_warning_callback) {
+      thermal_warning_callback();
+    }
+
+    if (schedule_more_requests) {
+      ReaderMutexLock state_reader_lock(&state_mutex_);
+      StdMutexLock submit_lock(&submit_mutex_);
+      // TODO Improve handling of this error.
+      CHECK_OK(TrySchedulePendingRequests());
+    }
   }
 }
 
+void Driver::NotifyThermalWarning() {
+  StdMutexLock lock(&scheduler_mutex_);
+  thermal_warning_pending_ = true;
+  scheduler_wakeup_.notify_one();
+}
+
 void Driver::HandleTpuRequestCompletion() {
+  // Only queued requests can be scheduled after a completion; P0 requests are
+  // submitted right away. Submit() tries to schedule after queueing a request,
+  // so one queued while this runs is not missed.
+  if (num_pending_requests_.load() == 0) {
+    return;
+  }
+
   StdMutexLock lock(&scheduler_mutex_);
   schedule_more_requests_ = true;
   scheduler_wakeup_.notify_one();
@@ -500,6 +578,7 @@ Status Driver::TrySchedulePendingRequests() {
         VLOG(5) << StringPrintf(
             "Request [%d]: All TPU requests are now submitted.", request->id());
         request_queue.pop();
+        num_pending_requests_.fetch_sub(1);
       }
     }
   }
@@ -542,6 +621,11 @@ StatusOr<bool> Driver::CanScheduleTpuRequest(
                         .ParameterCachingExecutableReference()
                         ->EstimatedCycles();
   }
+  const auto& package_ref = request->GetPackageReference();
+  total_cycles += HostToTpuTransferCycles(
+      InferenceTransferBytes(package_ref) +
+      (needs_parameter_caching ? ParameterCachingTransferBytes(package_ref)
+                               : 0));
 
   VLOG(7) << absl::StrFormat(
       "Request [%d]: Total cycles needed for scheduling a new inference: %lld, "
@@ -567,6 +651,7 @@ Status Driver::CancelAllPendingRequests() {
       RETURN_IF_ERROR(request->HandleTpuRequestsDone(
           CancelledError("Request cancelled."), remaining_tpu_requests));
       request_queue.pop();
+      num_pending_requests_.fetch_sub(1);
     }
   }
 
@@ -635,6 +720,11 @@ Status Driver::Close(api::Driver::ClosingMode mode) {
   // Note our intention to close.
   RETURN_IF_ERROR(SetState(kClosing));
 
+  // Stop changing clock rates before the device goes away.
+  if (thermal_monitor_) {
+    thermal_monitor_->Stop();
+  }
+
   // Before starting shutdown process in the lower layers of the stack, we
   // need to cancel all pending requests in the priority queue.
   RETURN_IF_ERROR(CancelAllPendingRequests());
@@ -664,10 +754,43 @@ void Driver::SetFatalErrorCallback(FatalErrorCallback callback) {
 }
 
 void Driver::SetThermalWarningCallback(ThermalWarningCallback callback) {
+  StdMutexLock lock(&scheduler_mutex_);
   thermal_warning_callback_ = std::move(callback);
 }
 
+void Driver::SetThermalSensor(std::unique_ptr<ThermalSensor> sensor) {
+  WriterMutexLock state_writer_lock(&state_mutex_);
+  CHECK_EQ(state_, kClosed);
+
+  // The monitor thread is joined while |state_mutex_| is held, so it must not
+  // wait on driver locks itself.
+  ThermalMonitor::SetPerformance set_performance;
+  if (HasImplementedPerformanceThrottling()) {
+    set_performance = [this](api::PerformanceExpectation performance) {
+      return DoSetPerformanceExpectation(performance);
+    };
+  }
+  thermal_monitor_ = gtl::MakeUnique<ThermalMonitor>(
+      thermal_monitor_options_, std::move(sensor), time_stamper_.get(),
+      performance_expectation_, std::move(set_performance),
+      [this]() { NotifyThermalWarning(); });
+}
+
+api::Driver::ThermalState Driver::GetThermalState() const {
+  ReaderMutexLock state_reader_lock(&state_mutex_);
+  if (!thermal_monitor_) {
+    return ThermalState();
+  }
+  return thermal_monitor_->GetState();
+}
+
 void Driver::NotifyFatalError(const Status& status) {
+  NotifyFatalError(status, ErrorRecord());
+}
+
+void Driver::NotifyFatalError(const Status& status, ErrorRecord record) {
+  RecordError(status, std::move(record));
+
   // Set error state.
   bool was_in_error = std::atomic_exchange(&in_error_, true);
   if (!was_in_error) {
@@ -680,8 +803,51 @@ void Driver::NotifyFatalError(const Status& status) {
   }
 }
 
+void Driver::SnapshotHibErrorCsrs(Registers* registers,
+                                  const config::HibUserCsrOffsets& offsets,
+                                  ErrorRecord* record) {
+  const std::pair<const char*, uint64> csrs[] = {
+      {"hib_error_status", offsets.hib_error_status},
+      {"hib_first_error_status", offsets.hib_first_error_status},
+      {"hib_first_error_timestamp", offsets.hib_first_error_timestamp},
+  };
+  for (const auto& csr : csrs) {
+    auto value_or_error = registers->Read(csr.second);
+    if (value_or_error.ok()) {
+      record->csr_snapshot.emplace_back(csr.first, value_or_error.ValueOrDie());
+    }
+  }
+}
+
+void Driver::RecordError(const Status& status, ErrorRecord record) {
+  record.timestamp_ns = time_stamper_->GetTimeNanoSeconds();
+  record.status_code = static_cast<int>(status.code());
+  record.message = std::string(status.message());
+
+  auto status_or_request = GetOldestActiveRequest();
+  if (status_or_request.ok()) {
+    const auto& request = status_or_request.ValueOrDie();
+    record.request_id = request->parent_id();
+    record.tpu_request_id = request->id();
+    const auto* name = request->executable_reference().executable().name();
+    if (name != nullptr) {
+      record.executable_name = name->str();
+    }
+  }
+
+  LOG(ERROR) << StringPrintf(
+      "Fatal error of class %d in request %d (%s): %s",
+      static_cast<int>(record.error_class), record.request_id,
+      record.executable_name.c_str(), record.message.c_str());
+  error_recorder_.Record(std::move(record));
+}
+
 void Driver::HandleWatchdogTimeout() {
   LOG(ERROR) << "Watchdog timed out. Collecting runtime metrics.";
+  ErrorRecord record;
+  record.error_class = ErrorClass::kWatchdogTimeout;
+  RecordError(DeadlineExceededError("Watchdog timed out."), std::move(record));
+
   auto status_or_request = GetOldestActiveRequest();
   if (!status_or_request.ok()) {
     // TODO: Log metric even if TpuRequest is not found.
@@ -713,6 +879,22 @@ void Driver::UpdateOperationalSettings(const OperationalSettings& settings) {
   operational_settings_ = settings;
 }
 
+api::Driver::OperationalSettings Driver::GetOperationalSettings() const {
+  StdMutexLock lock(&submit_mutex_);
+  return operational_settings_;
+}
+
+int64 Driver::HostToTpuTransferCycles(int64 size_bytes) const {
+  if (operational_settings_.host_to_tpu_bps <= 0 ||
+      operational_settings_.tpu_frequency_hz <= 0) {
+    return 0;
+  }
+
+  return static_cast<int64>(
+      size_bytes * static_cast<double>(operational_settings_.tpu_frequency_hz) /
+      operational_settings_.host_to_tpu_bps);
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
@@ -29,11 +29,17 @@
 #include "api/package_reference.h"
 #include "api/request.h"
 #include "api/telemeter_interface.h"
+#include "driver/config/hib_user_csr_offsets.h"
 #include "driver/default_telemeter.h"
 #include "driver/device_buffer_mapper.h"
+#include "driver/dma_statistics_recorder.h"
+#include "driver/error_recorder.h"
 #include "driver/memory/dma_direction.h"
 #include "driver/package_registry.h"
+#include "driver/registers/registers.h"
 #include "driver/request.h"
+#include "driver/thermal_monitor.h"
+#include "driver/thermal_sensor.h"
 #include "driver/tpu_request.h"
 #include "driver_shared/time_stamper/time_stamper.h"
 #include "executable/executable_generated.h"
@@ -95,7 +101,8 @@ class Driver : public api::Driver {
 
   void SetFatalErrorCallback(FatalErrorCallback callback) override;
 
-  void SetThermalWarningCallback(ThermalWarningCallback callback) override;
+  void SetThermalWarningCallback(ThermalWarningCallback callback)
+      LOCKS_EXCLUDED(scheduler_mutex_) override;
 
   Buffer MakeBuffer(size_t size_bytes) const override;
 
@@ -123,6 +130,29 @@ class Driver : public api::Driver {
   void UpdateOperationalSettings(const OperationalSettings& settings)
       LOCKS_EXCLUDED(submit_mutex_) override;
 
+  OperationalSettings GetOperationalSettings() const
+      LOCKS_EXCLUDED(submit_mutex_) override;
+
+  std::string GetLinkSpeed() const override { return std::string(); }
+
+  DmaStatistics GetDmaStatistics() const override {
+    return dma_statistics_recorder_.Get();
+  }
+
+  void ResetDmaStatistics() override { dma_statistics_recorder_.Reset(); }
+
+  ThermalState GetThermalState() const LOCKS_EXCLUDED(state_mutex_) override;
+
+  std::vector<ErrorRecord> GetErrorRecords() const override {
+    return error_recorder_.Get();
+  }
+
+  // Sets the sensor for monitoring die temperature of the device. The driver
+  // samples it while open, and steps the performance level down when the
+  // device runs hot and supports throttling. Must be called while closed.
+  void SetThermalSensor(std::unique_ptr<ThermalSensor> sensor)
+      LOCKS_EXCLUDED(state_mutex_);
+
  protected:
   Driver(api::Chip, std::unique_ptr<PackageRegistry> executable_registry,
          const api::DriverOptions& driver_options,
@@ -171,22 +201,55 @@ class Driver : public api::Driver {
 
   virtual Buffer DoMakeBuffer(size_t size_bytes) const = 0;
 
+  // Returns true if DoSetPerformanceExpectation() can change clock rates
+  // while requests are running. Otherwise the thermal monitor only reports
+  // thermal warnings.
+  virtual bool HasImplementedPerformanceThrottling() const { return false; }
+
+  // Changes clock rates of the device to the given performance level. Called
+  // by the thermal monitor while open.
+  virtual Status DoSetPerformanceExpectation(
+      api::PerformanceExpectation performance) {
+    return UnimplementedError("Unsupported operation");
+  }
+
   // Returns the upper bound estimation of driver on the number of cycles of
   // work remaining on the device.
   virtual int64 MaxRemainingCycles() const = 0;
 
-  // Notifies that the driver / device has entered an error state.
+  // Notifies that the driver / device has entered an error state. |record|
+  // carries what the caller knows about the error; the rest is filled in
+  // before it is kept for GetErrorRecords().
   void NotifyFatalError(const Status& status);
+  void NotifyFatalError(const Status& status, ErrorRecord record);
+
+  // Appends the HIB error CSRs at |offsets| to the snapshot of |record|. Best
+  // effort, registers may not be readable once the device has failed.
+  static void SnapshotHibErrorCsrs(Registers* registers,
+                                   const config::HibUserCsrOffsets& offsets,
+                                   ErrorRecord* record);
 
   // Unregisters all the currently registered models.
   Status UnregisterAll() { return executable_registry_->UnregisterAll(); }
 
+  // Sets whether packages registered from now on should use parameter caching
+  // when they also carry a stand-alone executable.
+  void SetPreferParameterCaching(bool prefer) {
+    executable_registry_->SetPreferParameterCaching(prefer);
+  }
+
   // Unmaps all mapped parameters. This method typically needs to get called
   // before closing the MMU mapper.
   Status UnmapAllParameters() {
     return executable_registry_->UnmapAllParameters();
   }
 
+  // Unmaps instruction buffers kept mapped across requests. Like parameters,
+  // they need to be unmapped before closing the MMU mapper.
+  Status UnmapAllInstructionBuffers() {
+    return executable_registry_->UnmapAllInstructionBuffers();
+  }
+
   // Handler for when TPU watchdog expires. This signals an unexpected state in
   // TPU.
   void HandleWatchdogTimeout();
@@ -196,11 +259,20 @@ class Driver : public api::Driver {
   // after MaxRemainingCycles is updated.
   void HandleTpuRequestCompletion();
 
+  // Returns true if the driver / device has entered an error state.
+  bool in_error() const { return in_error_; }
+
   // Get the telemeter interface pointer.
   api::TelemeterInterface* GetTelemeterInterface() {
     return telemeter_interface_;
   }
 
+  // Returns the recorder that sub-classes report completed DMAs and transfers
+  // to.
+  DmaStatisticsRecorder* GetDmaStatisticsRecorder() {
+    return &dma_statistics_recorder_;
+  }
+
   // Returns the oldest submitted request that's still active.
   virtual StatusOr<std::shared_ptr<TpuRequest>> GetOldestActiveRequest()
       const = 0;
@@ -276,13 +348,25 @@ class Driver : public api::Driver {
       SHARED_LOCKS_REQUIRED(state_mutex_)
           EXCLUSIVE_LOCKS_REQUIRED(submit_mutex_);
 
+  // Returns the estimated number of TPU cycles it takes to move size_bytes
+  // from host to TPU, based on operational settings. Returns 0 if host-to-TPU
+  // bandwidth is not known.
+  int64 HostToTpuTransferCycles(int64 size_bytes) const
+      EXCLUSIVE_LOCKS_REQUIRED(submit_mutex_);
+
   // Updates scheduler with static timing estimation from registered executable.
   Status UpdateInitialTiming(const api::PackageReference* api_package_reference)
       LOCKS_EXCLUDED(submit_mutex_);
 
+  // Fills in the time, status and active request of |record|, and keeps it.
+  void RecordError(const Status& status, ErrorRecord record);
+
   // Runs the scheduler thread.
   void SchedulerWorker();
 
+  // Has the scheduler thread invoke the thermal warning callback.
+  void NotifyThermalWarning() LOCKS_EXCLUDED(scheduler_mutex_);
+
   // Maintains integrity of the driver state.
   mutable SharedMutex state_mutex_;
 
@@ -302,11 +386,26 @@ class Driver : public api::Driver {
   // Driver clock for timestamp reporting
   std::unique_ptr<driver_shared::TimeStamper> time_stamper_;
 
+  // Accounting of DMA traffic. Uses |time_stamper_|.
+  DmaStatisticsRecorder dma_statistics_recorder_;
+
   // Registered fatal Error Callback.
   FatalErrorCallback fatal_error_callback_;
 
-  // Registered thermal warning Callback.
-  ThermalWarningCallback thermal_warning_callback_;
+  // Most recent fatal errors.
+  static constexpr int kMaxErrorRecords = 32;
+  ErrorRecorder error_recorder_{kMaxErrorRecords};
+
+  // Registered thermal warning Callback. Invoked from the scheduler thread, so
+  // that it can call back into the driver.
+  ThermalWarningCallback thermal_warning_callback_ GUARDED_BY(scheduler_mutex_);
+
+  // Thermal monitoring settings from driver options.
+  const ThermalMonitor::Options thermal_monitor_options_;
+  const api::PerformanceExpectation performance_expectation_;
+
+  // Samples die temperature while open. Null if the device has no sensor.
+  std::unique_ptr<ThermalMonitor> thermal_monitor_ GUARDED_BY(state_mutex_);
 
   // True, if device is in error state.
   std::atomic<bool> in_error_{false};
@@ -354,7 +453,14 @@ class Driver : public api::Driver {
   // are always 0 or larger and the larger the number the lower the priority.
   std::map<int, std::queue<std::shared_ptr<Request>>> pending_requests_;
 
-  // The thread that runs scheduler for pending requests.
+  // Number of requests in |pending_requests_|. Only changes under
+  // submit_mutex_, but is read without it so that TPU request completions do
+  // not wake the scheduler, which then contends with submitters for
+  // submit_mutex_, while no request is waiting.
+  std::atomic<int> num_pending_requests_{0};
+
+  // The thread that runs scheduler for pending requests, and thermal warning
+  // callbacks.
   std::thread scheduler_thread_;
 
   // Mutex to protect scheduler state.
@@ -368,6 +474,9 @@ class Driver : public api::Driver {
   // if scheduling constraints are met of course).
   bool schedule_more_requests_ GUARDED_BY(scheduler_mutex_){false};
 
+  // If the thermal warning callback is due.
+  bool thermal_warning_pending_ GUARDED_BY(scheduler_mutex_){false};
+
   // If we are destructing the class. This is used for the scheduler thread to
   // know when to quit.
   bool destructing_ GUARDED_BY(scheduler_mutex_){false};
@@ -0,0 +1,161 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures submitter throughput under the locking of Driver's submit and
+// completion paths for P0 requests. Submitters take state_mutex_ shared and
+// submit_mutex_, and a fake device completes every request right away. The
+// completion wakes the scheduler thread, which takes the same locks to scan
+// the priority queues, either always or only when requests are queued.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <cstdio>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "port/gflags.h"
+#include "port/integral_types.h"
+#include "port/shared_mutex.h"
+#include "port/std_mutex_lock.h"
+#include "port/thread_annotations.h"
+
+ABSL_FLAG(int, requests_per_thread, 200000,
+          "Number of requests each submitter thread submits.");
+ABSL_FLAG(int, max_threads, 8, "Largest number of submitter threads.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+// The locks of Driver on the P0 submit and completion paths.
+class FakeDriver {
+ public:
+  // |wake_when_idle| wakes the scheduler on every completion, as before
+  // completions checked for queued requests.
+  explicit FakeDriver(bool wake_when_idle) : wake_when_idle_(wake_when_idle) {
+    scheduler_thread_ = std::thread([this]() { SchedulerWorker(); });
+  }
+
+  ~FakeDriver() {
+    {
+      StdMutexLock scheduler_lock(&scheduler_mutex_);
+      destructing_ = true;
+      scheduler_wakeup_.notify_one();
+    }
+    scheduler_thread_.join();
+  }
+
+  void Submit() {
+    {
+      ReaderMutexLock state_reader_lock(&state_mutex_);
+      StdMutexLock submit_lock(&submit_mutex_);
+      ++num_submitted_;
+    }
+
+    // The fake device completes the request right away.
+    HandleTpuRequestCompletion();
+  }
+
+  int64 num_scheduler_passes() const { return num_scheduler_passes_.load(); }
+
+ private:
+  void HandleTpuRequestCompletion() {
+    if (!wake_when_idle_ && num_pending_requests_.load() == 0) {
+      return;
+    }
+
+    StdMutexLock lock(&scheduler_mutex_);
+    schedule_more_requests_ = true;
+    scheduler_wakeup_.notify_one();
+  }
+
+  void SchedulerWorker() {
+    while (true) {
+      {
+        StdCondMutexLock lock(&scheduler_mutex_);
+        while (!schedule_more_requests_ && !destructing_) {
+          scheduler_wakeup_.wait(lock);
+        }
+        if (destructing_) {
+          return;
+        }
+        schedule_more_requests_ = false;
+      }
+
+      // Scans the priority queues, which only ever hold P0 requests here.
+      ReaderMutexLock state_reader_lock(&state_mutex_);
+      StdMutexLock submit_lock(&submit_mutex_);
+      ++num_scheduler_passes_;
+    }
+  }
+
+  const bool wake_when_idle_;
+
+  SharedMutex state_mutex_;
+  std::mutex submit_mutex_;
+  int64 num_submitted_ GUARDED_BY(submit_mutex_){0};
+  std::atomic<int> num_pending_requests_{0};
+
+  std::mutex scheduler_mutex_;
+  std::condition_variable scheduler_wakeup_;
+  bool schedule_more_requests_ GUARDED_BY(scheduler_mutex_){false};
+  bool destructing_ GUARDED_BY(scheduler_mutex_){false};
+  std::atomic<int64> num_scheduler_passes_{0};
+  std::thread scheduler_thread_;
+};
+
+int Run() {
+  const int requests_per_thread = absl::GetFlag(FLAGS_requests_per_thread);
+  for (int num_threads = 1; num_threads <= absl::GetFlag(FLAGS_max_threads);
+       num_threads *= 2) {
+    for (const bool wake_when_idle : {true, false}) {
+      FakeDriver driver(wake_when_idle);
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&driver, requests_per_thread]() {
+          for (int j = 0; j < requests_per_thread; ++j) {
+            driver.Submit();
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      printf("%d threads, %-22s %7.2f M requests/s, %lld scheduler passes.\n",
+             num_threads,
+             wake_when_idle ? "wake on completion:" : "wake only if queued:",
+             num_threads * requests_per_thread / elapsed.count() / 1e6,
+             static_cast<long long>(  // NOLINT(runtime/int)
+                 driver.num_scheduler_passes()));
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
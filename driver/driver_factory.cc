@@ -47,9 +47,9 @@ std::vector<api::Device> DriverFactory::Enumerate() {
   StdMutexLock lock(&mutex_);
 
   std::vector<api::Device> device_list;
-  for (auto& provider : providers_) {
-    auto provider_supported_devices = provider->Enumerate();
-    for (auto& device : provider_supported_devices) {
+  for (auto& entry : providers_) {
+    const auto& provider_supported_devices = GetDevices(entry.get());
+    for (const auto& device : provider_supported_devices) {
       device_list.push_back(device);
     }
   }
@@ -57,6 +57,26 @@ std::vector<api::Device> DriverFactory::Enumerate() {
   return device_list;
 }
 
+const std::vector<api::Device>& DriverFactory::GetDevices(
+    ProviderEntry* entry) {
+  // Start watching lazily, as providers are registered during static
+  // initialization.
+  if (!entry->watch_started) {
+    entry->watch_started = true;
+    entry->watcher =
+        entry->provider->WatchDevices([entry] { entry->stale = true; });
+    VLOG(5) << (entry->watcher ? "Watching" : "Not watching")
+            << " devices of driver provider.";
+  }
+
+  // Clear the flag before enumerating, so that changes during enumeration
+  // trigger another one.
+  if (entry->watcher == nullptr || entry->stale.exchange(false)) {
+    entry->devices = entry->provider->Enumerate();
+  }
+  return entry->devices;
+}
+
 StatusOr<std::unique_ptr<api::Driver>> DriverFactory::CreateDriver(
     const api::Device& device) {
   return CreateDriver(device, api::DriverOptionsHelper::Defaults());
@@ -64,8 +84,6 @@ StatusOr<std::unique_ptr<api::Driver>> DriverFactory::CreateDriver(
 
 StatusOr<std::unique_ptr<api::Driver>> DriverFactory::CreateDriver(
     const api::Device& device, const api::Driver::Options& opaque_options) {
-  StdMutexLock lock(&mutex_);
-
   // Deserialize options.
   const api::DriverOptions* options =
       api::GetDriverOptions(opaque_options.data());
@@ -85,40 +103,61 @@ StatusOr<std::unique_ptr<api::Driver>> DriverFactory::CreateDriver(
   }
 #endif  // !DARWINN_PORT_USE_GOOGLE3
 
-  for (auto& provider : providers_) {
-    // Skip if the provider cannot create driver for this device spec.
-    if (!provider->CanCreate(device)) {
-      continue;
-    }
+  DriverProvider* provider = nullptr;
+  api::Device target_device = device;
+  std::shared_ptr<std::mutex> creation_mutex;
+  {
+    StdMutexLock lock(&mutex_);
+    for (auto& entry : providers_) {
+      // Skip if the provider cannot create driver for this device spec.
+      if (!entry->provider->CanCreate(device)) {
+        continue;
+      }
+
+      // Always invoke only the first provider which claims the ability.
+      if (device.path != kDefaultDevicePath) {
+        provider = entry->provider.get();
+        break;
+      }
 
-    // Always invoke only the first provider which claims the ability.
-    if (device.path != kDefaultDevicePath) {
-      return provider->CreateDriver(device, *options);
+      // Pick the first matching device known to this provider, if any.
+      for (const auto& provider_device : GetDevices(entry.get())) {
+        if (device.chip == provider_device.chip &&
+            device.type == provider_device.type) {
+          provider = entry->provider.get();
+          target_device = provider_device;
+          break;
+        }
+      }
+      if (provider != nullptr) {
+        break;
+      }
     }
 
-    // Try to enumerate with this provider.
-    std::vector<api::Device> device_list = provider->Enumerate();
-    // Skip this provider if there is no any device.
-    if (device_list.empty()) {
-      continue;
+    if (provider == nullptr) {
+      return NotFoundError("Unable to construct driver for device.");
     }
 
-    // Create driver associated with the device in the resulting list.
-    for (const auto& provider_device : device_list) {
-      if (device.chip == provider_device.chip &&
-          device.type == provider_device.type) {
-        return provider->CreateDriver(provider_device, *options);
-      }
+    auto& device_mutex = creation_mutexes_[target_device.path];
+    if (device_mutex == nullptr) {
+      device_mutex = std::make_shared<std::mutex>();
     }
+    creation_mutex = device_mutex;
   }
 
-  return NotFoundError("Unable to construct driver for device.");
+  // Providers are never removed, so the provider can be used without holding
+  // mutex_. Only creation for the same device is serialized.
+  StdMutexLock creation_lock(creation_mutex.get());
+  return provider->CreateDriver(target_device, *options);
 }
 
 void DriverFactory::RegisterDriverProvider(
     std::unique_ptr<DriverProvider> provider) {
+  auto entry = gtl::MakeUnique<ProviderEntry>();
+  entry->provider = std::move(provider);
+
   StdMutexLock lock(&mutex_);
-  providers_.push_back(std::move(provider));
+  providers_.push_back(std::move(entry));
 }
 
 DriverFactory* DriverFactory::GetOrCreate() {
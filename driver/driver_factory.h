@@ -15,10 +15,13 @@
 #ifndef DARWINN_DRIVER_DRIVER_FACTORY_H_
 #define DARWINN_DRIVER_DRIVER_FACTORY_H_
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include "api/chip.h"
@@ -33,6 +36,18 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+// Watches for devices being added or removed in the background, until
+// destroyed.
+class DeviceWatcher {
+ public:
+  DeviceWatcher() = default;
+  virtual ~DeviceWatcher() = default;
+
+  // This class is neither copyable nor movable.
+  DeviceWatcher(const DeviceWatcher&) = delete;
+  DeviceWatcher& operator=(const DeviceWatcher&) = delete;
+};
+
 // Interface for a class that can provide a Driver implementation.
 //
 // Once implemented, driver providers needs to be registered with the
@@ -57,6 +72,15 @@ class DriverProvider {
   // Enumerates all devices available through this provider.
   virtual std::vector<api::Device> Enumerate() = 0;
 
+  // Starts watching for devices available through this provider being added or
+  // removed, and calls on_change, from any thread, after every such change.
+  // Returns nullptr if the provider cannot watch its devices, in which case
+  // Enumerate is called every time devices are enumerated.
+  virtual std::unique_ptr<DeviceWatcher> WatchDevices(
+      std::function<void()> on_change) {
+    return nullptr;
+  }
+
   // Returns true, if the factory can create driver for given device.
   virtual bool CanCreate(const api::Device& device) = 0;
 
@@ -79,9 +103,18 @@ class DriverProvider {
                                             const std::string& device_name,
                                             api::Chip chip,
                                             api::Device::Type type);
+
+  // Helper function that watches for device files named /dev/<device_name>*
+  // being created or removed. Returns nullptr if not supported on this
+  // platform.
+  std::unique_ptr<DeviceWatcher> WatchDeviceFiles(
+      const std::string& device_name, std::function<void()> on_change);
 };
 
-// Enumerates devices and creates drivers for those devices.
+// Enumerates devices and creates drivers for those devices. Devices of
+// providers which can watch them are enumerated once, and then only again after
+// a device is added or removed. Drivers for different devices are created
+// concurrently.
 class DriverFactory : public api::DriverFactory {
  public:
   // Creates or returns the singleton instance of the driver factory.
@@ -111,13 +144,41 @@ class DriverFactory : public api::DriverFactory {
       LOCKS_EXCLUDED(mutex_);
 
  private:
+  // A registered driver provider, along with its known devices.
+  struct ProviderEntry {
+    std::unique_ptr<DriverProvider> provider;
+
+    // Devices last enumerated through the provider.
+    std::vector<api::Device> devices;
+
+    // True if devices must be enumerated again. Set by the watcher.
+    std::atomic<bool> stale{true};
+
+    // True once watching has been attempted.
+    bool watch_started{false};
+
+    // Watches devices of the provider, or nullptr if they cannot be watched.
+    // Declared last, so it is stopped before anything it refers to goes away.
+    std::unique_ptr<DeviceWatcher> watcher;
+  };
+
   // Constructor.
   DriverFactory() = default;
 
-  // Container for all registered driver providers.
-  std::vector<std::unique_ptr<DriverProvider>> providers_ GUARDED_BY(mutex_);
+  // Returns devices of the given provider, enumerating them again if they may
+  // have changed.
+  const std::vector<api::Device>& GetDevices(ProviderEntry* entry)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Container for all registered driver providers. Entries are never removed.
+  std::vector<std::unique_ptr<ProviderEntry>> providers_ GUARDED_BY(mutex_);
+
+  // Serializes creation of drivers for the same device, keyed by device path.
+  std::unordered_map<std::string, std::shared_ptr<std::mutex>>
+      creation_mutexes_ GUARDED_BY(mutex_);
 
-  // Maintains integrity of providers_.
+  // Maintains integrity of providers_ and creation_mutexes_. Not held while
+  // drivers are created.
   mutable std::mutex mutex_;
 };
 
@@ -15,11 +15,90 @@
 #include "driver/driver_factory.h"
 
 #include <dirent.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>  // NOLINT
+
+#include "port/ptr_util.h"
 
 namespace platforms {
 namespace darwinn {
 namespace driver {
+namespace {
+
+// Watches /dev for device files being created or removed, using inotify.
+class DeviceFileWatcher : public DeviceWatcher {
+ public:
+  DeviceFileWatcher(int inotify_fd, int stop_fd,
+                    const std::string& device_name,
+                    std::function<void()> on_change)
+      : inotify_fd_(inotify_fd),
+        stop_fd_(stop_fd),
+        device_name_(device_name),
+        on_change_(std::move(on_change)) {
+    thread_ = std::thread([this] { Run(); });
+  }
+
+  ~DeviceFileWatcher() override {
+    const uint64_t stop = 1;
+    if (write(stop_fd_, &stop, sizeof(stop)) != sizeof(stop)) {
+      LOG(ERROR) << "Failed to stop watching device files: " << strerror(errno);
+    }
+    thread_.join();
+    close(stop_fd_);
+    close(inotify_fd_);
+  }
+
+ private:
+  // Blocks until device files change or stop_fd_ is signaled.
+  void Run() {
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+      struct pollfd poll_fds[] = {{inotify_fd_, POLLIN, 0},
+                                  {stop_fd_, POLLIN, 0}};
+      if (poll(poll_fds, 2, /*timeout=*/-1) <= 0) {
+        continue;
+      }
+      if (poll_fds[1].revents != 0) {
+        return;
+      }
+
+      const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+      bool changed = false;
+      for (ssize_t offset = 0; offset < length;) {
+        const auto* event =
+            reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        if ((event->mask & IN_Q_OVERFLOW) ||
+            (event->len > 0 && strncmp(event->name, device_name_.c_str(),
+                                       device_name_.size()) == 0)) {
+          changed = true;
+        }
+        offset += sizeof(struct inotify_event) + event->len;
+      }
+
+      if (changed) {
+        VLOG(5) << "Device files of " << device_name_ << " changed.";
+        on_change_();
+      }
+    }
+  }
+
+  const int inotify_fd_;
+
+  // Event file signaled to stop watching.
+  const int stop_fd_;
+
+  const std::string device_name_;
+  const std::function<void()> on_change_;
+  std::thread thread_;
+};
+
+}  // namespace
 
 std::vector<api::Device> DriverProvider::EnumerateByClass(
     const std::string& class_name, const std::string& device_name,
@@ -59,6 +138,34 @@ std::vector<api::Device> DriverProvider::EnumerateByClass(
   return device_list;
 }
 
+std::unique_ptr<DeviceWatcher> DriverProvider::WatchDeviceFiles(
+    const std::string& device_name, std::function<void()> on_change) {
+  const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    VLOG(1) << "Failed to initialize inotify: " << strerror(errno);
+    return nullptr;
+  }
+
+  // Device files may be created before their permissions are set, so changes
+  // to attributes count as well.
+  if (inotify_add_watch(inotify_fd, "/dev",
+                        IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+    VLOG(1) << "Failed to watch /dev: " << strerror(errno);
+    close(inotify_fd);
+    return nullptr;
+  }
+
+  const int stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (stop_fd < 0) {
+    VLOG(1) << "Failed to create eventfd: " << strerror(errno);
+    close(inotify_fd);
+    return nullptr;
+  }
+
+  return gtl::MakeUnique<DeviceFileWatcher>(inotify_fd, stop_fd, device_name,
+                                            std::move(on_change));
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
@@ -80,6 +80,12 @@ std::vector<api::Device> DriverProvider::EnumerateByClass(
   return device_list;
 }
 
+std::unique_ptr<DeviceWatcher> DriverProvider::WatchDeviceFiles(
+    const std::string& device_name, std::function<void()> on_change) {
+  VLOG(5) << "Watching device files is not supported on Windows.";
+  return nullptr;
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
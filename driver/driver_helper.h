@@ -153,6 +153,26 @@ class DriverHelper : public api::Driver {
     driver_->UpdateOperationalSettings(settings);
   }
 
+  OperationalSettings GetOperationalSettings() const override {
+    return driver_->GetOperationalSettings();
+  }
+
+  std::string GetLinkSpeed() const override { return driver_->GetLinkSpeed(); }
+
+  DmaStatistics GetDmaStatistics() const override {
+    return driver_->GetDmaStatistics();
+  }
+
+  void ResetDmaStatistics() override { driver_->ResetDmaStatistics(); }
+
+  ThermalState GetThermalState() const override {
+    return driver_->GetThermalState();
+  }
+
+  std::vector<ErrorRecord> GetErrorRecords() const override {
+    return driver_->GetErrorRecords();
+  }
+
  private:
   // Wrapped driver instance.
   std::unique_ptr<api::Driver> driver_;
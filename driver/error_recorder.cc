@@ -0,0 +1,46 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/error_recorder.h"
+
+#include <utility>
+
+#include "port/logging.h"
+#include "port/std_mutex_lock.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+ErrorRecorder::ErrorRecorder(int capacity) : capacity_(capacity) {
+  CHECK_GT(capacity, 0);
+}
+
+void ErrorRecorder::Record(api::Driver::ErrorRecord record) {
+  StdMutexLock lock(&mutex_);
+  if (static_cast<int>(records_.size()) == capacity_) {
+    records_.pop_front();
+  }
+  records_.push_back(std::move(record));
+}
+
+std::vector<api::Driver::ErrorRecord> ErrorRecorder::Get() const {
+  StdMutexLock lock(&mutex_);
+  return std::vector<api::Driver::ErrorRecord>(records_.begin(),
+                                               records_.end());
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,60 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_ERROR_RECORDER_H_
+#define DARWINN_DRIVER_ERROR_RECORDER_H_
+
+#include <deque>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "api/driver.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Keeps the most recent fatal error records of a device, dropping the oldest
+// once full. Thread-safe.
+class ErrorRecorder {
+ public:
+  explicit ErrorRecorder(int capacity);
+
+  // This class is neither copyable nor movable.
+  ErrorRecorder(const ErrorRecorder&) = delete;
+  ErrorRecorder& operator=(const ErrorRecorder&) = delete;
+
+  ~ErrorRecorder() = default;
+
+  // Adds a record.
+  void Record(api::Driver::ErrorRecord record) LOCKS_EXCLUDED(mutex_);
+
+  // Returns the kept records, oldest first.
+  std::vector<api::Driver::ErrorRecord> Get() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  // Maximum number of records kept.
+  const int capacity_;
+
+  mutable std::mutex mutex_;
+
+  std::deque<api::Driver::ErrorRecord> records_ GUARDED_BY(mutex_);
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_ERROR_RECORDER_H_
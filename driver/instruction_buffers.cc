@@ -14,6 +14,9 @@
 
 #include "driver/instruction_buffers.h"
 
+#include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "driver/aligned_allocator.h"
@@ -21,6 +24,8 @@
 #include "driver/executable_util.h"
 #include "executable/executable_generated.h"
 #include "port/logging.h"
+#include "port/status_macros.h"
+#include "port/stringprintf.h"
 #include "port/tracing.h"
 
 namespace platforms {
@@ -31,90 +36,270 @@ using ::flatbuffers::Offset;
 using ::flatbuffers::Vector;
 using ::flatbuffers::VectorLength;
 
-InstructionBuffers::InstructionBuffers(
+namespace {
+
+// Returns device addresses of the given named device buffers.
+std::map<std::string, std::vector<uint64>> GetAddresses(
+    const DeviceBuffer::NamedMap& device_buffers) {
+  std::map<std::string, std::vector<uint64>> addresses;
+  for (const auto& name_and_buffers : device_buffers) {
+    auto& layer_addresses = addresses[name_and_buffers.first];
+    for (const auto& device_buffer : name_and_buffers.second) {
+      layer_addresses.push_back(device_buffer.device_address());
+    }
+  }
+  return addresses;
+}
+
+// Returns the address of the given device buffer, or 0 if invalid.
+uint64 GetAddress(const DeviceBuffer& device_buffer) {
+  return device_buffer.IsValid() ? device_buffer.device_address() : 0;
+}
+
+}  // namespace
+
+InstructionBuffers::ChunkLinks InstructionBuffers::GetChunkLinks(
+    const InstructionBitstream& chunk) {
+  ChunkLinks links;
+  if (chunk.field_offsets() == nullptr) {
+    return links;
+  }
+
+  for (const auto* field_offset : *chunk.field_offsets()) {
+    const auto* meta = field_offset->meta();
+    switch (meta->desc()) {
+      case Description_BASE_ADDRESS_SCRATCH:
+        links.scratch = true;
+        break;
+      case Description_BASE_ADDRESS_PARAMETER:
+        links.parameter = true;
+        break;
+      case Description_BASE_ADDRESS_INPUT_ACTIVATION:
+        links.inputs.insert(meta->name()->str());
+        break;
+      case Description_BASE_ADDRESS_OUTPUT_ACTIVATION:
+        links.outputs.insert(meta->name()->str());
+        break;
+    }
+  }
+  return links;
+}
+
+std::vector<Buffer> InstructionBuffers::CopyUnlinkedChunks(
     Allocator* const allocator,
     const Vector<Offset<InstructionBitstream>>& instruction_bitstreams) {
-  // Allocate and create an aligned copy of instruction bitstream.
-  buffers_.reserve(VectorLength(&instruction_bitstreams));
-
-  for (const auto& chunk : instruction_bitstreams) {
-    auto buffer = allocator->MakeBuffer(chunk->bitstream()->size());
-    buffers_.push_back(std::move(buffer));
-    memcpy(buffers_.back().ptr(), chunk->bitstream()->data(),
-           chunk->bitstream()->size());
+  const int num_chunks = VectorLength(&instruction_bitstreams);
+  std::vector<Buffer> unlinked_chunks(num_chunks);
+
+  for (int i = 0; i < num_chunks; ++i) {
+    const auto* chunk = instruction_bitstreams.Get(i);
+    if (!IsUnlinked(GetChunkLinks(*chunk))) {
+      continue;
+    }
+
+    // The bitstream in the package has no alignment guarantee.
+    const auto* bitstream = chunk->bitstream();
+    unlinked_chunks[i] = allocator->MakeBuffer(bitstream->size());
+    memcpy(unlinked_chunks[i].ptr(), bitstream->data(), bitstream->size());
+  }
+  return unlinked_chunks;
+}
+
+InstructionBuffers::InstructionBuffers(
+    Allocator* const allocator, const std::vector<Buffer>& unlinked_chunks,
+    const Vector<Offset<InstructionBitstream>>& instruction_bitstreams) {
+  const int num_chunks = VectorLength(&instruction_bitstreams);
+  CHECK_EQ(unlinked_chunks.size(), num_chunks);
+  buffers_.reserve(num_chunks);
+  mappings_.resize(num_chunks);
+  chunk_links_.resize(num_chunks);
+
+  for (int i = 0; i < num_chunks; ++i) {
+    const auto* chunk = instruction_bitstreams.Get(i);
+    const auto* bitstream = chunk->bitstream();
+    chunk_links_[i] = GetChunkLinks(*chunk);
+
+    if (IsUnlinked(chunk_links_[i])) {
+      // Nothing to link, share the aligned copy made for the executable.
+      CHECK(unlinked_chunks[i].IsValid());
+      buffers_.push_back(unlinked_chunks[i]);
+      continue;
+    }
+
+    // Allocate and create an aligned copy of instruction bitstream.
+    buffers_.push_back(allocator->MakeBuffer(bitstream->size()));
+    memcpy(buffers_.back().ptr(), bitstream->data(), bitstream->size());
   }
   VLOG(10) << "InstructionBuffers created.";
 }
 
 InstructionBuffers::~InstructionBuffers() {
+  const Status status = Unmap();
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to unmap instruction buffers: " << status;
+  }
   buffers_.clear();
   VLOG(10) << "InstructionBuffers destroyed.";
 }
 
-void InstructionBuffers::LinkInstructionBuffers(
+int64 InstructionBuffers::LinkedChunkBytes() const {
+  int64 size_bytes = 0;
+  for (int i = 0; i < buffers_.size(); ++i) {
+    if (!IsUnlinked(chunk_links_[i])) {
+      size_bytes += buffers_[i].size_bytes();
+    }
+  }
+  return size_bytes;
+}
+
+Status InstructionBuffers::UnmapChunk(int chunk) {
+  if (mappings_[chunk].device_buffer().IsValid()) {
+    RETURN_IF_ERROR(mappings_[chunk].Unmap());
+    mappings_[chunk] = MappedDeviceBuffer();
+  }
+  return Status();  // OK
+}
+
+Status InstructionBuffers::LinkInstructionBuffers(
     const DeviceBuffer& parameter_device_buffer,
     DeviceBufferMapper* device_buffer_mapper,
     const Vector<Offset<InstructionBitstream>>& instruction_bitstreams) {
   TRACE_SCOPE("InstructionBuffers::LinkInstructionBuffers");
 
+  LinkedAddresses addresses;
+  addresses.scratch =
+      GetAddress(device_buffer_mapper->GetScratchDeviceBuffer());
+  addresses.parameter = GetAddress(parameter_device_buffer);
+  addresses.inputs =
+      GetAddresses(device_buffer_mapper->GetInputDeviceBuffers());
+  addresses.outputs =
+      GetAddresses(device_buffer_mapper->GetOutputDeviceBuffers());
+
+  // If linking fails midway, chunks may not match |linked_addresses_|
+  // anymore, and everything is linked again in the next call.
+  const bool link_all = !linked_;
+  linked_ = false;
+
+  // Returns true if the given layer has to be linked to new addresses.
+  const auto layer_changed =
+      [link_all](const std::map<std::string, std::vector<uint64>>& new_addresses,
+             const std::map<std::string, std::vector<uint64>>& old_addresses,
+             const std::string& name) {
+        const auto new_it = new_addresses.find(name);
+        if (new_it == new_addresses.end()) {
+          return false;
+        }
+        const auto old_it = old_addresses.find(name);
+        return link_all || old_it == old_addresses.end() ||
+               old_it->second != new_it->second;
+      };
+
   // Update the instruction stream to link the input, output and parameter
   // addresses.
   for (int i = 0; i < VectorLength(&instruction_bitstreams); ++i) {
-    // Link scratch address if necessary.
-    // Note: we may be able to optimize this scratch address linking like the
-    // parameters below, so that we don't re-link it every time since we have
-    // more control on the scratch memory and could keep it at the same address.
-    // It's unclear how easy to make this change at this point though, and we
-    // could revisit this later if needed (yuchicheng).
-    if (device_buffer_mapper->GetScratchDeviceBuffer().IsValid()) {
-      ExecutableUtil::LinkScratchAddress(
-          device_buffer_mapper->GetScratchDeviceBuffer().device_address(),
-          instruction_bitstreams.Get(i)->field_offsets(),
-          gtl::MutableArraySlice<uint8>(
-              buffers_[i].ptr(),
-              VectorLength(instruction_bitstreams.Get(i)->bitstream())));
+    const ChunkLinks& links = chunk_links_[i];
+    const bool link_scratch =
+        links.scratch && addresses.scratch != 0 &&
+        (link_all || addresses.scratch != linked_addresses_.scratch);
+    const bool link_parameter =
+        links.parameter && addresses.parameter != 0 &&
+        (link_all || addresses.parameter != linked_addresses_.parameter);
+    std::vector<std::string> link_inputs;
+    for (const auto& name : links.inputs) {
+      if (layer_changed(addresses.inputs, linked_addresses_.inputs, name)) {
+        link_inputs.push_back(name);
+      }
+    }
+    std::vector<std::string> link_outputs;
+    for (const auto& name : links.outputs) {
+      if (layer_changed(addresses.outputs, linked_addresses_.outputs, name)) {
+        link_outputs.push_back(name);
+      }
     }
 
-    // Link parameters if necessary.
-    if (parameter_device_buffer.IsValid()) {
-      const uint64 linked_parameter_address =
-          parameter_device_buffer.device_address();
-      ExecutableUtil::LinkParameterAddress(
-          linked_parameter_address,
-          instruction_bitstreams.Get(i)->field_offsets(),
-          gtl::MutableArraySlice<uint8>(
-              buffers_[i].ptr(),
-              VectorLength(instruction_bitstreams.Get(i)->bitstream())));
+    if (!link_scratch && !link_parameter && link_inputs.empty() &&
+        link_outputs.empty()) {
+      continue;
     }
 
-    for (const auto& name_and_mapped_input :
-         device_buffer_mapper->GetInputDeviceBuffers()) {
-      std::vector<uint64> linked_input_addresses;
-      for (const auto& mapped_input : name_and_mapped_input.second) {
-        linked_input_addresses.push_back(mapped_input.device_address());
-      }
-      ExecutableUtil::LinkInputAddress(
-          name_and_mapped_input.first, linked_input_addresses,
-          instruction_bitstreams.Get(i)->field_offsets(),
-          gtl::MutableArraySlice<uint8>(
-              buffers_[i].ptr(),
-              VectorLength(instruction_bitstreams.Get(i)->bitstream())));
+    // Modifications to a mapped chunk may not be visible to the device due to
+    // cache coherency issues. Unmap it here so it is mapped again afterwards.
+    RETURN_IF_ERROR(UnmapChunk(i));
+
+    const auto* chunk = instruction_bitstreams.Get(i);
+    gtl::MutableArraySlice<uint8> encoded_buffer(
+        buffers_[i].ptr(), VectorLength(chunk->bitstream()));
+
+    if (link_scratch) {
+      ExecutableUtil::LinkScratchAddress(addresses.scratch,
+                                         chunk->field_offsets(),
+                                         encoded_buffer);
     }
 
-    for (const auto& name_and_mapped_output :
-         device_buffer_mapper->GetOutputDeviceBuffers()) {
-      std::vector<uint64> linked_output_addresses;
-      for (const auto& mapped_output : name_and_mapped_output.second) {
-        linked_output_addresses.push_back(mapped_output.device_address());
-      }
-      ExecutableUtil::LinkOutputAddress(
-          name_and_mapped_output.first, linked_output_addresses,
-          instruction_bitstreams.Get(i)->field_offsets(),
-          gtl::MutableArraySlice<uint8>(
-              buffers_[i].ptr(),
-              VectorLength(instruction_bitstreams.Get(i)->bitstream())));
+    if (link_parameter) {
+      ExecutableUtil::LinkParameterAddress(addresses.parameter,
+                                           chunk->field_offsets(),
+                                           encoded_buffer);
+    }
+
+    for (const auto& name : link_inputs) {
+      ExecutableUtil::LinkInputAddress(name, addresses.inputs[name],
+                                       chunk->field_offsets(), encoded_buffer);
+    }
+
+    for (const auto& name : link_outputs) {
+      ExecutableUtil::LinkOutputAddress(name, addresses.outputs[name],
+                                        chunk->field_offsets(),
+                                        encoded_buffer);
     }
   }
+
+  // Layers not linked in this call keep the addresses they were linked to.
+  for (auto& name_and_addresses : addresses.inputs) {
+    linked_addresses_.inputs[name_and_addresses.first] =
+        std::move(name_and_addresses.second);
+  }
+  for (auto& name_and_addresses : addresses.outputs) {
+    linked_addresses_.outputs[name_and_addresses.first] =
+        std::move(name_and_addresses.second);
+  }
+  if (addresses.scratch != 0) {
+    linked_addresses_.scratch = addresses.scratch;
+  }
+  if (addresses.parameter != 0) {
+    linked_addresses_.parameter = addresses.parameter;
+  }
+  linked_ = true;
+  return Status();  // OK
+}
+
+Status InstructionBuffers::Map(DeviceBufferMapper* device_buffer_mapper) {
+  TRACE_SCOPE("InstructionBuffers::Map");
+  std::vector<DeviceBuffer> device_buffers;
+  device_buffers.reserve(buffers_.size());
+  for (int i = 0; i < buffers_.size(); ++i) {
+    if (!mappings_[i].device_buffer().IsValid()) {
+      ASSIGN_OR_RETURN(mappings_[i],
+                       device_buffer_mapper->MapLongLivedInstruction(
+                           buffers_[i]));
+      VLOG(3) << StringPrintf(
+          "Mapped instructions[%d] : %s -> 0x%016llx, %zu bytes.", i,
+          buffers_[i].ToString().c_str(),
+          static_cast<unsigned long long>(  // NOLINT(runtime/int)
+              mappings_[i].device_buffer().device_address()),
+          mappings_[i].device_buffer().size_bytes());
+    }
+    device_buffers.push_back(mappings_[i].device_buffer());
+  }
+  return device_buffer_mapper->SetInstructions(device_buffers);
+}
+
+Status InstructionBuffers::Unmap() {
+  Status status;
+  for (int i = 0; i < mappings_.size(); ++i) {
+    status.Update(UnmapChunk(i));
+  }
+  return status;
 }
 
 }  // namespace driver
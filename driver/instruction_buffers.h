@@ -15,42 +15,113 @@
 #ifndef DARWINN_DRIVER_INSTRUCTION_BUFFERS_H_
 #define DARWINN_DRIVER_INSTRUCTION_BUFFERS_H_
 
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 #include <vector>
 
 #include "api/buffer.h"
 #include "driver/allocator.h"
 #include "driver/device_buffer_mapper.h"
 #include "executable/executable_generated.h"
+#include "port/status.h"
 
 namespace platforms {
 namespace darwinn {
 namespace driver {
 
 // Wrapper class for handling instruction buffers.
+//
+// Instruction buffers keep their device mappings across requests. Chunks that
+// need no linking are not copied per instance and refer to an aligned copy
+// shared by all instruction buffers of the executable. Chunks that need linking
+// are patched only when a linked address changes, after which they are
+// remapped on the next Map().
 class InstructionBuffers {
  public:
-  // Constructs the instruction buffers by allocating and copying instruction
-  // stream to host memory.
+  // Returns aligned copies of the instruction chunks that need no linking,
+  // indexed by chunk. Entries for chunks that need linking are invalid.
+  static std::vector<Buffer> CopyUnlinkedChunks(
+      platforms::darwinn::driver::Allocator *allocator,
+      const flatbuffers::Vector<flatbuffers::Offset<InstructionBitstream>>
+          &instruction_bitstreams);
+
+  // Constructs the instruction buffers by allocating and copying the
+  // instruction chunks that need linking to host memory. Other chunks refer to
+  // |unlinked_chunks|, as returned by CopyUnlinkedChunks().
   InstructionBuffers(
       platforms::darwinn::driver::Allocator *allocator,
+      const std::vector<Buffer> &unlinked_chunks,
       const flatbuffers::Vector<flatbuffers::Offset<InstructionBitstream>>
           &instruction_bitstreams);
   ~InstructionBuffers();
 
-  // Links scratch address, parameters, input, and output.
-  void LinkInstructionBuffers(
+  // Links scratch address, parameters, input, and output. Only fields whose
+  // address changed since the last call are rewritten.
+  Status LinkInstructionBuffers(
       const DeviceBuffer &parameter_device_buffer,
       DeviceBufferMapper *device_buffer_mapper,
       const flatbuffers::Vector<flatbuffers::Offset<InstructionBitstream>>
           &instruction_bitstreams);
 
+  // Maps the instruction buffers that are not mapped yet, and sets all of
+  // them as instructions of the request owning the given mapper. Must be
+  // called after LinkInstructionBuffers().
+  Status Map(DeviceBufferMapper *device_buffer_mapper);
+
+  // Unmaps all instruction buffers. Must be called before the address space
+  // they were mapped into goes away.
+  Status Unmap();
+
   // Returns the reference to the buffer vector.
   const std::vector<Buffer> &GetBuffers() const { return buffers_; }
 
+  // Returns the number of bytes allocated by this instance, which excludes
+  // the shared chunks that need no linking.
+  int64 LinkedChunkBytes() const;
+
  private:
+  // Linker targets referenced by one chunk.
+  struct ChunkLinks {
+    bool scratch = false;
+    bool parameter = false;
+    std::set<std::string> inputs;
+    std::set<std::string> outputs;
+  };
+
+  // Addresses currently linked into the chunks.
+  struct LinkedAddresses {
+    uint64 scratch = 0;
+    uint64 parameter = 0;
+    std::map<std::string, std::vector<uint64>> inputs;
+    std::map<std::string, std::vector<uint64>> outputs;
+  };
+
+  // Returns the linker targets referenced by the given chunk.
+  static ChunkLinks GetChunkLinks(const InstructionBitstream &chunk);
+
+  // Returns true if the given chunk has nothing to link.
+  static bool IsUnlinked(const ChunkLinks &links) {
+    return !links.scratch && !links.parameter && links.inputs.empty() &&
+           links.outputs.empty();
+  }
+
+  // Unmaps the given chunk, if mapped.
+  Status UnmapChunk(int chunk);
+
   // The actual buffers which holds the instruction stream.
   std::vector<Buffer> buffers_;
+
+  // Device mappings of |buffers_|. Invalid entries need to be mapped.
+  std::vector<MappedDeviceBuffer> mappings_;
+
+  // Linker targets for each chunk.
+  std::vector<ChunkLinks> chunk_links_;
+
+  // True if all chunks are linked to |linked_addresses_|.
+  bool linked_ = false;
+  LinkedAddresses linked_addresses_;
 };
 
 }  // namespace driver
@@ -14,6 +14,8 @@
 
 #include "driver/interrupt/wire_interrupt_handler.h"
 
+#include <atomic>
+#include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
@@ -46,7 +48,9 @@ WireInterruptHandler::WireInterruptHandler(
   CHECK(registers != nullptr);
   // Only supports 1 wire and 3 wire interrupt as of now.
   CHECK(num_wires_ == 1 || num_wires_ == 3);
-  interrupts_.resize(Interrupt::DW_INTERRUPT_COUNT);
+  for (auto& interrupt : interrupts_) {
+    interrupt.store(nullptr);
+  }
 }
 
 Status WireInterruptHandler::ValidateOpenState(bool open) const {
@@ -61,16 +65,20 @@ Status WireInterruptHandler::Open() {
   RETURN_IF_ERROR(ValidateOpenState(/*open=*/false));
   open_ = true;
 
-  for (int i = 0; i < DW_INTERRUPT_COUNT; ++i) {
-    interrupts_[i] = nullptr;
+  for (auto& interrupt : interrupts_) {
+    interrupt.store(nullptr);
   }
 
+  // The mask may have been changed while closed.
+  StdMutexLock mask_lock(&mask_mutex_);
+  mask_shadow_valid_ = false;
+
   return Status();  // OK
 }
 
 Status WireInterruptHandler::Close(bool in_error) {
-  // If in error, interrupt handler is already serving fatal error, and mutex is
-  // already locked. To avoid deadlock, return immediately.
+  // If in error, interrupt handler is already serving fatal error from within
+  // a dispatch. To avoid waiting for itself, return immediately.
   if (in_error) {
     return Status();  // OK
   }
@@ -79,52 +87,83 @@ Status WireInterruptHandler::Close(bool in_error) {
   RETURN_IF_ERROR(ValidateOpenState(/*open=*/true));
   open_ = false;
 
-  for (int i = 0; i < DW_INTERRUPT_COUNT; ++i) {
-    interrupts_[i] = nullptr;
+  for (auto& interrupt : interrupts_) {
+    interrupt.store(nullptr);
   }
+
+  // A dispatch that started before the handlers were unpublished may still be
+  // running one of them.
+  while (num_active_dispatches_.load() != 0) {
+    std::this_thread::yield();
+  }
+  handlers_.clear();
   return Status();  // OK
 }
 
-void WireInterruptHandler::MaskInterrupt(int interrupt_id, bool mask) {
-  config::registers::WireIntBitArray bit_array_helper_int_mask(ReadMaskArray());
+uint64 WireInterruptHandler::GetMaskBit(int interrupt_id) {
+  config::registers::WireIntBitArray bit_array_helper_int_mask(0);
   switch (interrupt_id) {
     case DW_INTERRUPT_INSTR_QUEUE:
-      bit_array_helper_int_mask.set_instruction_queue(mask);
+      bit_array_helper_int_mask.set_instruction_queue(1);
       break;
     case DW_INTERRUPT_SC_HOST_0:
-      bit_array_helper_int_mask.set_sc_host_0(mask);
+      bit_array_helper_int_mask.set_sc_host_0(1);
       break;
     case DW_INTERRUPT_SC_HOST_1:
-      bit_array_helper_int_mask.set_sc_host_1(mask);
+      bit_array_helper_int_mask.set_sc_host_1(1);
       break;
     case DW_INTERRUPT_SC_HOST_2:
-      bit_array_helper_int_mask.set_sc_host_2(mask);
+      bit_array_helper_int_mask.set_sc_host_2(1);
       break;
     case DW_INTERRUPT_SC_HOST_3:
-      bit_array_helper_int_mask.set_sc_host_3(mask);
+      bit_array_helper_int_mask.set_sc_host_3(1);
       break;
     case DW_INTERRUPT_FATAL_ERR:
-      bit_array_helper_int_mask.set_fatal_err(mask);
+      bit_array_helper_int_mask.set_fatal_err(1);
       break;
     default:
-      LOG(FATAL) << "MaskInterrupt: unhandled interrupt id: " << interrupt_id;
+      LOG(FATAL) << "GetMaskBit: unhandled interrupt id: " << interrupt_id;
   }
-  CHECK_OK(WriteMaskArray(bit_array_helper_int_mask.raw()));
+  return bit_array_helper_int_mask.raw();
 }
 
-void WireInterruptHandler::InvokeInterruptWithMask(int interrupt_id) {
-  StdMutexLock lock(&mutex_);
-  if (interrupts_[interrupt_id]) {
-    MaskInterrupt(interrupt_id, true);
-    interrupts_[interrupt_id]();
-    MaskInterrupt(interrupt_id, false);
+void WireInterruptHandler::UpdateMask(uint64 set_bits, uint64 clear_bits) {
+  StdMutexLock lock(&mask_mutex_);
+  if (!mask_shadow_valid_) {
+    mask_shadow_ = ReadMaskArray();
+    mask_shadow_valid_ = true;
   }
+  mask_shadow_ = (mask_shadow_ | set_bits) & ~clear_bits;
+  CHECK_OK(WriteMaskArray(mask_shadow_));
+}
+
+void WireInterruptHandler::InvokeInterruptsWithMask(const int* interrupt_ids,
+                                                    int num_interrupts) {
+  const Handler* handlers[DW_INTERRUPT_COUNT];
+  uint64 mask_bits = 0;
+  for (int i = 0; i < num_interrupts; ++i) {
+    handlers[i] = interrupts_[interrupt_ids[i]].load();
+    if (handlers[i] != nullptr) {
+      mask_bits |= GetMaskBit(interrupt_ids[i]);
+    }
+  }
+  if (mask_bits == 0) {
+    return;
+  }
+
+  UpdateMask(/*set_bits=*/mask_bits, /*clear_bits=*/0);
+  for (int i = 0; i < num_interrupts; ++i) {
+    if (handlers[i] != nullptr) {
+      (*handlers[i])();
+    }
+  }
+  UpdateMask(/*set_bits=*/0, /*clear_bits=*/mask_bits);
 }
 
 void WireInterruptHandler::InvokeInterrupt(int interrupt_id) {
-  StdMutexLock lock(&mutex_);
-  if (interrupts_[interrupt_id]) {
-    interrupts_[interrupt_id]();
+  const Handler* handler = interrupts_[interrupt_id].load();
+  if (handler != nullptr) {
+    (*handler)();
   }
 }
 
@@ -206,14 +245,18 @@ void WireInterruptHandler::HandleMsi3WireInterrupt(int wire_id) {
 
   switch (wire_id) {
     // Scalar core interrupt 0.
-    case 0:
-      InvokeInterruptWithMask(DW_INTERRUPT_SC_HOST_0);
+    case 0: {
+      const int interrupt_id = DW_INTERRUPT_SC_HOST_0;
+      InvokeInterruptsWithMask(&interrupt_id, 1);
       break;
+    }
 
     // Instruction queue interrupt.
-    case 1:
-      InvokeInterruptWithMask(DW_INTERRUPT_INSTR_QUEUE);
+    case 1: {
+      const int interrupt_id = DW_INTERRUPT_INSTR_QUEUE;
+      InvokeInterruptsWithMask(&interrupt_id, 1);
       break;
+    }
 
     // Remaining.
     default: {
@@ -227,21 +270,25 @@ void WireInterruptHandler::HandleMsi3WireInterrupt(int wire_id) {
           break;
         }
 
+        // Mask all pending sources at once, rather than one at a time.
+        int pending_ids[4];
+        int num_pending = 0;
         if (bit_array_helper.sc_host_1()) {
-          InvokeInterruptWithMask(DW_INTERRUPT_SC_HOST_1);
+          pending_ids[num_pending++] = DW_INTERRUPT_SC_HOST_1;
         }
 
         if (bit_array_helper.sc_host_2()) {
-          InvokeInterruptWithMask(DW_INTERRUPT_SC_HOST_2);
+          pending_ids[num_pending++] = DW_INTERRUPT_SC_HOST_2;
         }
 
         if (bit_array_helper.sc_host_3()) {
-          InvokeInterruptWithMask(DW_INTERRUPT_SC_HOST_3);
+          pending_ids[num_pending++] = DW_INTERRUPT_SC_HOST_3;
         }
 
         if (bit_array_helper.fatal_err()) {
-          InvokeInterruptWithMask(DW_INTERRUPT_FATAL_ERR);
+          pending_ids[num_pending++] = DW_INTERRUPT_FATAL_ERR;
         }
+        InvokeInterruptsWithMask(pending_ids, num_pending);
 
         if (bit_array_helper.top_level_0() || bit_array_helper.top_level_1() ||
             bit_array_helper.top_level_2() || bit_array_helper.top_level_3()) {
@@ -266,18 +313,27 @@ void WireInterruptHandler::HandleMsi3WireInterrupt(int wire_id) {
 }
 
 void WireInterruptHandler::InvokeAllPendingInterrupts(int wire_id) {
+  // Counted before any handler is loaded, so that Close() either sees this
+  // dispatch or this dispatch sees the unpublished handlers.
+  num_active_dispatches_.fetch_add(1);
   if (num_wires_ == 3) {
-    return HandleMsi3WireInterrupt(wire_id);
+    HandleMsi3WireInterrupt(wire_id);
   } else {
-    return HandlePlatformSingleWireInterrupt();
+    HandlePlatformSingleWireInterrupt();
   }
+  num_active_dispatches_.fetch_sub(1);
 }
 
 Status WireInterruptHandler::Register(Interrupt interrupt, Handler handler) {
   StdMutexLock lock(&mutex_);
   RETURN_IF_ERROR(ValidateOpenState(/*open=*/true));
 
-  interrupts_[interrupt] = std::move(handler);
+  if (handler) {
+    handlers_.push_back(gtl::MakeUnique<Handler>(std::move(handler)));
+    interrupts_[interrupt].store(handlers_.back().get());
+  } else {
+    interrupts_[interrupt].store(nullptr);
+  }
   return Status();  // OK;
 }
 
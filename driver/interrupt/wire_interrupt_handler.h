@@ -15,6 +15,8 @@
 #ifndef DARWINN_DRIVER_INTERRUPT_WIRE_INTERRUPT_HANDLER_H_
 #define DARWINN_DRIVER_INTERRUPT_WIRE_INTERRUPT_HANDLER_H_
 
+#include <atomic>
+#include <memory>
 #include <mutex>   // NOLINT
 #include <thread>  // NOLINT
 #include <vector>
@@ -30,6 +32,10 @@ namespace darwinn {
 namespace driver {
 
 // Wire Interrupt handler implementation.
+//
+// Dispatch does not take a lock: handlers are published through an atomic
+// table, and Close() waits for in-flight dispatches to drain. The mask CSR is
+// tracked in a shadow copy, so masking and unmasking are single writes.
 class WireInterruptHandler : public InterruptHandler {
  public:
   // Default close to avoid name hiding.
@@ -57,12 +63,18 @@ class WireInterruptHandler : public InterruptHandler {
   // Invokes the handler for the specified interrupt.
   void InvokeInterrupt(int interrupt_id) LOCKS_EXCLUDED(mutex_);
 
-  // Invokes the handler for the specified interrupt, and masks the interrput
-  // during processing.
-  void InvokeInterruptWithMask(int interrupt_id) LOCKS_EXCLUDED(mutex_);
+  // Invokes the handlers for the specified interrupts, and masks the
+  // interrupts that have a handler during processing. Masking and unmasking
+  // are coalesced into one CSR write each.
+  void InvokeInterruptsWithMask(const int* interrupt_ids, int num_interrupts)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Returns the mask bit of the given interrupt source.
+  static uint64 GetMaskBit(int interrupt_id);
 
-  // Masks and unmasks given interrput sources.
-  void MaskInterrupt(int interrupt_id, bool mask) SHARED_LOCKS_REQUIRED(mutex_);
+  // Sets and then clears the given bits in the mask CSR, with a single write.
+  void UpdateMask(uint64 set_bits, uint64 clear_bits)
+      LOCKS_EXCLUDED(mask_mutex_);
 
   // Performs CSR read access.
   uint64 ReadPendingBitArray();
@@ -89,14 +101,29 @@ class WireInterruptHandler : public InterruptHandler {
   // Number of wires.
   const int num_wires_;
 
-  // Mutex that guards interrupts_, open_ state.;
+  // Mutex that guards handlers_, open_ state.;
   mutable std::mutex mutex_;
 
   // Tracks open state.
   bool open_ GUARDED_BY(mutex_){false};
 
-  // Registered interrupts.
-  std::vector<Handler> interrupts_ GUARDED_BY(mutex_);
+  // Registered interrupts, indexed by interrupt id. Null if not registered.
+  std::atomic<const Handler*> interrupts_[DW_INTERRUPT_COUNT];
+
+  // Owns the handlers published in |interrupts_|. Replaced handlers are kept
+  // until Close(), as a dispatch may still be running them.
+  std::vector<std::unique_ptr<Handler>> handlers_ GUARDED_BY(mutex_);
+
+  // Number of dispatches in progress.
+  std::atomic<int> num_active_dispatches_{0};
+
+  // Serializes updates to the mask CSR.
+  std::mutex mask_mutex_;
+
+  // Shadow copy of the mask CSR. Read from the device on first use after
+  // Open().
+  bool mask_shadow_valid_ GUARDED_BY(mask_mutex_){false};
+  uint64 mask_shadow_ GUARDED_BY(mask_mutex_){0};
 };
 
 // Wire Interrupt handler implementation that polls the pending bit array.
@@ -0,0 +1,145 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Counts the CSR accesses WireInterruptHandler makes to dispatch interrupts,
+// using fake registers, and checks them against the expected counts.
+
+#include <cstdio>
+
+#include "driver/config/common_csr_helper.h"
+#include "driver/config/wire_csr_offsets.h"
+#include "driver/interrupt/interrupt_handler.h"
+#include "driver/interrupt/wire_interrupt_handler.h"
+#include "driver/registers/registers.h"
+#include "port/errors.h"
+#include "port/integral_types.h"
+#include "port/logging.h"
+#include "port/status.h"
+#include "port/statusor.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+// Offsets of the wire CSRs in the fake registers.
+constexpr uint64 kPendingBitArrayOffset = 0x10;
+constexpr uint64 kMaskArrayOffset = 0x8;
+
+// Registers holding the wire CSRs, which count accesses to them. Reading the
+// pending bit array clears it.
+class FakeRegisters : public Registers {
+ public:
+  Status Open() override { return OkStatus(); }
+  Status Close() override { return OkStatus(); }
+
+  Status Write(uint64 offset, uint64 value) override {
+    if (offset != kMaskArrayOffset) {
+      return InvalidArgumentError("Unexpected write.");
+    }
+    ++mask_writes;
+    mask = value;
+    return OkStatus();
+  }
+
+  StatusOr<uint64> Read(uint64 offset) override {
+    if (offset == kMaskArrayOffset) {
+      ++mask_reads;
+      return mask;
+    }
+    if (offset == kPendingBitArrayOffset) {
+      ++pending_reads;
+      const uint64 value = pending;
+      pending = 0;
+      return value;
+    }
+    return InvalidArgumentError("Unexpected read.");
+  }
+
+  Status Write32(uint64 offset, uint32 value) override {
+    return InvalidArgumentError("Unexpected write.");
+  }
+
+  StatusOr<uint32> Read32(uint64 offset) override {
+    return InvalidArgumentError("Unexpected read.");
+  }
+
+  void ResetCounts() { mask_reads = mask_writes = pending_reads = 0; }
+
+  uint64 mask = 0;
+  uint64 pending = 0;
+  int mask_reads = 0;
+  int mask_writes = 0;
+  int pending_reads = 0;
+};
+
+int Run() {
+  FakeRegisters registers;
+  config::WireCsrOffsets offsets;
+  offsets.wire_int_pending_bit_array = kPendingBitArrayOffset;
+  offsets.wire_int_mask_array = kMaskArrayOffset;
+  WireInterruptHandler handler(&registers, offsets, /*num_wires=*/3);
+  CHECK_OK(handler.Open());
+
+  // Every handler runs with its interrupt masked.
+  int calls = 0;
+  for (const auto interrupt : {DW_INTERRUPT_SC_HOST_0, DW_INTERRUPT_SC_HOST_1,
+                               DW_INTERRUPT_SC_HOST_2, DW_INTERRUPT_FATAL_ERR}) {
+    CHECK_OK(handler.Register(interrupt, [&registers, &calls]() {
+      CHECK_NE(registers.mask, uint64{0});
+      ++calls;
+    }));
+  }
+
+  // Wire 0 carries a single interrupt, which is masked around its handler.
+  // The mask is only read on the first dispatch after Open().
+  for (int i = 0; i < 3; ++i) {
+    registers.ResetCounts();
+    handler.InvokeAllPendingInterrupts(0);
+    printf("Wire 0 dispatch: %d mask reads, %d mask writes.\n",
+           registers.mask_reads, registers.mask_writes);
+    CHECK_EQ(registers.mask_reads, i == 0 ? 1 : 0);
+    CHECK_EQ(registers.mask_writes, 2);
+    CHECK_EQ(registers.mask, uint64{0});
+  }
+
+  // Interrupts sharing wire 2 are masked and unmasked together. The pending
+  // bit array is read again until it holds no more interrupts.
+  config::registers::WireIntBitArray pending(0);
+  pending.set_sc_host_1(1);
+  pending.set_sc_host_2(1);
+  pending.set_fatal_err(1);
+  registers.pending = pending.raw();
+  registers.ResetCounts();
+  calls = 0;
+  handler.InvokeAllPendingInterrupts(2);
+  printf("Wire 2 dispatch of 3 interrupts: %d pending reads, %d mask reads, "
+         "%d mask writes.\n",
+         registers.pending_reads, registers.mask_reads, registers.mask_writes);
+  CHECK_EQ(calls, 3);
+  CHECK_EQ(registers.pending_reads, 2);
+  CHECK_EQ(registers.mask_reads, 0);
+  CHECK_EQ(registers.mask_writes, 2);
+  CHECK_EQ(registers.mask, uint64{0});
+
+  CHECK_OK(handler.Close());
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main() { return platforms::darwinn::driver::Run(); }
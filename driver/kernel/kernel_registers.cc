@@ -19,7 +19,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <string>
+#include <thread>  // NOLINT
 
 #include "absl/strings/str_format.h"
 #include "driver/registers/registers.h"
@@ -35,6 +37,10 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+constexpr int KernelRegisters::kLookupPageShift;
+constexpr uint64 KernelRegisters::kLookupPageMask;
+constexpr uint64 KernelRegisters::kMaxLookupPages;
+
 KernelRegisters::KernelRegisters(const std::string& device_path,
                                  const std::vector<MmapRegion>& mmap_region,
                                  bool read_only)
@@ -74,6 +80,41 @@ void KernelRegisters::UnmapAllRegions() {
   }
 }
 
+void KernelRegisters::BuildLookupTable() {
+  lookup_table_.clear();
+  if (mmap_region_.empty()) {
+    return;
+  }
+
+  uint64 begin = mmap_region_.front().offset;
+  uint64 end = begin;
+  for (const auto& region : mmap_region_) {
+    if ((region.offset & kLookupPageMask) != 0 ||
+        (region.size & kLookupPageMask) != 0) {
+      VLOG(1) << "Register regions are not page-aligned, not using lookup.";
+      return;
+    }
+    begin = std::min(begin, region.offset);
+    end = std::max(end, region.offset + region.size);
+  }
+
+  const uint64 num_pages = (end - begin) >> kLookupPageShift;
+  if (num_pages > kMaxLookupPages) {
+    VLOG(1) << "Register regions span too many pages, not using lookup.";
+    return;
+  }
+
+  lookup_base_offset_ = begin;
+  lookup_table_.assign(num_pages, nullptr);
+  for (const auto& region : mmap_region_) {
+    uint8* base = reinterpret_cast<uint8*>(region.registers);
+    const uint64 first_page = (region.offset - begin) >> kLookupPageShift;
+    for (uint64 page = 0; page < (region.size >> kLookupPageShift); ++page) {
+      lookup_table_[first_page + page] = base + (page << kLookupPageShift);
+    }
+  }
+}
+
 Status KernelRegisters::Open() {
   StdMutexLock lock(&mutex_);
   if (fd_ != INVALID_FD_VALUE) {
@@ -108,15 +149,32 @@ Status KernelRegisters::Open() {
     VLOG(3) << "Got map addr at 0x" << std::hex << region.registers;
   }
 
+  BuildLookupTable();
+  epoch_.fetch_add(1, std::memory_order_release);
+
   return Status();  // OK
 }
 
 Status KernelRegisters::Close() {
-  StdMutexLock lock(&mutex_);
-  if (fd_ == INVALID_FD_VALUE) {
-    return FailedPreconditionError("Device not open.");
+  {
+    StdMutexLock lock(&mutex_);
+    if ((epoch_.load() & 1) == 0) {
+      return FailedPreconditionError("Device not open.");
+    }
+
+    // Make accessors fail before unmapping.
+    epoch_.fetch_add(1);
+  }
+
+  // An access that started before the epoch was bumped may still be using the
+  // mappings. The lock is released while waiting, as such an access may need
+  // it to look up an offset outside the lookup table. Open() keeps failing
+  // until |fd_| is closed below.
+  while (num_active_accesses_.load() != 0) {
+    std::this_thread::yield();
   }
 
+  StdMutexLock lock(&mutex_);
   for (auto& region : mmap_region_) {
     if (region.registers != nullptr) {
       VLOG(1) << StringPrintf(
@@ -171,11 +229,41 @@ inline StatusOr<uint8*> KernelRegisters::GetMappedOffset(uint64 offset,
       "Offset (0x%016llx) is not covered by any region", offset));
 }
 
-Status KernelRegisters::Write(uint64 offset, uint64 value) {
-  StdMutexLock lock(&mutex_);
-  if (fd_ == INVALID_FD_VALUE) {
+KernelRegisters::ScopedAccess::ScopedAccess(const KernelRegisters* registers)
+    : registers_(registers) {
+  const uint64 epoch = registers_->epoch_.load();
+  if ((epoch & 1) == 0) {
+    return;
+  }
+  registers_->num_active_accesses_.fetch_add(1);
+  open_ = registers_->epoch_.load() == epoch;
+  if (!open_) {
+    registers_->num_active_accesses_.fetch_sub(1);
+  }
+}
+
+KernelRegisters::ScopedAccess::~ScopedAccess() {
+  if (open_) {
+    registers_->num_active_accesses_.fetch_sub(1);
+  }
+}
+
+inline StatusOr<uint8*> KernelRegisters::GetRegister(const ScopedAccess& access,
+                                                     uint64 offset,
+                                                     int size_bytes) const {
+  if (!access.open()) {
     return FailedPreconditionError("Device not open.");
   }
+
+  // Offsets below the table wrap around to a large index.
+  const uint64 page = (offset - lookup_base_offset_) >> kLookupPageShift;
+  if (page < lookup_table_.size() && lookup_table_[page] != nullptr) {
+    return lookup_table_[page] + (offset & kLookupPageMask);
+  }
+  return LockAndGetMappedOffset(offset, size_bytes);
+}
+
+Status KernelRegisters::Write(uint64 offset, uint64 value) {
   if (read_only_) {
     return FailedPreconditionError("Read only, cannot write.");
   }
@@ -185,8 +273,10 @@ Status KernelRegisters::Write(uint64 offset, uint64 value) {
         static_cast<unsigned long long>(offset)));  // NOLINT(runtime/int)
   }
 
-  ASSIGN_OR_RETURN(auto mmap_register, GetMappedOffset(offset, sizeof(uint64)));
-  *reinterpret_cast<uint64*>(mmap_register) = value;
+  ScopedAccess access(this);
+  ASSIGN_OR_RETURN(auto mmap_register,
+                   GetRegister(access, offset, sizeof(uint64)));
+  *reinterpret_cast<volatile uint64*>(mmap_register) = value;
   VLOG(5) << StringPrintf(
       "Write: offset = 0x%016llx, value = 0x%016llx",
       static_cast<unsigned long long>(offset),  // NOLINT(runtime/int)
@@ -196,18 +286,16 @@ Status KernelRegisters::Write(uint64 offset, uint64 value) {
 }
 
 StatusOr<uint64> KernelRegisters::Read(uint64 offset) {
-  StdMutexLock lock(&mutex_);
-  if (fd_ == INVALID_FD_VALUE) {
-    return FailedPreconditionError("Device not open.");
-  }
   if (offset % sizeof(uint64) != 0) {
     return FailedPreconditionError(StringPrintf(
         "Offset (0x%016llx) not aligned to 8B",
         static_cast<unsigned long long>(offset)));  // NOLINT(runtime/int)
   }
 
-  ASSIGN_OR_RETURN(auto mmap_register, GetMappedOffset(offset, sizeof(uint64)));
-  uint64 value = *reinterpret_cast<uint64*>(mmap_register);
+  ScopedAccess access(this);
+  ASSIGN_OR_RETURN(auto mmap_register,
+                   GetRegister(access, offset, sizeof(uint64)));
+  const uint64 value = *reinterpret_cast<volatile uint64*>(mmap_register);
   VLOG(5) << StringPrintf(
       "Read: offset = 0x%016llx, value: = 0x%016llx",
       static_cast<unsigned long long>(offset),  // NOLINT(runtime/int)
@@ -217,10 +305,6 @@ StatusOr<uint64> KernelRegisters::Read(uint64 offset) {
 }
 
 Status KernelRegisters::Write32(uint64 offset, uint32 value) {
-  StdMutexLock lock(&mutex_);
-  if (fd_ == INVALID_FD_VALUE) {
-    return FailedPreconditionError("Device not open.");
-  }
   if (read_only_) {
     return FailedPreconditionError("Read only, cannot write.");
   }
@@ -230,8 +314,10 @@ Status KernelRegisters::Write32(uint64 offset, uint32 value) {
         static_cast<unsigned long long>(offset)));  // NOLINT(runtime/int)
   }
 
-  ASSIGN_OR_RETURN(auto mmap_register, GetMappedOffset(offset, sizeof(uint32)));
-  *reinterpret_cast<uint32*>(mmap_register) = value;
+  ScopedAccess access(this);
+  ASSIGN_OR_RETURN(auto mmap_register,
+                   GetRegister(access, offset, sizeof(uint32)));
+  *reinterpret_cast<volatile uint32*>(mmap_register) = value;
   VLOG(5) << StringPrintf(
       "Write: offset = 0x%016llx, value = 0x%08x",
       static_cast<unsigned long long>(offset),  // NOLINT(runtime/int)
@@ -241,18 +327,16 @@ Status KernelRegisters::Write32(uint64 offset, uint32 value) {
 }
 
 StatusOr<uint32> KernelRegisters::Read32(uint64 offset) {
-  StdMutexLock lock(&mutex_);
-  if (fd_ == INVALID_FD_VALUE) {
-    return FailedPreconditionError("Device not open.");
-  }
   if (offset % sizeof(uint32) != 0) {
     return FailedPreconditionError(StringPrintf(
         "Offset (0x%016llx) not aligned to 8B",
         static_cast<unsigned long long>(offset)));  // NOLINT(runtime/int)
   }
 
-  ASSIGN_OR_RETURN(auto mmap_register, GetMappedOffset(offset, sizeof(uint32)));
-  uint32 value = *reinterpret_cast<uint32*>(mmap_register);
+  ScopedAccess access(this);
+  ASSIGN_OR_RETURN(auto mmap_register,
+                   GetRegister(access, offset, sizeof(uint32)));
+  const uint32 value = *reinterpret_cast<volatile uint32*>(mmap_register);
   VLOG(5) << StringPrintf(
       "Read: offset = 0x%016llx, value: = 0x%08x",
       static_cast<unsigned long long>(offset),  // NOLINT(runtime/int)
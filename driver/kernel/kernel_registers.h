@@ -15,6 +15,7 @@
 #ifndef DARWINN_DRIVER_KERNEL_KERNEL_REGISTERS_H_
 #define DARWINN_DRIVER_KERNEL_KERNEL_REGISTERS_H_
 
+#include <atomic>
 #include <mutex>  // NOLINT
 #include <string>
 #include <vector>
@@ -31,6 +32,11 @@ namespace darwinn {
 namespace driver {
 
 // Kernel implementation of the register interface.
+//
+// Register accesses do not take a lock. Offsets are resolved through a table
+// built at Open(), and a lifecycle epoch tells accessors whether the device is
+// open. Accesses may race with Close(): Close() waits for accesses in progress
+// before unmapping, and accesses after Close() fail.
 class KernelRegisters : public Registers {
  public:
   struct MmapRegion {
@@ -83,10 +89,43 @@ class KernelRegisters : public Registers {
                              const MappedRegisterRegion& region) = 0;
 
  private:
+  // Granularity of the offset lookup table.
+  static constexpr int kLookupPageShift = 12;
+  static constexpr uint64 kLookupPageMask = (1ULL << kLookupPageShift) - 1;
+
+  // Upper bound on the number of lookup table entries, i.e. on the span of
+  // offsets covered by the table.
+  static constexpr uint64 kMaxLookupPages = 1 << 16;
+
+  // Counts a register access in progress for its lifetime, if the device is
+  // open when it starts. See |num_active_accesses_|.
+  class ScopedAccess {
+   public:
+    explicit ScopedAccess(const KernelRegisters* registers);
+    ~ScopedAccess();
+
+    // Returns true if the device stays open until the access ends.
+    bool open() const { return open_; }
+
+   private:
+    const KernelRegisters* const registers_;
+    bool open_{false};
+  };
+
   // Maps CSR offset to virtual address without acquiring the lock.
   StatusOr<uint8*> GetMappedOffset(uint64 offset, int alignment) const
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Maps CSR offset to virtual address through the lookup table. Falls back to
+  // GetMappedOffset() for offsets not in the table. The address is valid for
+  // the lifetime of |access|.
+  StatusOr<uint8*> GetRegister(const ScopedAccess& access, uint64 offset,
+                               int size_bytes) const LOCKS_EXCLUDED(mutex_);
+
+  // Builds the lookup table from the mapped regions. Leaves it empty if the
+  // regions are not page-aligned, or span too many pages.
+  void BuildLookupTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Device path.
   const std::string device_path_;
 
@@ -101,6 +140,26 @@ class KernelRegisters : public Registers {
 
   // Mutex that guards fd_;
   mutable std::mutex mutex_;
+
+  // Lifecycle epoch, odd while open. It is bumped after mapping in Open() and
+  // before unmapping in Close(), so an acquire load tells accessors whether
+  // the lookup table below is valid.
+  std::atomic<uint64> epoch_{0};
+
+  // Number of register accesses in progress. An access counts itself only
+  // while the epoch is open, and then checks that the epoch has not moved, so
+  // Close() either waits for the access or the access sees the closed epoch.
+  // Accesses starting after Close() bumped the epoch are not counted, so the
+  // count drains even under a steady stream of accesses.
+  mutable std::atomic<int> num_active_accesses_{0};
+
+  // Offset of the first page covered by the lookup table.
+  uint64 lookup_base_offset_{0};
+
+  // Virtual address of each page of offsets starting at |lookup_base_offset_|,
+  // or null if the page is not mapped. Only written in Open() while the epoch
+  // is even.
+  std::vector<uint8*> lookup_table_;
 };
 
 }  // namespace driver
@@ -0,0 +1,135 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the cost of KernelRegistersLinux accesses against a fake BAR
+// backed by a memfd, using the CSR regions of Beagle. Then races reader
+// threads with Close() and Open(), which must never unmap a register while it
+// is accessed.
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "driver/kernel/linux/kernel_registers_linux.h"
+#include "port/errors.h"
+#include "port/gflags.h"
+#include "port/logging.h"
+
+ABSL_FLAG(int, iterations, 20000000, "Number of write and read pairs.");
+ABSL_FLAG(int, close_rounds, 2000,
+          "Number of Close() and Open() rounds raced with readers.");
+ABSL_FLAG(int, reader_threads, 4, "Number of readers racing with Close().");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+// Size of the fake BAR, which covers all regions below.
+constexpr uint64 kBarSizeBytes = 0x50000;
+
+// Offset of the register region accessed by the benchmark.
+constexpr uint64 kRegionOffset = 0x48000;
+
+int Run() {
+  const int fd = memfd_create("fake_bar", MFD_CLOEXEC);
+  CHECK_GE(fd, 0);
+  CHECK_EQ(ftruncate(fd, kBarSizeBytes), 0);
+
+  const std::vector<KernelRegisters::MmapRegion> regions = {
+      {0x40000, 0x1000}, {0x44000, 0x1000}, {kRegionOffset, 0x1000}};
+  KernelRegistersLinux registers("/proc/self/fd/" + std::to_string(fd),
+                                 regions, /*read_only=*/false);
+  CHECK_OK(registers.Open());
+
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  uint64 sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    const uint64 index = (i & 0xff) * sizeof(uint64);
+    CHECK_OK(registers.Write(kRegionOffset + index, i));
+    sum += registers.Read(kRegionOffset + index).ValueOrDie();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const double elapsed_ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+  printf("%d write/read pairs: %.2f ns per access (checksum %llu).\n",
+         iterations, elapsed_ns / (2.0 * iterations),
+         static_cast<unsigned long long>(sum));  // NOLINT(runtime/int)
+
+  // Readers either read a mapped register or fail with the device closed. A
+  // read of an unmapped register crashes.
+  std::atomic<bool> done{false};
+  std::atomic<int64> num_reads{0};
+  std::atomic<int64> num_failed_reads{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < absl::GetFlag(FLAGS_reader_threads); ++i) {
+    readers.emplace_back([&]() {
+      int64 reads = 0;
+      int64 failed_reads = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        // Alternates between an offset in the lookup table and one past the
+        // regions, which goes through the locked lookup.
+        const uint64 offset = (reads & 1) ? kRegionOffset : kBarSizeBytes;
+        auto value_or_error = registers.Read(offset);
+        if (!value_or_error.ok()) {
+          CHECK(IsFailedPrecondition(value_or_error.status()) ||
+                IsOutOfRange(value_or_error.status()))
+              << value_or_error.status();
+          ++failed_reads;
+        }
+        ++reads;
+      }
+      num_reads += reads;
+      num_failed_reads += failed_reads;
+    });
+  }
+  const int close_rounds = absl::GetFlag(FLAGS_close_rounds);
+  for (int i = 0; i < close_rounds; ++i) {
+    CHECK_OK(registers.Close());
+    CHECK_OK(registers.Open());
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  CHECK_OK(registers.Close());
+  close(fd);
+
+  printf("%d Close() rounds raced with %zu readers: %lld reads, %lld failed "
+         "or out of range.\n",
+         close_rounds, readers.size(),
+         static_cast<long long>(num_reads.load()),  // NOLINT(runtime/int)
+         static_cast<long long>(                    // NOLINT(runtime/int)
+             num_failed_reads.load()));
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
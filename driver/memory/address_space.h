@@ -17,6 +17,8 @@
 
 #include <stddef.h>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "api/buffer.h"
 #include "driver/device_buffer.h"
@@ -39,6 +41,26 @@ enum class MappingTypeHint {
 
   // Use extended address space mappings, if the hardware is capable.
   kExtended,
+
+  // The mapping is long-lived and reused by many requests, e.g. parameters or
+  // cached instructions. Implementations may place it in the faster simple
+  // address space while it has room, and fall back to extended mappings.
+  kLongLived,
+};
+
+// Occupancy of one segment of an address space.
+struct AddressSpaceSegmentStats {
+  // Name of the segment.
+  std::string name;
+
+  // Bytes mapped, rounded up to whole blocks, bytes free, and the size of the
+  // largest free block.
+  uint64 allocated_bytes = 0;
+  uint64 free_bytes = 0;
+  uint64 largest_free_block_bytes = 0;
+
+  // Number of mappings placed in the segment with MappingTypeHint::kLongLived.
+  uint64 num_long_lived_mappings = 0;
 };
 
 // An interface for managing a DarwiNN virtual address space segment.
@@ -79,6 +101,12 @@ class AddressSpace {
   virtual Status UnmapCoherentMemory(DeviceBuffer buffer) {
     return UnmapMemory(buffer);
   }
+
+  // Returns occupancy of the segments of this address space. Empty if the
+  // implementation does not track it.
+  virtual std::vector<AddressSpaceSegmentStats> GetSegmentStats() const {
+    return {};
+  }
 };
 
 }  // namespace driver
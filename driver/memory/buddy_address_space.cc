@@ -87,6 +87,11 @@ Status BuddyAddressSpace::UnmapMemory(DeviceBuffer buffer) {
   return Status();  // OK.
 }
 
+BuddyAllocator::Stats BuddyAddressSpace::GetStats() const {
+  StdMutexLock lock(&mutex_);
+  return allocator_.GetStats();
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
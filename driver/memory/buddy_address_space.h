@@ -57,6 +57,9 @@ class BuddyAddressSpace final : public MmioAddressSpace {
   // Unmaps the given device buffer.
   Status UnmapMemory(DeviceBuffer buffer) override LOCKS_EXCLUDED(mutex_);
 
+  // Returns occupancy statistics of the underlying allocator.
+  BuddyAllocator::Stats GetStats() const LOCKS_EXCLUDED(mutex_);
+
  private:
   mutable std::mutex mutex_;
 
@@ -174,6 +174,22 @@ Status BuddyAllocator::Free(uint64 address, uint64 size_bytes) {
   return Status();  // OK.
 }
 
+BuddyAllocator::Stats BuddyAllocator::GetStats() const {
+  StdMutexLock lock(&mutex_);
+  Stats stats;
+  for (int bin = 0; bin < free_blocks_.size(); ++bin) {
+    const uint64 block_size_bytes = 1ULL << GetOrderFromBin(bin);
+    stats.allocated_bytes += allocated_blocks_[bin].size() * block_size_bytes;
+    stats.num_allocations += allocated_blocks_[bin].size();
+    if (!free_blocks_[bin].empty()) {
+      stats.free_bytes += free_blocks_[bin].size() * block_size_bytes;
+      stats.num_free_blocks += free_blocks_[bin].size();
+      stats.largest_free_block_bytes = block_size_bytes;
+    }
+  }
+  return stats;
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
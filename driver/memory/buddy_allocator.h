@@ -49,6 +49,33 @@ class BuddyAllocator : public AddressSpaceAllocator {
 
   ~BuddyAllocator() override = default;
 
+  // Snapshot of the occupancy of the address space.
+  struct Stats {
+    // Bytes currently handed out, rounded up to whole blocks.
+    uint64 allocated_bytes = 0;
+
+    // Bytes currently free, and the size of the largest free block.
+    uint64 free_bytes = 0;
+    uint64 largest_free_block_bytes = 0;
+
+    // Number of live allocations and of free blocks.
+    int num_allocations = 0;
+    int num_free_blocks = 0;
+
+    // Returns the fraction of free bytes that cannot be handed out in a single
+    // allocation: 0 when all free space is one block, approaching 1 as it is
+    // split into many small blocks.
+    double fragmentation() const {
+      return free_bytes == 0
+                 ? 0.0
+                 : 1.0 - static_cast<double>(largest_free_block_bytes) /
+                             free_bytes;
+    }
+  };
+
+  // Returns current occupancy statistics.
+  Stats GetStats() const LOCKS_EXCLUDED(mutex_);
+
   //////////////////////////////////////////////////////////////////////////////
   // Implementation of Allocator interface
   //
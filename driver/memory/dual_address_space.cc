@@ -15,15 +15,32 @@
 #include "driver/memory/dual_address_space.h"
 
 #include "driver/hardware_structures.h"
+#include "driver/memory/address_utilities.h"
 #include "driver/memory/buddy_address_space.h"
+#include "port/errors.h"
+#include "port/logging.h"
 #include "port/ptr_util.h"
+#include "port/status_macros.h"
 
 namespace platforms {
 namespace darwinn {
 namespace driver {
+namespace {
+
+// Returns the smallest power of two that is not less than |x|.
+uint64 RoundUpToPowerOfTwo(uint64 x) {
+  uint64 result = 1;
+  while (result < x) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
 
 DualAddressSpace::DualAddressSpace(
-    const config::ChipStructures& chip_structures, MmuMapper* mmu_mapper) {
+    const config::ChipStructures& chip_structures, MmuMapper* mmu_mapper)
+    : simple_reserved_bytes_(kMinNumSimplePageTableEntries * kHostPageSize) {
   const int num_simple_entries =
       GetNumSimplePageTableEntries(chip_structures.num_page_table_entries);
 
@@ -45,16 +62,70 @@ StatusOr<DeviceBuffer> DualAddressSpace::MapMemory(
     case MappingTypeHint::kSimple:
       return simple_->MapMemory(buffer, direction, mapping_type);
 
+    case MappingTypeHint::kLongLived:
+      return MapLongLived(buffer, direction);
+
     case MappingTypeHint::kExtended:
     case MappingTypeHint::kAny:
       return extended_->MapMemory(buffer, direction, mapping_type);
   }
 }
 
+StatusOr<DeviceBuffer> DualAddressSpace::MapLongLived(const Buffer& buffer,
+                                                      DmaDirection direction) {
+  // Buddy allocations are rounded up to a power of two pages. Only try the
+  // simple space if that leaves the reserve untouched.
+  const void* ptr = buffer.IsPtrType() ? buffer.ptr() : nullptr;
+  const uint64 footprint_bytes = RoundUpToPowerOfTwo(
+      GetNumberPages(ptr, buffer.size_bytes()) * kHostPageSize);
+  const BuddyAllocator::Stats simple_stats = simple_->GetStats();
+  if (simple_stats.free_bytes >= footprint_bytes + simple_reserved_bytes_ &&
+      simple_stats.largest_free_block_bytes >= footprint_bytes) {
+    auto simple_buffer_or_error =
+        simple_->MapMemory(buffer, direction, MappingTypeHint::kSimple);
+    if (simple_buffer_or_error.ok()) {
+      ++num_long_lived_simple_;
+      return simple_buffer_or_error;
+    }
+    // Lost a race for the space; anything else is a real error.
+    if (!IsResourceExhausted(simple_buffer_or_error.status())) {
+      return simple_buffer_or_error.status();
+    }
+  }
+
+  VLOG(4) << "Simple address space full, mapping long-lived buffer of "
+          << buffer.size_bytes() << " bytes in extended address space.";
+  ASSIGN_OR_RETURN(auto device_buffer,
+                   extended_->MapMemory(buffer, direction,
+                                        MappingTypeHint::kExtended));
+  ++num_long_lived_extended_;
+  return device_buffer;
+}
+
 Status DualAddressSpace::UnmapMemory(DeviceBuffer buffer) {
   return DetermineSource(buffer)->UnmapMemory(buffer);
 }
 
+std::vector<AddressSpaceSegmentStats> DualAddressSpace::GetSegmentStats()
+    const {
+  const auto make_segment_stats = [](const char* name,
+                                     const BuddyAllocator::Stats& stats,
+                                     uint64 num_long_lived_mappings) {
+    AddressSpaceSegmentStats segment_stats;
+    segment_stats.name = name;
+    segment_stats.allocated_bytes = stats.allocated_bytes;
+    segment_stats.free_bytes = stats.free_bytes;
+    segment_stats.largest_free_block_bytes = stats.largest_free_block_bytes;
+    segment_stats.num_long_lived_mappings = num_long_lived_mappings;
+    return segment_stats;
+  };
+
+  return {make_segment_stats("simple", simple_->GetStats(),
+                             num_long_lived_simple_),
+          make_segment_stats("extended", extended_->GetStats(),
+                             num_long_lived_extended_)};
+}
+
 AddressSpace* DualAddressSpace::DetermineSource(
     const DeviceBuffer& device_buffer) const {
   if (device_buffer.device_address() & kExtendedVirtualAddressBit) {
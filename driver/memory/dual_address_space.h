@@ -15,9 +15,16 @@
 #ifndef DARWINN_DRIVER_MEMORY_DUAL_ADDRESS_SPACE_H_
 #define DARWINN_DRIVER_MEMORY_DUAL_ADDRESS_SPACE_H_
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "driver/config/chip_structures.h"
 #include "driver/memory/address_space.h"
+#include "driver/memory/buddy_address_space.h"
+#include "driver/memory/buddy_allocator.h"
 #include "driver/memory/mmu_mapper.h"
+#include "port/integral_types.h"
 
 namespace platforms {
 namespace darwinn {
@@ -25,6 +32,11 @@ namespace driver {
 
 // An address space implementation that works with a split simple/extended page
 // table.
+//
+// Simple mappings translate with a single page table lookup, so long-lived
+// mappings (MappingTypeHint::kLongLived) are placed there while it has room.
+// A part of the simple space is always kept free for mappings that require it,
+// such as host queues. Everything else goes to the extended space.
 class DualAddressSpace final : public AddressSpace {
  public:
   using AddressSpace::MapMemory;  // Allows for proper overload resolution.
@@ -46,15 +58,31 @@ class DualAddressSpace final : public AddressSpace {
   // Unmaps the given device buffer.
   Status UnmapMemory(DeviceBuffer buffer) override;
 
+  // Returns occupancy of the simple and the extended space, in that order.
+  // Long-lived mappings counted in the extended space did not fit in the
+  // simple space.
+  std::vector<AddressSpaceSegmentStats> GetSegmentStats() const override;
+
  private:
+  // Maps a long-lived buffer, preferring the simple space.
+  StatusOr<DeviceBuffer> MapLongLived(const Buffer& buffer,
+                                      DmaDirection direction);
+
   // Determines which address space the device buffer was allocated from.
   AddressSpace* DetermineSource(const DeviceBuffer& device_buffer) const;
 
   // Underlying simple address space.
-  std::unique_ptr<AddressSpace> simple_;
+  std::unique_ptr<BuddyAddressSpace> simple_;
 
   // Underlying extended address space.
-  std::unique_ptr<AddressSpace> extended_;
+  std::unique_ptr<BuddyAddressSpace> extended_;
+
+  // Bytes of the simple space that long-lived mappings may not use.
+  uint64 simple_reserved_bytes_;
+
+  // Placement counters for long-lived mappings.
+  std::atomic<uint64> num_long_lived_simple_{0};
+  std::atomic<uint64> num_long_lived_extended_{0};
 };
 
 }  // namespace driver
@@ -0,0 +1,170 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a mapping trace against DualAddressSpace on a FakeMmuMapper with the
+// Beagle page table size, and checks where long-lived and one-shot mappings
+// are placed.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "api/buffer.h"
+#include "driver/config/beagle/beagle_chip_structures.h"
+#include "driver/device_buffer.h"
+#include "driver/hardware_structures.h"
+#include "driver/memory/address_space.h"
+#include "driver/memory/dma_direction.h"
+#include "driver/memory/dual_address_space.h"
+#include "driver/memory/fake_mmu_mapper.h"
+#include "port/aligned_malloc.h"
+#include "port/gflags.h"
+#include "port/logging.h"
+
+ABSL_FLAG(int, num_models, 12, "Number of models registered.");
+ABSL_FLAG(int, parameter_bytes, 3 << 20, "Parameter size of each model.");
+ABSL_FLAG(int, num_activations, 1000, "Number of one-shot activations.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+constexpr int kPageSizeBytes = 4096;
+
+// Instruction buffers pooled for each model.
+constexpr int kNumInstructionBuffers = 2;
+constexpr int kInstructionBufferBytes = 64 << 10;
+
+// The simple space held back for mappings that require it.
+constexpr uint64 kMinSimpleFreeBytes = 1 << 20;
+
+// Host memory for the trace. FakeMmuMapper never touches it.
+class HostMemory {
+ public:
+  ~HostMemory() {
+    for (void* ptr : allocations_) {
+      aligned_free(ptr);
+    }
+  }
+
+  Buffer Allocate(size_t size_bytes) {
+    void* ptr = aligned_malloc(size_bytes, kPageSizeBytes);
+    CHECK(ptr != nullptr);
+    allocations_.push_back(ptr);
+    return Buffer(ptr, size_bytes);
+  }
+
+ private:
+  std::vector<void*> allocations_;
+};
+
+bool IsExtended(const DeviceBuffer& device_buffer) {
+  return (device_buffer.device_address() & kExtendedVirtualAddressBit) != 0;
+}
+
+void PrintSegmentStats(const char* when, const AddressSpace& address_space) {
+  for (const auto& stats : address_space.GetSegmentStats()) {
+    const double fragmentation =
+        stats.free_bytes == 0
+            ? 0.0
+            : 1.0 - static_cast<double>(stats.largest_free_block_bytes) /
+                        stats.free_bytes;
+    printf("%s, %s space: %llu bytes mapped, %llu free, fragmentation %.3f, "
+           "%llu long-lived mappings.\n",
+           when, stats.name.c_str(),
+           static_cast<unsigned long long>(  // NOLINT(runtime/int)
+               stats.allocated_bytes),
+           static_cast<unsigned long long>(  // NOLINT(runtime/int)
+               stats.free_bytes),
+           fragmentation,
+           static_cast<unsigned long long>(  // NOLINT(runtime/int)
+               stats.num_long_lived_mappings));
+  }
+}
+
+int Run() {
+  FakeMmuMapper mmu_mapper;
+  DualAddressSpace address_space(config::kBeagleChipStructures, &mmu_mapper);
+  HostMemory host_memory;
+
+  // Host queues require the simple space and are mapped first.
+  const DeviceBuffer queue =
+      address_space
+          .MapMemory(host_memory.Allocate(kPageSizeBytes),
+                     DmaDirection::kBidirectional, MappingTypeHint::kSimple)
+          .ValueOrDie();
+  CHECK(!IsExtended(queue));
+
+  // Parameters and pooled instruction buffers of every model.
+  std::vector<DeviceBuffer> long_lived;
+  int num_simple = 0;
+  for (int model = 0; model < absl::GetFlag(FLAGS_num_models); ++model) {
+    std::vector<int> sizes(kNumInstructionBuffers, kInstructionBufferBytes);
+    sizes.push_back(absl::GetFlag(FLAGS_parameter_bytes));
+    for (const int size_bytes : sizes) {
+      const DeviceBuffer device_buffer =
+          address_space
+              .MapMemory(host_memory.Allocate(size_bytes),
+                         DmaDirection::kToDevice, MappingTypeHint::kLongLived)
+              .ValueOrDie();
+      num_simple += IsExtended(device_buffer) ? 0 : 1;
+      long_lived.push_back(device_buffer);
+    }
+  }
+  printf("%d of %zu long-lived mappings placed in the simple space.\n",
+         num_simple, long_lived.size());
+
+  // Room for mappings that require the simple space is held back.
+  const auto loaded_stats = address_space.GetSegmentStats();
+  CHECK_EQ(loaded_stats.size(), 2);
+  CHECK_GE(loaded_stats[0].free_bytes, kMinSimpleFreeBytes);
+  CHECK_EQ(loaded_stats[0].num_long_lived_mappings, num_simple);
+  CHECK_EQ(loaded_stats[1].num_long_lived_mappings,
+           long_lived.size() - num_simple);
+  PrintSegmentStats("Loaded", address_space);
+
+  // One-shot activations of random sizes always use the extended space.
+  std::mt19937 random(0);
+  std::uniform_int_distribution<int> num_pages(1, 64);
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_activations); ++i) {
+    const DeviceBuffer device_buffer =
+        address_space
+            .MapMemory(host_memory.Allocate(num_pages(random) * kPageSizeBytes),
+                       DmaDirection::kBidirectional, MappingTypeHint::kAny)
+            .ValueOrDie();
+    CHECK(IsExtended(device_buffer));
+    CHECK_OK(address_space.UnmapMemory(device_buffer));
+  }
+
+  for (const auto& device_buffer : long_lived) {
+    CHECK_OK(address_space.UnmapMemory(device_buffer));
+  }
+  CHECK_OK(address_space.UnmapMemory(queue));
+  for (const auto& stats : address_space.GetSegmentStats()) {
+    CHECK_EQ(stats.allocated_bytes, 0);
+  }
+  PrintSegmentStats("Drained", address_space);
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
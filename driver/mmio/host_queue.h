@@ -100,6 +100,13 @@ class HostQueue {
     return GetAvailableSpaceLocked();
   }
 
+  // Returns the index of the most recently completed element, or -1 if none
+  // completed since the queue was opened.
+  int GetLastCompletedIndex() const LOCKS_EXCLUDED(queue_mutex_) {
+    StdMutexLock lock(&queue_mutex_);
+    return last_completed_;
+  }
+
   // Returns the size of the queue.
   int size() const { return size_; }
 
@@ -217,6 +224,7 @@ class HostQueue {
   // Variables to control queue.
   int completed_head_ GUARDED_BY(queue_mutex_){0};
   int tail_ GUARDED_BY(queue_mutex_){0};
+  int last_completed_ GUARDED_BY(queue_mutex_){-1};
 
   // Configuration containing all the offsets related to the host queue.
   const config::QueueCsrOffsets csr_offsets_;
@@ -361,6 +369,7 @@ Status HostQueue<Element, StatusBlock>::Close(bool in_error) {
   queue_ = nullptr;
   completed_head_ = 0;
   tail_ = 0;
+  last_completed_ = -1;
 
   // Release coherent memory block.
   RETURN_IF_ERROR(coherent_allocator_->Close());
@@ -410,6 +419,7 @@ void HostQueue<Element, StatusBlock>::ProcessStatusBlock() {
       if (callbacks_[completed_head_]) {
         dones.push_back(std::move(callbacks_[completed_head_]));
       }
+      last_completed_ = completed_head_;
       ++completed_head_;
       completed_head_ &= (size_ - 1);
     }
@@ -454,6 +464,7 @@ void HostQueue<Element, StatusBlock>::ProcessStatusBlockIfOpen() {
       if (callbacks_[completed_head_]) {
         dones.push_back(std::move(callbacks_[completed_head_]));
       }
+      last_completed_ = completed_head_;
       ++completed_head_;
       completed_head_ &= (size_ - 1);
     }
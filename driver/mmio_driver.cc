@@ -39,7 +39,7 @@
 #include "driver/single_tpu_request.h"
 #include "driver/top_level_handler.h"
 #include "driver/tpu_request.h"
-#include "driver_shared/time_stamper/driver_time_stamper.h"
+#include "driver_shared/time_stamper/driver_time_stamper_factory.h"
 #include "driver_shared/time_stamper/time_stamper.h"
 #include "executable/executable_generated.h"
 #include "port/cleanup.h"
@@ -112,7 +112,8 @@ MmioDriver::MmioDriver(
       dma_scheduler_(api::Watchdog::MakeWatchdog(
                          driver_options.watchdog_timeout_ns(),
                          [this](int64) { HandleWatchdogTimeout(); }),
-                     gtl::MakeUnique<driver_shared::DriverTimeStamper>()),
+                     driver_shared::DriverTimeStamperFactory()
+                         .CreateTimeStamper()),
       chip_config_(std::move(chip_config)) {}
 
 MmioDriver::~MmioDriver() {
@@ -221,7 +222,7 @@ Status MmioDriver::RegisterAndEnableAllInterrupts() {
         // and clearing the interrupts. This is handle inside CheckFatalError().
         CHECK_OK(fatal_error_interrupt_controller_->DisableInterrupts());
         CHECK_OK(fatal_error_interrupt_controller_->ClearInterruptStatus(0));
-        CheckFatalError(CheckHibError());
+        CheckFatalError(CheckHibError(), ErrorClass::kHibError);
       }));
 
   // Enable interrupts, if needed.
@@ -406,6 +407,7 @@ Status MmioDriver::DoClose(bool in_error, api::Driver::ClosingMode mode) {
 
   // Begin shutdown.
   status.Update(dma_scheduler_.Close(mode));
+  status.Update(UnmapAllInstructionBuffers());
   status.Update(UnmapAllParameters());
   status.Update(mmu_mapper_->Close());
   status.Update(top_level_handler_->EnableReset());
@@ -433,6 +435,22 @@ Status MmioDriver::DoCancelAndWaitRequests(bool in_error) {
   return Status();  // OK
 }
 
+api::Driver::DmaStatistics MmioDriver::GetDmaStatistics() const {
+  DmaStatistics statistics = Driver::GetDmaStatistics();
+  for (const auto& segment_stats : address_space_->GetSegmentStats()) {
+    DmaStatistics::AddressSpace address_space;
+    address_space.name = segment_stats.name;
+    address_space.allocated_bytes = segment_stats.allocated_bytes;
+    address_space.free_bytes = segment_stats.free_bytes;
+    address_space.largest_free_block_bytes =
+        segment_stats.largest_free_block_bytes;
+    address_space.num_long_lived_mappings =
+        segment_stats.num_long_lived_mappings;
+    statistics.address_spaces.push_back(std::move(address_space));
+  }
+  return statistics;
+}
+
 Buffer MmioDriver::DoMakeBuffer(size_t size_bytes) const {
   return allocator_->MakeBuffer(size_bytes);
 }
@@ -442,7 +460,7 @@ StatusOr<MappedDeviceBuffer> MmioDriver::DoMapBuffer(const Buffer& buffer,
   if (buffer.IsValid()) {
     ASSIGN_OR_RETURN(auto device_buffer,
                      address_space_->MapMemory(buffer, direction,
-                                               MappingTypeHint::kExtended));
+                                               MappingTypeHint::kLongLived));
     // TODO : this is dangerous: the std::bind captures a raw pointer to
     // the address space. This will break if executable registry outlives
     // address space in the driver. A better way is to at least use share_ptr
@@ -512,6 +530,7 @@ Status MmioDriver::TryIssueDmas() {
     // Enqueue should always succeed.
     CheckFatalError(
         instruction_queue_->Enqueue(descriptor, [this, dma](uint32 error_code) {
+          GetDmaStatisticsRecorder()->RecordDma(*dma);
           CHECK_OK(dma_scheduler_.NotifyDmaCompletion(dma));
           HandleHostQueueCompletion(error_code);
         }));
@@ -536,17 +555,29 @@ void MmioDriver::HandleHostQueueCompletion(uint32 error_code) {
   if (error_code != 0) {
     // TODO: Parse the error code and attach a human readable string.
     CheckFatalError(
-        InternalError(StringPrintf("Host Queue error %d.", error_code)));
+        InternalError(StringPrintf("Host Queue error %d.", error_code)),
+        ErrorClass::kHostQueueError);
     return;
   }
   CHECK_OK(TryIssueDmas());
 }
 
-void MmioDriver::CheckFatalError(const Status& status) {
+void MmioDriver::CheckFatalError(const Status& status,
+                                 ErrorClass error_class) {
   if (status.ok()) {
     return;
   }
-  NotifyFatalError(status);
+
+  ErrorRecord record;
+  record.error_class = error_class;
+  if (instruction_queue_) {
+    record.last_completed_descriptor =
+        instruction_queue_->GetLastCompletedIndex();
+  }
+
+  SnapshotHibErrorCsrs(registers_.get(), hib_user_csr_offsets_, &record);
+
+  NotifyFatalError(status, std::move(record));
 }
 
 Status MmioDriver::DoSetRealtimeMode(bool on) {
@@ -91,6 +91,9 @@ class MmioDriver : public Driver {
     return chip_structure_.allocation_alignment_bytes;
   }
 
+  // Adds occupancy of the device address space to the DMA statistics.
+  DmaStatistics GetDmaStatistics() const override;
+
  protected:
   Status DoOpen(bool debug_mode) LOCKS_EXCLUDED(state_mutex_) override;
   Status DoClose(bool in_error, api::Driver::ClosingMode mode)
@@ -122,6 +125,14 @@ class MmioDriver : public Driver {
 
   Status DoSetRealtimeMode(bool on) final;
 
+  // Clock rates are changed by the kernel driver.
+  bool HasImplementedPerformanceThrottling() const final { return true; }
+
+  Status DoSetPerformanceExpectation(
+      api::PerformanceExpectation performance) final {
+    return top_level_handler_->SetPerformanceExpectation(performance);
+  }
+
   Status DoSubmit(std::shared_ptr<driver::TpuRequest> request)
       LOCKS_EXCLUDED(state_mutex_) override;
 
@@ -174,8 +185,11 @@ class MmioDriver : public Driver {
   // Checks for HIB Errors.
   Status CheckHibError();
 
-  // Catch all fatal error handling during runtime.
-  void CheckFatalError(const Status& status);
+  // Catch all fatal error handling during runtime. Errors are recorded with
+  // |error_class| and a snapshot of the HIB error registers.
+  void CheckFatalError(
+      const Status& status,
+      api::Driver::ErrorClass error_class = api::Driver::ErrorClass::kUnknown);
 
   // Registers and enables all interrupts.
   Status RegisterAndEnableAllInterrupts();
@@ -14,6 +14,14 @@
 
 #include "driver/package_registry.h"
 
+#if defined(__linux__)
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+#include <algorithm>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -39,6 +47,81 @@ namespace {
 // Alignment for buffers allocated by the registry.
 constexpr uint64 kAlignment = 4096;
 
+// Decodes DMA hints of the given executable into a plan that can be resolved
+// against request buffers without walking the flatbuffer.
+DmaHintPlan DecodeDmaHints(const Executable& executable) {
+  DmaHintPlan plan;
+  if (executable.dma_hints() == nullptr ||
+      executable.dma_hints()->hints() == nullptr) {
+    return plan;
+  }
+
+  plan.reserve(executable.dma_hints()->hints()->size());
+  for (const auto& dma_hint : *executable.dma_hints()->hints()) {
+    DmaHintPlanEntry entry;
+    switch (dma_hint->any_hint_type()) {
+      case AnyHint_DmaDescriptorHint: {
+        const auto& descriptor = dma_hint->any_hint_as_DmaDescriptorHint();
+        const auto& meta = descriptor->meta();
+        entry.offset_bytes = descriptor->offset_in_bytes();
+        entry.size_bytes = descriptor->size_in_bytes();
+        switch (meta->desc()) {
+          case Description_BASE_ADDRESS_INPUT_ACTIVATION:
+            entry.type = DmaDescriptorType::kInputActivation;
+            entry.source = DmaHintPlanEntry::Source::kInputActivation;
+            entry.layer_name = meta->name()->str();
+            entry.batch = meta->batch();
+            break;
+
+          case Description_BASE_ADDRESS_OUTPUT_ACTIVATION:
+            entry.type = DmaDescriptorType::kOutputActivation;
+            entry.source = DmaHintPlanEntry::Source::kOutputActivation;
+            entry.layer_name = meta->name()->str();
+            entry.batch = meta->batch();
+            break;
+
+          case Description_BASE_ADDRESS_PARAMETER:
+            entry.type = DmaDescriptorType::kParameter;
+            entry.source = DmaHintPlanEntry::Source::kParameter;
+            break;
+
+          case Description_BASE_ADDRESS_SCRATCH:
+            entry.type = (dma_hint->direction() == Direction_INFEED)
+                             ? DmaDescriptorType::kInputActivation
+                             : DmaDescriptorType::kOutputActivation;
+            entry.source = DmaHintPlanEntry::Source::kScratch;
+            break;
+        }
+        break;
+      }
+
+      case AnyHint_InstructionHint:
+        entry.type = DmaDescriptorType::kInstruction;
+        entry.source = DmaHintPlanEntry::Source::kInstruction;
+        entry.chunk_id =
+            dma_hint->any_hint_as_InstructionHint()->instruction_chunk_index();
+        break;
+
+      case AnyHint_InterruptHint:
+        entry.type = static_cast<DmaDescriptorType>(
+            static_cast<int>(DmaDescriptorType::kScalarCoreInterrupt0) +
+            static_cast<int>(dma_hint->any_hint_as_InterruptHint()->type()));
+        break;
+
+      case AnyHint_FenceHint:
+        entry.type = DmaDescriptorType::kLocalFence;
+        break;
+
+      case AnyHint_NONE:
+        LOG(FATAL) << StringPrintf("Unrecognized hint");
+        break;
+    }
+    plan.push_back(std::move(entry));
+  }
+
+  return plan;
+}
+
 }  // namespace
 
 PackageRegistry::PackageRegistry() : PackageRegistry(api::Chip::kUnknown) {}
@@ -120,7 +203,8 @@ PackageRegistry::GetExecutablesFromBinary(const char* executable_content,
 }
 
 StatusOr<const Executable*> PackageRegistry::GetMainExecutableFromExecutableMap(
-    std::unordered_map<ExecutableType, const Executable*> executables) {
+    std::unordered_map<ExecutableType, const Executable*> executables,
+    bool prefer_parameter_caching) {
   switch (executables.size()) {
     case 1:
       // TODO Here we are considering the sole executable in a
@@ -132,12 +216,13 @@ StatusOr<const Executable*> PackageRegistry::GetMainExecutableFromExecutableMap(
     case 2:
       return executables[ExecutableType_EXECUTION_ONLY];
 
-    // TODO Once this feature is implemented, we need to update the
-    // constructor used here. Right now we still allow 3 executables in a
-    // package to avoid future backward-incompatibility. The current behavior is
-    // to always use the stand-alone one.
+    // Packages with 3 executables can run either stand-alone, or through
+    // parameter caching. Stand-alone is used unless parameter caching is
+    // preferred.
     case 3:
-      return executables[ExecutableType_STAND_ALONE];
+      return prefer_parameter_caching
+                 ? executables[ExecutableType_EXECUTION_ONLY]
+                 : executables[ExecutableType_STAND_ALONE];
 
     default:
       return InternalError("Unexpected combination of executables.");
@@ -145,14 +230,17 @@ StatusOr<const Executable*> PackageRegistry::GetMainExecutableFromExecutableMap(
 }
 
 StatusOr<const Executable*> PackageRegistry::GetPCExecutableFromExecutableMap(
-    std::unordered_map<ExecutableType, const Executable*> executables) {
+    std::unordered_map<ExecutableType, const Executable*> executables,
+    bool prefer_parameter_caching) {
   switch (executables.size()) {
     case 1:
       return nullptr;
     case 2:
       return executables[ExecutableType_PARAMETER_CACHING];
     case 3:
-      return nullptr;
+      return prefer_parameter_caching
+                 ? executables[ExecutableType_PARAMETER_CACHING]
+                 : nullptr;
     default:
       return InternalError("Unexpected combination of executables.");
   }
@@ -169,10 +257,13 @@ StatusOr<const api::PackageReference*> PackageRegistry::RegisterPackage(
     RETURN_IF_ERROR(VerifyExecutableMatchesChip(it.second));
   }
 
+  const bool prefer_parameter_caching = prefer_parameter_caching_;
   ASSIGN_OR_RETURN(const Executable* main_executable,
-                   GetMainExecutableFromExecutableMap(executables));
+                   GetMainExecutableFromExecutableMap(
+                       executables, prefer_parameter_caching));
   ASSIGN_OR_RETURN(const Executable* parameter_caching_executable,
-                   GetPCExecutableFromExecutableMap(executables));
+                   GetPCExecutableFromExecutableMap(executables,
+                                                    prefer_parameter_caching));
 
   PackageReference* package_reference;
 
@@ -186,6 +277,8 @@ StatusOr<const api::PackageReference*> PackageRegistry::RegisterPackage(
                              dram_allocator_, verifier_.get());
   }
 
+  package_reference->ReleaseUnneededBytes();
+
   return SetRegistrations(
       std::unique_ptr<api::PackageReference>(package_reference));
 }
@@ -196,8 +289,10 @@ PackageRegistry::GetMainExecutableLayersInfoFromBinary(
   ASSIGN_OR_RETURN(auto executables,
                    GetExecutablesFromBinary(executable_content, length));
 
+  // Layers are the same across all executables in a package.
   ASSIGN_OR_RETURN(const Executable* main_executable,
-                   GetMainExecutableFromExecutableMap(executables));
+                   GetMainExecutableFromExecutableMap(
+                       executables, /*prefer_parameter_caching=*/false));
 
   return gtl::MakeUnique<ExecutableLayersInfo>(main_executable);
 }
@@ -350,6 +445,7 @@ Status PackageRegistry::Unregister(
 }
 
 Status PackageRegistry::UnregisterAll() {
+  RETURN_IF_ERROR(UnmapAllInstructionBuffers());
   RETURN_IF_ERROR(UnmapAllParameters());
 
   StdMutexLock registrations_lock(&registrations_mutex_);
@@ -385,6 +481,22 @@ Status PackageRegistry::UnmapAllParameters() {
   return status;
 }
 
+Status PackageRegistry::UnmapAllInstructionBuffers() {
+  StdMutexLock registrations_lock(&registrations_mutex_);
+  Status status;
+
+  for (auto& it : registrations_) {
+    if (it.first == nullptr) {
+      return InternalError("Encountered nullptr key to package reference.");
+    }
+    PackageReference* package = const_cast<PackageReference*>(
+        static_cast<const PackageReference*>(it.first));
+    status.Update(package->UnmapInstructionBuffers());
+  }
+
+  return status;
+}
+
 std::vector<api::PackageReference*> PackageRegistry::GetAllRegistrations()
     const {
   StdMutexLock registrations_lock(&registrations_mutex_);
@@ -591,6 +703,9 @@ ExecutableReference::ExecutableReference(const Executable* executable,
   // Extracts the input and output layers info from the executable binary.
   executable_layers_info_ = gtl::MakeUnique<ExecutableLayersInfo>(executable);
 
+  // Decodes DMA hints once, as they are identical for every request.
+  dma_hint_plan_ = DecodeDmaHints(*executable);
+
   // The DRAM will be needed if any of the component needs to access it.
   if (executable_layers_info_->NeedsDramInLayers()) {
     needs_dram_ = true;
@@ -614,6 +729,24 @@ Status ExecutableReference::ValidateInput(const std::string& input_name,
   return OkStatus();
 }
 
+Status ExecutableReference::ValidateInput(const std::string& input_name,
+                                          const Buffer& input,
+                                          api::InputDataFormat format) const {
+  if (format == api::InputDataFormat::kNative) {
+    return ValidateInput(input_name, input);
+  }
+  ASSIGN_OR_RETURN(const auto* layer, InputLayer(input_name));
+
+  const int expected_size_bytes = layer->InputSizeBytes(format);
+  if (input.size_bytes() != expected_size_bytes) {
+    return InvalidArgumentError(StringPrintf(
+        "Unexpected input size for \"%s\". Expected %d, got %zu",
+        input_name.c_str(), expected_size_bytes, input.size_bytes()));
+  }
+
+  return OkStatus();
+}
+
 Status ExecutableReference::ValidateOutput(const std::string& output_name,
                                            const Buffer& output) const {
   ASSIGN_OR_RETURN(const int expected_size_bytes,
@@ -626,6 +759,24 @@ Status ExecutableReference::ValidateOutput(const std::string& output_name,
   return Status();  // OK
 }
 
+Status ExecutableReference::ValidateOutput(
+    const std::string& output_name, const Buffer& output,
+    const api::OutputDestination& destination) const {
+  if (destination.IsDefault()) {
+    return ValidateOutput(output_name, output);
+  }
+  ASSIGN_OR_RETURN(const auto* layer, OutputLayer(output_name));
+  ASSIGN_OR_RETURN(const int expected_size_bytes,
+                   layer->DestinationSizeBytes(destination));
+  if (output.size_bytes() < expected_size_bytes) {
+    return InvalidArgumentError(StringPrintf(
+        "Output buffer for \"%s\" is too small for its destination. "
+        "expected>=%d, actual=%zu.",
+        output_name.c_str(), expected_size_bytes, output.size_bytes()));
+  }
+  return Status();  // OK
+}
+
 // Reuses the instruction buffers if available. Creates a new one if not.
 std::unique_ptr<InstructionBuffers> ExecutableReference::GetInstructionBuffers(
     Allocator* const allocator) {
@@ -641,13 +792,43 @@ std::unique_ptr<InstructionBuffers> ExecutableReference::GetInstructionBuffers(
     return old_instruction_buffers;
   }
 
+  // Chunks that need no linking are copied once and shared by all instances.
+  if (unlinked_instruction_chunks_.empty()) {
+    unlinked_instruction_chunks_ = InstructionBuffers::CopyUnlinkedChunks(
+        allocator, *executable().instruction_bitstreams());
+  }
+
   auto instruction_buffers = gtl::MakeUnique<InstructionBuffers>(
-      allocator, *executable().instruction_bitstreams());
+      allocator, unlinked_instruction_chunks_,
+      *executable().instruction_bitstreams());
 
   VLOG(10) << "Created new instruction buffers.";
   return instruction_buffers;
 }
 
+int64 ExecutableReference::PooledInstructionBufferBytes() const {
+  StdMutexLock lock(&instruction_buffers_vector_mutex_);
+
+  int64 size_bytes = 0;
+  for (const auto& buffer : unlinked_instruction_chunks_) {
+    size_bytes += buffer.size_bytes();
+  }
+  for (const auto& instruction_buffers : instruction_buffers_vector_) {
+    size_bytes += instruction_buffers->LinkedChunkBytes();
+  }
+  return size_bytes;
+}
+
+Status ExecutableReference::UnmapInstructionBuffers() {
+  StdMutexLock lock(&instruction_buffers_vector_mutex_);
+
+  Status status;
+  for (const auto& instruction_buffers : instruction_buffers_vector_) {
+    status.Update(instruction_buffers->Unmap());
+  }
+  return status;
+}
+
 // Returns instruction buffers back to the executable references so that the
 // next request could reuse it.
 void ExecutableReference::ReturnInstructionBuffers(
@@ -745,6 +926,82 @@ PackageReference::AllExecutableReferences() const {
   return all_references;
 }
 
+void PackageReference::ReleaseUnneededBytes() {
+  if (verifier_->CanVerifySignature()) {
+    return;
+  }
+
+  if (package_->signature() != nullptr) {
+    ReleasePages(package_->signature()->data(), package_->signature()->size());
+  }
+
+  // Packages carrying a stand-alone executable next to a parameter-caching
+  // pair only use one side, which is decided at registration.
+  const auto all_references = AllExecutableReferences();
+  const auto* multi_executable = flatbuffers::GetRoot<MultiExecutable>(
+      package_->serialized_multi_executable()->data());
+  for (const auto* executable_serialized :
+       *multi_executable->serialized_executables()) {
+    const auto* executable =
+        flatbuffers::GetRoot<Executable>(executable_serialized->c_str());
+    const bool in_use =
+        std::any_of(all_references.begin(), all_references.end(),
+                    [executable](const ExecutableReference* reference) {
+                      return &reference->executable() == executable;
+                    });
+    if (!in_use) {
+      ReleasePages(executable_serialized->c_str(),
+                   executable_serialized->size());
+    }
+  }
+
+  VLOG(2) << StringPrintf("Released %lld of %zu package bytes.",
+                          static_cast<long long>(released_package_bytes_),
+                          package_buffer_.size_bytes());
+}
+
+void PackageReference::ReleasePages(const void* ptr, size_t size_bytes) {
+#if defined(__linux__)
+  // The package copy is private anonymous memory, so released pages read back
+  // as zeros should anything touch them again.
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + page_size - 1) / page_size *
+      page_size;
+  const uintptr_t end =
+      (reinterpret_cast<uintptr_t>(ptr) + size_bytes) / page_size * page_size;
+  if (end <= begin) {
+    return;
+  }
+
+  if (madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) ==
+      0) {
+    released_package_bytes_ += end - begin;
+  } else {
+    VLOG(1) << StringPrintf("Failed to release package pages: %s",
+                            strerror(errno));
+  }
+#else   // !defined(__linux__)
+  (void)ptr;
+  (void)size_bytes;
+#endif  // defined(__linux__)
+}
+
+api::PackageMemoryUsage PackageReference::GetMemoryUsage() const {
+  api::PackageMemoryUsage usage;
+  usage.package_bytes = package_buffer_.size_bytes();
+  usage.released_package_bytes = released_package_bytes_;
+  for (const ExecutableReference* executable_ref : AllExecutableReferences()) {
+    usage.instruction_buffer_bytes +=
+        executable_ref->PooledInstructionBufferBytes();
+    const Buffer scratch = executable_ref->scratch();
+    if (scratch.IsValid() && !scratch.IsDramType()) {
+      usage.scratch_bytes += scratch.size_bytes();
+    }
+  }
+  return usage;
+}
+
 Status PackageReference::UnmapParameters() {
   Status status;
 
@@ -755,6 +1012,16 @@ Status PackageReference::UnmapParameters() {
   return status;
 }
 
+Status PackageReference::UnmapInstructionBuffers() {
+  Status status;
+
+  for (ExecutableReference* executable_ref : AllExecutableReferences()) {
+    status.Update(executable_ref->UnmapInstructionBuffers());
+  }
+
+  return status;
+}
+
 StatusOr<bool> PackageReference::ParametersMapped() const {
   auto all_executable_refs = AllExecutableReferences();
   if (all_executable_refs.empty()) {
@@ -15,6 +15,7 @@
 #ifndef DARWINN_DRIVER_PACKAGE_REGISTRY_H_
 #define DARWINN_DRIVER_PACKAGE_REGISTRY_H_
 
+#include <atomic>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
@@ -29,6 +30,7 @@
 #include "api/package_reference.h"
 #include "driver/aligned_allocator.h"
 #include "driver/device_buffer_mapper.h"
+#include "driver/dma_info.h"
 #include "driver/instruction_buffers.h"
 #include "driver/memory/dram_allocator.h"
 #include "driver/package_verifier.h"
@@ -323,6 +325,10 @@ class ExecutableReference {
   // Returns true if the parameters buffer is already mapped to the device.
   bool ParametersMapped() const { return parameters_mapped_; }
 
+  // Unmaps the device mappings kept by pooled instruction buffers.
+  Status UnmapInstructionBuffers()
+      LOCKS_EXCLUDED(instruction_buffers_vector_mutex_);
+
   // Returns the device mapped buffer for the parameters in this executable.
   const DeviceBuffer& GetParameterDeviceBuffer() const {
     return mapped_parameters_.device_buffer();
@@ -332,14 +338,26 @@ class ExecutableReference {
   // buffer will be invalid.
   Buffer scratch() const { return scratch_; }
 
+  // Returns the number of bytes held by instruction buffers pooled for reuse.
+  int64 PooledInstructionBufferBytes() const
+      LOCKS_EXCLUDED(instruction_buffers_vector_mutex_);
+
   // Validates that the given input buffer is compatible with the executable.
   Status ValidateInput(const std::string& input_name,
                        const Buffer& input) const;
 
+  // Same as above, for input data in the given format.
+  Status ValidateInput(const std::string& input_name, const Buffer& input,
+                       api::InputDataFormat format) const;
+
   // Validates that the given output buffer is compatible with the executable.
   Status ValidateOutput(const std::string& output_name,
                         const Buffer& output) const;
 
+  // Same as above, for an output written to the given destination.
+  Status ValidateOutput(const std::string& output_name, const Buffer& output,
+                        const api::OutputDestination& destination) const;
+
   // Returns the parameter-caching token which is unique across models that are
   // compiled together and can cache their parameters on TPU SRAM at the same
   // time. If 0, it means this executable's parameters cannot safely co-exist
@@ -390,6 +408,10 @@ class ExecutableReference {
     return *package_reference_;
   }
 
+  // Returns DMA hints of this executable, decoded at registration time. Empty
+  // if the executable does not carry DMA hints.
+  const DmaHintPlan& dma_hint_plan() const { return dma_hint_plan_; }
+
  private:
   friend class PackageReference;
 
@@ -413,10 +435,19 @@ class ExecutableReference {
   // Holds the information on input and output layers.
   std::unique_ptr<ExecutableLayersInfo> executable_layers_info_;
 
+  // DMA hints decoded from the executable, so requests do not need to walk
+  // the flatbuffer again.
+  DmaHintPlan dma_hint_plan_;
+
   mutable std::mutex instruction_buffers_vector_mutex_;
   std::vector<std::unique_ptr<InstructionBuffers>> instruction_buffers_vector_
       GUARDED_BY(instruction_buffers_vector_mutex_);
 
+  // Aligned copies of instruction chunks that need no linking, shared by all
+  // instruction buffers of this executable. Created with the first ones.
+  std::vector<Buffer> unlinked_instruction_chunks_
+      GUARDED_BY(instruction_buffers_vector_mutex_);
+
   // Specifies if parameters of this executable are mapped to the device.
   bool parameters_mapped_ = false;
 
@@ -584,6 +615,8 @@ class PackageReference : public api::PackageReference {
     return flatbuffers::GetString(package_->model_identifier());
   }
 
+  api::PackageMemoryUsage GetMemoryUsage() const override;
+
   // Returns the stored execution context interface. This class still owns the
   // object.
   api::ExecutionContextInterface* GetExecutionContextInterface() const {
@@ -618,9 +651,23 @@ class PackageReference : public api::PackageReference {
   // Unmaps parameters of all executables in this package.
   Status UnmapParameters();
 
+  // Unmaps pooled instruction buffers of all executables in this package.
+  Status UnmapInstructionBuffers();
+
+  // Returns package bytes which are not needed once registered to the
+  // operating system: the signature and executables not referenced by this
+  // package, if signatures cannot be verified anyway.
+  void ReleaseUnneededBytes();
+
+  // Releases whole pages within the given range of the package buffer.
+  void ReleasePages(const void* ptr, size_t size_bytes);
+
   // Buffer backing the package buffer.
   Buffer package_buffer_;
 
+  // Number of bytes of the package buffer released after registration.
+  int64 released_package_bytes_ = 0;
+
   // The flatbuffer representation of the package we are wrapping.
   const Package* package_;
 
@@ -698,6 +745,9 @@ class PackageRegistry {
   // Unmaps all parameters in all registered packages.
   Status UnmapAllParameters() LOCKS_EXCLUDED(registrations_mutex_);
 
+  // Unmaps all pooled instruction buffers in all registered packages.
+  Status UnmapAllInstructionBuffers() LOCKS_EXCLUDED(registrations_mutex_);
+
   // Returns the number of registered executables.
   int GetRegistrySize() const LOCKS_EXCLUDED(registrations_mutex_) {
     StdMutexLock registration_lock(&registrations_mutex_);
@@ -712,19 +762,29 @@ class PackageRegistry {
   // loaded on TPU DRAM.
   void ResetParametersLoaded() LOCKS_EXCLUDED(registrations_mutex_);
 
+  // Sets whether packages carrying both a stand-alone executable and a
+  // parameter-caching / execution-only pair should run through the latter.
+  // Caching parameters on TPU avoids streaming them on every inference, which
+  // pays off on slow host links. Only affects packages registered afterwards.
+  void SetPreferParameterCaching(bool prefer) {
+    prefer_parameter_caching_ = prefer;
+  }
+
  private:
   // Returns the main executable from the executable map.
   // Returns error if failed to find main executable or had unexpected
   // executable combinations.
   static StatusOr<const Executable*> GetMainExecutableFromExecutableMap(
-      std::unordered_map<ExecutableType, const Executable*>);
+      std::unordered_map<ExecutableType, const Executable*>,
+      bool prefer_parameter_caching);
 
   // Returns the parameter caching executable from the executable map.
   // Returns nullptr if no parameter caching executable could be found in the
-  // map.
+  // map, or if the stand-alone executable is to be used.
   // Returns error if had unexpected executable combinations.
   static StatusOr<const Executable*> GetPCExecutableFromExecutableMap(
-      std::unordered_map<ExecutableType, const Executable*>);
+      std::unordered_map<ExecutableType, const Executable*>,
+      bool prefer_parameter_caching);
 
   // Registers an executable package binary.
   StatusOr<const api::PackageReference*> RegisterPackage(
@@ -782,6 +842,10 @@ class PackageRegistry {
 
   // A verifier for checking digital signatures on executable packages.
   std::unique_ptr<PackageVerifier> verifier_;
+
+  // If true, parameter-caching executables are used over stand-alone ones when
+  // a package carries both.
+  std::atomic<bool> prefer_parameter_caching_{false};
 };
 
 }  // namespace driver
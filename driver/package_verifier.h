@@ -38,6 +38,10 @@ class PackageVerifier {
 
   // Verifies the executable package provided its buffer.
   virtual Status VerifySignature(const void* package_buffer) const = 0;
+
+  // Returns false if VerifySignature always fails, in which case package bytes
+  // only covered by the signature need not be kept.
+  virtual bool CanVerifySignature() const { return true; }
 };
 
 // A noop implementation of ExecutableVerifier that errors out on all calls.
@@ -46,6 +50,7 @@ class NoopPackageVerifier : public PackageVerifier {
   NoopPackageVerifier() = default;
   ~NoopPackageVerifier() override = default;
   Status VerifySignature(const void* package_buffer) const override;
+  bool CanVerifySignature() const override { return false; }
 };
 
 // Makes an ExecutableVerifier provided a public key. If the key is empty a noop
@@ -0,0 +1,79 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/registers/register_batch.h"
+
+#include <utility>
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+void RegisterBatch::Read(uint64 offset, uint64* value) {
+  Operation operation{Type::kRead, offset};
+  operation.read_value = value;
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Read32(uint64 offset, uint32* value) {
+  Operation operation{Type::kRead32, offset};
+  operation.read_value32 = value;
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Write(uint64 offset, uint64 value) {
+  Operation operation{Type::kWrite, offset};
+  operation.value = value;
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Write32(uint64 offset, uint32 value) {
+  Operation operation{Type::kWrite32, offset};
+  operation.value = value;
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Modify32(uint64 offset, Modifier modifier) {
+  Operation operation{Type::kModify32, offset};
+  operation.modifier = std::move(modifier);
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Poll(uint64 offset, uint64 expected_value,
+                         int64 timeout_us) {
+  Operation operation{Type::kPoll, offset};
+  operation.value = expected_value;
+  operation.timeout_us = timeout_us;
+  operations_.push_back(std::move(operation));
+}
+
+void RegisterBatch::Poll32(uint64 offset, uint32 expected_value,
+                           int64 timeout_us) {
+  Poll32(
+      offset,
+      [expected_value](uint32 value) { return value == expected_value; },
+      timeout_us);
+}
+
+void RegisterBatch::Poll32(uint64 offset, Condition condition,
+                           int64 timeout_us) {
+  Operation operation{Type::kPoll32, offset};
+  operation.condition = std::move(condition);
+  operation.timeout_us = timeout_us;
+  operations_.push_back(std::move(operation));
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,117 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_REGISTERS_REGISTER_BATCH_H_
+#define DARWINN_DRIVER_REGISTERS_REGISTER_BATCH_H_
+
+#include <functional>
+#include <vector>
+
+#include "driver/registers/registers.h"
+#include "port/integral_types.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// A sequence of register accesses, executed in order by Registers::Execute().
+// Knowing the whole sequence up front lets transports where every access is a
+// round trip, e.g. a control transfer on USB, skip accesses whose outcome is
+// already known from earlier accesses in the same batch.
+//
+// Example:
+//   RegisterBatch batch;
+//   batch.Modify32(offset, [](uint32 value) { return value | kEnable; });
+//   batch.Poll32(offset, [](uint32 value) { return value & kReady; });
+//   RETURN_IF_ERROR(registers->Execute(batch));
+class RegisterBatch {
+ public:
+  // Returns the new value of a register given its current value.
+  using Modifier = std::function<uint32(uint32)>;
+
+  // Returns true if a register has reached the awaited value.
+  using Condition = std::function<bool(uint32)>;
+
+  enum class Type {
+    kRead,
+    kRead32,
+    kWrite,
+    kWrite32,
+    kModify32,
+    kPoll,
+    kPoll32,
+  };
+
+  struct Operation {
+    Type type;
+    uint64 offset;
+
+    // Value to write for kWrite and kWrite32, and expected value for kPoll.
+    uint64 value{0};
+
+    // Destinations of kRead and kRead32.
+    uint64* read_value{nullptr};
+    uint32* read_value32{nullptr};
+
+    Modifier modifier;
+    Condition condition;
+
+    // Timeout of polls in microseconds.
+    int64 timeout_us{Registers::kInfiniteTimeout};
+  };
+
+  RegisterBatch() = default;
+
+  // This class is movable, but not copyable.
+  RegisterBatch(RegisterBatch&& other) = default;
+  RegisterBatch& operator=(RegisterBatch&& other) = default;
+  RegisterBatch(const RegisterBatch&) = delete;
+  RegisterBatch& operator=(const RegisterBatch&) = delete;
+
+  // Reads a register into |value|, which must stay valid until the batch is
+  // executed.
+  void Read(uint64 offset, uint64* value);
+  void Read32(uint64 offset, uint32* value);
+
+  // Writes a register.
+  void Write(uint64 offset, uint64 value);
+  void Write32(uint64 offset, uint32 value);
+
+  // Reads, modifies, and writes back a register. Only meant for registers
+  // where reads have no side effects and writing the current value back
+  // changes nothing: the read may be skipped if the batch already knows the
+  // value, and the write if it does not change the value.
+  void Modify32(uint64 offset, Modifier modifier);
+
+  // Polls a register until it has the given value, or until |condition| holds
+  // for its value. Polls forever if timeout is zero or negative.
+  void Poll(uint64 offset, uint64 expected_value,
+            int64 timeout_us = Registers::kInfiniteTimeout);
+  void Poll32(uint64 offset, uint32 expected_value,
+              int64 timeout_us = Registers::kInfiniteTimeout);
+  void Poll32(uint64 offset, Condition condition,
+              int64 timeout_us = Registers::kInfiniteTimeout);
+
+  // Returns queued operations in order.
+  const std::vector<Operation>& operations() const { return operations_; }
+
+ private:
+  std::vector<Operation> operations_;
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_REGISTERS_REGISTER_BATCH_H_
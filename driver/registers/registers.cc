@@ -14,6 +14,7 @@
 
 #include "driver/registers/registers.h"
 
+#include "driver/registers/register_batch.h"
 #include "port/integral_types.h"
 #include "port/status.h"
 #include "port/status_macros.h"
@@ -33,6 +34,53 @@ Status Registers::Poll32(uint64 offset, uint32 expected_value,
                         [this](uint64 offset) { return Read32(offset); });
 }
 
+Status Registers::Execute(const RegisterBatch& batch) {
+  for (const RegisterBatch::Operation& operation : batch.operations()) {
+    switch (operation.type) {
+      case RegisterBatch::Type::kRead: {
+        ASSIGN_OR_RETURN(*operation.read_value, Read(operation.offset));
+        break;
+      }
+
+      case RegisterBatch::Type::kRead32: {
+        ASSIGN_OR_RETURN(*operation.read_value32, Read32(operation.offset));
+        break;
+      }
+
+      case RegisterBatch::Type::kWrite:
+        RETURN_IF_ERROR(Write(operation.offset, operation.value));
+        break;
+
+      case RegisterBatch::Type::kWrite32:
+        RETURN_IF_ERROR(Write32(operation.offset,
+                                static_cast<uint32>(operation.value)));
+        break;
+
+      case RegisterBatch::Type::kModify32: {
+        ASSIGN_OR_RETURN(const uint32 value, Read32(operation.offset));
+        RETURN_IF_ERROR(
+            Write32(operation.offset, operation.modifier(value)));
+        break;
+      }
+
+      case RegisterBatch::Type::kPoll:
+        RETURN_IF_ERROR(
+            Poll(operation.offset, operation.value, operation.timeout_us));
+        break;
+
+      case RegisterBatch::Type::kPoll32:
+        RETURN_IF_ERROR(
+            SpinReadUntilHelper<uint32>(
+                operation.offset, operation.condition, operation.timeout_us,
+                [this](uint64 offset) { return Read32(offset); })
+                .status());
+        break;
+    }
+  }
+
+  return Status();  // OK
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
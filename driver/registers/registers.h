@@ -27,6 +27,8 @@ namespace platforms {
 namespace darwinn {
 namespace driver {
 
+class RegisterBatch;
+
 // Interface for CSR access.
 class Registers : public driver_shared::Registers {
  public:
@@ -52,6 +54,10 @@ class Registers : public driver_shared::Registers {
   }
   virtual Status Poll32(uint64 offset, uint32 expected_value, int64 timeout_us);
 
+  // Executes accesses of |batch| in order, and stops at the first error. The
+  // default implementation performs every access as queued.
+  virtual Status Execute(const RegisterBatch& batch);
+
  protected:
   // Helper function for spin reads a register until received expected value or
   // reached timeout.  Polls forever if timeout is zero or negative.
@@ -59,13 +65,29 @@ class Registers : public driver_shared::Registers {
   template <typename IntType, typename FuncType>
   Status SpinReadHelper(uint64 offset, IntType expected_value, int64 timeout_us,
                         const FuncType& read_func) {
+    return SpinReadUntilHelper<IntType>(
+               offset,
+               [expected_value](IntType value) {
+                 return value == expected_value;
+               },
+               timeout_us, read_func)
+        .status();
+  }
+
+  // Same as above, but reads until |condition| holds for the value read, and
+  // returns that value.
+  template <typename IntType, typename ConditionType, typename FuncType>
+  StatusOr<IntType> SpinReadUntilHelper(uint64 offset,
+                                        const ConditionType& condition,
+                                        int64 timeout_us,
+                                        const FuncType& read_func) {
     int64 start_time_us, end_time_us;
     if (timeout_us > 0) {
       start_time_us = GetCurrentTimeMicros();
     }
 
-    ASSIGN_OR_RETURN(auto actual_value, read_func(offset));
-    while (actual_value != expected_value) {
+    ASSIGN_OR_RETURN(IntType actual_value, read_func(offset));
+    while (!condition(actual_value)) {
       if (timeout_us > 0) {
         end_time_us = GetCurrentTimeMicros();
         if (end_time_us - start_time_us > timeout_us) {
@@ -74,7 +96,7 @@ class Registers : public driver_shared::Registers {
       }
       ASSIGN_OR_RETURN(actual_value, read_func(offset));
     }
-    return OkStatus();
+    return actual_value;
   }
 };
 
@@ -40,24 +40,37 @@ Request::Request(int id, const PackageReference& package_ref,
 }
 
 Status Request::AddInput(const std::string& name, const Buffer& input) {
+  return AddInput(name, input, api::InputDataFormat::kNative);
+}
+
+Status Request::AddInput(const std::string& name, const Buffer& input,
+                         api::InputDataFormat format) {
   StdMutexLock lock(&mutex_);
   RETURN_IF_ERROR(ValidateState(kInitial));
 
-  RETURN_IF_ERROR(main_executable_ref_.ValidateInput(name, input));
+  RETURN_IF_ERROR(main_executable_ref_.ValidateInput(name, input, format));
   VLOG(3) << StringPrintf("Adding input \"%s\" with %zu bytes.", name.c_str(),
                           input.size_bytes());
   inputs_[name].push_back(input);
+  input_formats_[name].push_back(format);
   return OkStatus();
 }
 
 Status Request::AddOutput(const std::string& name, const Buffer output) {
+  return AddOutput(name, output, api::OutputDestination());
+}
+
+Status Request::AddOutput(const std::string& name, const Buffer output,
+                          const api::OutputDestination& destination) {
   StdMutexLock lock(&mutex_);
   RETURN_IF_ERROR(ValidateState(kInitial));
 
-  RETURN_IF_ERROR(main_executable_ref_.ValidateOutput(name, output));
+  RETURN_IF_ERROR(
+      main_executable_ref_.ValidateOutput(name, output, destination));
   VLOG(3) << StringPrintf("Adding output \"%s\" with %zu bytes.", name.c_str(),
                           output.size_bytes());
   outputs_[name].push_back(output);
+  output_destinations_[name].push_back(destination);
   return OkStatus();
 }
 
@@ -232,12 +245,14 @@ Status Request::PrepareIORequest(std::shared_ptr<TpuRequest> tpu_request) {
 
     for (const auto& name : main_executable_ref_.InputLayerNames()) {
       RETURN_IF_ERROR(
-          tpu_request->AddInput(name, inputs_.at(name)[buffer_index]));
+          tpu_request->AddInput(name, inputs_.at(name)[buffer_index],
+                                input_formats_.at(name)[buffer_index]));
     }
 
     for (const auto& name : main_executable_ref_.OutputLayerNames()) {
       RETURN_IF_ERROR(
-          tpu_request->AddOutput(name, outputs_.at(name)[buffer_index]));
+          tpu_request->AddOutput(name, outputs_.at(name)[buffer_index],
+                                 output_destinations_.at(name)[buffer_index]));
     }
   }
 
@@ -15,6 +15,10 @@
 #ifndef DARWINN_DRIVER_REQUEST_H_
 #define DARWINN_DRIVER_REQUEST_H_
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "api/request.h"
 #include "driver/tpu_request.h"
 #include "driver_shared/time_stamper/time_stamper.h"
@@ -53,10 +57,15 @@ class Request : public api::Request {
   // Adds an input buffer. Please refer to the API documentation for more info.
   Status AddInput(const std::string& name, const Buffer& input) override
       LOCKS_EXCLUDED(mutex_);
+  Status AddInput(const std::string& name, const Buffer& input,
+                  api::InputDataFormat format) override LOCKS_EXCLUDED(mutex_);
 
   // Adds an output buffer. Please refer to the API documentation for more info.
   Status AddOutput(const std::string& name, Buffer output) override
       LOCKS_EXCLUDED(mutex_);
+  Status AddOutput(const std::string& name, Buffer output,
+                   const api::OutputDestination& destination) override
+      LOCKS_EXCLUDED(mutex_);
 
   Status SetPriority(int priority) override LOCKS_EXCLUDED(mutex_);
 
@@ -175,9 +184,17 @@ class Request : public api::Request {
   // All input buffers in this request (name->batch_index->buffer).
   Buffer::NamedMap inputs_ GUARDED_BY(mutex_);
 
+  // Formats of the buffers in |inputs_| (name->batch_index->format).
+  std::unordered_map<std::string, std::vector<api::InputDataFormat>>
+      input_formats_ GUARDED_BY(mutex_);
+
   // All output buffers in this request (name->batch_index->buffer).
   Buffer::NamedMap outputs_ GUARDED_BY(mutex_);
 
+  // Destinations of the buffers in |outputs_| (name->batch_index->destination).
+  std::unordered_map<std::string, std::vector<api::OutputDestination>>
+      output_destinations_ GUARDED_BY(mutex_);
+
   // Final request completion callback.
   Done done_ GUARDED_BY(mutex_);
 
@@ -106,32 +106,52 @@ Status SingleTpuRequest::SetDone(Done done) {
 
 Status SingleTpuRequest::AddInput(const std::string& name,
                                   const Buffer& user_input) {
+  return AddInput(name, user_input, api::InputDataFormat::kNative);
+}
+
+Status SingleTpuRequest::AddInput(const std::string& name,
+                                  const Buffer& user_input,
+                                  api::InputDataFormat format) {
   TRACE_SCOPE("SingleTpuRequest::AddInput");
   StdMutexLock lock(&mutex_);
   RETURN_IF_ERROR(ValidateState(kUninitialized));
-  RETURN_IF_ERROR(executable_reference_.ValidateInput(name, user_input));
+  RETURN_IF_ERROR(
+      executable_reference_.ValidateInput(name, user_input, format));
   VLOG(3) << StringPrintf("Adding input \"%s\" with %zu bytes.", name.c_str(),
                           user_input.size_bytes());
 
   ASSIGN_OR_RETURN(const auto* layer, executable_reference_.InputLayer(name));
   Buffer host_input = user_input;
 
-  // For iterative models, we need to add padding after each iteration.
-  if (layer->execution_count_per_inference() > 1 &&
-      host_input.size_bytes() != layer->PaddedSizeBytes()) {
-    if (user_input.IsDramType())
+  if (format != api::InputDataFormat::kNative) {
+    TRACE_SCOPE("SingleTpuRequest::AddInput::ConvertInput");
+    if (!user_input.IsPtrType()) {
       return UnimplementedError(
-          "DRAM input buffers currently do not support "
-          "execution_count_per_inference > 1");
-    host_input = ScatterInput(user_input, layer);
-  }
+          "Input conversion is only supported for host memory buffers.");
+    }
+    // Quantizes, transforms signed data types and pads iterations in a single
+    // pass over the input, writing to an aligned buffer.
+    host_input = allocator_->MakeBuffer(layer->PaddedSizeBytes());
+    RETURN_IF_ERROR(
+        layer->ConvertInput(format, user_input.ptr(), host_input.ptr()));
+  } else {
+    // For iterative models, we need to add padding after each iteration.
+    if (layer->execution_count_per_inference() > 1 &&
+        host_input.size_bytes() != layer->PaddedSizeBytes()) {
+      if (user_input.IsDramType())
+        return UnimplementedError(
+            "DRAM input buffers currently do not support "
+            "execution_count_per_inference > 1");
+      host_input = ScatterInput(user_input, layer);
+    }
 
-  if (layer->SignedDataType()) {
-    if (user_input.IsDramType())
-      return UnimplementedError(
-          "DRAM input buffers currently do not support "
-          "signed data type");
-    RETURN_IF_ERROR(layer->TransformSignedDataType(host_input));
+    if (layer->SignedDataType()) {
+      if (user_input.IsDramType())
+        return UnimplementedError(
+            "DRAM input buffers currently do not support "
+            "signed data type");
+      RETURN_IF_ERROR(layer->TransformSignedDataType(host_input));
+    }
   }
 
   // If this buffer needs to be cached on TPU DRAM, we should replace it with a
@@ -178,11 +198,17 @@ Status SingleTpuRequest::AddInput(const std::string& name,
 }
 
 Status SingleTpuRequest::AddOutput(const std::string& name, Buffer output) {
+  return AddOutput(name, std::move(output), api::OutputDestination());
+}
+
+Status SingleTpuRequest::AddOutput(const std::string& name, Buffer output,
+                                   const api::OutputDestination& destination) {
   TRACE_SCOPE("SingleTpuRequest::AddOutput");
 
   StdMutexLock lock(&mutex_);
   RETURN_IF_ERROR(ValidateState(kUninitialized));
-  RETURN_IF_ERROR(executable_reference_.ValidateOutput(name, output));
+  RETURN_IF_ERROR(
+      executable_reference_.ValidateOutput(name, output, destination));
 
   VLOG(3) << StringPrintf("Adding output \"%s\" with %zu bytes.", name.c_str(),
                           output.size_bytes());
@@ -201,6 +227,11 @@ Status SingleTpuRequest::AddOutput(const std::string& name, Buffer output) {
     // validate that this output buffer does not in fact need
     // post-processing.
 
+    host_outputs_[name].push_back(output);
+  } else if (destination.IsDefault() && CanOutputDirectly(layer, output)) {
+    TRACE_SCOPE("SingleTpuRequest::AddOutput::PushUserBufferToHostOutput");
+    // The output needs no post-processing, so have the device write to the
+    // user-provided buffer and skip the copy from a temporary buffer.
     host_outputs_[name].push_back(output);
   } else {
     TRACE_SCOPE("SingleTpuRequest::AddOutput::CreateTmpAndPushToHostOutput");
@@ -217,6 +248,7 @@ Status SingleTpuRequest::AddOutput(const std::string& name, Buffer output) {
   }
 
   user_outputs_[name].push_back(std::move(output));
+  user_output_destinations_[name].push_back(destination);
 
   return Status();  // OK
 }
@@ -274,8 +306,7 @@ Status SingleTpuRequest::MapDataBuffers() {
 
 Status SingleTpuRequest::MapInstructionBuffers() {
   TRACE_SCOPE("Request::MapInstructionBuffers");
-  RETURN_IF_ERROR(device_buffer_mapper_->MapInstructions(
-      instruction_buffers_->GetBuffers()));
+  RETURN_IF_ERROR(instruction_buffers_->Map(device_buffer_mapper_.get()));
 
   return Status();  // OK
 }
@@ -365,15 +396,19 @@ Status SingleTpuRequest::Prepare() {
   VLOG(10) << "MapDataBuffers() done.";
 
   // Update the instruction stream to link the input, output and parameter
-  // addresses.
-  instruction_buffers_->LinkInstructionBuffers(
+  // addresses. Chunks whose linked addresses did not change are left as is.
+  auto status = instruction_buffers_->LinkInstructionBuffers(
       parameter_device_buffer_, device_buffer_mapper_.get(),
       *executable().instruction_bitstreams());
 
   // Mapping of instruction buffers must happen after instructions have been
   // been patched with linked addresses. Any further modifications to
   // instructions may not be visible to device due to cache coherency issues.
-  auto status = MapInstructionBuffers();
+  // Patched chunks are therefore unmapped during linking and mapped again here,
+  // while unchanged chunks keep their mappings from previous requests.
+  if (status.ok()) {
+    status = MapInstructionBuffers();
+  }
   if (!status.ok()) {
     status.Update(device_buffer_mapper_->UnmapAll());
     return status;
@@ -435,8 +470,12 @@ StatusOr<std::list<DmaInfo>> SingleTpuRequest::GetDmaInfos() const {
         StringPrintf("Unexpected call to GetDmaInfos in state_ = %d.", state_));
   }
 
-  return extractor_.ExtractDmaInfos(executable_reference_,
-                                    *device_buffer_mapper_);
+  auto dmas = extractor_.ExtractDmaInfos(executable_reference_,
+                                         *device_buffer_mapper_);
+  for (auto& dma : dmas) {
+    dma.set_executable(&executable_reference_);
+  }
+  return dmas;
 }
 
 Status SingleTpuRequest::Cancel() {
@@ -531,6 +570,27 @@ bool SingleTpuRequest::IsBufferAligned(const Buffer& buffer) {
   return reinterpret_cast<intptr_t>(buffer.ptr()) % alignment_bytes_ == 0;
 }
 
+bool SingleTpuRequest::CanOutputDirectly(
+    const api::OutputLayerInformation* layer, const Buffer& output) {
+  // Outputs cached on TPU DRAM are copied to host memory after execution
+  // anyway. Batched outputs are kept contiguous in |batch_outputs_|.
+  if (!output.IsPtrType() || layer->CacheOnDram() ||
+      executable_reference_.BatchSize() != 1) {
+    return false;
+  }
+
+  // Relayout, sign conversion and removing padding between iterations all
+  // need a separate buffer.
+  if (layer->NeedsRelayout() || layer->SignedDataType() ||
+      layer->execution_count_per_inference() != 1) {
+    return false;
+  }
+
+  // The device writes padded outputs.
+  return output.size_bytes() == layer->PaddedSizeBytes() &&
+         IsBufferAligned(output);
+}
+
 Status SingleTpuRequest::PostProcessOutputBuffers() {
   TRACE_SCOPE("SingleTpuRequest::PostProcessOutputBuffers");
   for (const auto& name_and_output : host_outputs_) {
@@ -554,6 +614,7 @@ Status SingleTpuRequest::PostProcessOutputBuffers() {
 
     ASSIGN_OR_RETURN(const auto* layer,
                      executable_reference_.OutputLayer(layer_name));
+    const auto& destinations = user_output_destinations_.at(layer_name);
 
     for (int i = 0; i < user_output_buffers.size(); ++i) {
       Buffer user_buffer = user_output_buffers[i];
@@ -566,11 +627,15 @@ Status SingleTpuRequest::PostProcessOutputBuffers() {
         // post-processing.
         continue;
       }
-      // Otherwise, always do post-processing even if tests indicate that
-      // it is not needed: the post-processing will also synchronize data
-      // between the runtime-managed (host) and user-provided output buffer.
 
       Buffer host_buffer = host_output_buffers[i];
+      if (host_buffer == user_buffer) {
+        // The device wrote the output directly into the user-provided buffer.
+        continue;
+      }
+
+      // Otherwise, post-processing also synchronizes data between the
+      // runtime-managed (host) and user-provided output buffer.
       if (host_buffer.IsDramType()) {
         TRACE_SCOPE(
             "SingleTpuRequest::PostProcessOutputBuffers::DramToHostOutput");
@@ -579,6 +644,24 @@ Status SingleTpuRequest::PostProcessOutputBuffers() {
         RETURN_IF_ERROR(dram_buffer->WriteTo(host_buffer.ptr()));
       }
 
+      if (!destinations[i].IsDefault()) {
+        // The destination window may be strided or sit inside a larger
+        // buffer, so convert the sign in the runtime-managed buffer and write
+        // the elements straight to their final location.
+        if (layer->SignedDataType()) {
+          TRACE_SCOPE(
+              "SingleTpuRequest::PostProcessOutputBuffers::"
+              "TransformSignedDataType");
+          RETURN_IF_ERROR(layer->TransformSignedDataType(
+              Buffer(host_buffer.ptr(), layer->PaddedSizeBytes())));
+        }
+        TRACE_SCOPE(
+            "SingleTpuRequest::PostProcessOutputBuffers::RelayoutToDestination");
+        RETURN_IF_ERROR(layer->Relayout(user_buffer.ptr(), host_buffer.ptr(),
+                                        destinations[i]));
+        continue;
+      }
+
       {
         TRACE_SCOPE("SingleTpuRequest::PostProcessOutputBuffers::Relayout");
         RETURN_IF_ERROR(layer->Relayout(user_buffer.ptr(), host_buffer.ptr()));
@@ -78,8 +78,13 @@ class SingleTpuRequest : public TpuRequest {
   Status SetDone(Done done) LOCKS_EXCLUDED(mutex_) override;
   Status AddInput(const std::string& name, const Buffer& input)
       LOCKS_EXCLUDED(mutex_) override;
+  Status AddInput(const std::string& name, const Buffer& input,
+                  api::InputDataFormat format) LOCKS_EXCLUDED(mutex_) override;
   Status AddOutput(const std::string& name, Buffer output)
       LOCKS_EXCLUDED(mutex_) override;
+  Status AddOutput(const std::string& name, Buffer output,
+                   const api::OutputDestination& destination)
+      LOCKS_EXCLUDED(mutex_) override;
   Status AddNoopInputs(const std::string& name, int count)
       LOCKS_EXCLUDED(mutex_) override;
   Status AddNoopOutputs(const std::string& name, int count)
@@ -99,6 +104,7 @@ class SingleTpuRequest : public TpuRequest {
   Status NotifyCompletion(Status status) LOCKS_EXCLUDED(mutex_) override;
 
   int id() const override { return id_; }
+  int parent_id() const override { return parent_request_->id(); }
 
   RequestType type() const override { return type_; }
 
@@ -156,6 +162,12 @@ class SingleTpuRequest : public TpuRequest {
   // Returns true if the alignment requirement for a provided buffer is met.
   bool IsBufferAligned(const Buffer& buffer);
 
+  // Returns true if the device can write the given output layer directly into
+  // the user-provided buffer, i.e. no post-processing is needed and the buffer
+  // is aligned and holds the full padded output.
+  bool CanOutputDirectly(const api::OutputLayerInformation* layer,
+                         const Buffer& output);
+
   // Post processes the output buffers. This includes:
   // 1. Relayout the outputs in host_outputs_ to user-expected layouts and
   //    store them in the user_outputs_. Some outputs do not need a relayout
@@ -232,6 +244,10 @@ class SingleTpuRequest : public TpuRequest {
   // or methods exposed in the API, we deal with user_outputs_.
   Buffer::NamedMap user_outputs_ GUARDED_BY(mutex_);
 
+  // Destinations of the buffers in |user_outputs_|.
+  std::unordered_map<std::string, std::vector<api::OutputDestination>>
+      user_output_destinations_ GUARDED_BY(mutex_);
+
   // Final request completion callback.
   Done done_ GUARDED_BY(mutex_);
 
@@ -0,0 +1,199 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/thermal_monitor.h"
+
+#include <chrono>  // NOLINT
+#include <utility>
+
+#include "port/logging.h"
+#include "port/status_macros.h"
+#include "port/std_mutex_lock.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+ThermalMonitor::ThermalMonitor(const Options& options,
+                               std::unique_ptr<ThermalSensor> sensor,
+                               const driver_shared::TimeStamper* time_stamper,
+                               api::PerformanceExpectation ceiling,
+                               SetPerformance set_performance,
+                               ThrottleCallback throttle_callback)
+    : options_(options),
+      sensor_(std::move(sensor)),
+      time_stamper_(time_stamper),
+      ceiling_(ceiling),
+      set_performance_(std::move(set_performance)),
+      throttle_callback_(std::move(throttle_callback)),
+      performance_(ceiling) {
+  CHECK(sensor_ != nullptr);
+  CHECK(time_stamper_ != nullptr);
+  CHECK_LE(options_.release_millicelsius, options_.throttle_millicelsius);
+}
+
+ThermalMonitor::~ThermalMonitor() { Stop(); }
+
+void ThermalMonitor::Start() {
+  if (options_.period_ms <= 0 || thread_.joinable()) {
+    return;
+  }
+
+  {
+    StdMutexLock lock(&thread_mutex_);
+    stopping_ = false;
+  }
+  {
+    StdMutexLock lock(&state_mutex_);
+    running_ = true;
+  }
+  thread_ = std::thread([this]() { Worker(); });
+}
+
+void ThermalMonitor::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    StdMutexLock lock(&thread_mutex_);
+    stopping_ = true;
+    thread_wakeup_.notify_one();
+  }
+  thread_.join();
+
+  StdMutexLock lock(&state_mutex_);
+  running_ = false;
+}
+
+void ThermalMonitor::Worker() {
+  // Errors tend to repeat every period, only the first one is logged.
+  bool log_error = true;
+
+  StdCondMutexLock lock(&thread_mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    Status status = Sample();
+    if (!status.ok() && log_error) {
+      LOG(WARNING) << "Thermal monitoring failed: " << status.message();
+      log_error = false;
+    }
+    lock.lock();
+
+    thread_wakeup_.wait_for(lock, std::chrono::milliseconds(options_.period_ms),
+                            [this]() { return stopping_; });
+  }
+}
+
+bool ThermalMonitor::IsHot(const ThermalReading& reading) const {
+  return reading.warning ||
+         (reading.has_temperature &&
+          reading.temperature_millicelsius >= options_.throttle_millicelsius);
+}
+
+api::PerformanceExpectation ThermalMonitor::NextPerformance(
+    const ThermalReading& reading, api::PerformanceExpectation current) {
+  if (IsHot(reading)) {
+    num_cool_samples_ = 0;
+    if (current > api::PerformanceExpectation_Low) {
+      return static_cast<api::PerformanceExpectation>(current - 1);
+    }
+    return current;
+  }
+
+  // Sensors without temperature only report warnings, so the absence of a
+  // warning is as cool as it gets.
+  const bool cool =
+      !reading.has_temperature ||
+      reading.temperature_millicelsius <= options_.release_millicelsius;
+  if (!cool || current >= ceiling_) {
+    num_cool_samples_ = 0;
+    return current;
+  }
+
+  if (++num_cool_samples_ < options_.release_samples) {
+    return current;
+  }
+
+  num_cool_samples_ = 0;
+  return static_cast<api::PerformanceExpectation>(current + 1);
+}
+
+Status ThermalMonitor::Sample() {
+  StdMutexLock policy_lock(&policy_mutex_);
+
+  ASSIGN_OR_RETURN(const ThermalReading reading, sensor_->Read());
+
+  const api::PerformanceExpectation current = performance();
+  const api::PerformanceExpectation next =
+      set_performance_ ? NextPerformance(reading, current) : current;
+
+  Status status;  // OK
+  if (next != current) {
+    status = set_performance_(next);
+    if (status.ok()) {
+      VLOG(1) << StringPrintf(
+          "Thermal monitor changed performance expectation from %d to %d.",
+          current, next);
+    }
+  }
+  const bool throttled = status.ok() && next < current;
+
+  {
+    StdMutexLock state_lock(&state_mutex_);
+    if (status.ok()) {
+      performance_ = next;
+    }
+    if (throttled) {
+      ++num_throttles_;
+    }
+
+    api::Driver::ThermalSample sample;
+    sample.timestamp_ns = time_stamper_->GetTimeNanoSeconds();
+    sample.has_temperature = reading.has_temperature;
+    sample.temperature_millicelsius = reading.temperature_millicelsius;
+    sample.warning = reading.warning;
+    sample.performance_expectation = performance_;
+    history_.push_back(sample);
+    while (history_.size() > static_cast<size_t>(options_.history_size)) {
+      history_.pop_front();
+    }
+  }
+
+  const bool notify = set_performance_ ? throttled : IsHot(reading);
+  if (notify && throttle_callback_) {
+    throttle_callback_();
+  }
+
+  return status;
+}
+
+api::PerformanceExpectation ThermalMonitor::performance() const {
+  StdMutexLock lock(&state_mutex_);
+  return performance_;
+}
+
+api::Driver::ThermalState ThermalMonitor::GetState() const {
+  StdMutexLock lock(&state_mutex_);
+  api::Driver::ThermalState state;
+  state.monitoring = running_;
+  state.num_throttles = num_throttles_;
+  state.history.assign(history_.begin(), history_.end());
+  return state;
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
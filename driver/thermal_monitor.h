@@ -0,0 +1,148 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_THERMAL_MONITOR_H_
+#define DARWINN_DRIVER_THERMAL_MONITOR_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+
+#include "api/driver.h"
+#include "api/driver_options_generated.h"
+#include "driver/thermal_sensor.h"
+#include "driver_shared/time_stamper/time_stamper.h"
+#include "port/integral_types.h"
+#include "port/status.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Periodically samples die temperature and keeps the device away from its
+// thermal shutdown threshold by stepping the performance level down while the
+// device runs hot, and back up once it has cooled down.
+//
+// The policy has hysteresis: performance drops one level per sample at or
+// above the throttling temperature or with a thermal warning, and rises one
+// level only after |release_samples| consecutive samples at or below the
+// release temperature without warnings. Performance never rises above the
+// configured level. Without a way to set performance, the monitor only records
+// samples and reports every hot sample as a thermal warning.
+class ThermalMonitor {
+ public:
+  struct Options {
+    // Sampling period in milliseconds. 0 disables the monitor thread.
+    int period_ms{1000};
+
+    // Temperatures in millidegrees Celsius for stepping performance down and
+    // back up.
+    int throttle_millicelsius{85000};
+    int release_millicelsius{75000};
+
+    // Number of consecutive cool samples required before stepping up.
+    int release_samples{5};
+
+    // Number of samples kept in the history.
+    int history_size{60};
+  };
+
+  // Applies the given performance level to the device. Called from the monitor
+  // thread while requests may be running.
+  using SetPerformance = std::function<Status(api::PerformanceExpectation)>;
+
+  // Notified every time performance is stepped down, or for every hot sample
+  // without a way to set performance. Called from the monitor thread.
+  using ThrottleCallback = std::function<void()>;
+
+  // |ceiling| is the configured performance level, which the device is
+  // expected to run at when the monitor is created. |set_performance| may be
+  // empty.
+  ThermalMonitor(const Options& options, std::unique_ptr<ThermalSensor> sensor,
+                 const driver_shared::TimeStamper* time_stamper,
+                 api::PerformanceExpectation ceiling,
+                 SetPerformance set_performance,
+                 ThrottleCallback throttle_callback);
+
+  // Stops the monitor thread.
+  ~ThermalMonitor();
+
+  // This class is neither copyable nor movable.
+  ThermalMonitor(const ThermalMonitor&) = delete;
+  ThermalMonitor& operator=(const ThermalMonitor&) = delete;
+
+  // Starts and stops periodic sampling. Must be called while the device is
+  // open, and never concurrently. The current performance level is kept
+  // across Stop() and Start(), as is the history.
+  void Start() LOCKS_EXCLUDED(thread_mutex_);
+  void Stop() LOCKS_EXCLUDED(thread_mutex_);
+
+  // Takes one sample and acts on it. Called by the monitor thread, and can be
+  // called directly to drive the policy with a synthetic sensor.
+  Status Sample() LOCKS_EXCLUDED(policy_mutex_, state_mutex_);
+
+  // Returns the performance level currently requested by the monitor.
+  api::PerformanceExpectation performance() const LOCKS_EXCLUDED(state_mutex_);
+
+  // Returns the sampled history.
+  api::Driver::ThermalState GetState() const LOCKS_EXCLUDED(state_mutex_);
+
+ private:
+  // Samples every |period_ms| until stopped.
+  void Worker() LOCKS_EXCLUDED(thread_mutex_);
+
+  // Returns true if |reading| calls for less performance.
+  bool IsHot(const ThermalReading& reading) const;
+
+  // Returns the performance level the policy moves to after |reading|.
+  api::PerformanceExpectation NextPerformance(
+      const ThermalReading& reading, api::PerformanceExpectation current)
+      EXCLUSIVE_LOCKS_REQUIRED(policy_mutex_);
+
+  const Options options_;
+  const std::unique_ptr<ThermalSensor> sensor_;
+  const driver_shared::TimeStamper* const time_stamper_;
+  const api::PerformanceExpectation ceiling_;
+  const SetPerformance set_performance_;
+  const ThrottleCallback throttle_callback_;
+
+  // Serializes sampling and guards the policy state.
+  std::mutex policy_mutex_;
+
+  // Number of consecutive samples that allow stepping up.
+  int num_cool_samples_ GUARDED_BY(policy_mutex_){0};
+
+  // Guards the state visible to readers.
+  mutable std::mutex state_mutex_;
+  api::PerformanceExpectation performance_ GUARDED_BY(state_mutex_);
+  bool running_ GUARDED_BY(state_mutex_){false};
+  int64 num_throttles_ GUARDED_BY(state_mutex_){0};
+  std::deque<api::Driver::ThermalSample> history_ GUARDED_BY(state_mutex_);
+
+  // Monitor thread and its stop signal.
+  std::mutex thread_mutex_;
+  std::condition_variable thread_wakeup_;
+  bool stopping_ GUARDED_BY(thread_mutex_){false};
+  std::thread thread_;
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_THERMAL_MONITOR_H_
@@ -0,0 +1,48 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_THERMAL_SENSOR_H_
+#define DARWINN_DRIVER_THERMAL_SENSOR_H_
+
+#include "port/statusor.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// A single reading of the die temperature sensor.
+struct ThermalReading {
+  // Die temperature in millidegrees Celsius. Only valid if has_temperature is
+  // true.
+  bool has_temperature{false};
+  int temperature_millicelsius{0};
+
+  // True if the device raised a thermal warning since the previous reading.
+  bool warning{false};
+};
+
+// Interface for reading die temperature of a device.
+class ThermalSensor {
+ public:
+  virtual ~ThermalSensor() = default;
+
+  // Reads the current die temperature. Only called while the device is open.
+  virtual StatusOr<ThermalReading> Read() = 0;
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_THERMAL_SENSOR_H_
@@ -15,6 +15,8 @@
 #ifndef DARWINN_DRIVER_TOP_LEVEL_HANDLER_H_
 #define DARWINN_DRIVER_TOP_LEVEL_HANDLER_H_
 
+#include "api/driver_options_generated.h"
+#include "port/errors.h"
 #include "port/status.h"
 
 namespace platforms {
@@ -69,6 +71,13 @@ class TopLevelHandler {
   virtual Status LpmCoreToRailGate() {
     return Status();  // OK
   }
+
+  // Changes clock rates to the given performance level while out of reset.
+  // The level is also used for subsequent QuitReset() calls.
+  virtual Status SetPerformanceExpectation(
+      api::PerformanceExpectation performance) {
+    return UnimplementedError("Changing performance level is not supported.");
+  }
 };
 
 }  // namespace driver
@@ -55,7 +55,11 @@ class TpuRequest {
   // buffers do not match executable, will return failure. Memory backing the
   // |Buffer| instance must be valid throughout the life of the request.
   virtual Status AddInput(const std::string& name, const Buffer& input) = 0;
+  virtual Status AddInput(const std::string& name, const Buffer& input,
+                          api::InputDataFormat format) = 0;
   virtual Status AddOutput(const std::string& name, Buffer output) = 0;
+  virtual Status AddOutput(const std::string& name, Buffer output,
+                           const api::OutputDestination& destination) = 0;
 
   // Add a provided number of dummy input/output buffers. This is helpful for
   // evening out the number of buffers to native batch size.
@@ -94,6 +98,9 @@ class TpuRequest {
   // Returns request id.
   virtual int id() const = 0;
 
+  // Returns id of the driver request this TPU request is part of.
+  virtual int parent_id() const = 0;
+
   // Returns the TPU request type that is used for logging.
   virtual RequestType type() const = 0;
 
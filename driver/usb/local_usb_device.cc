@@ -18,6 +18,7 @@
 
 #include "driver/usb/libusb_options.h"
 #include "driver/usb/usb_device_interface.h"
+#include "port/aligned_malloc.h"
 #include "port/cleanup.h"
 #include "port/errors.h"
 #include "port/logging.h"
@@ -29,6 +30,10 @@
 #include "port/time.h"
 #include "port/tracing.h"
 
+#if LIBUSB_HAS_MEM_ALLOC
+#include <sys/mman.h>
+#endif  // LIBUSB_HAS_MEM_ALLOC
+
 #define VLOG_IF_ERROR(L, S)                               \
   if (!(S).ok()) {                                        \
     VLOG((L)) << S << " " << __FILE__ << ":" << __LINE__; \
@@ -44,6 +49,9 @@ namespace {
 constexpr int kMaxUsbPathDepth = 7;
 constexpr const char* kUsbPathPrefix = "/sys/bus/usb/devices/";
 
+// Alignment of transfer buffers emulated in user space.
+constexpr int kTransferBufferAlignmentBytes = 4096;
+
 // Automatic retry for control commands, to reduce failure rates.
 constexpr int kMaxNumRetriesForCommands = 5;
 
@@ -840,7 +848,10 @@ uint8_t* LocalUsbDevice::DoAllocateTransferBuffer(size_t buffer_size) {
   }
 #endif  // LIBUSB_HAS_MEM_ALLOC
 
-  return new uint8_t[buffer_size];
+  // Zero-copy memory is page aligned, and so is the emulation, so callers can
+  // rely on the same alignment either way.
+  return static_cast<uint8_t*>(
+      aligned_malloc(buffer_size, kTransferBufferAlignmentBytes));
 }
 
 Status LocalUsbDevice::ReleaseTransferBuffer(MutableBuffer buffer) {
@@ -871,12 +882,40 @@ Status LocalUsbDevice::DoReleaseTransferBuffer(MutableBuffer buffer) {
   }
 #endif  // LIBUSB_HAS_MEM_ALLOC
 
-  // Use plain old delete [] to release the memory block.
-  delete[] buffer.data();
+  aligned_free(buffer.data());
 
   return Status();  // OK.
 }
 
+StatusOr<std::function<void()>> LocalUsbDevice::DetachTransferBuffer(
+    MutableBuffer buffer) {
+  VLOG(10) << __func__;
+  StdMutexLock lock(&mutex_);
+
+  RETURN_IF_ERROR(CheckForNullHandle(__func__));
+
+  auto block = transfer_buffers_.find(buffer.data());
+
+  // Missing record of the memory buffer is a fatal error.
+  CHECK(block != transfer_buffers_.end());
+  transfer_buffers_.erase(block);
+
+#if LIBUSB_HAS_MEM_ALLOC
+  if (use_zero_copy_) {
+    // The usbfs mapping holds its own reference to the device file, so it
+    // stays valid after the handle is closed. Unmap it directly when the
+    // buffer is released, as libusb_dev_mem_free would.
+    uint8_t* data = buffer.data();
+    const size_t length = buffer.length();
+    return std::function<void()>([data, length] { munmap(data, length); });
+  }
+#endif  // LIBUSB_HAS_MEM_ALLOC
+
+  // Emulated transfer buffers do not reference the device.
+  uint8_t* data = buffer.data();
+  return std::function<void()>([data] { aligned_free(data); });
+}
+
 LocalUsbDeviceFactory::LocalUsbDeviceFactory(bool use_zero_copy)
     : use_zero_copy_(use_zero_copy) {}
 
@@ -1094,6 +1133,93 @@ StatusOr<std::unique_ptr<UsbDeviceInterface>> LocalUsbDeviceFactory::OpenDevice(
   return {std::move(device)};
 }
 
+StatusOr<std::unique_ptr<LocalUsbHotplugMonitor>>
+LocalUsbHotplugMonitor::Create(const std::vector<DeviceId>& device_ids,
+                               std::function<void()> on_change) {
+  TRACE_SCOPE("LocalUsbHotplugMonitor::Create");
+
+  if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+    return UnimplementedError("libusb hotplug is not supported");
+  }
+
+  libusb_context* context = nullptr;
+  const int libusb_init_error = libusb_init(&context);
+  if (libusb_init_error != 0) {
+    return FailedPreconditionError("libusb initialization failed");
+  }
+
+  // The monitor owns the context from here on.
+  auto monitor = gtl::WrapUnique(
+      new LocalUsbHotplugMonitor(context, std::move(on_change)));
+
+  for (const auto& device_id : device_ids) {
+    libusb_hotplug_callback_handle handle;
+    RETURN_IF_ERROR(ConvertLibUsbError(
+        libusb_hotplug_register_callback(
+            context,
+            static_cast<libusb_hotplug_event>(
+                LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+            static_cast<libusb_hotplug_flag>(0), device_id.vendor_id,
+            device_id.product_id, LIBUSB_HOTPLUG_MATCH_ANY, HotplugCallback,
+            monitor.get(), &handle),
+        "libusb_hotplug_register_callback"));
+    monitor->callback_handles_.push_back(handle);
+  }
+
+  LocalUsbHotplugMonitor* monitor_ptr = monitor.get();
+  monitor->event_thread_ = std::thread([monitor_ptr]() {
+    TRACE_START_THREAD("LocalUsbHotplugMonitorThread");
+    while (monitor_ptr->keep_running_) {
+#if LIBUSB_API_VERSION >= 0x01000105
+      // Blocks until an event arrives, or the destructor interrupts it.
+      libusb_handle_events_completed(monitor_ptr->context_, nullptr);
+#else
+      // Older libusb cannot be interrupted, so wake up periodically to check
+      // whether to stop.
+      struct timeval timeout = {0, 100000};
+      libusb_handle_events_timeout_completed(monitor_ptr->context_, &timeout,
+                                             nullptr);
+#endif  // LIBUSB_API_VERSION >= 0x01000105
+    }
+  });
+
+  return monitor;
+}
+
+LocalUsbHotplugMonitor::LocalUsbHotplugMonitor(libusb_context* context,
+                                               std::function<void()> on_change)
+    : context_(context), on_change_(std::move(on_change)) {}
+
+LocalUsbHotplugMonitor::~LocalUsbHotplugMonitor() {
+  keep_running_ = false;
+  for (auto handle : callback_handles_) {
+    libusb_hotplug_deregister_callback(context_, handle);
+  }
+#if LIBUSB_API_VERSION >= 0x01000105
+  // The interruption is remembered, even if the event thread is not blocked
+  // in libusb yet.
+  libusb_interrupt_event_handler(context_);
+#endif  // LIBUSB_API_VERSION >= 0x01000105
+  if (event_thread_.joinable()) {
+    event_thread_.join();
+  }
+  libusb_exit(context_);
+}
+
+int LIBUSB_CALL LocalUsbHotplugMonitor::HotplugCallback(
+    libusb_context* context, libusb_device* device, libusb_hotplug_event event,
+    void* user_data) {
+  VLOG(5) << StringPrintf(
+      "%s: device %s on bus %d", __func__,
+      event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ? "arrived" : "left",
+      libusb_get_bus_number(device));
+  static_cast<LocalUsbHotplugMonitor*>(user_data)->on_change_();
+
+  // Keep the callback registered.
+  return 0;
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
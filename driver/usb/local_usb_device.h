@@ -17,10 +17,13 @@
 
 #include <atomic>              // NOLINT
 #include <condition_variable>  // NOLINT
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>               // NOLINT
 #include <thread>              // NOLINT
 #include <unordered_set>
+#include <vector>
 
 #include "driver/usb/usb_device_interface.h"
 #include "port/array_slice.h"
@@ -126,6 +129,9 @@ class LocalUsbDevice : public UsbDeviceInterface {
   Status ReleaseTransferBuffer(MutableBuffer buffer) override
       LOCKS_EXCLUDED(mutex_);
 
+  StatusOr<std::function<void()>> DetachTransferBuffer(
+      MutableBuffer buffer) override LOCKS_EXCLUDED(mutex_);
+
  private:
   friend class LocalUsbDeviceFactory;
 
@@ -256,6 +262,55 @@ class LocalUsbDeviceFactory : public UsbDeviceFactory {
   const bool use_zero_copy_{false};
 };
 
+// Watches for locally connected USB devices with the given vendor and product
+// IDs being attached or detached, using libusb hotplug events. The callback is
+// invoked on an internal thread. Thread-safe.
+class LocalUsbHotplugMonitor {
+ public:
+  // Vendor and product ID of watched devices.
+  struct DeviceId {
+    uint16_t vendor_id;
+    uint16_t product_id;
+  };
+
+  // Starts watching. Returns an error if hotplug events are not supported on
+  // this platform.
+  static StatusOr<std::unique_ptr<LocalUsbHotplugMonitor>> Create(
+      const std::vector<DeviceId>& device_ids, std::function<void()> on_change);
+
+  // Stops watching.
+  ~LocalUsbHotplugMonitor();
+
+  // This class is neither copyable nor movable.
+  LocalUsbHotplugMonitor(const LocalUsbHotplugMonitor&) = delete;
+  LocalUsbHotplugMonitor& operator=(const LocalUsbHotplugMonitor&) = delete;
+
+ private:
+  LocalUsbHotplugMonitor(libusb_context* context,
+                         std::function<void()> on_change);
+
+  // Invoked by libusb for every attached or detached device.
+  static int LIBUSB_CALL HotplugCallback(libusb_context* context,
+                                         libusb_device* device,
+                                         libusb_hotplug_event event,
+                                         void* user_data);
+
+  // Context dedicated to this monitor.
+  libusb_context* const context_;
+
+  // Invoked after every change.
+  const std::function<void()> on_change_;
+
+  // Registered hotplug callbacks.
+  std::vector<libusb_hotplug_callback_handle> callback_handles_;
+
+  // False if the event thread should stop running.
+  std::atomic<bool> keep_running_{true};
+
+  // Thread running the libusb event loop.
+  std::thread event_thread_;
+};
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
@@ -0,0 +1,37 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/usb/usb_bulk_in_transfer_size.h"
+
+#include <algorithm>
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+size_t GetBulkInTransferSize(size_t expected_bytes, size_t covered_bytes,
+                             size_t chunk_size, size_t max_transfer_size) {
+  if (max_transfer_size <= chunk_size ||
+      expected_bytes <= covered_bytes + chunk_size) {
+    return chunk_size;
+  }
+
+  const size_t uncovered_bytes =
+      std::min(expected_bytes - covered_bytes, max_transfer_size);
+  return std::max(chunk_size, uncovered_bytes / chunk_size * chunk_size);
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
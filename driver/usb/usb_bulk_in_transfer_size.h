@@ -0,0 +1,39 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_USB_USB_BULK_IN_TRANSFER_SIZE_H_
+#define DARWINN_DRIVER_USB_USB_BULK_IN_TRANSFER_SIZE_H_
+
+#include <cstddef>
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Returns the size of the next queued bulk-in transfer. |expected_bytes| are
+// the output bytes still expected through DMA hints, and |covered_bytes| are
+// the bytes already covered by transfers in flight and filled buffers.
+//
+// When more than one chunk is uncovered, the transfer covers it in whole
+// |chunk_size| chunks, up to |max_transfer_size|, so it never waits for data
+// beyond the outputs known to be coming. Otherwise, and for the tail, the
+// transfer is a regular |chunk_size| chunk.
+size_t GetBulkInTransferSize(size_t expected_bytes, size_t covered_bytes,
+                             size_t chunk_size, size_t max_transfer_size);
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_USB_USB_BULK_IN_TRANSFER_SIZE_H_
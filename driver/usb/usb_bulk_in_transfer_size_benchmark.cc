@@ -0,0 +1,169 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the bulk-in completions and host CPU time per output megabyte of
+// sizing queued bulk-in transfers with GetBulkInTransferSize, against fixed
+// size transfers. A simulated device streams each output into a ring of
+// queued transfers; every completion goes through a callback queue and is
+// copied into the output buffer, as in UsbDriver.
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "driver/usb/usb_bulk_in_transfer_size.h"
+#include "port/gflags.h"
+#include "port/integral_types.h"
+#include "port/logging.h"
+
+ABSL_FLAG(int, output_kb, 1024, "Size of each output in KB.");
+ABSL_FLAG(int, iterations, 200, "Number of outputs streamed per policy.");
+ABSL_FLAG(int, queued_transfers, 32,
+          "Number of bulk-in transfers kept queued, as in UsbDriver.");
+ABSL_FLAG(int, chunk_size_kb, 1, "Bulk-in chunk size in KB.");
+ABSL_FLAG(int, max_transfer_size_kb, 64,
+          "Largest adaptive bulk-in transfer in KB.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+constexpr size_t kFixedTransferSize = 32 * 1024;
+
+struct Result {
+  int64 completions;
+  double cpu_seconds;
+};
+
+double GetProcessCpuSeconds() {
+  struct timespec ts;
+  CHECK_EQ(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts), 0);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Streams |iterations| outputs of |output_bytes| through |queued_transfers|
+// transfers sized by |next_transfer_size|, which is given the bytes still
+// expected and the bytes covered by queued transfers.
+Result Stream(
+    size_t output_bytes, int iterations, int queued_transfers,
+    size_t max_transfer_size,
+    const std::function<size_t(size_t expected, size_t covered)>&
+        next_transfer_size) {
+  std::vector<uint8> device_data(output_bytes, 0x5a);
+  std::vector<uint8> output(output_bytes);
+  std::vector<std::vector<uint8>> buffers(queued_transfers,
+                                          std::vector<uint8>(max_transfer_size));
+  std::deque<std::function<void()>> callback_queue;
+
+  Result result = {0, 0.0};
+  const double start = GetProcessCpuSeconds();
+  for (int i = 0; i < iterations; ++i) {
+    size_t sent_bytes = 0;
+    size_t received_bytes = 0;
+    size_t covered_bytes = 0;
+    // Queued transfers as (buffer index, size), in submission order.
+    std::deque<std::pair<int, size_t>> in_flight;
+    std::vector<int> free_buffers;
+    for (int j = 0; j < queued_transfers; ++j) {
+      free_buffers.push_back(j);
+    }
+
+    while (received_bytes < output_bytes) {
+      // Keeps the ring full while output bytes are still expected.
+      while (!free_buffers.empty() && covered_bytes < output_bytes) {
+        const size_t size = std::min(
+            next_transfer_size(output_bytes, covered_bytes), max_transfer_size);
+        in_flight.emplace_back(free_buffers.back(), size);
+        free_buffers.pop_back();
+        covered_bytes += size;
+      }
+
+      // The device fills the oldest transfer, and ends it short at the end of
+      // the output.
+      const int buffer_index = in_flight.front().first;
+      const size_t length =
+          std::min(in_flight.front().second, output_bytes - sent_bytes);
+      in_flight.pop_front();
+      memcpy(buffers[buffer_index].data(), device_data.data() + sent_bytes,
+             length);
+      sent_bytes += length;
+      ++result.completions;
+
+      callback_queue.push_back([&, buffer_index, length]() {
+        memcpy(output.data() + received_bytes, buffers[buffer_index].data(),
+               length);
+        received_bytes += length;
+        free_buffers.push_back(buffer_index);
+      });
+      while (!callback_queue.empty()) {
+        callback_queue.front()();
+        callback_queue.pop_front();
+      }
+    }
+    CHECK_EQ(memcmp(output.data(), device_data.data(), output_bytes), 0);
+  }
+  result.cpu_seconds = GetProcessCpuSeconds() - start;
+  return result;
+}
+
+int Run() {
+  const size_t output_bytes = absl::GetFlag(FLAGS_output_kb) * 1024;
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  const int queued_transfers = absl::GetFlag(FLAGS_queued_transfers);
+  const size_t chunk_size = absl::GetFlag(FLAGS_chunk_size_kb) * 1024;
+  const size_t max_transfer_size =
+      absl::GetFlag(FLAGS_max_transfer_size_kb) * 1024;
+  CHECK_GT(output_bytes, 0);
+  CHECK_GT(iterations, 0);
+  CHECK_GT(queued_transfers, 0);
+  CHECK_GE(max_transfer_size, std::max(chunk_size, kFixedTransferSize));
+
+  const double total_mb = static_cast<double>(output_bytes) * iterations /
+                          (1024.0 * 1024.0);
+  auto report = [total_mb](const char* name, const Result& result) {
+    printf("%-22s %9.1f completions/MB %9.1f CPU us/MB\n", name,
+           result.completions / total_mb, result.cpu_seconds * 1e6 / total_mb);
+  };
+
+  report("fixed chunk:",
+         Stream(output_bytes, iterations, queued_transfers, max_transfer_size,
+                [chunk_size](size_t, size_t) { return chunk_size; }));
+  report("fixed 32 KB:",
+         Stream(output_bytes, iterations, queued_transfers, max_transfer_size,
+                [](size_t, size_t) { return kFixedTransferSize; }));
+  const Result adaptive = Stream(
+      output_bytes, iterations, queued_transfers, max_transfer_size,
+      [chunk_size, max_transfer_size](size_t expected, size_t covered) {
+        return GetBulkInTransferSize(expected, covered, chunk_size,
+                                     max_transfer_size);
+      });
+  report("GetBulkInTransferSize:", adaptive);
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
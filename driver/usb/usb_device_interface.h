@@ -15,6 +15,8 @@
 #ifndef DARWINN_DRIVER_USB_USB_DEVICE_INTERFACE_H_
 #define DARWINN_DRIVER_USB_USB_DEVICE_INTERFACE_H_
 
+#include <functional>
+
 #include "port/array_slice.h"
 #include "port/integral_types.h"
 #include "port/status.h"
@@ -324,6 +326,14 @@ class UsbDeviceInterface {
   // CloseDevice automatically releases all transfer buffers associated with the
   // device.
   virtual Status ReleaseTransferBuffer(MutableBuffer buffer) = 0;
+
+  // Detaches transfer buffer previously allocated from this device, so the
+  // device can be closed and opened again while the buffer is in use. The
+  // buffer stays mapped and keeps its content; it may be accessed during and
+  // after this call. Returns the function releasing the buffer, which is no
+  // longer released by CloseDevice.
+  virtual StatusOr<std::function<void()>> DetachTransferBuffer(
+      MutableBuffer buffer) = 0;
 };
 
 // This interface abstracts the enumeration for connected USB devices.
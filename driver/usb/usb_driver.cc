@@ -14,6 +14,7 @@
 
 #include "driver/usb/usb_driver.h"
 
+#include <algorithm>
 #include <bitset>
 #include <functional>
 #include <queue>
@@ -33,9 +34,11 @@
 #include "driver/single_tpu_request.h"
 #include "driver/top_level_handler.h"
 #include "driver/tpu_request.h"
+#include "driver/usb/usb_bulk_in_transfer_size.h"
 #include "driver/usb/usb_dfu_util.h"
 #include "driver/usb/usb_latest_firmware.h"
 #include "driver/usb/usb_ml_commands.h"
+#include "driver/usb/usb_pinned_allocator.h"
 #include "driver_shared/time_stamper/time_stamper.h"
 #include "port/cleanup.h"
 #include "port/errors.h"
@@ -69,6 +72,31 @@ constexpr uint16_t kTargetAppProductId = 0x9302;
 constexpr uint16_t kTargetDfuVendorId = 0x1A6E;
 constexpr uint16_t kTargetDfuProductId = 0x089A;
 
+// Effective bulk-out throughput, in bytes per second, observed on each link
+// speed. These are well below the signaling rates, as they account for
+// protocol overhead and host controller scheduling.
+constexpr int64 kFullSpeedHostToTpuBps = 1000000LL;
+constexpr int64 kHighSpeedHostToTpuBps = 35000000LL;
+constexpr int64 kSuperSpeedHostToTpuBps = 320000000LL;
+
+// Returns a readable name for the given link speed, or an empty string if
+// unknown.
+const char* GetLinkSpeedName(UsbStandardCommands::DeviceSpeed speed) {
+  switch (speed) {
+    case UsbStandardCommands::DeviceSpeed::kLow:
+      return "LowSpeed";
+    case UsbStandardCommands::DeviceSpeed::kFull:
+      return "FullSpeed";
+    case UsbStandardCommands::DeviceSpeed::kHigh:
+      return "HighSpeed";
+    case UsbStandardCommands::DeviceSpeed::kSuper:
+      return "SuperSpeed";
+    case UsbStandardCommands::DeviceSpeed::kUnknown:
+    default:
+      return "";
+  }
+}
+
 // This class implements BasicLockable concept, to be used with
 // std::conditional_variable_any.
 // The implementation is specialized as no re-locking is needed.
@@ -148,12 +176,17 @@ UsbDriver::UsbDriver(
       registers_(std::move(registers)),
       allocator_(gtl::MakeUnique<AlignedAllocator>(
           chip_config_->GetChipStructures().allocation_alignment_bytes)),
+      request_allocator_(
+          gtl::MakeUnique<UsbPinnedAllocator>([this](size_t size_bytes) {
+            return MakeTransferBuffer(size_bytes);
+          })),
       top_level_interrupt_manager_(std::move(top_level_interrupt_manager)),
       fatal_error_interrupt_controller_(
           std::move(fatal_error_interrupt_controller)),
       top_level_handler_(std::move(top_level_handler)),
       dram_allocator_(std::move(dram_allocator)),
       options_(options),
+      derive_host_to_tpu_bps_(driver_options.host_to_tpu_bps() <= 0),
       dma_info_extractor_(
           options.usb_enable_processing_of_hints
               ? DmaInfoExtractor::ExtractorType::kDmaHints
@@ -443,7 +476,7 @@ void UsbDriver::HandleInterrupt(
         << kTopLevelInterruptBitShift;
     if (interrupt_info.raw_data & kFatalErrorInterruptMask) {
       VLOG(1) << StringPrintf("%s Fatal error interrupt received.", __func__);
-      CHECK_OK(CheckHibError());
+      CheckFatalError(CheckHibError(), ErrorClass::kHibError);
       CHECK_OK(fatal_error_interrupt_controller_->ClearInterruptStatus(0));
     }
     if ((interrupt_info.raw_data & kTopLevelInterruptMask) != 0) {
@@ -512,6 +545,42 @@ uint32_t UsbDriver::GetCredits(UsbMlCommands::DescriptorTag tag) {
   }
 }
 
+void UsbDriver::RecordEndpointTransfer(const UsbIoRequest& io_request) {
+  const size_t size_bytes = io_request.GetBuffer().size_bytes();
+  switch (io_request.GetType()) {
+    case UsbIoRequest::Type::kBulkOut: {
+      uint8_t endpoint = UsbMlCommands::kSingleBulkOutEndpoint;
+      if (options_.mode != OperatingMode::kSingleEndpoint) {
+        switch (io_request.GetTag()) {
+          case UsbMlCommands::DescriptorTag::kInstructions:
+            endpoint = UsbMlCommands::kInstructionsEndpoint;
+            break;
+          case UsbMlCommands::DescriptorTag::kInputActivations:
+            endpoint = UsbMlCommands::kInputActivationsEndpoint;
+            break;
+          case UsbMlCommands::DescriptorTag::kParameters:
+            endpoint = UsbMlCommands::kParametersEndpoint;
+            break;
+          default:
+            return;
+        }
+      }
+      GetDmaStatisticsRecorder()->RecordEndpointTransfer(
+          endpoint, /*device_to_host=*/false, size_bytes);
+      break;
+    }
+
+    case UsbIoRequest::Type::kBulkIn:
+      GetDmaStatisticsRecorder()->RecordEndpointTransfer(
+          UsbMlCommands::kBulkInEndpoint, /*device_to_host=*/true, size_bytes);
+      break;
+
+    default:
+      // Interrupts carry no data.
+      break;
+  }
+}
+
 // TODO: breaks up this function according to functionality.
 StatusOr<bool> UsbDriver::ProcessIo() {
   TRACE_SCOPE("UsbDriver::ProcessIO");
@@ -521,8 +590,16 @@ StatusOr<bool> UsbDriver::ProcessIo() {
       UsbMlCommands::kInputActivationsEndpoint,
       UsbMlCommands::kParametersEndpoint};
   int num_active_transfers = 0;
+  int num_active_transfers_per_tag[kNumBulkOutTags] = {0, 0, 0};
   std::bitset<kNumBulkOutTags> tag_to_bulk_out_with_unsent_chunk;
 
+  // In multiple-ep hardware control mode, every bulk-out endpoint can be given
+  // its own transfer budget, and the hardware flow control on each endpoint
+  // keeps data from getting ahead of the instructions consuming it.
+  const bool use_per_endpoint_budget =
+      (options_.mode == OperatingMode::kMultipleEndpointsHardwareControl) &&
+      (options_.usb_max_num_async_transfers_per_endpoint > 0);
+
   // Remove UsbIoRequest that are completed.
   while (!io_requests_.empty()) {
     const auto& io_request = io_requests_.front();
@@ -538,7 +615,9 @@ StatusOr<bool> UsbDriver::ProcessIo() {
       break;
     }
 
+    RecordEndpointTransfer(io_request);
     if (io_request.FromDmaHint()) {
+      GetDmaStatisticsRecorder()->RecordDma(*io_request.dma_info());
       CHECK_OK(dma_scheduler_.NotifyDmaCompletion(io_request.dma_info()));
     }
 
@@ -588,10 +667,27 @@ StatusOr<bool> UsbDriver::ProcessIo() {
       if (io_request.IsActive()) {
         // simply increase the counter and proceed to see if we can fire another
         // request for the next chunk.
-        num_active_transfers += io_request.GetActiveCounts(
+        const int active_counts = io_request.GetActiveCounts(
             options_.max_bulk_out_transfer_size_in_bytes);
+        num_active_transfers += active_counts;
+        num_active_transfers_per_tag[tag] += active_counts;
       } else {
-        if (options_.mode == OperatingMode::kMultipleEndpointsHardwareControl) {
+        if (use_per_endpoint_budget) {
+          // With per-endpoint budgets, let's continue searching for a
+          // different tag to be sent out. It's never okay to interleve/mix
+          // chunks from different requests of the same tag. Since each
+          // endpoint has its own budget, unsent instructions no longer have
+          // to stall input activations and parameters.
+          if (tag_to_bulk_out_with_unsent_chunk.all()) {
+            // If all endpoints(tags) are busy, break from the search.
+            break;
+          } else if (tag_to_bulk_out_with_unsent_chunk[tag]) {
+            // If something sharing with my endpoint is busy, keep looking for
+            // something different.
+            continue;
+          }
+        } else if (options_.mode ==
+                   OperatingMode::kMultipleEndpointsHardwareControl) {
           // In multiple-ep hardware control mode, let's continue
           // searching for a different tag to be sent out. It's never okay to
           // interleve/mix chunks from different requests of the same tag.
@@ -639,12 +735,28 @@ StatusOr<bool> UsbDriver::ProcessIo() {
               io_request.id(), tag);
           break;
         }
-      } else if (num_active_transfers >= options_.usb_max_num_async_transfers) {
+      } else if (use_per_endpoint_budget) {
+        if (num_active_transfers_per_tag[tag] >=
+            options_.usb_max_num_async_transfers_per_endpoint) {
+          VLOG(10) << StringPrintf(
+              "[%d-%d] number of concurrent transfers on endpoint too high, "
+              "wait (%d >= %d)",
+              io_request.id(), tag, num_active_transfers_per_tag[tag],
+              options_.usb_max_num_async_transfers_per_endpoint);
+
+          // Later requests of the same tag must wait for this one, but other
+          // endpoints can still proceed.
+          if (io_request.HasNextChunk()) {
+            tag_to_bulk_out_with_unsent_chunk[tag] = true;
+          }
+          continue;
+        }
+      } else if (num_active_transfers >= max_num_async_transfers_) {
         VLOG(10) << StringPrintf(
             "[%d-%d] number of concurrent transfers too high, wait "
             "(%d >= %d)",
             io_request.id(), tag, num_active_transfers,
-            options_.usb_max_num_async_transfers);
+            max_num_async_transfers_);
         break;
       }
 
@@ -721,6 +833,7 @@ StatusOr<bool> UsbDriver::ProcessIo() {
         uint32_t transfer_size = static_cast<uint32_t>(transfer_buffer.size());
 
         ++num_active_transfers;
+        ++num_active_transfers_per_tag[tag];
         if (io_request.HasNextChunk()) {
           // This request still has some data not sent over to the pipeline.
           // Setting this to true prevents rquests of the same tag to start, as
@@ -909,6 +1022,7 @@ StatusOr<bool> UsbDriver::ProcessIo() {
 
           memcpy(host_buffer.ptr(), buffer.ptr() + filled_info.begin_offset,
                  transferred_bytes);
+          bulk_in_bytes_filled_ -= transferred_bytes;
 
           io_request.NotifyTransferComplete(transferred_bytes);
 
@@ -959,12 +1073,15 @@ StatusOr<bool> UsbDriver::ProcessIo() {
             "bulk-out requests complete, wait",
             io_request.id(), tag);
         break;
-      } else if (num_active_transfers >= options_.usb_max_num_async_transfers) {
+      } else if (!use_per_endpoint_budget &&
+                 num_active_transfers >= max_num_async_transfers_) {
+        // With per-endpoint budgets, bulk-in has its own endpoint and is
+        // serialized below, so bulk-out transfers do not count against it.
         VLOG(10) << StringPrintf(
             "[%d-%d] number of concurrent transfers too high, wait "
             "(%d >= %d)",
             io_request.id(), tag, num_active_transfers,
-            options_.usb_max_num_async_transfers);
+            max_num_async_transfers_);
         break;
       } else if (io_request.IsActive()) {
         ++num_active_transfers;
@@ -977,9 +1094,10 @@ StatusOr<bool> UsbDriver::ProcessIo() {
         is_task_state_changed = true;
         is_any_bulk_in_still_uncompleted = true;
 
-        auto device_buffer = (cap_bulk_in_size_at_256_bytes_)
-                                 ? io_request.GetNextChunk(256)
-                                 : io_request.GetNextChunk();
+        auto device_buffer =
+            (cap_bulk_in_size_at_256_bytes_)
+                ? io_request.GetNextChunk(256)
+                : io_request.GetNextChunk(bulk_in_chunk_sizer_.get());
 
         auto host_buffer = address_space_.Translate(device_buffer).ValueOrDie();
         UsbMlCommands::MutableBuffer transfer_buffer(host_buffer.ptr(),
@@ -999,13 +1117,21 @@ StatusOr<bool> UsbDriver::ProcessIo() {
               // thread. Note that the reference to io_request could have been
               // invalidated when the async transfer is cancelled.
               StdMutexLock queue_lock(&callback_mutex_);
-              callback_queue_.push([&io_request, status, num_bytes_transferred,
-                                    tag, transfer_size] {
+              callback_queue_.push([this, &io_request, status,
+                                    num_bytes_transferred, tag,
+                                    transfer_size] {
                 // Starting from here is an functor which would be executed
                 // within the worker thread context, after the async
                 // transfer has been completed.
                 if (status.ok()) {
                   io_request.NotifyTransferComplete(num_bytes_transferred);
+                  if (num_bytes_transferred < transfer_size) {
+                    // The rest is asked for again in the next chunk.
+                    GetDmaStatisticsRecorder()->RecordEndpointDrop(
+                        UsbMlCommands::kBulkInEndpoint,
+                        /*device_to_host=*/true,
+                        transfer_size - num_bytes_transferred);
+                  }
                   VLOG(10) << StringPrintf(
                       "[%d-%d] bulk in for %u bytes has yielded %zu bytes",
                       io_request.id(), tag, transfer_size,
@@ -1128,12 +1254,40 @@ Status UsbDriver::HandleDmaDescriptor(UsbMlCommands::DescriptorTag tag,
   return Status();  // OK.
 }
 
+size_t UsbDriver::GetNextBulkInTransferSize() const {
+  const size_t chunk_size = options_.usb_bulk_in_max_chunk_size_in_bytes;
+
+  // Hints are only complete when descriptors from device are disabled. On
+  // USB2, every 256-byte chunk is a short packet which terminates the
+  // transfer anyway.
+  if (cap_bulk_in_size_at_256_bytes_ ||
+      options_.usb_enable_bulk_descriptors_from_device) {
+    return chunk_size;
+  }
+
+  size_t expected_bytes = 0;
+  for (const auto& io_request : io_requests_) {
+    if (io_request.GetType() == UsbIoRequest::Type::kBulkIn &&
+        io_request.FromDmaHint()) {
+      expected_bytes += io_request.GetRemainingBytes();
+    }
+  }
+
+  return GetBulkInTransferSize(
+      expected_bytes, bulk_in_bytes_in_flight_ + bulk_in_bytes_filled_,
+      chunk_size, options_.usb_bulk_in_max_transfer_size_in_bytes);
+}
+
 void UsbDriver::HandleQueuedBulkIn(const Status& status, int buffer_index,
                                    size_t num_bytes_transferred) {
+  bulk_in_bytes_in_flight_ -= bulk_in_transfer_sizes_[buffer_index];
+  bulk_in_transfer_sizes_[buffer_index] = 0;
+
   if (status.ok()) {
     // Enqueue the filled buffer with actual data size.
     filled_bulk_in_buffers_.push(
         FilledBulkInInfo{buffer_index, 0, num_bytes_transferred});
+    bulk_in_bytes_filled_ += num_bytes_transferred;
 
     VLOG(1) << StringPrintf("bulk in %zu bytes from buffer index [%d]",
                             num_bytes_transferred, buffer_index);
@@ -1253,8 +1407,23 @@ void UsbDriver::WorkerThreadFunc() {
       }
 
       if (options_.usb_enable_queued_bulk_in_requests) {
-        while (!available_bulk_in_buffers_.empty()) {
+        while (!available_bulk_in_buffers_.empty() && !in_error()) {
           const int buffer_index = available_bulk_in_buffers_.front();
+
+          const size_t transfer_size = GetNextBulkInTransferSize();
+          if (bulk_in_buffers_[buffer_index].size_bytes() < transfer_size) {
+            // Grow this buffer to hold a larger transfer. It keeps its size
+            // for later transfers.
+            auto chunk = DoMakeBuffer(transfer_size);
+            if (!chunk.IsValid()) {
+              CheckFatalError(ResourceExhaustedError(StringPrintf(
+                  "Bulk-in buffer allocation of %zu bytes failed.",
+                  transfer_size)));
+              break;
+            }
+            bulk_in_buffers_[buffer_index] = chunk;
+          }
+
           available_bulk_in_buffers_.pop();
 
           VLOG(7) << StringPrintf(
@@ -1263,10 +1432,11 @@ void UsbDriver::WorkerThreadFunc() {
 
           background_ops[kReadOutputActivations] = true;
           reevaluation_needed = true;
+          bulk_in_transfer_sizes_[buffer_index] = transfer_size;
+          bulk_in_bytes_in_flight_ += transfer_size;
 
           UsbMlCommands::MutableBuffer transfer_buffer(
-              bulk_in_buffers_[buffer_index].ptr(),
-              bulk_in_buffers_[buffer_index].size_bytes());
+              bulk_in_buffers_[buffer_index].ptr(), transfer_size);
 
           // Clear data to prevent data leakage from request to request.
           memset(transfer_buffer.data(), 0, transfer_buffer.size());
@@ -1482,6 +1652,56 @@ Status UsbDriver::PrepareUsbDevice() {
   return OpenMlUsbDevice();
 }
 
+std::string UsbDriver::GetLinkSpeed() const {
+  StdMutexLock state_lock(&mutex_);
+  return GetLinkSpeedName(link_speed_);
+}
+
+void UsbDriver::AdaptToLinkSpeed(UsbStandardCommands::DeviceSpeed speed) {
+  link_speed_ = speed;
+  max_num_async_transfers_ = options_.usb_max_num_async_transfers;
+
+  int64 host_to_tpu_bps = 0;
+  switch (speed) {
+    case UsbStandardCommands::DeviceSpeed::kFull:
+      host_to_tpu_bps = kFullSpeedHostToTpuBps;
+      break;
+
+    case UsbStandardCommands::DeviceSpeed::kHigh:
+      host_to_tpu_bps = kHighSpeedHostToTpuBps;
+      break;
+
+    case UsbStandardCommands::DeviceSpeed::kSuper:
+      host_to_tpu_bps = kSuperSpeedHostToTpuBps;
+      break;
+
+    default:
+      // Nothing is known about the link. Keep everything as configured.
+      return;
+  }
+
+  const bool is_usb2 = speed != UsbStandardCommands::DeviceSpeed::kSuper;
+  if (is_usb2 && max_num_async_transfers_ > kUsb2MaxNumAsyncTransfers) {
+    max_num_async_transfers_ = kUsb2MaxNumAsyncTransfers;
+    VLOG(7) << StringPrintf("Reducing concurrent transfers to %d for USB2",
+                            kUsb2MaxNumAsyncTransfers);
+  }
+
+  // Streaming parameters on every inference is much more expensive on USB2, so
+  // cache them on TPU whenever packages allow it.
+  SetPreferParameterCaching(is_usb2);
+
+  // Submissions, which hold the base driver's submit lock while taking
+  // mutex_, are excluded by the state lock held throughout open.
+  if (derive_host_to_tpu_bps_) {
+    auto settings = GetOperationalSettings();
+    settings.host_to_tpu_bps = host_to_tpu_bps;
+    UpdateOperationalSettings(settings);
+    VLOG(7) << StringPrintf("Estimating host to TPU bandwidth at %lld bps",
+                            static_cast<long long>(host_to_tpu_bps));
+  }
+}
+
 Status UsbDriver::DoOpen(bool debug_mode) {
   TRACE_SCOPE("UsbDriver::DoOpen");
 
@@ -1501,6 +1721,11 @@ Status UsbDriver::DoOpen(bool debug_mode) {
           "Bulk-in buffer max chunk size must be 1024-byte aligned");
     }
 
+    if (options_.usb_bulk_in_max_transfer_size_in_bytes & k1kBMask) {
+      return OutOfRangeError(
+          "Bulk-in max transfer size must be 1024-byte aligned");
+    }
+
     if (options_.usb_bulk_in_queue_capacity <= 0) {
       return OutOfRangeError("Bulk-in queue capacity must be positive");
     }
@@ -1540,6 +1765,7 @@ Status UsbDriver::DoOpen(bool debug_mode) {
       VLOG(7) << "Connection speed is unknown, ignore speed constraint";
       break;
   }
+  AdaptToLinkSpeed(usb_device_->GetDeviceSpeed());
 
   constexpr int kMlInterface = 0;
   RETURN_IF_ERROR(usb_device_->ClaimInterface(kMlInterface));
@@ -1576,6 +1802,29 @@ Status UsbDriver::DoOpen(bool debug_mode) {
     }
   }
 
+  // Without queuing, bulk-in is serialized. Let one chunk carry at most what
+  // the link would keep in flight across its async transfer queue.
+  bulk_in_chunk_sizer_ = gtl::MakeUnique<DmaChunkSizer>(
+      static_cast<int>(options_.usb_bulk_in_max_chunk_size_in_bytes),
+      static_cast<int>(options_.usb_bulk_in_max_transfer_size_in_bytes) *
+          std::max(1, max_num_async_transfers_));
+
+  if (options_.usb_pinned_buffer_pool_capacity_in_bytes > 0) {
+    StdMutexLock pool_lock(&pinned_buffer_pool_mutex_);
+    pinned_buffer_pool_ = UsbPinnedBufferPool::Create(
+        usb_device_, options_.usb_pinned_buffer_pool_capacity_in_bytes);
+  }
+  auto pinned_buffer_pool_closer = MakeCleanup([this] {
+    // Bulk-in buffers may come from the pool, and would otherwise keep the
+    // device alive.
+    bulk_in_buffers_.clear();
+    bulk_in_transfer_sizes_.clear();
+    while (!available_bulk_in_buffers_.empty()) {
+      available_bulk_in_buffers_.pop();
+    }
+    DetachPinnedBufferPool();
+  });
+
   for (int i = 0; i < options_.usb_bulk_in_queue_capacity; ++i) {
     auto chunk = DoMakeBuffer(options_.usb_bulk_in_max_chunk_size_in_bytes);
     if (!chunk.IsValid()) {
@@ -1585,6 +1834,7 @@ Status UsbDriver::DoOpen(bool debug_mode) {
     // Save the Buffer object into a container, so it will be destroyed when
     // driver destructs.
     bulk_in_buffers_.push_back(chunk);
+    bulk_in_transfer_sizes_.push_back(0);
 
     // Save the index of available Buffer into the queue.
     available_bulk_in_buffers_.push(i);
@@ -1607,6 +1857,7 @@ Status UsbDriver::DoOpen(bool debug_mode) {
   // Release cleanup functions.
   dma_scheduler_closer.release();
   top_level_handler_closer.release();
+  pinned_buffer_pool_closer.release();
 
   return Status();  // OK
 }
@@ -1635,6 +1886,7 @@ Status UsbDriver::DoClose(bool in_error, api::Driver::ClosingMode mode) {
 
   RETURN_IF_ERROR(dma_scheduler_.Close(mode));
   RETURN_IF_ERROR(DisableAllInterrupts());
+  RETURN_IF_ERROR(UnmapAllInstructionBuffers());
   RETURN_IF_ERROR(UnmapAllParameters());
   RETURN_IF_ERROR(run_controller_->DoRunControl(RunControl::kMoveToHalt));
   RETURN_IF_ERROR(top_level_handler_->EnableReset());
@@ -1644,6 +1896,9 @@ Status UsbDriver::DoClose(bool in_error, api::Driver::ClosingMode mode) {
   // Deallocate all bulk-in buffers. This is not absolutely necessary, but it's
   // better to have a clean slate for the next Open.
   bulk_in_buffers_.clear();
+  bulk_in_transfer_sizes_.clear();
+  bulk_in_bytes_in_flight_ = 0;
+  bulk_in_bytes_filled_ = 0;
 
   // Flush available buffers queue, marking we have no any buffer available.
   while (!available_bulk_in_buffers_.empty()) {
@@ -1654,12 +1909,18 @@ Status UsbDriver::DoClose(bool in_error, api::Driver::ClosingMode mode) {
   // been canceled.
   CHECK(filled_bulk_in_buffers_.empty());
 
+  // Stop handing out transfer buffers. Buffers still held by the application
+  // are moved off the device, so it can be released and opened again.
+  DetachPinnedBufferPool();
+
   // Release ownership to the USB device instance.
   usb_device_.reset();
 
   // Finalize.
   {
     StdMutexLock state_lock(&mutex_);
+    link_speed_ = UsbStandardCommands::DeviceSpeed::kUnknown;
+    max_num_async_transfers_ = options_.usb_max_num_async_transfers;
     RETURN_IF_ERROR(SetState(kClosed));
   }
 
@@ -1674,9 +1935,37 @@ Status UsbDriver::DoCancelAndWaitRequests(bool in_error) {
   return Status();  // OK
 }
 
-Buffer UsbDriver::DoMakeBuffer(size_t size_bytes) const {
-  Buffer buffer = allocator_->MakeBuffer(size_bytes);
+void UsbDriver::DetachPinnedBufferPool() {
+  std::shared_ptr<UsbPinnedBufferPool> pool;
+  {
+    StdMutexLock pool_lock(&pinned_buffer_pool_mutex_);
+    pool = std::move(pinned_buffer_pool_);
+  }
+  if (pool) {
+    VLOG(7) << StringPrintf("Detaching pinned buffer pool, %zu bytes allocated",
+                            pool->allocated_bytes());
+    pool->Detach();
+  }
+}
+
+Buffer UsbDriver::MakeTransferBuffer(size_t size_bytes) const {
+  Buffer buffer;
+  {
+    StdMutexLock pool_lock(&pinned_buffer_pool_mutex_);
+    if (pinned_buffer_pool_) {
+      buffer = pinned_buffer_pool_->MakeBuffer(size_bytes);
+    }
+  }
+
+  // Fall back to regular host memory if no transfer buffer is available.
+  if (!buffer.IsValid()) {
+    buffer = allocator_->MakeBuffer(size_bytes);
+  }
+  return buffer;
+}
 
+Buffer UsbDriver::DoMakeBuffer(size_t size_bytes) const {
+  Buffer buffer = MakeTransferBuffer(size_bytes);
   if (buffer.IsValid()) {
     // Clear data to prevent data leakage from request to request.
     memset(buffer.ptr(), 0, buffer.size_bytes());
@@ -1720,7 +2009,7 @@ StatusOr<std::shared_ptr<TpuRequest>> UsbDriver::DoCreateRequest(
   }
 
   return {std::make_shared<SingleTpuRequest>(
-      next_id_++, parent_request, executable_ref, allocator_.get(),
+      next_id_++, parent_request, executable_ref, request_allocator_.get(),
       dram_allocator_.get(),
       gtl::MakeUnique<DeviceBufferMapper>(&address_space_),
       &dma_info_extractor_,
@@ -1760,9 +2049,17 @@ Status UsbDriver::DoSetExecutableTiming(const ExecutableReference* executable,
       "This driver does not support real-time mode.");
 }
 
-void UsbDriver::CheckFatalError(const Status& status) {
-  // TODO: Forward to the client application for handling.
-  CHECK_OK(status) << "Driver fatal error";
+void UsbDriver::CheckFatalError(const Status& status,
+                                ErrorClass error_class) {
+  if (status.ok()) {
+    return;
+  }
+
+  ErrorRecord record;
+  record.error_class = error_class;
+  SnapshotHibErrorCsrs(registers_.get(), hib_user_csr_offsets_, &record);
+
+  NotifyFatalError(status, std::move(record));
 }
 
 }  // namespace driver
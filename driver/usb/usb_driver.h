@@ -20,6 +20,7 @@
 #include <memory>
 #include <mutex>  // NOLINT
 #include <queue>
+#include <string>
 #include <thread>  // NOLINT
 
 #include "api/buffer.h"
@@ -51,6 +52,7 @@
 #include "driver/usb/usb_dfu_commands.h"
 #include "driver/usb/usb_io_request.h"
 #include "driver/usb/usb_ml_commands.h"
+#include "driver/usb/usb_pinned_buffer_pool.h"
 #include "driver/usb/usb_registers.h"
 #include "port/integral_types.h"
 #include "port/statusor.h"
@@ -121,6 +123,14 @@ class UsbDriver : public Driver {
     // Max number of concurrent async bulk transfers.
     int usb_max_num_async_transfers{kDefaultMaxNumAsyncTransfers};
 
+    // Max number of concurrent async bulk-out transfers on each of the
+    // instructions, input activations, and parameters endpoints. If positive,
+    // and in kMultipleEndpointsHardwareControl mode, it replaces
+    // #usb_max_num_async_transfers, so every endpoint can keep its own pipe
+    // full independently of the others. This raises the number of transfers
+    // in flight, and hence usbfs memory, so it is disabled (0) by default.
+    int usb_max_num_async_transfers_per_endpoint{0};
+
     // Maximum amount of data to be sent to device in a single bulk out
     // transfer.
     uint32 max_bulk_out_transfer_size_in_bytes{
@@ -169,6 +179,25 @@ class UsbDriver : public Driver {
 
     // Max number of buffers to queue.
     int usb_bulk_in_queue_capacity{32};
+
+    // Upper limit of a single queued bulk-in transfer. When DMA hints tell
+    // how many output bytes are still expected, queued bulk-in transfers are
+    // sized to cover them, up to this limit, instead of always using
+    // #usb_bulk_in_max_chunk_size_in_bytes. Must be 1024-byte aligned. Set it
+    // to #usb_bulk_in_max_chunk_size_in_bytes or less to disable.
+    //
+    // Without queuing, bulk-in chunks adapt their size to how previous ones
+    // completed, up to this limit times the number of concurrent transfers
+    // allowed on the link.
+    size_t usb_bulk_in_max_transfer_size_in_bytes{
+        kDefaultMaxBulkInTransferSizeInBytes};
+
+    // Max amount of zero-copy transfer memory handed out by MakeBuffer and
+    // used for bulk-in buffers. Once exhausted, or if the device cannot
+    // allocate transfer memory, regular host memory is used instead. 0, the
+    // default, disables zero-copy buffers.
+    size_t usb_pinned_buffer_pool_capacity_in_bytes{
+        kDefaultPinnedBufferPoolCapacityInBytes};
   };
 
   // Constructs a device from the factory provided, and performs DFU according
@@ -217,6 +246,8 @@ class UsbDriver : public Driver {
     return chip_config_->GetChipStructures().allocation_alignment_bytes;
   }
 
+  std::string GetLinkSpeed() const LOCKS_EXCLUDED(mutex_) final;
+
  protected:
   Status DoOpen(bool debug_mode) LOCKS_EXCLUDED(mutex_) final;
   Status DoClose(bool in_error, api::Driver::ClosingMode mode)
@@ -277,6 +308,20 @@ class UsbDriver : public Driver {
   // client.
   static constexpr uint32 kDefaultSoftwareCreditsLowerLimitInBytes = 8 * 1024;
 
+  // Default value for #usb_bulk_in_max_transfer_size_in_bytes, if not set by
+  // the client.
+  static constexpr size_t kDefaultMaxBulkInTransferSizeInBytes = 64 * 1024;
+
+  // Default value for #usb_pinned_buffer_pool_capacity_in_bytes, if not set by
+  // the client. Zero-copy memory is accounted against the usbfs memory limit,
+  // which defaults to 16MB for the whole system and is shared with in-flight
+  // transfers of all devices, so the pool is opt-in.
+  static constexpr size_t kDefaultPinnedBufferPoolCapacityInBytes = 0;
+
+  // Upper limit of #usb_max_num_async_transfers on USB2 links. Slow links gain
+  // nothing from deep queues, which only hold on to more kernel memory.
+  static constexpr int kUsb2MaxNumAsyncTransfers = 2;
+
   // Constructor to be used as delegate target.
   UsbDriver(
       const api::DriverOptions& driver_options,
@@ -294,6 +339,19 @@ class UsbDriver : public Driver {
   // Prepares USB device with resets and DFU according to options_.
   Status PrepareUsbDevice();
 
+  // Tunes transfers and scheduling estimates for the negotiated link speed.
+  void AdaptToLinkSpeed(UsbStandardCommands::DeviceSpeed speed)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Stops handing out buffers from #pinned_buffer_pool_ and releases its idle
+  // transfer buffers.
+  void DetachPinnedBufferPool() LOCKS_EXCLUDED(pinned_buffer_pool_mutex_);
+
+  // Returns a transfer buffer from #pinned_buffer_pool_, or regular host
+  // memory if none is available. Contents are not cleared.
+  Buffer MakeTransferBuffer(size_t size_bytes) const
+      LOCKS_EXCLUDED(pinned_buffer_pool_mutex_);
+
   // Creates a UsbMlCommands and assigns it to usb_device_, with timed retry.
   Status OpenMlUsbDevice();
 
@@ -311,8 +369,11 @@ class UsbDriver : public Driver {
   Status ValidateStates(const std::vector<State>& expected_states) const
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Catches all fatal error handling during runtime.
-  void CheckFatalError(const Status& status);
+  // Catches all fatal error handling during runtime. Errors are recorded with
+  // |error_class| and a snapshot of the HIB error registers.
+  void CheckFatalError(
+      const Status& status,
+      api::Driver::ErrorClass error_class = api::Driver::ErrorClass::kUnknown);
 
   // Initializes the chip through CSR access.
   Status InitializeChip() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -331,6 +392,11 @@ class UsbDriver : public Driver {
   void HandleQueuedBulkIn(const Status& status, int buffer_index,
                           size_t num_bytes_transferred);
 
+  // Returns the size of the next queued bulk-in transfer. Transfers are
+  // sized from output bytes known to be expected through DMA hints, and fall
+  // back to #usb_bulk_in_max_chunk_size_in_bytes otherwise.
+  size_t GetNextBulkInTransferSize() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Handles data in/out and software interrupt events sent from the device,
   // in the worker thread. Thread safety analysis is confused by wrapping
   // this function into a functor, and hence has to be disabled.
@@ -352,6 +418,11 @@ class UsbDriver : public Driver {
   // Processes data in/out requests associated with specified task.
   StatusOr<bool> ProcessIo() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Accounts the bytes of a completed bulk-in or bulk-out request to the
+  // endpoint it was transferred on.
+  void RecordEndpointTransfer(const UsbIoRequest& io_request)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Records DMA descriptors and in-band interrupts sent from device.
   Status HandleDmaDescriptor(UsbMlCommands::DescriptorTag tag,
                              uint64_t device_virtual_address,
@@ -362,8 +433,9 @@ class UsbDriver : public Driver {
   std::function<StatusOr<std::unique_ptr<UsbDeviceInterface>>()>
       device_factory_;
 
-  // The current active USB device supporting ML commands.
-  std::unique_ptr<UsbMlCommands> usb_device_;
+  // The current active USB device supporting ML commands. Shared with
+  // #pinned_buffer_pool_ while the driver is open.
+  std::shared_ptr<UsbMlCommands> usb_device_;
 
   // CSR offsets.
   std::unique_ptr<config::ChipConfig> chip_config_;
@@ -372,9 +444,21 @@ class UsbDriver : public Driver {
   std::unique_ptr<UsbRegisters> registers_;
 
   // Buffer management.
-  // TODO: Allocate zero copy USB buffers.
   std::unique_ptr<Allocator> allocator_;
 
+  // Allocates the host buffers of requests, including the instruction chunks
+  // an executable shares across requests, as pinned transfer buffers while
+  // #pinned_buffer_pool_ has room.
+  std::unique_ptr<Allocator> request_allocator_;
+
+  // Protects #pinned_buffer_pool_, which is accessed from MakeBuffer without
+  // holding the driver state lock.
+  mutable std::mutex pinned_buffer_pool_mutex_;
+
+  // Zero-copy transfer buffers, available while the driver is open.
+  std::shared_ptr<UsbPinnedBufferPool> pinned_buffer_pool_
+      GUARDED_BY(pinned_buffer_pool_mutex_);
+
   // Protects access to callback queue, resource shared by the worker thread
   // and callbacks from usb device.
   mutable std::mutex callback_mutex_;
@@ -420,6 +504,10 @@ class UsbDriver : public Driver {
   // Driver options.
   UsbDriverOptions options_;
 
+  // If true, host_to_tpu_bps is not set in driver options, and is derived from
+  // the link speed instead.
+  const bool derive_host_to_tpu_bps_;
+
   // DMA info extractor.
   DmaInfoExtractor dma_info_extractor_;
 
@@ -430,13 +518,36 @@ class UsbDriver : public Driver {
   // through out async callbacks.
   std::list<UsbIoRequest> io_requests_;
 
+  // Link speed negotiated at open.
+  UsbStandardCommands::DeviceSpeed link_speed_ GUARDED_BY(mutex_){
+      UsbStandardCommands::DeviceSpeed::kUnknown};
+
+  // Max number of concurrent async bulk transfers in effect while open. Starts
+  // from options_.usb_max_num_async_transfers on every open, and is lowered
+  // for slow links. Only changed while the worker thread is not running.
+  int max_num_async_transfers_{kDefaultMaxNumAsyncTransfers};
+
   // If true, limit every bulk-in request to be at most 256-byte long.
   // This is part of workaround for b/73181174
   bool cap_bulk_in_size_at_256_bytes_{false};
 
-  // Container for all bulk-in buffers.
+  // Sizes bulk-in chunks when bulk-in requests are not queued. Created on
+  // open, once link speed is known. Only accessed from the worker thread.
+  std::unique_ptr<DmaChunkSizer> bulk_in_chunk_sizer_;
+
+  // Container for all bulk-in buffers. Buffers grow on demand up to
+  // #usb_bulk_in_max_transfer_size_in_bytes, and are reused afterwards.
   std::vector<Buffer> bulk_in_buffers_;
 
+  // Size of the transfer currently queued on each bulk-in buffer.
+  std::vector<size_t> bulk_in_transfer_sizes_;
+
+  // Total size of queued bulk-in transfers which have not completed yet.
+  size_t bulk_in_bytes_in_flight_{0};
+
+  // Number of bytes in filled bulk-in buffers not yet consumed by any request.
+  size_t bulk_in_bytes_filled_{0};
+
   // Container for indices for bulk-in buffers that are not queued for data in.
   // Note the reason for using queue here is for easier log interpretation.
   std::queue<int> available_bulk_in_buffers_;
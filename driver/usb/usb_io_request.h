@@ -85,6 +85,9 @@ class UsbIoRequest {
     return true;
   }
 
+  // Returns number of bytes which have not been transferred yet.
+  size_t GetRemainingBytes() const { return chunker_.GetRemainingBytes(); }
+
   // Returns true if there is chunk to transfer.
   bool HasNextChunk() const { return chunker_.HasNextChunk(); }
 
@@ -96,6 +99,11 @@ class UsbIoRequest {
     return chunker_.GetNextChunk(num_bytes);
   }
 
+  // Returns a next chunk sized by "sizer".
+  DeviceBuffer GetNextChunk(DmaChunkSizer* sizer) {
+    return chunker_.GetNextChunk(sizer);
+  }
+
   // Notifies that "num_bytes" of transfer is completed.
   void NotifyTransferComplete(int num_bytes) {
     chunker_.NotifyTransfer(num_bytes);
@@ -0,0 +1,49 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/usb/usb_pinned_allocator.h"
+
+#include <utility>
+
+#include "port/logging.h"
+#include "port/std_mutex_lock.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+UsbPinnedAllocator::UsbPinnedAllocator(MakeBufferFunction make_buffer)
+    : make_buffer_(std::move(make_buffer)) {}
+
+void* UsbPinnedAllocator::Allocate(size_t size) {
+  Buffer buffer = make_buffer_(size);
+  if (!buffer.IsValid()) {
+    return nullptr;
+  }
+
+  void* ptr = buffer.ptr();
+  StdMutexLock lock(&mutex_);
+  buffers_[ptr] = std::move(buffer);
+  return ptr;
+}
+
+void UsbPinnedAllocator::Free(void* buffer) {
+  StdMutexLock lock(&mutex_);
+  const int num_erased = buffers_.erase(buffer);
+  CHECK_EQ(num_erased, 1) << "Freeing a buffer not allocated here.";
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
@@ -0,0 +1,65 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_USB_USB_PINNED_ALLOCATOR_H_
+#define DARWINN_DRIVER_USB_USB_PINNED_ALLOCATOR_H_
+
+#include <functional>
+#include <map>
+#include <mutex>  // NOLINT
+
+#include "api/buffer.h"
+#include "driver/allocator.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Allocator drawing host memory from a buffer factory, such as
+// UsbDriver::DoMakeBuffer, which serves pinned USB transfer buffers while its
+// pool has room and regular host memory otherwise. Buffers the driver keeps
+// for a request, like the instruction chunks shared across requests, are then
+// transferred without kernel copies. Thread-safe.
+class UsbPinnedAllocator : public Allocator {
+ public:
+  using MakeBufferFunction = std::function<Buffer(size_t size_bytes)>;
+
+  explicit UsbPinnedAllocator(MakeBufferFunction make_buffer);
+  ~UsbPinnedAllocator() override = default;
+
+  // This class is neither copyable nor movable.
+  UsbPinnedAllocator(const UsbPinnedAllocator&) = delete;
+  UsbPinnedAllocator& operator=(const UsbPinnedAllocator&) = delete;
+
+  void* Allocate(size_t size) override LOCKS_EXCLUDED(mutex_);
+  void Free(void* buffer) override LOCKS_EXCLUDED(mutex_);
+
+ private:
+  // Makes the buffers handed out.
+  const MakeBufferFunction make_buffer_;
+
+  // Guards |buffers_|.
+  std::mutex mutex_;
+
+  // Buffers handed out, keyed by their address. Each stays allocated until
+  // freed.
+  std::map<void*, Buffer> buffers_ GUARDED_BY(mutex_);
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_USB_USB_PINNED_ALLOCATOR_H_
@@ -0,0 +1,178 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the host CPU time USB inferences take with input and output
+// buffers from Driver::MakeBuffer, with and without the pinned transfer buffer
+// pool. Kernel copies through usbfs bounce buffers show up as system time, so
+// process CPU accounting tells the two apart without capturing USB traffic.
+// Needs an Edge TPU on USB and a compiled executable package.
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/buffer.h"
+#include "api/driver.h"
+#include "api/driver_factory.h"
+#include "api/driver_options_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "port/gflags.h"
+#include "port/integral_types.h"
+#include "port/logging.h"
+#include "port/status_macros.h"
+#include "port/statusor.h"
+
+ABSL_FLAG(std::string, executable, "",
+          "Compiled executable package to run, as accepted by "
+          "Driver::RegisterExecutableFile.");
+ABSL_FLAG(int, iterations, 1000, "Number of inferences per configuration.");
+ABSL_FLAG(int, pinned_buffer_pool_capacity, 8 * 1024 * 1024,
+          "Pinned buffer pool capacity in bytes of the pooled configuration.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+struct Result {
+  double user_seconds;
+  double system_seconds;
+  double wall_seconds;
+  int64 bytes;
+};
+
+double ToSeconds(const struct timeval& tv) {
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+StatusOr<std::unique_ptr<api::Driver>> CreateDriver(int pool_capacity) {
+  flatbuffers::FlatBufferBuilder builder;
+  auto public_key = builder.CreateString("");
+  api::DriverUsbOptionsBuilder usb_options(builder);
+  usb_options.add_has_pinned_buffer_pool_capacity(true);
+  usb_options.add_pinned_buffer_pool_capacity(pool_capacity);
+  auto usb = usb_options.Finish();
+  api::DriverOptionsBuilder options(builder);
+  options.add_public_key(public_key);
+  options.add_usb(usb);
+  builder.Finish(options.Finish());
+
+  api::Device device;
+  device.chip = api::Chip::kBeagle;
+  device.type = api::Device::Type::USB;
+  device.path = api::DriverFactory::kDefaultDevicePath;
+  return api::DriverFactory::GetOrCreate()->CreateDriver(
+      device, api::Driver::Options(
+                  builder.GetBufferPointer(),
+                  builder.GetBufferPointer() + builder.GetSize()));
+}
+
+// Runs |iterations| inferences with buffers from MakeBuffer.
+StatusOr<Result> Measure(int pool_capacity, const std::string& executable,
+                         int iterations) {
+  ASSIGN_OR_RETURN(auto driver, CreateDriver(pool_capacity));
+  ASSIGN_OR_RETURN(const api::PackageReference* package,
+                   driver->RegisterExecutableFile(executable));
+  RETURN_IF_ERROR(driver->Open());
+
+  std::vector<Buffer> inputs;
+  std::vector<Buffer> outputs;
+  int64 bytes_per_inference = 0;
+  for (int i = 0; i < package->NumInputLayers(); ++i) {
+    inputs.push_back(driver->MakeBuffer(package->InputLayerSizeBytes(i)));
+    bytes_per_inference += package->InputLayerSizeBytes(i);
+  }
+  for (int i = 0; i < package->NumOutputLayers(); ++i) {
+    outputs.push_back(driver->MakeBuffer(package->OutputLayerSizeBytes(i)));
+    bytes_per_inference += package->OutputLayerSizeBytes(i);
+  }
+
+  auto run = [&]() -> Status {
+    ASSIGN_OR_RETURN(auto request, driver->CreateRequest(package));
+    for (int i = 0; i < package->NumInputLayers(); ++i) {
+      RETURN_IF_ERROR(
+          request->AddInput(package->InputLayerName(i), inputs[i]));
+    }
+    for (int i = 0; i < package->NumOutputLayers(); ++i) {
+      RETURN_IF_ERROR(
+          request->AddOutput(package->OutputLayerName(i), outputs[i]));
+    }
+    return driver->Execute(request);
+  };
+
+  // Warms up the device and the pool.
+  RETURN_IF_ERROR(run());
+
+  struct rusage start_usage, end_usage;
+  getrusage(RUSAGE_SELF, &start_usage);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    RETURN_IF_ERROR(run());
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  getrusage(RUSAGE_SELF, &end_usage);
+
+  inputs.clear();
+  outputs.clear();
+  RETURN_IF_ERROR(driver->Close(api::Driver::ClosingMode::kGraceful));
+
+  return Result{ToSeconds(end_usage.ru_utime) - ToSeconds(start_usage.ru_utime),
+                ToSeconds(end_usage.ru_stime) - ToSeconds(start_usage.ru_stime),
+                elapsed.count(), bytes_per_inference * iterations};
+}
+
+int Run() {
+  const std::string executable = absl::GetFlag(FLAGS_executable);
+  if (executable.empty()) {
+    printf("--executable is required.\n");
+    return 1;
+  }
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  CHECK_GT(iterations, 0);
+
+  for (const int pool_capacity :
+       {0, absl::GetFlag(FLAGS_pinned_buffer_pool_capacity)}) {
+    auto result_or_error = Measure(pool_capacity, executable, iterations);
+    if (!result_or_error.ok()) {
+      printf("Pool capacity %d: %s\n", pool_capacity,
+             result_or_error.status().ToString().c_str());
+      return 1;
+    }
+    const Result& result = result_or_error.ValueOrDie();
+    const double megabytes = result.bytes / (1024.0 * 1024.0);
+    printf("Pool capacity %9d: %8.1f us user %8.1f us system per inference, "
+           "%7.1f us CPU per MB, %7.1f inferences/s.\n",
+           pool_capacity, result.user_seconds * 1e6 / iterations,
+           result.system_seconds * 1e6 / iterations,
+           (result.user_seconds + result.system_seconds) * 1e6 / megabytes,
+           iterations / result.wall_seconds);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver::Run();
+}
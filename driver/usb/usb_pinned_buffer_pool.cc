@@ -0,0 +1,202 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver/usb/usb_pinned_buffer_pool.h"
+
+#include <iterator>
+#include <utility>
+
+#include "api/allocated_buffer.h"
+#include "port/logging.h"
+#include "port/status.h"
+#include "port/std_mutex_lock.h"
+#include "port/stringprintf.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+namespace {
+
+// Zero-copy memory is mapped by the kernel in units of pages, so there is no
+// point in handing out smaller size classes.
+constexpr size_t kMinSizeClassBytes = 4096;
+
+// Returns the size class used to serve a request of size_bytes.
+size_t GetSizeClass(size_t size_bytes) {
+  size_t size_class_bytes = kMinSizeClassBytes;
+  while (size_class_bytes < size_bytes) {
+    size_class_bytes <<= 1;
+  }
+  return size_class_bytes;
+}
+
+}  // namespace
+
+std::shared_ptr<UsbPinnedBufferPool> UsbPinnedBufferPool::Create(
+    std::shared_ptr<UsbMlCommands> device, size_t capacity_bytes) {
+  return std::shared_ptr<UsbPinnedBufferPool>(
+      new UsbPinnedBufferPool(std::move(device), capacity_bytes));
+}
+
+UsbPinnedBufferPool::UsbPinnedBufferPool(std::shared_ptr<UsbMlCommands> device,
+                                         size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), device_(std::move(device)) {}
+
+UsbPinnedBufferPool::~UsbPinnedBufferPool() {
+  // Every outstanding buffer holds a reference to this pool, so by now all of
+  // them have been returned.
+  Detach();
+}
+
+Buffer UsbPinnedBufferPool::MakeBuffer(size_t size_bytes) {
+  if (size_bytes == 0) {
+    return Buffer();
+  }
+
+  const size_t size_class_bytes = GetSizeClass(size_bytes);
+  uint8_t* ptr = nullptr;
+  {
+    StdMutexLock lock(&mutex_);
+    if (detached_ || !device_) {
+      return Buffer();
+    }
+
+    auto idle = idle_buffers_.find(size_class_bytes);
+    if (idle != idle_buffers_.end()) {
+      ptr = idle->second;
+      idle_buffers_.erase(idle);
+    } else {
+      if (!ReclaimIdleBuffers(size_class_bytes)) {
+        VLOG(5) << StringPrintf(
+            "%s: pool exhausted, %zu of %zu bytes allocated", __func__,
+            allocated_bytes_, capacity_bytes_);
+        return Buffer();
+      }
+
+      auto buffer_or_error = device_->AllocateTransferBuffer(size_class_bytes);
+      if (!buffer_or_error.ok()) {
+        VLOG(5) << StringPrintf("%s: allocation of %zu bytes failed: %s",
+                                __func__, size_class_bytes,
+                                buffer_or_error.status().ToString().c_str());
+        return Buffer();
+      }
+      ptr = buffer_or_error.ValueOrDie().data();
+      allocated_bytes_ += size_class_bytes;
+    }
+    outstanding_buffers_[ptr] = size_class_bytes;
+  }
+
+  // Each outstanding buffer keeps the pool alive.
+  auto self = shared_from_this();
+  return Buffer(std::make_shared<AllocatedBuffer>(
+      ptr, size_bytes, [self, size_class_bytes](void* ptr) {
+        self->Return(static_cast<uint8_t*>(ptr), size_class_bytes);
+      }));
+}
+
+void UsbPinnedBufferPool::Return(uint8_t* ptr, size_t size_class_bytes) {
+  StdMutexLock lock(&mutex_);
+  if (!detached_) {
+    outstanding_buffers_.erase(ptr);
+    idle_buffers_.insert({size_class_bytes, ptr});
+    return;
+  }
+
+  // The device is gone by now, release the detached mapping.
+  auto detached = detached_buffers_.find(ptr);
+  if (detached != detached_buffers_.end()) {
+    detached->second();
+    detached_buffers_.erase(detached);
+  }
+}
+
+void UsbPinnedBufferPool::Detach() {
+  StdMutexLock lock(&mutex_);
+  if (detached_) {
+    return;
+  }
+  detached_ = true;
+
+  for (const auto& idle : idle_buffers_) {
+    ReleaseToDevice(idle.second, idle.first);
+  }
+  idle_buffers_.clear();
+
+  // Buffers still held by the application would otherwise keep the device
+  // open until they are destroyed.
+  if (!outstanding_buffers_.empty()) {
+    VLOG(1) << StringPrintf(
+        "%zu transfer buffers are still in use; detaching them from the device",
+        outstanding_buffers_.size());
+  }
+  for (const auto& outstanding : outstanding_buffers_) {
+    auto release_or_error = device_->DetachTransferBuffer(
+        UsbMlCommands::MutableBuffer(outstanding.first, outstanding.second));
+    if (release_or_error.ok()) {
+      detached_buffers_[outstanding.first] =
+          std::move(release_or_error.ValueOrDie());
+    } else {
+      // The device will release the memory when closed, which is still
+      // better than holding the device open indefinitely.
+      LOG(ERROR) << StringPrintf(
+          "Failed to detach transfer buffer from device: %s",
+          release_or_error.status().ToString().c_str());
+    }
+    allocated_bytes_ -= outstanding.second;
+  }
+  outstanding_buffers_.clear();
+
+  device_.reset();
+}
+
+size_t UsbPinnedBufferPool::allocated_bytes() const {
+  StdMutexLock lock(&mutex_);
+  return allocated_bytes_;
+}
+
+int UsbPinnedBufferPool::num_outstanding_buffers() const {
+  StdMutexLock lock(&mutex_);
+  return outstanding_buffers_.size() + detached_buffers_.size();
+}
+
+bool UsbPinnedBufferPool::ReclaimIdleBuffers(size_t size_bytes) {
+  if (size_bytes > capacity_bytes_) {
+    return false;
+  }
+
+  // Release the largest idle buffers first, as they free up capacity fastest.
+  while (allocated_bytes_ + size_bytes > capacity_bytes_) {
+    if (idle_buffers_.empty()) {
+      return false;
+    }
+    auto largest = std::prev(idle_buffers_.end());
+    ReleaseToDevice(largest->second, largest->first);
+    idle_buffers_.erase(largest);
+  }
+  return true;
+}
+
+void UsbPinnedBufferPool::ReleaseToDevice(uint8_t* ptr,
+                                          size_t size_class_bytes) {
+  allocated_bytes_ -= size_class_bytes;
+  Status status = device_->ReleaseTransferBuffer(
+      UsbMlCommands::MutableBuffer(ptr, size_class_bytes));
+  if (!status.ok()) {
+    VLOG(1) << StringPrintf("%s: %s", __func__, status.ToString().c_str());
+  }
+}
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
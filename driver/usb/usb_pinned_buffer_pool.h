@@ -0,0 +1,120 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_USB_USB_PINNED_BUFFER_POOL_H_
+#define DARWINN_DRIVER_USB_USB_PINNED_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+
+#include "api/buffer.h"
+#include "driver/usb/usb_ml_commands.h"
+#include "port/thread_annotations.h"
+
+namespace platforms {
+namespace darwinn {
+namespace driver {
+
+// Pool of host buffers allocated as USB transfer buffers. When the underlying
+// libusb and OS support zero-copy, these buffers are pinned and mapped by the
+// kernel, so transfers from and into them do not have to be copied through
+// kernel bounce buffers.
+//
+// Buffers handed out return to the pool when the last Buffer referencing them
+// is destroyed. Memory is allocated in power-of-two size classes, and the total
+// amount of allocated memory is bounded, as zero-copy memory is a limited
+// kernel resource. Thread-safe.
+class UsbPinnedBufferPool
+    : public std::enable_shared_from_this<UsbPinnedBufferPool> {
+ public:
+  // Creates a pool allocating from the given device, holding at most
+  // capacity_bytes of transfer buffers.
+  static std::shared_ptr<UsbPinnedBufferPool> Create(
+      std::shared_ptr<UsbMlCommands> device, size_t capacity_bytes);
+
+  // This class is neither copyable nor movable.
+  UsbPinnedBufferPool(const UsbPinnedBufferPool&) = delete;
+  UsbPinnedBufferPool& operator=(const UsbPinnedBufferPool&) = delete;
+
+  ~UsbPinnedBufferPool();
+
+  // Returns a buffer of size_bytes backed by a transfer buffer. Returns an
+  // invalid Buffer if the pool has been detached, its capacity is exhausted,
+  // or the device fails to allocate, in which case callers are expected to
+  // fall back to regular host memory.
+  Buffer MakeBuffer(size_t size_bytes) LOCKS_EXCLUDED(mutex_);
+
+  // Releases all idle transfer buffers, stops handing out new ones, and
+  // releases the device. Outstanding buffers are detached from the device, so
+  // it can be opened again, but stay mapped until their last Buffer is
+  // destroyed. They may be accessed throughout.
+  void Detach() LOCKS_EXCLUDED(mutex_);
+
+  // Returns number of bytes currently allocated from the device.
+  size_t allocated_bytes() const LOCKS_EXCLUDED(mutex_);
+
+  // Returns number of buffers currently handed out.
+  int num_outstanding_buffers() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  UsbPinnedBufferPool(std::shared_ptr<UsbMlCommands> device,
+                      size_t capacity_bytes);
+
+  // Returns a buffer of the given size class back to the pool.
+  void Return(uint8_t* ptr, size_t size_class_bytes) LOCKS_EXCLUDED(mutex_);
+
+  // Releases idle buffers until size_bytes more can be allocated within
+  // capacity. Returns false if that is not possible.
+  bool ReclaimIdleBuffers(size_t size_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Releases a single transfer buffer back to the device.
+  void ReleaseToDevice(uint8_t* ptr, size_t size_class_bytes)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Maximum number of bytes allocated from the device.
+  const size_t capacity_bytes_;
+
+  // Guards all mutable states.
+  mutable std::mutex mutex_;
+
+  // Device the transfer buffers are allocated from. Reset once the pool is
+  // detached.
+  std::shared_ptr<UsbMlCommands> device_ GUARDED_BY(mutex_);
+
+  // True if no new buffers are to be handed out.
+  bool detached_ GUARDED_BY(mutex_){false};
+
+  // Idle transfer buffers, keyed by their size class.
+  std::multimap<size_t, uint8_t*> idle_buffers_ GUARDED_BY(mutex_);
+
+  // Number of bytes allocated from the device, both idle and outstanding.
+  size_t allocated_bytes_ GUARDED_BY(mutex_){0};
+
+  // Buffers handed out, with their size class.
+  std::map<uint8_t*, size_t> outstanding_buffers_ GUARDED_BY(mutex_);
+
+  // Functions releasing buffers that were outstanding when the pool was
+  // detached.
+  std::map<uint8_t*, std::function<void()>> detached_buffers_
+      GUARDED_BY(mutex_);
+};
+
+}  // namespace driver
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_USB_USB_PINNED_BUFFER_POOL_H_
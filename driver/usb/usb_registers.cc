@@ -14,17 +14,52 @@
 
 #include "driver/usb/usb_registers.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "driver/usb/usb_ml_commands.h"
 #include "port/errors.h"
 #include "port/logging.h"
 #include "port/ptr_util.h"
 #include "port/status_macros.h"
 #include "port/stringprintf.h"
+#include "port/time.h"
 
 namespace platforms {
 namespace darwinn {
 namespace driver {
 
+namespace {
+
+// Delay between reads of a poll, doubling after every read. Awaited state
+// changes, e.g. power state transitions, often take several times as long as
+// a control transfer, and reading back to back only floods the control
+// endpoint.
+constexpr int kMinPollDelayMicros = 20;
+constexpr int kMaxPollDelayMicros = 1000;
+
+// Reads a register until |condition| holds for its value, and returns that
+// value. Polls forever if timeout is zero or negative.
+template <typename IntType, typename ConditionType, typename FuncType>
+StatusOr<IntType> ReadUntil(uint64 offset, const ConditionType& condition,
+                            int64 timeout_us, const FuncType& read_func) {
+  const int64 start_time_us = GetCurrentTimeMicros();
+  int delay_us = kMinPollDelayMicros;
+
+  ASSIGN_OR_RETURN(IntType actual_value, read_func(offset));
+  while (!condition(actual_value)) {
+    if (timeout_us > 0 && GetCurrentTimeMicros() - start_time_us > timeout_us) {
+      return DeadlineExceededError("Register poll timeout.");
+    }
+    Microsleep(delay_us);
+    delay_us = std::min(delay_us * 2, kMaxPollDelayMicros);
+    ASSIGN_OR_RETURN(actual_value, read_func(offset));
+  }
+  return actual_value;
+}
+
+}  // namespace
+
 Status UsbRegisters::Open() {
   return UnimplementedError("USB register open without attached device");
 }
@@ -68,6 +103,97 @@ StatusOr<uint32> UsbRegisters::Read32(uint64 offset) {
   return FailedPreconditionError("USB register read32 without attached device");
 }
 
+Status UsbRegisters::Poll(uint64 offset, uint64 expected_value,
+                          int64 timeout_us) {
+  return ReadUntil<uint64>(
+             offset,
+             [expected_value](uint64 value) { return value == expected_value; },
+             timeout_us, [this](uint64 offset) { return Read(offset); })
+      .status();
+}
+
+Status UsbRegisters::Poll32(uint64 offset, uint32 expected_value,
+                            int64 timeout_us) {
+  return ReadUntil<uint32>(
+             offset,
+             [expected_value](uint32 value) { return value == expected_value; },
+             timeout_us, [this](uint64 offset) { return Read32(offset); })
+      .status();
+}
+
+Status UsbRegisters::Execute(const RegisterBatch& batch) {
+  // Values of 32-bit registers as of their last access in this batch.
+  std::unordered_map<uint64, uint32> known_values;
+
+  // 64-bit accesses cover two 32-bit registers.
+  auto forget_values = [&known_values](uint64 offset) {
+    known_values.erase(offset);
+    known_values.erase(offset + sizeof(uint32));
+  };
+
+  for (const RegisterBatch::Operation& operation : batch.operations()) {
+    const uint64 offset = operation.offset;
+    switch (operation.type) {
+      case RegisterBatch::Type::kRead: {
+        ASSIGN_OR_RETURN(*operation.read_value, Read(offset));
+        forget_values(offset);
+        break;
+      }
+
+      case RegisterBatch::Type::kRead32: {
+        ASSIGN_OR_RETURN(*operation.read_value32, Read32(offset));
+        known_values[offset] = *operation.read_value32;
+        break;
+      }
+
+      case RegisterBatch::Type::kWrite:
+        RETURN_IF_ERROR(Write(offset, operation.value));
+        forget_values(offset);
+        break;
+
+      case RegisterBatch::Type::kWrite32: {
+        const uint32 value = static_cast<uint32>(operation.value);
+        RETURN_IF_ERROR(Write32(offset, value));
+        known_values[offset] = value;
+        break;
+      }
+
+      case RegisterBatch::Type::kModify32: {
+        uint32 value;
+        auto it = known_values.find(offset);
+        if (it != known_values.end()) {
+          value = it->second;
+        } else {
+          ASSIGN_OR_RETURN(value, Read32(offset));
+        }
+
+        const uint32 new_value = operation.modifier(value);
+        if (new_value != value) {
+          RETURN_IF_ERROR(Write32(offset, new_value));
+        }
+        known_values[offset] = new_value;
+        break;
+      }
+
+      case RegisterBatch::Type::kPoll:
+        RETURN_IF_ERROR(Poll(offset, operation.value, operation.timeout_us));
+        forget_values(offset);
+        break;
+
+      case RegisterBatch::Type::kPoll32: {
+        ASSIGN_OR_RETURN(
+            known_values[offset],
+            ReadUntil<uint32>(
+                offset, operation.condition, operation.timeout_us,
+                [this](uint64 offset) { return Read32(offset); }));
+        break;
+      }
+    }
+  }
+
+  return Status();  // OK
+}
+
 }  // namespace driver
 }  // namespace darwinn
 }  // namespace platforms
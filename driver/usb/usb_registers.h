@@ -17,6 +17,7 @@
 
 #include <memory>
 
+#include "driver/registers/register_batch.h"
 #include "driver/registers/registers.h"
 #include "driver/usb/usb_ml_commands.h"
 #include "port/status.h"
@@ -45,6 +46,16 @@ class UsbRegisters : public Registers {
   Status Write32(uint64 offset, uint32 value) override;
   StatusOr<uint32> Read32(uint64 offset) override;
 
+  // Every access is a control transfer. Polls back off between reads, and
+  // batches skip reads and writes of values already known from earlier
+  // accesses in the same batch.
+  using Registers::Poll;
+  using Registers::Poll32;
+  Status Poll(uint64 offset, uint64 expected_value, int64 timeout_us) override;
+  Status Poll32(uint64 offset, uint32 expected_value,
+                int64 timeout_us) override;
+  Status Execute(const RegisterBatch& batch) override;
+
  private:
   // Underlying device.
   UsbMlCommands* usb_device_{nullptr};
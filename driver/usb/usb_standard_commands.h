@@ -242,6 +242,10 @@ class UsbStandardCommands {
     return device_->ReleaseTransferBuffer(buffer);
   }
 
+  StatusOr<std::function<void()>> DetachTransferBuffer(MutableBuffer buffer) {
+    return device_->DetachTransferBuffer(buffer);
+  }
+
   uint8_t ComposeUsbRequestType(CommandDataDir dir, CommandType type,
                                 CommandRecipient recipient) {
     return device_->ComposeUsbRequestType(dir, type, recipient);
@@ -0,0 +1,292 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "driver_shared/time_stamper/cycle_counter_time_stamper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "port/logging.h"
+#include "port/time.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define DARWINN_CYCLE_COUNTER_SUPPORTED 1
+#elif defined(__aarch64__)
+#define DARWINN_CYCLE_COUNTER_SUPPORTED 1
+#else
+#define DARWINN_CYCLE_COUNTER_SUPPORTED 0
+#endif
+
+namespace platforms {
+namespace darwinn {
+
+namespace driver_shared {
+
+#if DARWINN_CYCLE_COUNTER_SUPPORTED
+
+namespace {
+
+// Time from the first sample to the first calibration, and between anchors
+// afterwards.
+constexpr int64 kCalibrationIntervalNs = 20 * 1000 * 1000;
+constexpr int64 kReanchorIntervalNs = 1000 * 1000 * 1000;
+
+// Number of reads used to pin down each anchor.
+constexpr int kAnchorReads = 16;
+
+// Counter rates outside of this range indicate a broken counter.
+constexpr double kMinTicksPerSecond = 1e6;
+constexpr double kMaxTicksPerSecond = 1e10;
+
+inline uint64 ReadCounter() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  uint64 ticks;
+  asm volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#endif
+}
+
+inline int64 GetMonotonicTimeNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns true if the counter ticks at a constant rate regardless of power
+// states, and is trusted by the kernel.
+bool IsCounterInvariant() {
+#if defined(__x86_64__)
+  // CPUID.80000007H:EDX[8] advertises an invariant TSC.
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1u << 8))) {
+    VLOG(1) << "TSC is not invariant.";
+    return false;
+  }
+
+  // Linux switches away from the TSC when it finds it unsynchronized across
+  // cores or unstable. Follow its judgement when it is available.
+  std::ifstream clocksource(
+      "/sys/devices/system/clocksource/clocksource0/current_clocksource");
+  std::string name;
+  if (clocksource >> name && name != "tsc") {
+    VLOG(1) << "Kernel clocksource is " << name << ", not using TSC.";
+    return false;
+  }
+  return true;
+#else
+  // The ARMv8 generic timer runs at a fixed frequency by definition.
+  uint64 frequency;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+  return frequency != 0;
+#endif
+}
+
+// Reads the monotonic clock together with the counter, and returns the read
+// with the smallest counter interval around it, to keep preemption and the
+// cost of the clock read out of the anchor.
+void ReadClockAndCounter(int64* monotonic_ns, uint64* ticks) {
+  uint64 best_interval = ~0ULL;
+  for (int i = 0; i < kAnchorReads; ++i) {
+    const uint64 before = ReadCounter();
+    const int64 now_ns = GetMonotonicTimeNanos();
+    const uint64 after = ReadCounter();
+    if (after > before && after - before < best_interval) {
+      best_interval = after - before;
+      *monotonic_ns = now_ns;
+      *ticks = before + (after - before) / 2;
+    }
+  }
+}
+
+}  // namespace
+
+// Converts counter ticks to monotonic clock nanoseconds from the most recent
+// anchor. Readers never block: the anchor is published under a sequence
+// counter, and only one thread at a time re-anchors while the others keep
+// using the previous anchor.
+class CycleCounterTimeStamper::Clock {
+ public:
+  Clock() : epoch_offset_ns_(GetCurrentTimeNanos() - GetMonotonicTimeNanos()) {
+    ReadClockAndCounter(&clock_ns_, &clock_ticks_);
+    Store(Anchor{clock_ticks_, clock_ns_, 0.0, 0});
+  }
+
+  // Returns the current time in nanoseconds, in the epoch of
+  // GetCurrentTimeNanos().
+  int64 GetTimeNanoSeconds() {
+    const Anchor anchor = Load();
+    if (anchor.ns_per_tick == 0.0) {
+      // Not calibrated yet.
+      const int64 now_ns = GetMonotonicTimeNanos();
+      if (now_ns - anchor.base_ns >= kCalibrationIntervalNs) {
+        Reanchor(anchor);
+      }
+      return now_ns + epoch_offset_ns_;
+    }
+
+    // The counter read is not ordered after the anchor loads, and counters
+    // of different cores may be slightly apart, so it can land just before
+    // |anchor.base_ticks|. Such reads are taken as the anchor itself.
+    const int64 elapsed_ticks = std::max<int64>(
+        0, static_cast<int64>(ReadCounter() - anchor.base_ticks));
+    if (static_cast<uint64>(elapsed_ticks) >= anchor.reanchor_ticks) {
+      Reanchor(anchor);
+    }
+    return anchor.base_ns +
+           static_cast<int64>(elapsed_ticks * anchor.ns_per_tick) +
+           epoch_offset_ns_;
+  }
+
+ private:
+  // Conversion published to readers. Uncalibrated while ns_per_tick is 0.
+  struct Anchor {
+    uint64 base_ticks;
+    int64 base_ns;
+    double ns_per_tick;
+
+    // Ticks after |base_ticks| at which to re-anchor.
+    uint64 reanchor_ticks;
+  };
+
+  Anchor Load() const {
+    while (true) {
+      const uint32 sequence = sequence_.load(std::memory_order_acquire);
+      const Anchor anchor{base_ticks_.load(std::memory_order_relaxed),
+                          base_ns_.load(std::memory_order_relaxed),
+                          ns_per_tick_.load(std::memory_order_relaxed),
+                          reanchor_ticks_.load(std::memory_order_relaxed)};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ((sequence & 1) == 0 &&
+          sequence_.load(std::memory_order_relaxed) == sequence) {
+        return anchor;
+      }
+    }
+  }
+
+  // Must be called with |mutex_| held, or from the constructor.
+  void Store(const Anchor& anchor) {
+    const uint32 sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    base_ticks_.store(anchor.base_ticks, std::memory_order_relaxed);
+    base_ns_.store(anchor.base_ns, std::memory_order_relaxed);
+    ns_per_tick_.store(anchor.ns_per_tick, std::memory_order_relaxed);
+    reanchor_ticks_.store(anchor.reanchor_ticks, std::memory_order_relaxed);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Calibrates the counter rate over the interval since the previous clock
+  // read, and anchors the conversion at the current time. |previous| is the
+  // anchor the caller found stale.
+  void Reanchor(const Anchor& previous) {
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || Load().base_ticks != previous.base_ticks) {
+      // Another thread is re-anchoring, or already has.
+      return;
+    }
+
+    int64 now_ns = 0;
+    uint64 now_ticks = 0;
+    ReadClockAndCounter(&now_ns, &now_ticks);
+    if (now_ticks <= clock_ticks_ || now_ns <= clock_ns_) {
+      return;
+    }
+    const double ticks_per_second = (now_ticks - clock_ticks_) * 1e9 /
+                                    static_cast<double>(now_ns - clock_ns_);
+    clock_ns_ = now_ns;
+    clock_ticks_ = now_ticks;
+    if (ticks_per_second < kMinTicksPerSecond ||
+        ticks_per_second > kMaxTicksPerSecond) {
+      // Keep reading the monotonic clock, and try again later.
+      VLOG(1) << "Implausible cycle counter rate " << ticks_per_second
+              << " Hz.";
+      Store(Anchor{now_ticks, now_ns, 0.0, 0});
+      return;
+    }
+
+    // Never step back behind the previous conversion, so timestamps stay
+    // monotonic across anchors.
+    int64 base_ns = now_ns;
+    if (previous.ns_per_tick != 0.0) {
+      base_ns = std::max(
+          base_ns, previous.base_ns +
+                       static_cast<int64>((now_ticks - previous.base_ticks) *
+                                          previous.ns_per_tick));
+    } else {
+      VLOG(1) << "Cycle counter calibrated at " << ticks_per_second << " Hz.";
+    }
+    Store(Anchor{now_ticks, base_ns, 1e9 / ticks_per_second,
+                 static_cast<uint64>(kReanchorIntervalNs * ticks_per_second /
+                                     1e9)});
+  }
+
+  // Offset from the monotonic clock to the epoch of GetCurrentTimeNanos().
+  const int64 epoch_offset_ns_;
+
+  // Published anchor, see Load() and Store().
+  std::atomic<uint32> sequence_{0};
+  std::atomic<uint64> base_ticks_{0};
+  std::atomic<int64> base_ns_{0};
+  std::atomic<double> ns_per_tick_{0.0};
+  std::atomic<uint64> reanchor_ticks_{0};
+
+  // Serializes re-anchoring.
+  std::mutex mutex_;
+
+  // Most recent read of the monotonic clock and the counter, which the next
+  // calibration starts from. Guarded by |mutex_|.
+  int64 clock_ns_{0};
+  uint64 clock_ticks_{0};
+};
+
+#endif  // DARWINN_CYCLE_COUNTER_SUPPORTED
+
+CycleCounterTimeStamper::Clock* CycleCounterTimeStamper::GetClock() {
+#if DARWINN_CYCLE_COUNTER_SUPPORTED
+  static Clock* const clock = IsCounterInvariant() ? new Clock() : nullptr;
+  return clock;
+#else
+  return nullptr;
+#endif  // DARWINN_CYCLE_COUNTER_SUPPORTED
+}
+
+std::unique_ptr<TimeStamper> CycleCounterTimeStamper::Create() {
+  Clock* clock = GetClock();
+  if (clock == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<TimeStamper>(new CycleCounterTimeStamper(clock));
+}
+
+int64 CycleCounterTimeStamper::GetTimeNanoSeconds() const {
+#if DARWINN_CYCLE_COUNTER_SUPPORTED
+  return clock_->GetTimeNanoSeconds();
+#else
+  LOG(FATAL) << "Cycle counter is not supported on this platform.";
+  return kInvalidTimestamp;
+#endif  // DARWINN_CYCLE_COUNTER_SUPPORTED
+}
+
+}  // namespace driver_shared
+}  // namespace darwinn
+}  // namespace platforms
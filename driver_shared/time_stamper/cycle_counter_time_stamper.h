@@ -0,0 +1,65 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DARWINN_DRIVER_SHARED_TIME_STAMPER_CYCLE_COUNTER_TIME_STAMPER_H_
+#define DARWINN_DRIVER_SHARED_TIME_STAMPER_CYCLE_COUNTER_TIME_STAMPER_H_
+
+#include <memory>
+
+#include "driver_shared/time_stamper/time_stamper.h"
+#include "port/integral_types.h"
+
+namespace platforms {
+namespace darwinn {
+
+namespace driver_shared {
+
+// Monotonic clock read from the CPU cycle counter: the invariant TSC on x86-64,
+// and the virtual counter (cntvct_el0) on ARM64. A sample costs a few
+// nanoseconds instead of a clock_gettime call.
+//
+// The counter rate is calibrated lazily against the monotonic clock, shared
+// by all instances in the process. Until the first calibration interval has
+// passed, samples read the monotonic clock. Afterwards the conversion is
+// re-anchored to the monotonic clock about once a second, so counter rate
+// errors do not accumulate. Timestamps share their epoch with
+// DriverTimeStamper at the time of the first sample.
+class CycleCounterTimeStamper : public TimeStamper {
+ public:
+  // Returns a time stamper, or nullptr if the counter is missing, does not
+  // tick at a constant rate, or is not trusted by the kernel. Does not block.
+  static std::unique_ptr<TimeStamper> Create();
+
+  ~CycleCounterTimeStamper() override = default;
+
+  int64 GetTimeNanoSeconds() const override;
+
+ private:
+  // Process-wide conversion from counter ticks to nanoseconds.
+  class Clock;
+
+  explicit CycleCounterTimeStamper(Clock* clock) : clock_(clock) {}
+
+  // Returns the process-wide clock, or nullptr if the counter is not usable.
+  static Clock* GetClock();
+
+  // Not owned.
+  Clock* const clock_;
+};
+
+}  // namespace driver_shared
+}  // namespace darwinn
+}  // namespace platforms
+
+#endif  // DARWINN_DRIVER_SHARED_TIME_STAMPER_CYCLE_COUNTER_TIME_STAMPER_H_
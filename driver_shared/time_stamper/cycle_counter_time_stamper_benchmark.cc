@@ -0,0 +1,153 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the per-sample cost of CycleCounterTimeStamper against
+// DriverTimeStamper, and its drift from the monotonic clock over time. Reader
+// threads sample concurrently throughout the drift measurement, so they race
+// with re-anchoring.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "driver_shared/time_stamper/cycle_counter_time_stamper.h"
+#include "driver_shared/time_stamper/driver_time_stamper.h"
+#include "port/gflags.h"
+#include "port/logging.h"
+
+ABSL_FLAG(int, iterations, 10000000, "Number of samples per time stamper.");
+ABSL_FLAG(int, seconds, 10, "Duration of the drift measurement.");
+ABSL_FLAG(int64_t, max_drift_ns, 100000,
+          "Largest drift from the monotonic clock that passes.");
+ABSL_FLAG(int, reader_threads, 4,
+          "Number of threads sampling during the drift measurement.");
+
+namespace platforms {
+namespace darwinn {
+namespace driver_shared {
+namespace {
+
+int64 GetMonotonicTimeNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns the average cost of a sample in nanoseconds.
+double MeasureCost(const TimeStamper& time_stamper, int iterations) {
+  int64 last = time_stamper.GetTimeNanoSeconds();
+  const int64 start_ns = GetMonotonicTimeNanos();
+  for (int i = 0; i < iterations; ++i) {
+    const int64 now = time_stamper.GetTimeNanoSeconds();
+    CHECK_GE(now, last) << "Time stamper went backwards.";
+    last = now;
+  }
+  return (GetMonotonicTimeNanos() - start_ns) / static_cast<double>(iterations);
+}
+
+int Run() {
+  const int64 create_start_ns = GetMonotonicTimeNanos();
+  std::unique_ptr<TimeStamper> cycle_counter =
+      CycleCounterTimeStamper::Create();
+  const int64 create_ns = GetMonotonicTimeNanos() - create_start_ns;
+  if (cycle_counter == nullptr) {
+    printf("Cycle counter is not usable on this machine.\n");
+    return 0;
+  }
+  printf("Create() took %.3f ms.\n", create_ns / 1e6);
+  CHECK_LT(create_ns, 5 * 1000 * 1000) << "Create() blocked.";
+
+  DriverTimeStamper driver;
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  const double driver_ns = MeasureCost(driver, iterations);
+  const double cycle_counter_ns = MeasureCost(*cycle_counter, iterations);
+  printf("Per sample: DriverTimeStamper %.2f ns, CycleCounterTimeStamper "
+         "%.2f ns.\n",
+         driver_ns, cycle_counter_ns);
+  printf("Offset from DriverTimeStamper: %lld ns.\n",
+         static_cast<long long>(  // NOLINT(runtime/int)
+             cycle_counter->GetTimeNanoSeconds() -
+             driver.GetTimeNanoSeconds()));
+
+  // Reader threads sample back to back, and each checks that its own samples
+  // never go backwards while another thread re-anchors.
+  std::atomic<bool> done{false};
+  std::atomic<int64> num_reader_samples{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < absl::GetFlag(FLAGS_reader_threads); ++i) {
+    readers.emplace_back([&cycle_counter, &done, &num_reader_samples]() {
+      int64 last_ns = cycle_counter->GetTimeNanoSeconds();
+      int64 num_samples = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        const int64 now_ns = cycle_counter->GetTimeNanoSeconds();
+        CHECK_GE(now_ns, last_ns) << "Time stamper went backwards in a reader.";
+        last_ns = now_ns;
+        ++num_samples;
+      }
+      num_reader_samples += num_samples;
+    });
+  }
+
+  // Compares elapsed time on both clocks once a second. Samples in between
+  // cross the re-anchoring points and must not go backwards.
+  const int seconds = absl::GetFlag(FLAGS_seconds);
+  const int64 monotonic_start_ns = GetMonotonicTimeNanos();
+  const int64 cycle_counter_start_ns = cycle_counter->GetTimeNanoSeconds();
+  int64 last_ns = cycle_counter_start_ns;
+  int64 max_drift_ns = 0;
+  for (int second = 1; second <= seconds; ++second) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < deadline) {
+      const int64 now_ns = cycle_counter->GetTimeNanoSeconds();
+      CHECK_GE(now_ns, last_ns) << "Time stamper went backwards.";
+      last_ns = now_ns;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const int64 monotonic_ns = GetMonotonicTimeNanos() - monotonic_start_ns;
+    const int64 cycle_counter_ns =
+        cycle_counter->GetTimeNanoSeconds() - cycle_counter_start_ns;
+    const int64 drift_ns = cycle_counter_ns - monotonic_ns;
+    if (std::llabs(drift_ns) > std::llabs(max_drift_ns)) {
+      max_drift_ns = drift_ns;
+    }
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  printf("Max drift from the monotonic clock over %d s: %lld ns.\n", seconds,
+         static_cast<long long>(max_drift_ns));  // NOLINT(runtime/int)
+  printf("%zu reader threads took %lld samples without going backwards.\n",
+         readers.size(),
+         static_cast<long long>(  // NOLINT(runtime/int)
+             num_reader_samples.load()));
+  CHECK_LE(std::llabs(max_drift_ns), absl::GetFlag(FLAGS_max_drift_ns));
+  return 0;
+}
+
+}  // namespace
+}  // namespace driver_shared
+}  // namespace darwinn
+}  // namespace platforms
+
+int main(int argc, char* argv[]) {
+  ParseFlags(argc, argv);
+  return platforms::darwinn::driver_shared::Run();
+}
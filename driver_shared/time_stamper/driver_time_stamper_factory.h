@@ -15,6 +15,7 @@
 #ifndef DARWINN_DRIVER_SHARED_TIME_STAMPER_DRIVER_TIME_STAMPER_FACTORY_H_
 #define DARWINN_DRIVER_SHARED_TIME_STAMPER_DRIVER_TIME_STAMPER_FACTORY_H_
 
+#include "driver_shared/time_stamper/cycle_counter_time_stamper.h"
 #include "driver_shared/time_stamper/driver_time_stamper.h"
 #include "driver_shared/time_stamper/time_stamper.h"
 #include "driver_shared/time_stamper/time_stamper_factory.h"
@@ -25,13 +26,18 @@ namespace darwinn {
 
 namespace driver_shared {
 
-// Factory class for creating DriverTimeStamper objects.
+// Factory class for creating time stampers used by drivers. Prefers the
+// cycle counter, and falls back to DriverTimeStamper where it is not usable.
 class DriverTimeStamperFactory : public TimeStamperFactory {
  public:
   DriverTimeStamperFactory() = default;
   virtual ~DriverTimeStamperFactory() = default;
 
   std::unique_ptr<TimeStamper> CreateTimeStamper() override {
+    auto time_stamper = CycleCounterTimeStamper::Create();
+    if (time_stamper) {
+      return time_stamper;
+    }
     return gtl::MakeUnique<DriverTimeStamper>();
   }
 };
@@ -160,6 +160,8 @@ Status ParseUsbOptions(
 const char* EdgeTpuDriverWrapper::STATUS_IS_READY = "IsReady";
 const char* EdgeTpuDriverWrapper::STATUS_EXCLUSIVE_OWNERSHIP =
     "ExclusiveOwnership";
+const char* EdgeTpuDriverWrapper::STATUS_LINK_SPEED = "LinkSpeed";
+const char* EdgeTpuDriverWrapper::STATUS_HOST_TO_TPU_BPS = "HostToTpuBps";
 
 EdgeTpuDriverWrapper::EdgeTpuDriverWrapper(
     std::unique_ptr<api::Driver> driver,
@@ -287,6 +289,17 @@ EdgeTpuManager::DeviceOptions EdgeTpuDriverWrapper::GetDeviceOptions() const {
   if (is_exclusively_owned_) {
     status.insert({STATUS_EXCLUSIVE_OWNERSHIP, std::string()});
   }
+  if (driver_) {
+    const std::string link_speed = driver_->GetLinkSpeed();
+    if (!link_speed.empty()) {
+      status.insert({STATUS_LINK_SPEED, link_speed});
+    }
+    const auto host_to_tpu_bps =
+        driver_->GetOperationalSettings().host_to_tpu_bps;
+    if (host_to_tpu_bps > 0) {
+      status.insert({STATUS_HOST_TO_TPU_BPS, std::to_string(host_to_tpu_bps)});
+    }
+  }
   return status;
 }
 
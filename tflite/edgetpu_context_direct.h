@@ -95,6 +95,8 @@ class EdgeTpuDriverWrapper {
  private:
   static const char* STATUS_IS_READY;
   static const char* STATUS_EXCLUSIVE_OWNERSHIP;
+  static const char* STATUS_LINK_SPEED;
+  static const char* STATUS_HOST_TO_TPU_BPS;
 
   // Serializes access to this device.
   mutable std::mutex mutex_;
@@ -0,0 +1,443 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tflite/public/edgetpu_model_c.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/buffer.h"
+#include "api/driver.h"
+#include "api/layer_information.h"
+#include "api/package_reference.h"
+#include "api/request.h"
+#include "port/errors.h"
+#include "port/logging.h"
+#include "port/ptr_util.h"
+#include "port/status.h"
+#include "port/status_macros.h"
+#include "port/statusor.h"
+#include "port/stringprintf.h"
+#include "tflite/custom_op_data.h"
+#include "tflite/edgetpu_context_direct.h"
+#include "tflite/public/edgetpu.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+using platforms::darwinn::Buffer;
+using platforms::darwinn::Status;
+using platforms::darwinn::StatusOr;
+using platforms::darwinn::api::Driver;
+using platforms::darwinn::api::LayerInformation;
+using platforms::darwinn::api::PackageReference;
+using platforms::darwinn::api::Request;
+
+struct edgetpu_model {
+  // Keeps the device open while the model is loaded.
+  std::shared_ptr<edgetpu::EdgeTpuContext> context;
+  Driver* driver = nullptr;
+  const PackageReference* package = nullptr;
+};
+
+struct edgetpu_request {
+  edgetpu_model* model = nullptr;
+  std::vector<Buffer> inputs;
+  std::vector<Buffer> outputs;
+};
+
+namespace platforms {
+namespace darwinn {
+namespace tflite {
+namespace {
+
+using edgetpu::DeviceType;
+using edgetpu::EdgeTpuManager;
+
+// Description of the last failure on this thread.
+std::string& LastError() {
+  static thread_local std::string last_error;
+  return last_error;
+}
+
+// Records the given status for edgetpu_last_error, and returns its code.
+int ReportStatus(const Status& status) {
+  if (!status.ok()) {
+    LastError() = status.ToString();
+    VLOG(1) << LastError();
+  }
+  return static_cast<int>(status.code());
+}
+
+// Records that the given argument was NULL, and returns the error code.
+int ReportNullArgument(const char* name) {
+  return ReportStatus(
+      InvalidArgumentError(StringPrintf("%s must not be NULL.", name)));
+}
+
+// Returns the executable package carried by the single edge TPU custom op of
+// a compiled .tflite model, or the given data itself if it is not a .tflite
+// model.
+StatusOr<CustomOpWrappedBuffer> ExtractPackage(const void* model_data,
+                                               size_t model_size) {
+  const auto* data = reinterpret_cast<const uint8_t*>(model_data);
+  if (model_size < 8 || !::tflite::ModelBufferHasIdentifier(data)) {
+    return CustomOpWrappedBuffer{reinterpret_cast<const char*>(data),
+                                 model_size};
+  }
+
+  flatbuffers::Verifier verifier(data, model_size);
+  if (!::tflite::VerifyModelBuffer(verifier)) {
+    return InvalidArgumentError("Model is not a valid TensorFlow Lite model.");
+  }
+
+  const auto* model = ::tflite::GetModel(data);
+  if (model->subgraphs() == nullptr || model->subgraphs()->size() != 1 ||
+      model->operator_codes() == nullptr) {
+    return InvalidArgumentError("Model must have exactly one subgraph.");
+  }
+  const auto* operators = model->subgraphs()->Get(0)->operators();
+  if (operators == nullptr || operators->size() != 1) {
+    return InvalidArgumentError(
+        "Model must consist of a single edge TPU custom op. Use the TensorFlow "
+        "Lite delegate for models with operators running on the CPU.");
+  }
+
+  const auto* op = operators->Get(0);
+  if (op->opcode_index() >= model->operator_codes()->size()) {
+    return InvalidArgumentError("Model has an invalid operator code index.");
+  }
+  const auto* custom_code =
+      model->operator_codes()->Get(op->opcode_index())->custom_code();
+  if (custom_code == nullptr || custom_code->str() != edgetpu::kCustomOp ||
+      op->custom_options() == nullptr) {
+    return InvalidArgumentError("Model operator is not an edge TPU custom op.");
+  }
+
+  const auto custom_op_data = DeserializeCustomOpData(
+      op->custom_options()->data(), op->custom_options()->size());
+  if (!custom_op_data || custom_op_data->executables.empty()) {
+    return InvalidArgumentError("Failed to read edge TPU custom op data.");
+  }
+  return custom_op_data->executables[0];
+}
+
+// Fills layer metadata.
+Status GetLayerInfo(const LayerInformation* layer,
+                    const std::string& layer_name, edgetpu_layer_info* info) {
+  if (info == nullptr) {
+    return InvalidArgumentError("Layer info must not be NULL.");
+  }
+  info->name = layer_name.c_str();
+  info->data_type = static_cast<edgetpu_data_type>(layer->data_type());
+  info->y_dim = layer->y_dim();
+  info->x_dim = layer->x_dim();
+  info->z_dim = layer->z_dim();
+  info->size_bytes = layer->ActualSizeBytes();
+  info->scale = layer->dequantization_factor();
+  info->zero_point = layer->zero_point();
+  return OkStatus();
+}
+
+// Validates and stores a buffer binding.
+Status Bind(const std::vector<Buffer>::size_type num_layers, size_t index,
+            int layer_size_bytes, Buffer buffer, std::vector<Buffer>* bindings) {
+  if (index >= num_layers) {
+    return OutOfRangeError(
+        StringPrintf("Layer index %zu is out of range.", index));
+  }
+  if (buffer.size_bytes() == 0 ||
+      buffer.size_bytes() % layer_size_bytes != 0) {
+    return InvalidArgumentError(StringPrintf(
+        "Buffer size %zu is not a multiple of layer %zu size %d.",
+        buffer.size_bytes(), index, layer_size_bytes));
+  }
+  (*bindings)[index] = std::move(buffer);
+  return OkStatus();
+}
+
+// Creates a driver request with all bound buffers. Multiples of the layer size
+// are added as consecutive batches.
+StatusOr<std::shared_ptr<Request>> CreateDriverRequest(
+    const edgetpu_request& request) {
+  const edgetpu_model& model = *request.model;
+  const PackageReference& package = *model.package;
+  ASSIGN_OR_RETURN(auto driver_request,
+                   model.driver->CreateRequest(model.package));
+
+  size_t batches = 0;
+  const auto check_batches = [&batches](const Buffer& buffer, size_t index,
+                                        int layer_size_bytes) -> Status {
+    if (!buffer.IsValid()) {
+      return FailedPreconditionError(
+          StringPrintf("Layer %zu is not bound.", index));
+    }
+    const size_t layer_batches = buffer.size_bytes() / layer_size_bytes;
+    if (batches != 0 && layer_batches != batches) {
+      return InvalidArgumentError(StringPrintf(
+          "Layer %zu is bound to %zu batches, expected %zu.", index,
+          layer_batches, batches));
+    }
+    batches = layer_batches;
+    return OkStatus();
+  };
+
+  for (size_t i = 0; i < request.inputs.size(); ++i) {
+    const int size_bytes = package.InputLayerSizeBytes(i);
+    const Buffer& input = request.inputs[i];
+    RETURN_IF_ERROR(check_batches(input, i, size_bytes));
+    const bool signed_data_type = package.InputLayer(i)->SignedDataType();
+    for (size_t batch = 0; batch < batches; ++batch) {
+      Buffer batch_input(input.ptr() + batch * size_bytes, size_bytes);
+      if (signed_data_type) {
+        // Signed inputs are converted in place, which must not modify the
+        // caller's buffer.
+        Buffer copy = model.driver->MakeBuffer(size_bytes);
+        memcpy(copy.ptr(), batch_input.ptr(), size_bytes);
+        batch_input = copy;
+      }
+      RETURN_IF_ERROR(driver_request->AddInput(package.InputLayerName(i),
+                                               batch_input));
+    }
+  }
+
+  for (size_t i = 0; i < request.outputs.size(); ++i) {
+    const int size_bytes = package.OutputLayerSizeBytes(i);
+    Buffer output = request.outputs[i];
+    RETURN_IF_ERROR(check_batches(output, i, size_bytes));
+    for (size_t batch = 0; batch < batches; ++batch) {
+      RETURN_IF_ERROR(driver_request->AddOutput(
+          package.OutputLayerName(i),
+          Buffer(output.ptr() + batch * size_bytes, size_bytes)));
+    }
+  }
+
+  return driver_request;
+}
+
+StatusOr<edgetpu_model*> LoadModel(edgetpu_device_type type, const char* path,
+                                   const edgetpu_option* options,
+                                   size_t num_options, const void* model_data,
+                                   size_t model_size) {
+  if (model_data == nullptr || model_size == 0) {
+    return InvalidArgumentError("Model data must not be empty.");
+  }
+  ASSIGN_OR_RETURN(const auto package_data,
+                   ExtractPackage(model_data, model_size));
+
+  auto* manager = EdgeTpuManager::GetSingleton();
+  const auto device_type = static_cast<DeviceType>(type);
+  std::shared_ptr<edgetpu::EdgeTpuContext> context;
+  if (num_options > 0) {
+    if (options == nullptr || path == nullptr) {
+      return InvalidArgumentError(
+          "Options require a non-NULL device path and option array.");
+    }
+    EdgeTpuManager::DeviceOptions device_options;
+    for (size_t i = 0; i < num_options; ++i) {
+      device_options.insert({options[i].name, options[i].value});
+    }
+    context = manager->OpenDevice(device_type, path, device_options);
+  } else {
+    context = (path == nullptr) ? manager->OpenDevice(device_type)
+                                : manager->OpenDevice(device_type, path);
+  }
+  if (!context) {
+    return UnavailableError("Failed to open edge TPU device.");
+  }
+
+  auto model = gtl::MakeUnique<edgetpu_model>();
+  model->context = std::move(context);
+  model->driver = static_cast<EdgeTpuContextDirect*>(model->context.get())
+                      ->GetDriverWrapper()
+                      ->GetDriver();
+  ASSIGN_OR_RETURN(model->package,
+                   model->driver->RegisterExecutableSerialized(
+                       package_data.data, package_data.length));
+  return model.release();
+}
+
+}  // namespace
+}  // namespace tflite
+}  // namespace darwinn
+}  // namespace platforms
+
+using platforms::darwinn::tflite::ReportNullArgument;
+using platforms::darwinn::tflite::ReportStatus;
+
+extern "C" {
+
+const char* edgetpu_last_error() {
+  return platforms::darwinn::tflite::LastError().c_str();
+}
+
+struct edgetpu_model* edgetpu_model_load(enum edgetpu_device_type type,
+                                         const char* path,
+                                         const struct edgetpu_option* options,
+                                         size_t num_options,
+                                         const void* model_data,
+                                         size_t model_size) {
+  auto model_or_error = platforms::darwinn::tflite::LoadModel(
+      type, path, options, num_options, model_data, model_size);
+  if (!model_or_error.ok()) {
+    ReportStatus(model_or_error.status());
+    return nullptr;
+  }
+  return model_or_error.ValueOrDie();
+}
+
+void edgetpu_model_free(struct edgetpu_model* model) {
+  if (model == nullptr) return;
+  const Status status = model->driver->UnregisterExecutable(model->package);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to unregister model: " << status;
+  }
+  delete model;
+}
+
+size_t edgetpu_model_num_inputs(const struct edgetpu_model* model) {
+  if (model == nullptr) {
+    ReportNullArgument("Model");
+    return 0;
+  }
+  return model->package->NumInputLayers();
+}
+
+size_t edgetpu_model_num_outputs(const struct edgetpu_model* model) {
+  if (model == nullptr) {
+    ReportNullArgument("Model");
+    return 0;
+  }
+  return model->package->NumOutputLayers();
+}
+
+int edgetpu_model_batch_size(const struct edgetpu_model* model) {
+  if (model == nullptr) {
+    ReportNullArgument("Model");
+    return 0;
+  }
+  return model->package->BatchSize();
+}
+
+int edgetpu_model_input_info(const struct edgetpu_model* model, size_t index,
+                             struct edgetpu_layer_info* info) {
+  if (model == nullptr) {
+    return ReportNullArgument("Model");
+  }
+  if (index >= model->package->NumInputLayers()) {
+    return ReportStatus(platforms::darwinn::OutOfRangeError(
+        platforms::darwinn::StringPrintf("Input index %zu is out of range.",
+                                         index)));
+  }
+  return ReportStatus(platforms::darwinn::tflite::GetLayerInfo(
+      model->package->InputLayer(index),
+      model->package->InputLayerNames()[index], info));
+}
+
+int edgetpu_model_output_info(const struct edgetpu_model* model, size_t index,
+                              struct edgetpu_layer_info* info) {
+  if (model == nullptr) {
+    return ReportNullArgument("Model");
+  }
+  if (index >= model->package->NumOutputLayers()) {
+    return ReportStatus(platforms::darwinn::OutOfRangeError(
+        platforms::darwinn::StringPrintf("Output index %zu is out of range.",
+                                         index)));
+  }
+  return ReportStatus(platforms::darwinn::tflite::GetLayerInfo(
+      model->package->OutputLayer(index),
+      model->package->OutputLayerNames()[index], info));
+}
+
+struct edgetpu_request* edgetpu_request_create(struct edgetpu_model* model) {
+  if (model == nullptr) {
+    ReportNullArgument("Model");
+    return nullptr;
+  }
+  auto* request = new edgetpu_request;
+  request->model = model;
+  request->inputs.resize(model->package->NumInputLayers());
+  request->outputs.resize(model->package->NumOutputLayers());
+  return request;
+}
+
+void edgetpu_request_free(struct edgetpu_request* request) { delete request; }
+
+int edgetpu_request_bind_input(struct edgetpu_request* request, size_t index,
+                               const void* data, size_t size_bytes) {
+  if (request == nullptr) {
+    return ReportNullArgument("Request");
+  }
+  if (data == nullptr) {
+    return ReportNullArgument("Data");
+  }
+  const auto* package = request->model->package;
+  const int layer_size_bytes =
+      index < request->inputs.size() ? package->InputLayerSizeBytes(index) : 0;
+  return ReportStatus(platforms::darwinn::tflite::Bind(
+      request->inputs.size(), index, layer_size_bytes, Buffer(data, size_bytes),
+      &request->inputs));
+}
+
+int edgetpu_request_bind_output(struct edgetpu_request* request, size_t index,
+                                void* data, size_t size_bytes) {
+  if (request == nullptr) {
+    return ReportNullArgument("Request");
+  }
+  if (data == nullptr) {
+    return ReportNullArgument("Data");
+  }
+  const auto* package = request->model->package;
+  const int layer_size_bytes = index < request->outputs.size()
+                                   ? package->OutputLayerSizeBytes(index)
+                                   : 0;
+  return ReportStatus(platforms::darwinn::tflite::Bind(
+      request->outputs.size(), index, layer_size_bytes,
+      Buffer(data, size_bytes), &request->outputs));
+}
+
+int edgetpu_request_run(struct edgetpu_request* request) {
+  if (request == nullptr) {
+    return ReportNullArgument("Request");
+  }
+  auto driver_request_or_error =
+      platforms::darwinn::tflite::CreateDriverRequest(*request);
+  if (!driver_request_or_error.ok()) {
+    return ReportStatus(driver_request_or_error.status());
+  }
+  return ReportStatus(request->model->driver->Execute(
+      std::move(driver_request_or_error).ValueOrDie()));
+}
+
+int edgetpu_request_submit(struct edgetpu_request* request,
+                           edgetpu_request_done done, void* user_data) {
+  if (request == nullptr) {
+    return ReportNullArgument("Request");
+  }
+  if (done == nullptr) {
+    return ReportNullArgument("Completion callback");
+  }
+  auto driver_request_or_error =
+      platforms::darwinn::tflite::CreateDriverRequest(*request);
+  if (!driver_request_or_error.ok()) {
+    return ReportStatus(driver_request_or_error.status());
+  }
+  return ReportStatus(request->model->driver->Submit(
+      std::move(driver_request_or_error).ValueOrDie(),
+      [request, done, user_data](int /*id*/, Status status) {
+        done(request, ReportStatus(status), user_data);
+      }));
+}
+
+}  // extern "C"
@@ -306,6 +306,10 @@ class EdgeTpuContext : public TfLiteExternalContext {
   //  - "ExclusiveOwnership": present when it is under exclusive ownership
   //  (unique_ptr returned by NewEdgeTpuContext).
   //  - "IsReady": present when it is ready for further requests.
+  //  - "LinkSpeed": ["FullSpeed", "HighSpeed", "SuperSpeed"], present when
+  //  the negotiated link speed is known, e.g. for USB devices.
+  //  - "HostToTpuBps": estimated host to TPU bandwidth in bytes per second,
+  //  present when known. Derived from the link speed unless set explicitly.
   virtual EdgeTpuManager::DeviceOptions GetDeviceOptions() const = 0;
 
   // Returns true if the device is most likely ready to accept requests.
@@ -56,42 +56,12 @@ limitations under the License.
 #define TFLITE_PUBLIC_EDGETPU_C_H_
 
 #include "tensorflow/lite/c/common.h"
-
-#if defined(_WIN32)
-#ifdef EDGETPU_COMPILE_LIBRARY
-#define EDGETPU_EXPORT __declspec(dllexport)
-#else
-#define EDGETPU_EXPORT __declspec(dllimport)
-#endif  // EDGETPU_COMPILE_LIBRARY
-#else
-#define EDGETPU_EXPORT __attribute__((visibility("default")))
-#endif  // _WIN32
+#include "edgetpu_c_common.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-enum edgetpu_device_type {
-  EDGETPU_APEX_PCI = 0,
-  EDGETPU_APEX_USB = 1,
-};
-
-struct edgetpu_device {
-  enum edgetpu_device_type type;
-  const char* path;
-};
-
-struct edgetpu_option {
-  const char* name;
-  const char* value;
-};
-
-// Returns array of connected edge TPU devices.
-EDGETPU_EXPORT struct edgetpu_device* edgetpu_list_devices(size_t* num_devices);
-
-// Frees array returned by `edgetpu_list_devices`.
-EDGETPU_EXPORT void edgetpu_free_devices(struct edgetpu_device* dev);
-
 // Creates a delegate which handles all edge TPU custom ops inside
 // `tflite::Interpreter`. Options must be available only during the call of this
 // function.
@@ -102,13 +72,6 @@ EDGETPU_EXPORT TfLiteDelegate* edgetpu_create_delegate(
 // Frees delegate returned by `edgetpu_create_delegate`.
 EDGETPU_EXPORT void edgetpu_free_delegate(TfLiteDelegate* delegate);
 
-// Sets verbosity of operating logs related to edge TPU.
-// Verbosity level can be set to [0-10], in which 10 is the most verbose.
-EDGETPU_EXPORT void edgetpu_verbosity(int verbosity);
-
-// Returns the version of edge TPU runtime stack.
-EDGETPU_EXPORT const char* edgetpu_version();
-
 #ifdef __cplusplus
 }  // extern "C"
 #endif
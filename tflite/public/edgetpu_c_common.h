@@ -0,0 +1,72 @@
+/*
+Copyright 2019 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+//
+// This header defines the parts of the edge TPU C API which do not depend on
+// TensorFlow Lite: device enumeration, options, logging and version queries.
+// It is included by both `edgetpu_c.h` and `edgetpu_model_c.h`.
+
+#ifndef TFLITE_PUBLIC_EDGETPU_C_COMMON_H_
+#define TFLITE_PUBLIC_EDGETPU_C_COMMON_H_
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#ifdef EDGETPU_COMPILE_LIBRARY
+#define EDGETPU_EXPORT __declspec(dllexport)
+#else
+#define EDGETPU_EXPORT __declspec(dllimport)
+#endif  // EDGETPU_COMPILE_LIBRARY
+#else
+#define EDGETPU_EXPORT __attribute__((visibility("default")))
+#endif  // _WIN32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum edgetpu_device_type {
+  EDGETPU_APEX_PCI = 0,
+  EDGETPU_APEX_USB = 1,
+};
+
+struct edgetpu_device {
+  enum edgetpu_device_type type;
+  const char* path;
+};
+
+struct edgetpu_option {
+  const char* name;
+  const char* value;
+};
+
+// Returns array of connected edge TPU devices.
+EDGETPU_EXPORT struct edgetpu_device* edgetpu_list_devices(size_t* num_devices);
+
+// Frees array returned by `edgetpu_list_devices`.
+EDGETPU_EXPORT void edgetpu_free_devices(struct edgetpu_device* dev);
+
+// Sets verbosity of operating logs related to edge TPU.
+// Verbosity level can be set to [0-10], in which 10 is the most verbose.
+EDGETPU_EXPORT void edgetpu_verbosity(int verbosity);
+
+// Returns the version of edge TPU runtime stack.
+EDGETPU_EXPORT const char* edgetpu_version();
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // TFLITE_PUBLIC_EDGETPU_C_COMMON_H_
@@ -0,0 +1,170 @@
+/*
+Copyright 2019 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+//
+// This header defines a C API to run models compiled for the edge TPU directly
+// on the driver, without the TensorFlow Lite interpreter. It only supports
+// models which run entirely on the edge TPU, and leaves input quantization and
+// output dequantization to the caller.
+//
+// Typical API usage involves several steps:
+//
+// 1. Load the compiled model on a device.
+//
+// struct edgetpu_model* model = edgetpu_model_load(
+//     EDGETPU_APEX_USB, NULL, NULL, 0, model_data, model_size);
+//
+// 2. Query layer metadata.
+//
+// struct edgetpu_layer_info info;
+// edgetpu_model_input_info(model, 0, &info);
+//
+// 3. Create a request and bind buffers by layer index. A buffer holding N times
+//    `size_bytes` of a layer runs a batch of N.
+//
+// struct edgetpu_request* request = edgetpu_request_create(model);
+// edgetpu_request_bind_input(request, 0, input, info.size_bytes);
+// edgetpu_request_bind_output(request, 0, output, output_size);
+//
+// 4. Run, synchronously or asynchronously.
+//
+// if (edgetpu_request_run(request) != 0) {
+//   fprintf(stderr, "%s\n", edgetpu_last_error());
+// }
+//
+// 5. Free everything.
+//
+// edgetpu_request_free(request);
+// edgetpu_model_free(model);
+
+#ifndef TFLITE_PUBLIC_EDGETPU_MODEL_C_H_
+#define TFLITE_PUBLIC_EDGETPU_MODEL_C_H_
+
+#include <stdint.h>
+
+#include "edgetpu_c_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Model loaded on an edge TPU device.
+struct edgetpu_model;
+
+// Set of buffers bound to a model, which can be run repeatedly.
+struct edgetpu_request;
+
+// Element types of layers. Values match those used by the edge TPU compiler.
+enum edgetpu_data_type {
+  EDGETPU_DATA_UINT8 = 0,
+  EDGETPU_DATA_UINT16 = 1,
+  EDGETPU_DATA_INT32 = 2,
+  EDGETPU_DATA_BFLOAT16 = 3,
+  EDGETPU_DATA_FLOAT16 = 4,
+  EDGETPU_DATA_FLOAT32 = 5,
+  EDGETPU_DATA_INT8 = 8,
+  EDGETPU_DATA_INT16 = 9,
+};
+
+// Metadata of one input or output layer, in a single-batch layout of
+// y_dim * x_dim * z_dim elements. Quantized values map to real values as
+// (value - zero_point) * scale.
+struct edgetpu_layer_info {
+  // Valid as long as the model is loaded.
+  const char* name;
+  enum edgetpu_data_type data_type;
+  int y_dim;
+  int x_dim;
+  int z_dim;
+  size_t size_bytes;
+  float scale;
+  int32_t zero_point;
+};
+
+// Called once an asynchronous run completes. `status` is 0 on success.
+typedef void (*edgetpu_request_done)(struct edgetpu_request* request,
+                                     int status, void* user_data);
+
+// Functions returning an int return 0 on success, or a non-zero canonical
+// error code on failure, including NULL arguments. In both cases, a
+// description of the last failure on the calling thread is returned by
+// `edgetpu_last_error`.
+EDGETPU_EXPORT const char* edgetpu_last_error();
+
+// Opens the given device (or the default one of the type if `path` is NULL)
+// and loads a model on it. `model_data` may either be a compiled .tflite model
+// holding a single edge TPU custom op and no other operators, or the
+// executable package carried by that custom op. Options and model data only
+// need to remain valid during the call. Returns NULL on failure.
+EDGETPU_EXPORT struct edgetpu_model* edgetpu_model_load(
+    enum edgetpu_device_type type, const char* path,
+    const struct edgetpu_option* options, size_t num_options,
+    const void* model_data, size_t model_size);
+
+// Unloads a model. All its requests must have been freed.
+EDGETPU_EXPORT void edgetpu_model_free(struct edgetpu_model* model);
+
+// Returns the number of input and output layers, or 0 if `model` is NULL.
+EDGETPU_EXPORT size_t edgetpu_model_num_inputs(const struct edgetpu_model* model);
+EDGETPU_EXPORT size_t
+edgetpu_model_num_outputs(const struct edgetpu_model* model);
+
+// Returns the number of batches the device runs at once. Requests may bind
+// any number of batches; this is only a hint for efficient sizing. Returns 0
+// if `model` is NULL.
+EDGETPU_EXPORT int edgetpu_model_batch_size(const struct edgetpu_model* model);
+
+// Fills metadata of the input or output layer at the given index.
+EDGETPU_EXPORT int edgetpu_model_input_info(const struct edgetpu_model* model,
+                                            size_t index,
+                                            struct edgetpu_layer_info* info);
+EDGETPU_EXPORT int edgetpu_model_output_info(const struct edgetpu_model* model,
+                                             size_t index,
+                                             struct edgetpu_layer_info* info);
+
+// Creates a request for the model. Returns NULL on failure.
+EDGETPU_EXPORT struct edgetpu_request* edgetpu_request_create(
+    struct edgetpu_model* model);
+
+// Frees a request. It must not be running.
+EDGETPU_EXPORT void edgetpu_request_free(struct edgetpu_request* request);
+
+// Binds a caller-owned buffer to the input or output layer at the given index.
+// `size_bytes` must be a non-zero multiple of the layer size, and all layers
+// must be bound to the same number of batches. Buffers must remain valid while
+// the request runs, and stay bound until bound again. Aligning output buffers
+// to the page size lets the device write them without a copy.
+EDGETPU_EXPORT int edgetpu_request_bind_input(struct edgetpu_request* request,
+                                              size_t index, const void* data,
+                                              size_t size_bytes);
+EDGETPU_EXPORT int edgetpu_request_bind_output(struct edgetpu_request* request,
+                                               size_t index, void* data,
+                                               size_t size_bytes);
+
+// Runs the request and blocks until outputs are written.
+EDGETPU_EXPORT int edgetpu_request_run(struct edgetpu_request* request);
+
+// Starts running the request and returns. `done` is called on a driver thread
+// when outputs are written, and should return quickly. A request may only be
+// run again after it completed.
+EDGETPU_EXPORT int edgetpu_request_submit(struct edgetpu_request* request,
+                                          edgetpu_request_done done,
+                                          void* user_data);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // TFLITE_PUBLIC_EDGETPU_MODEL_C_H_